@@ -7,6 +7,7 @@
 #include "crypto/sha256.h"
 #include "key.h"
 #include "random.h"
+#include "script/sigcache.h"
 #include "util.h"
 #include "validation.h"
 
@@ -14,7 +15,10 @@ int main(int argc, char **argv) {
     SHA256AutoDetect();
     RandomInit();
     ECC_Start();
+    // Needed by benchmarks that verify signatures
+    ECCVerifyHandle verifyHandle;
     SetupEnvironment();
+    InitSignatureCache();
 
     // don't want to write to bitcoind.log file
     GetLogger().fPrintToDebugLog = false;
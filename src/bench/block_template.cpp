@@ -0,0 +1,60 @@
+// Copyright (c) 2019 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "bench.h"
+
+#include "amount.h"
+#include "persistent_vector.h"
+#include "primitives/transaction.h"
+
+#include <vector>
+
+// Number of txns in the template. A template of 10M txns takes ten times as
+// long to copy, while taking a snapshot stays the same.
+static const size_t BLOCK_TEMPLATE_BENCH_TXNS = 1000000;
+
+template <typename T>
+static void SetElement(std::vector<T> &v, size_t pos, const T &value) {
+    v[pos] = value;
+}
+
+template <typename T>
+static void SetElement(persistent_vector<T> &v, size_t pos, const T &value) {
+    v.set(pos, value);
+}
+
+// What the journaling block assembler does to hand a template out: copy its
+// txns into the block, and its fees and sig op counts into the template with
+// the coinbase entries updated.
+template <typename Fees, typename SigOps>
+static void CreateTemplates(benchmark::State &state) {
+    const CTransactionRef txn = MakeTransactionRef(CMutableTransaction());
+    std::vector<CTransactionRef> blockTxns;
+    Fees txFees;
+    SigOps txSigOpsCount;
+    for (size_t i = 0; i < BLOCK_TEMPLATE_BENCH_TXNS; ++i) {
+        blockTxns.push_back(txn);
+        txFees.push_back(Amount(i));
+        txSigOpsCount.push_back(i);
+    }
+
+    while (state.KeepRunning()) {
+        std::vector<CTransactionRef> vtx = blockTxns;
+        Fees vTxFees = txFees;
+        SigOps vTxSigOpsCount = txSigOpsCount;
+        SetElement(vTxFees, 0, Amount(-1));
+        SetElement(vTxSigOpsCount, 0, int64_t{-1});
+    }
+}
+
+static void BlockTemplateCopy(benchmark::State &state) {
+    CreateTemplates<std::vector<Amount>, std::vector<int64_t>>(state);
+}
+
+static void BlockTemplateSnapshot(benchmark::State &state) {
+    CreateTemplates<persistent_vector<Amount>, persistent_vector<int64_t>>(
+        state);
+}
+
+BENCHMARK(BlockTemplateCopy);
+BENCHMARK(BlockTemplateSnapshot);
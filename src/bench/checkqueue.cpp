@@ -4,8 +4,15 @@
 
 #include "checkqueuepool.h"
 #include "bench.h"
+#include "config.h"
+#include "key.h"
+#include "policy/policy.h"
 #include "prevector.h"
 #include "random.h"
+#include "script/interpreter.h"
+#include "script/sighashtype.h"
+#include "script/sigcache.h"
+#include "script/standard.h"
 #include "util.h"
 #include "validation.h"
 
@@ -101,5 +108,88 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State &state) {
     tg.interrupt_all();
     tg.join_all();
 }
+// This Benchmark tests the CheckQueue with signed P2PKH inputs, so the cost is
+// dominated by signature verification and signature cache lookups.
+static void CCheckQueueP2PKH(benchmark::State &state, bool batched) {
+    // Hides the batch overload of CScriptCheck so that signatures are
+    // verified one at a time
+    struct UnbatchedScriptCheck {
+        CScriptCheck check;
+        std::optional<bool> operator()(const task::CCancellationToken& token)
+        {
+            return check(token);
+        }
+    };
+
+    const Config &config = GlobalConfig::GetConfig();
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    const Amount amount(1000);
+
+    std::vector<CTransaction> txns;
+    txns.reserve(BATCHES * BATCH_SIZE);
+    for (size_t i = 0; i < BATCHES * BATCH_SIZE; ++i) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = amount;
+        std::vector<uint8_t> vchSig;
+        key.Sign(SignatureHash(scriptPubKey, CTransaction(mtx), 0,
+                               SigHashType().withForkId(), amount),
+                 vchSig);
+        vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+        mtx.vin[0].scriptSig = CScript() << vchSig << ToByteVector(key.GetPubKey());
+        txns.emplace_back(mtx);
+    }
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(txns.size());
+    for (const CTransaction &tx : txns) {
+        txdata.emplace_back(tx);
+    }
+
+    auto run = [&](auto &pool, auto wrap) {
+        using check_type = decltype(wrap(std::declval<CScriptCheck>()));
+        auto source = task::CCancellationSource::Make();
+        while (state.KeepRunning()) {
+            auto control = pool.GetChecker(0, source->GetToken());
+            for (size_t i = 0; i < BATCHES; ++i) {
+                std::vector<check_type> vChecks;
+                vChecks.reserve(BATCH_SIZE);
+                for (size_t j = i * BATCH_SIZE; j < (i + 1) * BATCH_SIZE; ++j) {
+                    vChecks.push_back(wrap(CScriptCheck(
+                        config, true, scriptPubKey, amount, txns[j], 0,
+                        STANDARD_SCRIPT_VERIFY_FLAGS, false, txdata[j])));
+                }
+                control.Add(vChecks);
+            }
+            assert(control.Wait().value());
+        }
+    };
+
+    boost::thread_group tg;
+    const size_t nThreads = std::max(MIN_CORES, static_cast<size_t>(GetNumCores()));
+    if (batched) {
+        checkqueue::CCheckQueuePool<CScriptCheck, int> pool{1, tg, nThreads, QUEUE_BATCH_SIZE};
+        run(pool, [](CScriptCheck &&check) { return std::move(check); });
+    } else {
+        checkqueue::CCheckQueuePool<UnbatchedScriptCheck, int> pool{1, tg, nThreads, QUEUE_BATCH_SIZE};
+        run(pool, [](CScriptCheck &&check) { return UnbatchedScriptCheck{std::move(check)}; });
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void CCheckQueueP2PKHBatched(benchmark::State &state) {
+    CCheckQueueP2PKH(state, true);
+}
+
+static void CCheckQueueP2PKHUnbatched(benchmark::State &state) {
+    CCheckQueueP2PKH(state, false);
+}
+
 BENCHMARK(CCheckQueueSpeed);
 BENCHMARK(CCheckQueueSpeedPrevectorJob);
+BENCHMARK(CCheckQueueP2PKHBatched);
+BENCHMARK(CCheckQueueP2PKHUnbatched);
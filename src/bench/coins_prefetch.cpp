@@ -0,0 +1,109 @@
+// Copyright (c) 2019 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "task_helpers.h"
+#include "threadpool.h"
+#include "txdb.h"
+#include "util.h"
+#include "validation.h"
+
+#include <future>
+
+// Block spending coins scattered over a UTXO set that is much larger than the
+// coins database cache, so most lookups have to go to the database.
+static const size_t PREFETCH_BENCH_UTXO_TXNS = 200000;
+static const size_t PREFETCH_BENCH_BLOCK_TXNS = 2000;
+static const size_t PREFETCH_BENCH_INPUTS_PER_TXN = 2;
+static const size_t PREFETCH_BENCH_DB_CACHE = 1 << 20;
+
+namespace
+{
+    class CPrefetchBenchSetup
+    {
+    public:
+        CPrefetchBenchSetup()
+        {
+            fs::create_directories(mDir);
+            gArgs.ForceSetArg("-datadir", mDir.string());
+            ClearDatadirCache();
+            mView = std::make_unique<CCoinsViewDB>(PREFETCH_BENCH_DB_CACHE);
+
+            FastRandomContext rng(true);
+            std::vector<COutPoint> outpoints;
+            {
+                CCoinsViewCache cache(mView.get());
+                for (size_t i = 0; i < PREFETCH_BENCH_UTXO_TXNS; ++i) {
+                    CTxOut txout;
+                    txout.nValue = Amount(int64_t(1 + rng.randrange(1000000)));
+                    txout.scriptPubKey.assign(25, uint8_t(rng.randbits(8)));
+                    COutPoint outpoint(TxId(rng.rand256()), 0);
+                    cache.AddCoin(outpoint, Coin(txout, 1, false), false, 0);
+                    outpoints.push_back(outpoint);
+                }
+                cache.SetBestBlock(rng.rand256());
+                cache.Flush();
+            }
+
+            CMutableTransaction coinbase;
+            coinbase.vin.resize(1);
+            coinbase.vout.resize(1);
+            mBlock.vtx.push_back(MakeTransactionRef(coinbase));
+            for (size_t i = 0; i < PREFETCH_BENCH_BLOCK_TXNS; ++i) {
+                CMutableTransaction tx;
+                for (size_t n = 0; n < PREFETCH_BENCH_INPUTS_PER_TXN; ++n) {
+                    tx.vin.emplace_back(
+                        outpoints[rng.randrange(outpoints.size())]);
+                }
+                tx.vout.emplace_back(Amount(1), CScript());
+                mBlock.vtx.push_back(MakeTransactionRef(tx));
+            }
+        }
+
+        ~CPrefetchBenchSetup()
+        {
+            mView.reset();
+            fs::remove_all(mDir);
+        }
+
+        // Look up all inputs the way ConnectBlock does
+        void ConnectInputs(const CCoinsViewCache &cache) const
+        {
+            for (size_t i = 1; i < mBlock.vtx.size(); ++i) {
+                assert(cache.HaveInputs(*mBlock.vtx[i]));
+            }
+        }
+
+        const fs::path mDir = fs::temp_directory_path() / fs::unique_path();
+        std::unique_ptr<CCoinsViewDB> mView;
+        CBlock mBlock;
+    };
+}
+
+static void CoinsFetchColdCache(benchmark::State &state) {
+    CPrefetchBenchSetup setup;
+    while (state.KeepRunning()) {
+        CCoinsViewCache cache(setup.mView.get());
+        setup.ConnectInputs(cache);
+    }
+}
+
+static void CoinsPrefetchColdCache(benchmark::State &state) {
+    CPrefetchBenchSetup setup;
+    CThreadPool<CQueueAdaptor> pool("CoinsPrefetchBench",
+                                    DEFAULT_COINS_PREFETCH_THREADS);
+    while (state.KeepRunning()) {
+        CCoinsViewCache cache(setup.mView.get());
+        for (auto &task : PrefetchBlockInputs(setup.mBlock, cache, pool)) {
+            task.get();
+        }
+        setup.ConnectInputs(cache);
+    }
+}
+
+BENCHMARK(CoinsFetchColdCache);
+BENCHMARK(CoinsPrefetchColdCache);
@@ -5,8 +5,14 @@
 #include "bench.h"
 
 #include "config.h"
+#include "consensus/consensus.h"
+#include "hash.h"
+#include "primitives/transaction.h"
+#include "script/compiled_script.h"
 #include "script/interpreter.h"
 #include "script/script.h"
+#include "script/script_flags.h"
+#include "script/standard.h"
 #include "taskcancellation.h"
 
 using namespace std;
@@ -80,3 +86,386 @@ static void interpreter_rshift_6m_minus_1(benchmark::State& state)
     }
 }
 BENCHMARK(interpreter_rshift_6m_minus_1);
+
+namespace
+{
+    // Accepts every signature so that only signature hashing is measured
+    class SighashOnlyChecker : public TransactionSignatureChecker
+    {
+    public:
+        using TransactionSignatureChecker::TransactionSignatureChecker;
+
+    protected:
+        bool VerifySignature(const std::vector<uint8_t>&,
+                             const CPubKey&,
+                             const uint256&) const override
+        {
+            return true;
+        }
+    };
+
+    // Locking script with a large data push followed by many
+    // <sig> <pubkey> OP_CHECKSIGVERIFY that share the same scriptCode
+    CScript LargeScriptWithSignatures(size_t dataSize, size_t nSigs)
+    {
+        std::vector<uint8_t> sig(71, 0x30);
+        sig.push_back(SIGHASH_ALL | SIGHASH_FORKID);
+        std::vector<uint8_t> pubkey(33, 0x01);
+        pubkey[0] = 0x02;
+
+        CScript script;
+        script << std::vector<uint8_t>(dataSize, 0x42) << OP_DROP;
+        for(size_t i = 0; i < nSigs; ++i)
+        {
+            script << sig << pubkey << OP_CHECKSIGVERIFY;
+        }
+        script << OP_TRUE;
+        return script;
+    }
+
+    CMutableTransaction SpendingTransaction()
+    {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(TxId(uint256S("01")), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = Amount(1);
+        return tx;
+    }
+
+    void EvalLargeScript(benchmark::State& state, bool precompute)
+    {
+        const CScript script { LargeScriptWithSignatures(1'000'000, 50) };
+        const CTransaction tx { SpendingTransaction() };
+        const PrecomputedTransactionData txdata { tx };
+        const SighashOnlyChecker checker {
+            precompute ? SighashOnlyChecker{&tx, 0, Amount(1), txdata}
+                       : SighashOnlyChecker{&tx, 0, Amount(1)} };
+
+        auto source = task::CCancellationSource::Make();
+        const auto flags { SCRIPT_UTXO_AFTER_GENESIS | SCRIPT_ENABLE_SIGHASH_FORKID };
+        ScriptError err;
+        while(state.KeepRunning())
+        {
+            LimitedStack stack { INT64_MAX };
+            auto res = EvalScript(GlobalConfig::GetConfig(), true, source->GetToken(), stack,
+                                  script, flags, checker, &err);
+            assert(res.value());
+        }
+    }
+}
+
+static void interpreter_checksig_1mb_script_50_sigs(benchmark::State& state)
+{
+    EvalLargeScript(state, false);
+}
+BENCHMARK(interpreter_checksig_1mb_script_50_sigs);
+
+static void interpreter_checksig_1mb_script_50_sigs_midstate(benchmark::State& state)
+{
+    EvalLargeScript(state, true);
+}
+BENCHMARK(interpreter_checksig_1mb_script_50_sigs_midstate);
+
+namespace
+{
+    // Accepts every signature so that only stack handling is measured
+    class AcceptAllChecker : public BaseSignatureChecker
+    {
+    public:
+        bool CheckSig(const std::vector<uint8_t>&,
+                      const std::vector<uint8_t>&,
+                      const CScript&,
+                      bool) const override
+        {
+            return true;
+        }
+    };
+
+    std::vector<uint8_t> DummySignature()
+    {
+        std::vector<uint8_t> sig(72, 0x30);
+        sig.push_back(SIGHASH_ALL | SIGHASH_FORKID);
+        return sig;
+    }
+
+    std::vector<uint8_t> DummyPubKey(uint8_t n)
+    {
+        std::vector<uint8_t> pubkey(33, n);
+        pubkey[0] = 0x02;
+        return pubkey;
+    }
+
+    // Verifies with the interpreter or with the standard template routines
+    void BenchVerifyScript(benchmark::State& state,
+                           const CScript& scriptSig,
+                           const CScript& scriptPubKey,
+                           bool useTemplate = false)
+    {
+        auto source = task::CCancellationSource::Make();
+        const AcceptAllChecker checker {};
+        ScriptError err;
+        while(state.KeepRunning())
+        {
+            for(int i = 0; i < 1000; ++i)
+            {
+                auto res = useTemplate
+                    ? VerifyStandardScript(GlobalConfig::GetConfig(), true,
+                                           scriptSig, scriptPubKey, SCRIPT_VERIFY_NONE,
+                                           checker, &err)
+                    : VerifyScript(GlobalConfig::GetConfig(), true, source->GetToken(),
+                                   scriptSig, scriptPubKey, SCRIPT_VERIFY_NONE,
+                                   checker, &err);
+                assert(res.value());
+            }
+        }
+    }
+
+    CScript P2PKHScriptPubKey()
+    {
+        const std::vector<uint8_t> pubkey { DummyPubKey(0x01) };
+        const uint160 pubkeyHash { Hash160(pubkey) };
+        return CScript() << OP_DUP << OP_HASH160 << ToByteVector(pubkeyHash)
+                         << OP_EQUALVERIFY << OP_CHECKSIG;
+    }
+
+    CScript MultisigScriptPubKey()
+    {
+        return CScript() << OP_2 << DummyPubKey(0x01) << DummyPubKey(0x02)
+                         << DummyPubKey(0x03) << OP_3 << OP_CHECKMULTISIG;
+    }
+}
+
+static void interpreter_p2pkh(benchmark::State& state)
+{
+    const CScript scriptSig { CScript() << DummySignature() << DummyPubKey(0x01) };
+    BenchVerifyScript(state, scriptSig, P2PKHScriptPubKey());
+}
+BENCHMARK(interpreter_p2pkh);
+
+static void interpreter_p2pkh_template(benchmark::State& state)
+{
+    const CScript scriptSig { CScript() << DummySignature() << DummyPubKey(0x01) };
+    BenchVerifyScript(state, scriptSig, P2PKHScriptPubKey(), true);
+}
+BENCHMARK(interpreter_p2pkh_template);
+
+static void interpreter_p2pk(benchmark::State& state)
+{
+    const CScript scriptPubKey { CScript() << DummyPubKey(0x01) << OP_CHECKSIG };
+    const CScript scriptSig { CScript() << DummySignature() };
+    BenchVerifyScript(state, scriptSig, scriptPubKey);
+}
+BENCHMARK(interpreter_p2pk);
+
+static void interpreter_p2pk_template(benchmark::State& state)
+{
+    const CScript scriptPubKey { CScript() << DummyPubKey(0x01) << OP_CHECKSIG };
+    const CScript scriptSig { CScript() << DummySignature() };
+    BenchVerifyScript(state, scriptSig, scriptPubKey, true);
+}
+BENCHMARK(interpreter_p2pk_template);
+
+static void interpreter_multisig_2_of_3(benchmark::State& state)
+{
+    const CScript scriptSig { CScript() << OP_0 << DummySignature()
+                                        << DummySignature() };
+    BenchVerifyScript(state, scriptSig, MultisigScriptPubKey());
+}
+BENCHMARK(interpreter_multisig_2_of_3);
+
+static void interpreter_multisig_2_of_3_template(benchmark::State& state)
+{
+    const CScript scriptSig { CScript() << OP_0 << DummySignature()
+                                        << DummySignature() };
+    BenchVerifyScript(state, scriptSig, MultisigScriptPubKey(), true);
+}
+BENCHMARK(interpreter_multisig_2_of_3_template);
+
+namespace
+{
+    // Post-Genesis arithmetic on two operands of the given size in bytes
+    void EvalArithmetic(benchmark::State& state, opcodetype opcode, size_t size)
+    {
+        const std::vector<uint8_t> a(size, 0x5a);
+        const std::vector<uint8_t> b(size, 0x3c);
+        CScript script;
+        for(int i = 0; i < 100; ++i)
+        {
+            script << a << b << opcode << OP_DROP;
+        }
+
+        auto source = task::CCancellationSource::Make();
+        ScriptError err;
+        while(state.KeepRunning())
+        {
+            LimitedStack stack { INT64_MAX };
+            auto res = EvalScript(GlobalConfig::GetConfig(), true, source->GetToken(), stack,
+                                  script, SCRIPT_UTXO_AFTER_GENESIS,
+                                  BaseSignatureChecker{}, &err);
+            assert(res.value());
+        }
+    }
+}
+
+static void interpreter_add_8_bytes(benchmark::State& state)
+{
+    EvalArithmetic(state, OP_ADD, 8);
+}
+BENCHMARK(interpreter_add_8_bytes);
+
+static void interpreter_add_32_bytes(benchmark::State& state)
+{
+    EvalArithmetic(state, OP_ADD, 32);
+}
+BENCHMARK(interpreter_add_32_bytes);
+
+static void interpreter_add_64_bytes(benchmark::State& state)
+{
+    EvalArithmetic(state, OP_ADD, 64);
+}
+BENCHMARK(interpreter_add_64_bytes);
+
+// Operands too large for the fixed width path
+static void interpreter_add_128_bytes(benchmark::State& state)
+{
+    EvalArithmetic(state, OP_ADD, 128);
+}
+BENCHMARK(interpreter_add_128_bytes);
+
+static void interpreter_mul_8_bytes(benchmark::State& state)
+{
+    EvalArithmetic(state, OP_MUL, 8);
+}
+BENCHMARK(interpreter_mul_8_bytes);
+
+static void interpreter_mul_32_bytes(benchmark::State& state)
+{
+    EvalArithmetic(state, OP_MUL, 32);
+}
+BENCHMARK(interpreter_mul_32_bytes);
+
+// Product doesn't fit in the fixed width
+static void interpreter_mul_64_bytes(benchmark::State& state)
+{
+    EvalArithmetic(state, OP_MUL, 64);
+}
+BENCHMARK(interpreter_mul_64_bytes);
+
+static void interpreter_div_8_bytes(benchmark::State& state)
+{
+    EvalArithmetic(state, OP_DIV, 8);
+}
+BENCHMARK(interpreter_div_8_bytes);
+
+static void interpreter_div_32_bytes(benchmark::State& state)
+{
+    EvalArithmetic(state, OP_DIV, 32);
+}
+BENCHMARK(interpreter_div_32_bytes);
+
+static void interpreter_div_64_bytes(benchmark::State& state)
+{
+    EvalArithmetic(state, OP_DIV, 64);
+}
+BENCHMARK(interpreter_div_64_bytes);
+
+static void interpreter_div_128_bytes(benchmark::State& state)
+{
+    EvalArithmetic(state, OP_DIV, 128);
+}
+BENCHMARK(interpreter_div_128_bytes);
+
+static void interpreter_split_cat_100mb(benchmark::State& state)
+{
+    std::vector<uint8_t> data(100'000'000, 0x0);
+
+    auto source = task::CCancellationSource::Make();
+    LimitedStack stack = LimitedStack({data}, INT64_MAX);
+    CScript script;
+    for(int i = 0; i < 10; ++i)
+    {
+        script << 50'000'000 << OP_SPLIT << OP_CAT;
+    }
+    const auto flags{SCRIPT_UTXO_AFTER_GENESIS};
+    ScriptError err;
+    while(state.KeepRunning())
+    {
+        EvalScript(GlobalConfig::GetConfig(), true, source->GetToken(), stack,
+                   script, flags, BaseSignatureChecker{}, &err);
+    }
+}
+BENCHMARK(interpreter_split_cat_100mb);
+
+static void interpreter_split_off_100mb(benchmark::State& state)
+{
+    std::vector<uint8_t> data(100'000'000, 0x0);
+
+    // Consume the element in 100kB chunks from the front
+    auto source = task::CCancellationSource::Make();
+    CScript script;
+    for(int i = 0; i < 999; ++i)
+    {
+        script << 100'000 << OP_SPLIT << OP_NIP;
+    }
+    const auto flags{SCRIPT_UTXO_AFTER_GENESIS};
+    ScriptError err;
+    while(state.KeepRunning())
+    {
+        LimitedStack stack = LimitedStack({data}, INT64_MAX);
+        EvalScript(GlobalConfig::GetConfig(), true, source->GetToken(), stack,
+                   script, flags, BaseSignatureChecker{}, &err);
+    }
+}
+BENCHMARK(interpreter_split_off_100mb);
+
+namespace
+{
+    // Script of about 1MB that pushes and drops data and has a large branch
+    // that is not executed, as used by repeated data carrier templates
+    CScript LargeTemplateScript()
+    {
+        const std::vector<uint8_t> data(1'000, 0x42);
+        CScript script;
+        for(int i = 0; i < 500; ++i)
+        {
+            script << data << OP_DROP;
+        }
+        script << OP_0 << OP_IF;
+        for(int i = 0; i < 500; ++i)
+        {
+            script << data << OP_DUP << OP_CAT << OP_DROP;
+        }
+        script << OP_ENDIF << OP_1;
+        return script;
+    }
+
+    void EvalLargeTemplate(benchmark::State& state, size_t nCacheSize)
+    {
+        const CScript script {LargeTemplateScript()};
+        GetCompiledScriptCache().Configure(nCacheSize, MIN_COMPILED_SCRIPT_SIZE);
+
+        auto source = task::CCancellationSource::Make();
+        const auto flags{SCRIPT_UTXO_AFTER_GENESIS};
+        ScriptError err;
+        while(state.KeepRunning())
+        {
+            LimitedStack stack(INT64_MAX);
+            EvalScript(GlobalConfig::GetConfig(), true, source->GetToken(),
+                       stack, script, flags, BaseSignatureChecker{}, &err);
+        }
+        GetCompiledScriptCache().Configure(0, MIN_COMPILED_SCRIPT_SIZE);
+    }
+}
+
+static void interpreter_template_1mb(benchmark::State& state)
+{
+    EvalLargeTemplate(state, 0);
+}
+BENCHMARK(interpreter_template_1mb);
+
+static void interpreter_template_1mb_compiled(benchmark::State& state)
+{
+    EvalLargeTemplate(state, 64 * ONE_MEBIBYTE);
+}
+BENCHMARK(interpreter_template_1mb_compiled);
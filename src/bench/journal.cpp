@@ -0,0 +1,138 @@
+// Copyright (c) 2019 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "bench.h"
+
+#include "mining/journal.h"
+#include "mining/journal_builder.h"
+#include "mining/journal_change_set.h"
+
+#include <atomic>
+#include <cassert>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace mining;
+
+// Each run adds this many txns one at a time, as the mempool does for new
+// txns, and then removes them again in blocks.
+static const size_t JOURNAL_BENCH_TXNS = 100000;
+static const size_t JOURNAL_BENCH_BLOCK_TXNS = 1000;
+static const size_t JOURNAL_BENCH_READERS = 2;
+
+static std::vector<CJournalEntry> MakeEntries(size_t count = JOURNAL_BENCH_TXNS,
+                                              uint32_t firstLockTime = 0) {
+    std::vector<CJournalEntry> entries;
+    entries.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        CMutableTransaction mtx;
+        mtx.nLockTime = firstLockTime + i;
+        entries.emplace_back(MakeTransactionRef(std::move(mtx)),
+                             std::make_shared<AncestorDescendantCounts>(1, 1),
+                             Amount(0), 0);
+    }
+    return entries;
+}
+
+// Replay the current journal like the journaling block assembler does,
+// starting again whenever our position is invalidated.
+static void ReadJournal(const CJournalBuilder &builder,
+                        const std::atomic<bool> &running) {
+    CJournalPtr journal = builder.getCurrentJournal();
+    CJournal::Index index = CJournal::ReadLock(journal).begin();
+    while (running) {
+        CJournal::ReadLock lock(journal);
+        if (!index.valid()) {
+            lock = CJournal::ReadLock();
+            journal = builder.getCurrentJournal();
+            lock = CJournal::ReadLock(journal);
+            index = lock.begin();
+        }
+        try {
+            index.reset();
+        } catch (const std::runtime_error &) {
+            // Invalidated since we checked, start again
+            continue;
+        }
+        while (index != lock.end()) {
+            assert(index.at().getTxn());
+            ++index;
+        }
+    }
+}
+
+static void JournalApplyChanges(benchmark::State &state) {
+    const std::vector<CJournalEntry> entries = MakeEntries();
+
+    while (state.KeepRunning()) {
+        CJournalBuilder builder;
+        std::atomic<bool> running(true);
+        std::vector<std::thread> readers;
+        for (size_t i = 0; i < JOURNAL_BENCH_READERS; ++i) {
+            readers.emplace_back(ReadJournal, std::cref(builder),
+                                 std::cref(running));
+        }
+
+        for (const auto &entry : entries) {
+            CJournalChangeSetPtr changeSet =
+                builder.getNewChangeSet(JournalUpdateReason::NEW_TXN);
+            changeSet->addOperation(CJournalChangeSet::Operation::ADD, entry);
+        }
+        for (size_t i = 0; i < entries.size();
+             i += JOURNAL_BENCH_BLOCK_TXNS) {
+            CJournalChangeSetPtr changeSet =
+                builder.getNewChangeSet(JournalUpdateReason::REMOVE_TXN);
+            for (size_t j = i; j < i + JOURNAL_BENCH_BLOCK_TXNS; ++j) {
+                changeSet->addOperation(CJournalChangeSet::Operation::REMOVE,
+                                        entries[j]);
+            }
+        }
+        assert(builder.getCurrentJournal()->size() == 0);
+
+        running = false;
+        for (auto &reader : readers) {
+            reader.join();
+        }
+    }
+}
+
+// A block's worth of txns goes back to the front of a full journal in a
+// reorg, and is removed again by the next block. Neither depends on the size
+// of the journal.
+static void JournalReorg(benchmark::State &state) {
+    const std::vector<CJournalEntry> entries = MakeEntries();
+    const std::vector<CJournalEntry> blockEntries =
+        MakeEntries(JOURNAL_BENCH_BLOCK_TXNS, JOURNAL_BENCH_TXNS);
+    CJournalBuilder builder;
+    {
+        CJournalChangeSetPtr changeSet =
+            builder.getNewChangeSet(JournalUpdateReason::NEW_TXN);
+        for (const auto &entry : entries) {
+            changeSet->addOperation(CJournalChangeSet::Operation::ADD, entry);
+        }
+    }
+
+    while (state.KeepRunning()) {
+        {
+            CJournalChangeSetPtr changeSet =
+                builder.getNewChangeSet(JournalUpdateReason::REORG);
+            for (const auto &entry : blockEntries) {
+                changeSet->addOperation(CJournalChangeSet::Operation::ADD,
+                                        entry);
+            }
+        }
+        {
+            CJournalChangeSetPtr changeSet =
+                builder.getNewChangeSet(JournalUpdateReason::NEW_BLOCK);
+            for (const auto &entry : blockEntries) {
+                changeSet->addOperation(CJournalChangeSet::Operation::REMOVE,
+                                        entry);
+            }
+        }
+        assert(builder.getCurrentJournal()->size() == entries.size());
+    }
+}
+
+BENCHMARK(JournalApplyChanges);
+BENCHMARK(JournalReorg);
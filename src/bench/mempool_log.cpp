@@ -0,0 +1,89 @@
+// Copyright (c) 2019 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "bench.h"
+
+#include "clientversion.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "txmempool_log.h"
+
+#include <cassert>
+
+// Synthetic mempool churn. Pools of 1M-10M txns take proportionally longer:
+// appending and replaying scale linearly with the number of logged changes,
+// while a compaction rewrites the pool only after the log outgrew it, so
+// every logged byte is written at most about twice.
+static const size_t MEMPOOL_LOG_BENCH_TXNS = 100000;
+
+static std::vector<CTransactionRef> MakeTxns() {
+    FastRandomContext rng(true);
+    std::vector<CTransactionRef> txns;
+    txns.reserve(MEMPOOL_LOG_BENCH_TXNS);
+    for (size_t i = 0; i < MEMPOOL_LOG_BENCH_TXNS; ++i) {
+        // P2PKH sized spend
+        CMutableTransaction mtx;
+        mtx.vin.emplace_back(COutPoint(rng.rand256(), 0));
+        mtx.vin[0].scriptSig.assign(107, uint8_t(rng.randbits(8)));
+        mtx.vout.emplace_back(Amount(1000), CScript());
+        mtx.vout[0].scriptPubKey.assign(25, uint8_t(rng.randbits(8)));
+        txns.push_back(MakeTransactionRef(mtx));
+    }
+    return txns;
+}
+
+static CTxMemPoolLog::SnapshotFn MakeSnapshot(const fs::path &dir) {
+    return [dir]() {
+        CAutoFile file(fsbridge::fopen(dir / "mempool.dat", "wb"), SER_DISK,
+                       CLIENT_VERSION);
+        return !file.IsNull();
+    };
+}
+
+// Every txn is added to and later removed from the pool
+static void LogChurn(CTxMemPool &pool,
+                     const std::vector<CTransactionRef> &txns) {
+    for (const auto &tx : txns) {
+        pool.NotifyEntryAdded(tx);
+    }
+    for (const auto &tx : txns) {
+        pool.NotifyEntryRemoved(tx, MemPoolRemovalReason::BLOCK);
+    }
+}
+
+static void MempoolLogAppend(benchmark::State &state) {
+    fs::path dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(dir);
+    CTxMemPool pool;
+    std::vector<CTransactionRef> txns = MakeTxns();
+
+    while (state.KeepRunning()) {
+        CTxMemPoolLog log(pool, dir, MakeSnapshot(dir));
+        LogChurn(pool, txns);
+        log.Flush();
+    }
+
+    fs::remove_all(dir);
+}
+
+static void MempoolLogReplay(benchmark::State &state) {
+    fs::path dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(dir);
+    CTxMemPool pool;
+    {
+        CTxMemPoolLog log(pool, dir, MakeSnapshot(dir),
+                          std::numeric_limits<uint64_t>::max());
+        LogChurn(pool, MakeTxns());
+    }
+
+    while (state.KeepRunning()) {
+        CTxMemPoolLogReplay replay = CTxMemPoolLog::Replay(dir);
+        assert(replay.GetNumRecords() == 2 * MEMPOOL_LOG_BENCH_TXNS);
+    }
+
+    fs::remove_all(dir);
+}
+
+BENCHMARK(MempoolLogAppend);
+BENCHMARK(MempoolLogReplay);
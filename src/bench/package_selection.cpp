@@ -0,0 +1,88 @@
+// Copyright (c) 2019 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "bench.h"
+
+#include "mining/journal_change_set.h"
+#include "mining/legacy.h"
+#include "policy/policy.h"
+#include "random.h"
+#include "txmempool.h"
+
+#include <cassert>
+#include <mutex>
+#include <shared_mutex>
+
+namespace
+{
+    mining::CJournalChangeSetPtr nullChangeSet {nullptr};
+}
+
+// Synthetic mempool of independent chains of txns with random fees. The time
+// to copy the mempool, which is all that mempool writers wait for, and the
+// time to select packages both grow linearly with the number of txns.
+static const size_t PACKAGE_SELECTION_BENCH_CHAINS = 20000;
+static const size_t PACKAGE_SELECTION_BENCH_CHAIN_LENGTH = 5;
+
+static void FillMempool(CTxMemPool &pool) {
+    FastRandomContext rng(true);
+    for (size_t c = 0; c < PACKAGE_SELECTION_BENCH_CHAINS; ++c) {
+        COutPoint prevout(rng.rand256(), 0);
+        for (size_t i = 0; i < PACKAGE_SELECTION_BENCH_CHAIN_LENGTH; ++i) {
+            CMutableTransaction mtx;
+            mtx.vin.emplace_back(prevout);
+            mtx.vin[0].scriptSig.assign(107, uint8_t(rng.randbits(8)));
+            mtx.vout.emplace_back(Amount(1000), CScript());
+            mtx.vout[0].scriptPubKey.assign(25, uint8_t(rng.randbits(8)));
+            CTransactionRef tx = MakeTransactionRef(mtx);
+            Amount nFee(250 + rng.randrange(10000));
+            LockPoints lp;
+            pool.AddUnchecked(tx->GetId(),
+                              CTxMemPoolEntry(tx, nFee, 0, 10.0, 1,
+                                              tx->GetValueOut(), false, 1, lp),
+                              nullChangeSet);
+            prevout = COutPoint(tx->GetId(), 0);
+        }
+    }
+}
+
+static void PackageSelectionSnapshot(benchmark::State &state) {
+    CTxMemPool pool;
+    FillMempool(pool);
+
+    while (state.KeepRunning()) {
+        std::shared_lock lock(pool.smtx);
+        CPackageSelectionSnapshot snapshot(pool, CTxMemPool::setEntries(), 1,
+                                           false);
+        assert(snapshot.size() == PACKAGE_SELECTION_BENCH_CHAINS *
+                                      PACKAGE_SELECTION_BENCH_CHAIN_LENGTH);
+    }
+}
+
+static void SelectPackages(benchmark::State &state, size_t nThreads) {
+    CTxMemPool pool;
+    FillMempool(pool);
+    std::shared_lock lock(pool.smtx);
+    CPackageSelectionSnapshot snapshot(pool, CTxMemPool::setEntries(), 1,
+                                       false);
+    lock.unlock();
+
+    while (state.KeepRunning()) {
+        int nDescendantsUpdated = 0;
+        auto selections = snapshot.SelectIndependentPackages(
+            CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE), nThreads, nDescendantsUpdated);
+        assert(selections.size() == nThreads);
+    }
+}
+
+static void PackageSelectionSequential(benchmark::State &state) {
+    SelectPackages(state, 1);
+}
+
+static void PackageSelectionParallel(benchmark::State &state) {
+    SelectPackages(state, 4);
+}
+
+BENCHMARK(PackageSelectionSnapshot);
+BENCHMARK(PackageSelectionSequential);
+BENCHMARK(PackageSelectionParallel);
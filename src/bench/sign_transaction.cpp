@@ -0,0 +1,63 @@
+// Copyright (c) 2019 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "bench.h"
+
+#include "config.h"
+#include "key.h"
+#include "keystore.h"
+#include "random.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "util.h"
+
+#include <cassert>
+
+// Transaction spending many P2PKH outputs of a few keys, as signed by
+// signrawtransaction when consolidating coins.
+static const size_t SIGN_BENCH_INPUTS = 2000;
+static const size_t SIGN_BENCH_KEYS = 10;
+
+static void SignTransaction(benchmark::State &state, size_t nThreads) {
+    const Config &config = GlobalConfig::GetConfig();
+    CBasicKeyStore keystore;
+    std::vector<CScript> scriptPubKeys;
+    for (size_t i = 0; i < SIGN_BENCH_KEYS; ++i) {
+        CKey key;
+        key.MakeNewKey(true);
+        keystore.AddKey(key);
+        scriptPubKeys.push_back(
+            GetScriptForDestination(key.GetPubKey().GetID()));
+    }
+
+    CMutableTransaction mtx;
+    std::vector<std::optional<SpentOutput>> spentOutputs;
+    for (size_t i = 0; i < SIGN_BENCH_INPUTS; ++i) {
+        mtx.vin.emplace_back(COutPoint(GetRandHash(), 0));
+        spentOutputs.push_back(SpentOutput{
+            CTxOut(Amount(1000), scriptPubKeys[i % scriptPubKeys.size()]),
+            true});
+    }
+    mtx.vout.emplace_back(Amount(1000 * SIGN_BENCH_INPUTS), scriptPubKeys[0]);
+
+    while (state.KeepRunning()) {
+        CMutableTransaction signedTx(mtx);
+        auto errors = SignTransactionInputs(
+            config, keystore, true, signedTx, spentOutputs, {},
+            SigHashType().withForkId(), nThreads);
+        for (const auto &error : errors) {
+            assert(error && *error == SCRIPT_ERR_OK);
+        }
+    }
+}
+
+static void SignTransactionSingleThread(benchmark::State &state) {
+    SignTransaction(state, 1);
+}
+
+static void SignTransactionMultiThread(benchmark::State &state) {
+    SignTransaction(state, std::max(2, GetNumCores()));
+}
+
+BENCHMARK(SignTransactionSingleThread);
+BENCHMARK(SignTransactionMultiThread);
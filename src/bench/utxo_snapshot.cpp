@@ -0,0 +1,64 @@
+// Copyright (c) 2019 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "random.h"
+#include "taskcancellation.h"
+#include "txdb.h"
+#include "util.h"
+#include "utxo_snapshot.h"
+
+// Synthetic UTXO set size. Real chainstates are several orders of magnitude
+// larger; dump and load both scale linearly with the number of coins so the
+// per-coin cost measured here extrapolates to the full set.
+static const size_t SNAPSHOT_BENCH_TXNS = 100000;
+static const size_t SNAPSHOT_BENCH_OUTPUTS_PER_TXN = 2;
+
+static void PopulateView(CCoinsViewDB &view) {
+    FastRandomContext rng(true);
+    CCoinsViewCache cache(&view);
+    for (size_t i = 0; i < SNAPSHOT_BENCH_TXNS; ++i) {
+        TxId txid(rng.rand256());
+        for (size_t n = 0; n < SNAPSHOT_BENCH_OUTPUTS_PER_TXN; ++n) {
+            CTxOut txout;
+            txout.nValue = Amount(int64_t(rng.randrange(1000000)));
+            // P2PKH sized locking scripts
+            txout.scriptPubKey.assign(25, uint8_t(rng.randbits(8)));
+            cache.AddCoin(COutPoint(txid, n), Coin(txout, 1, false), false,
+                          0);
+        }
+    }
+    cache.SetBestBlock(rng.rand256());
+    cache.Flush();
+}
+
+static void UTXOSnapshotDumpLoad(benchmark::State &state) {
+    fs::path dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(dir);
+    gArgs.ForceSetArg("-datadir", dir.string());
+    ClearDatadirCache();
+
+    auto source = task::CCancellationSource::Make();
+    CCoinsViewDB sourceView(1 << 23, true);
+    PopulateView(sourceView);
+
+    fs::path path = dir / "utxo.dat";
+    while (state.KeepRunning()) {
+        fs::remove(path);
+        CUTXOSnapshotMetadata metadata;
+        metadata.hashBaseBlock = sourceView.GetBestBlock();
+        std::unique_ptr<CCoinsViewCursor> cursor(sourceView.Cursor());
+        DumpUTXOSnapshot(*cursor, metadata, path, source->GetToken());
+
+        CCoinsViewDB targetView(1 << 23, true);
+        LoadUTXOSnapshot(targetView, path, metadata,
+                         DEFAULT_UTXO_SNAPSHOT_LOAD_THREADS,
+                         source->GetToken());
+    }
+
+    fs::remove_all(dir);
+}
+
+BENCHMARK(UTXOSnapshotDumpLoad);
@@ -0,0 +1,264 @@
+// Copyright (c) 2019 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "chainstate_warmup.h"
+
+#include "clientversion.h"
+#include "coins.h"
+#include "logging.h"
+#include "streams.h"
+#include "task_helpers.h"
+#include "taskcancellation.h"
+#include "threadpool.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    std::mutex warmupStatusMtx {};
+    CChainstateWarmupStatus warmupStatus {};
+
+    template<typename Callable>
+    void UpdateStatus(Callable&& update)
+    {
+        std::lock_guard<std::mutex> lock { warmupStatusMtx };
+        update(warmupStatus);
+    }
+}
+
+CChainstateWarmupStatus GetChainstateWarmupStatus()
+{
+    std::lock_guard<std::mutex> lock { warmupStatusMtx };
+    CChainstateWarmupStatus status { warmupStatus };
+    if(status.state == "running")
+    {
+        status.nDurationMillis = GetTimeMillis() - status.nStartTime;
+    }
+    return status;
+}
+
+void SetChainstateWarmupState(ChainstateWarmupMode mode, const std::string& state)
+{
+    UpdateStatus(
+        [&](CChainstateWarmupStatus& status)
+        {
+            if(state == "running")
+            {
+                status = CChainstateWarmupStatus{};
+                status.nStartTime = GetTimeMillis();
+            }
+            else if(status.state == "running")
+            {
+                status.nDurationMillis = GetTimeMillis() - status.nStartTime;
+            }
+            status.mode = mode;
+            status.state = state;
+        });
+}
+
+std::string ChainstateWarmupModeToString(ChainstateWarmupMode mode)
+{
+    switch(mode)
+    {
+        case ChainstateWarmupMode::NONE:
+            return "none";
+        case ChainstateWarmupMode::VMTOUCH:
+            return "vmtouch";
+        case ChainstateWarmupMode::HOT_COINS:
+            return "hotcoins";
+    }
+    return "unknown";
+}
+
+uint64_t DumpHotCoinsProfile(
+    const CCoinsViewCache& tip,
+    const CTxMemPool& mempool,
+    const fs::path& path,
+    uint64_t maxCoins)
+{
+    int64_t nStart = GetTimeMillis();
+
+    // Inputs of mempool transactions are the coins most likely to be spent by
+    // the next blocks so they take precedence over the rest of the cache.
+    std::vector<COutPoint> outpoints {};
+    for(const TxMempoolInfo& info : mempool.InfoAll())
+    {
+        for(const CTxIn& txin : info.tx->vin)
+        {
+            if(outpoints.size() >= maxCoins)
+            {
+                break;
+            }
+            if(!mempool.Exists(txin.prevout.GetTxId()))
+            {
+                outpoints.push_back(txin.prevout);
+            }
+        }
+    }
+    if(outpoints.size() < maxCoins)
+    {
+        std::vector<COutPoint> cached { tip.GetCachedOutpoints(maxCoins - outpoints.size()) };
+        outpoints.insert(outpoints.end(), cached.begin(), cached.end());
+    }
+
+    // Database key order makes the reads at startup mostly sequential
+    std::sort(outpoints.begin(), outpoints.end());
+    outpoints.erase(std::unique(outpoints.begin(), outpoints.end()), outpoints.end());
+
+    fs::path pathTmp { path };
+    pathTmp += ".new";
+    CAutoFile file { fsbridge::fopen(pathTmp, "wb"), SER_DISK, CLIENT_VERSION };
+    if(file.IsNull())
+    {
+        throw std::runtime_error("Unable to open " + pathTmp.string() + " for writing");
+    }
+
+    file << HOT_COINS_PROFILE_VERSION;
+    file << static_cast<uint64_t>(outpoints.size());
+    // Outpoints are grouped by txid: txid, VARINT(number of outputs) and then
+    // VARINT(n) for each output
+    for(auto it = outpoints.begin(); it != outpoints.end();)
+    {
+        auto end = std::find_if(it, outpoints.end(),
+            [&it](const COutPoint& outpoint){ return outpoint.GetTxId() != it->GetTxId(); });
+        file << it->GetTxId();
+        file << VARINT(static_cast<uint64_t>(std::distance(it, end)));
+        for(; it != end; ++it)
+        {
+            file << VARINT(it->GetN());
+        }
+    }
+    FileCommit(file.Get());
+    file.fclose();
+
+    if(!RenameOver(pathTmp, path))
+    {
+        throw std::runtime_error("Unable to rename " + pathTmp.string() + " to " + path.string());
+    }
+
+    LogPrintf("Dumped hot coins profile: %u outpoints in %dms\n",
+        outpoints.size(), GetTimeMillis() - nStart);
+    return outpoints.size();
+}
+
+void WarmupFromHotCoinsProfile(
+    CCoinsViewCache& tip,
+    const fs::path& path,
+    size_t nThreads,
+    size_t maxCacheUsage,
+    const task::CCancellationToken& cancellationToken)
+{
+    SetChainstateWarmupState(ChainstateWarmupMode::HOT_COINS, "running");
+
+    CAutoFile file { fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION };
+    if(file.IsNull())
+    {
+        LogPrintf("Hot coins profile %s not found, chainstate will not be preloaded\n", path.string());
+        SetChainstateWarmupState(ChainstateWarmupMode::HOT_COINS, "failed");
+        return;
+    }
+
+    nThreads = std::max<size_t>(nThreads, 1);
+    CThreadPool<CQueueAdaptor> pool { "ChainstateWarmup", nThreads };
+    const size_t maxInFlight { nThreads * 2 };
+    // Batch size and number of coins loaded from the batch
+    std::deque<std::pair<size_t, std::future<size_t>>> results {};
+    auto waitOldest = [&]()
+    {
+        auto result { std::move(results.front()) };
+        results.pop_front();
+        size_t nLoaded { result.second.get() };
+        UpdateStatus(
+            [&result, nLoaded](CChainstateWarmupStatus& status)
+            {
+                status.nProcessed += result.first;
+                status.nLoaded += nLoaded;
+            });
+    };
+
+    std::string state { "finished" };
+    try
+    {
+        uint64_t version {0};
+        uint64_t nTotal {0};
+        file >> version;
+        if(version != HOT_COINS_PROFILE_VERSION)
+        {
+            throw std::runtime_error(strprintf("unsupported version %d", version));
+        }
+        file >> nTotal;
+        UpdateStatus([nTotal](CChainstateWarmupStatus& status){ status.nTotal = nTotal; });
+        LogPrintf("Preloading %u coins from hot coins profile\n", nTotal);
+
+        auto batch { std::make_shared<std::vector<COutPoint>>() };
+        auto dispatch = [&]()
+        {
+            while(results.size() >= maxInFlight)
+            {
+                waitOldest();
+            }
+            results.emplace_back(batch->size(), make_task(pool,
+                [&tip, batch](){ return tip.Prefetch(*batch); }));
+            batch = std::make_shared<std::vector<COutPoint>>();
+        };
+
+        uint64_t nRead {0};
+        while(nRead < nTotal)
+        {
+            if(cancellationToken.IsCanceled())
+            {
+                state = "canceled";
+                break;
+            }
+            if(tip.DynamicMemoryUsage() >= maxCacheUsage)
+            {
+                LogPrintf("Coins cache is full, stopping chainstate preload\n");
+                break;
+            }
+
+            TxId txid;
+            uint64_t nOutputs {0};
+            file >> txid;
+            file >> VARINT(nOutputs);
+            for(uint64_t i = 0; i < nOutputs && nRead < nTotal; ++i, ++nRead)
+            {
+                uint32_t n {0};
+                file >> VARINT(n);
+                batch->emplace_back(txid, n);
+                if(batch->size() >= HOT_COINS_WARMUP_BATCH_SIZE)
+                {
+                    dispatch();
+                }
+            }
+        }
+        if(!batch->empty() && state != "canceled")
+        {
+            dispatch();
+        }
+        while(!results.empty())
+        {
+            waitOldest();
+        }
+    }
+    catch(const std::exception& e)
+    {
+        for(auto& result : results)
+        {
+            result.second.wait();
+        }
+        LogPrintf("Failed to preload chainstate from hot coins profile: %s\n", e.what());
+        state = "failed";
+    }
+
+    SetChainstateWarmupState(ChainstateWarmupMode::HOT_COINS, state);
+    CChainstateWarmupStatus status { GetChainstateWarmupStatus() };
+    LogPrintf("Chainstate preload %s: loaded %u of %u coins in %dms\n",
+        state, status.nLoaded, status.nTotal, status.nDurationMillis);
+}
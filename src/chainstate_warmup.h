@@ -0,0 +1,93 @@
+// Copyright (c) 2019 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef BITCOIN_CHAINSTATE_WARMUP_H
+#define BITCOIN_CHAINSTATE_WARMUP_H
+
+#include "fs.h"
+
+#include <cstdint>
+#include <string>
+
+class CCoinsViewCache;
+class CTxMemPool;
+
+namespace task
+{
+    class CCancellationToken;
+}
+
+//! Name of the hot coins profile file in the data directory.
+static const char HOT_COINS_PROFILE_FILENAME[] = "hotcoins.dat";
+//! Current hot coins profile file format version.
+static const uint64_t HOT_COINS_PROFILE_VERSION = 1;
+//! Maximum number of outpoints recorded in the hot coins profile.
+static const uint64_t DEFAULT_HOT_COINS_PROFILE_MAX_COINS = 4000000;
+//! Number of outpoints handed to a warmup thread at once.
+static const size_t HOT_COINS_WARMUP_BATCH_SIZE = 1000;
+
+/** -preload modes */
+enum class ChainstateWarmupMode : int
+{
+    NONE = 0,
+    //! Pull the whole chainstate directory into the OS page cache
+    VMTOUCH = 1,
+    //! Load coins recorded in the hot coins profile into the coins cache
+    HOT_COINS = 2
+};
+
+/** Progress of the chainstate warmup requested with -preload */
+struct CChainstateWarmupStatus
+{
+    ChainstateWarmupMode mode { ChainstateWarmupMode::NONE };
+    //! "not started", "running", "finished", "failed" or "canceled"
+    std::string state { "not started" };
+    //! Number of outpoints in the hot coins profile
+    uint64_t nTotal { 0 };
+    //! Number of outpoints looked up so far
+    uint64_t nProcessed { 0 };
+    //! Number of coins found and loaded into the coins cache
+    uint64_t nLoaded { 0 };
+    int64_t nStartTime { 0 };
+    int64_t nDurationMillis { 0 };
+};
+
+//! Return a copy of the current warmup progress.
+CChainstateWarmupStatus GetChainstateWarmupStatus();
+
+//! Update mode and state of the warmup; used by warmup modes not implemented
+//! in this file.
+void SetChainstateWarmupState(ChainstateWarmupMode mode, const std::string& state);
+
+//! Return the -preload mode name as reported by RPC.
+std::string ChainstateWarmupModeToString(ChainstateWarmupMode mode);
+
+/**
+ * Record outpoints of coins that are likely to be accessed soon after a
+ * restart: unspent coins currently held in tip (i.e. recently used by block
+ * or transaction validation) and confirmed inputs of mempool transactions.
+ * At most maxCoins outpoints are written, sorted in database key order.
+ *
+ * Must be called before tip is flushed. Returns number of outpoints written;
+ * throws std::runtime_error on failure.
+ */
+uint64_t DumpHotCoinsProfile(
+    const CCoinsViewCache& tip,
+    const CTxMemPool& mempool,
+    const fs::path& path,
+    uint64_t maxCoins);
+
+/**
+ * Load coins listed in the hot coins profile at path into tip from its
+ * backing view using nThreads parallel readers. Stops once the dynamic
+ * memory usage of tip reaches maxCacheUsage so the warmup never causes a
+ * cache flush. Progress is reported through GetChainstateWarmupStatus().
+ */
+void WarmupFromHotCoinsProfile(
+    CCoinsViewCache& tip,
+    const fs::path& path,
+    size_t nThreads,
+    size_t maxCacheUsage,
+    const task::CCancellationToken& cancellationToken);
+
+#endif // BITCOIN_CHAINSTATE_WARMUP_H
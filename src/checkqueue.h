@@ -12,6 +12,7 @@
 #include <optional>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <vector>
 
 #include <boost/thread/thread.hpp>
@@ -33,6 +34,11 @@
  * done adding work, it temporarily joins the worker pool as an N'th worker,
  * until all jobs are done.
  *
+ * T may also declare a nested `batch_type` with `bool Verify()`. In that case
+ * each worker calls `operator()(const task::CCancellationToken&, batch_type&)`
+ * through which checks can defer part of their work into a batch that is
+ * verified once all the checks taken by the worker have run.
+ *
  * NOTE: This class is intended to be used through CCheckQueuePool and not by
  *       itself.
  */
@@ -42,6 +48,15 @@ private:
     static_assert(
         std::is_same_v<std::optional<bool>,
         decltype(std::declval<T>()(std::declval<task::CCancellationToken>()))>);
+
+    //! Work deferred by the checks that a worker runs at once
+    struct CNoBatch {};
+    template <typename U, typename = void>
+    struct batch_of { using type = CNoBatch; };
+    template <typename U>
+    struct batch_of<U, std::void_t<typename U::batch_type>> { using type = typename U::batch_type; };
+    using batch_type = typename batch_of<T>::type;
+    static constexpr bool fBatched = !std::is_same_v<batch_type, CNoBatch>;
     /**
      * Scope guard that makes sure that even if an exception is thrown inside
      * Loop() (e.g. by cond.wait(lock);) the worker count will be correct.
@@ -140,6 +155,7 @@ private:
         boost::condition_variable &cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
+        [[maybe_unused]] batch_type batch;
         unsigned int nNow = 0;
         std::optional<bool> fOk = true;
         CTotalScopeGuard guard{mutex, nTotal};
@@ -244,7 +260,26 @@ private:
                     break;
                 }
 
-                fOk = check(*mSessionToken);
+                if constexpr (fBatched)
+                {
+                    fOk = check(*mSessionToken, batch);
+                }
+                else
+                {
+                    fOk = check(*mSessionToken);
+                }
+            }
+            if constexpr (fBatched)
+            {
+                if (fOk.has_value() && fOk.value() && !mSessionToken->IsCanceled())
+                {
+                    fOk = batch.Verify();
+                }
+                else
+                {
+                    // Result is already known, drop the deferred work
+                    batch = batch_type{};
+                }
             }
             vChecks.clear();
         } while (true);
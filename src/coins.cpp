@@ -204,6 +204,70 @@ bool CCoinsViewCache::HaveCoinInCache(const COutPoint &outpoint) const {
     return it != cacheCoins.end();
 }
 
+size_t CCoinsViewCache::Prefetch(const std::vector<COutPoint> &outpoints) {
+    std::vector<const COutPoint *> missing;
+    uint64_t flushGeneration;
+    {
+        std::unique_lock<std::mutex> lock { mCoinsViewCacheMtx };
+        flushGeneration = mFlushGeneration;
+        for (const COutPoint &outpoint : outpoints) {
+            if (cacheCoins.find(outpoint) == cacheCoins.end()) {
+                missing.push_back(&outpoint);
+            }
+        }
+    }
+
+    std::vector<std::pair<const COutPoint *, Coin>> fetched;
+    fetched.reserve(missing.size());
+    for (const COutPoint *outpoint : missing) {
+        Coin coin;
+        if (base->GetCoin(*outpoint, coin)) {
+            fetched.emplace_back(outpoint, std::move(coin));
+        }
+    }
+
+    std::unique_lock<std::mutex> lock { mCoinsViewCacheMtx };
+    if (flushGeneration != mFlushGeneration) {
+        // Cache was flushed while reading so coins spent in the flushed
+        // changes may have been read before they were written.
+        return 0;
+    }
+    size_t loaded = 0;
+    for (auto &entry : fetched) {
+        CCoinsMap::iterator it;
+        bool inserted;
+        std::tie(it, inserted) = cacheCoins.emplace(
+            std::piecewise_construct, std::forward_as_tuple(*entry.first),
+            std::forward_as_tuple(std::move(entry.second)));
+        if (!inserted) {
+            continue;
+        }
+        if (it->second.coin.IsSpent()) {
+            // Same as in FetchCoinNL()
+            it->second.flags = CCoinsCacheEntry::FRESH;
+        }
+        cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+        ++loaded;
+    }
+    return loaded;
+}
+
+std::vector<COutPoint>
+CCoinsViewCache::GetCachedOutpoints(size_t maxCount) const {
+    std::unique_lock<std::mutex> lock { mCoinsViewCacheMtx };
+    std::vector<COutPoint> outpoints;
+    outpoints.reserve(std::min(maxCount, cacheCoins.size()));
+    for (const auto &entry : cacheCoins) {
+        if (outpoints.size() >= maxCount) {
+            break;
+        }
+        if (!entry.second.coin.IsSpent()) {
+            outpoints.push_back(entry.first);
+        }
+    }
+    return outpoints;
+}
+
 uint256 CCoinsViewCache::GetBestBlock() const {
     std::unique_lock<std::mutex> lock { mCoinsViewCacheMtx };
     if (hashBlock.IsNull()) {
@@ -311,6 +375,7 @@ bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
     cachedCoinsUsage = 0;
+    ++mFlushGeneration;
     return fOk;
 }
 
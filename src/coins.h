@@ -230,6 +230,20 @@ public:
      */
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
+    /**
+     * Load coins for the given outpoints from the backing view into the cache.
+     * Lookups in the backing view are made without holding the cache lock so
+     * several threads may prefetch into the same cache concurrently with
+     * other users of the cache. Entries that were loaded or modified in the
+     * meantime are left untouched and nothing is loaded if the cache was
+     * flushed while reading. The backing view must support concurrent reads.
+     * Returns the number of coins added to the cache.
+     */
+    size_t Prefetch(const std::vector<COutPoint> &outpoints);
+
+    //! Return up to maxCount outpoints of unspent coins held in the cache.
+    std::vector<COutPoint> GetCachedOutpoints(size_t maxCount) const;
+
     /**
      * Return a reference to a Coin in the cache, or a pruned one if not found.
      * This is more efficient than GetCoin. Modifications to other cache entries
@@ -327,6 +341,9 @@ private:
 private:
     /* A mutex to support a thread safe access. */
     mutable std::mutex mCoinsViewCacheMtx {};
+
+    /* Number of times the cache was flushed; used to detect stale prefetches. */
+    uint64_t mFlushGeneration {0};
 };
 
 //! Utility function to add all of a transaction's outputs to a cache.
@@ -51,12 +51,15 @@ void GlobalConfig::Reset()
     mMaxParallelBlocks = DEFAULT_SCRIPT_CHECK_POOL_SIZE;
     mPerBlockScriptValidatorThreadsCount = DEFAULT_SCRIPTCHECK_THREADS;
     mPerBlockScriptValidationMaxBatchSize = DEFAULT_SCRIPT_CHECK_MAX_BATCH_SIZE;
+    mCoinsPrefetchThreadsCount = DEFAULT_COINS_PREFETCH_THREADS;
+    mMaxUndoWriteQueueSize = DEFAULT_MAX_UNDO_WRITE_QUEUE_SIZE * ONE_MEGABYTE;
     maxOpsPerScriptPolicy = DEFAULT_OPS_PER_SCRIPT_POLICY_AFTER_GENESIS;
     maxTxSigOpsCountPolicy = DEFAULT_TX_SIGOPS_COUNT_POLICY_AFTER_GENESIS;
     maxPubKeysPerMultiSig = DEFAULT_PUBKEYS_PER_MULTISIG_POLICY_AFTER_GENESIS;
 
     mMaxStdTxnValidationDuration = DEFAULT_MAX_STD_TXN_VALIDATION_DURATION;
     mMaxNonStdTxnValidationDuration = DEFAULT_MAX_NON_STD_TXN_VALIDATION_DURATION;
+    mMaxStdTxnScriptCost = DEFAULT_MAX_STD_TXN_SCRIPT_COST;
 
     maxStackMemoryUsagePolicy = DEFAULT_STACK_MEMORY_USAGE_POLICY_AFTER_GENESIS;
     maxStackMemoryUsageConsensus = DEFAULT_STACK_MEMORY_USAGE_CONSENSUS_AFTER_GENESIS;
@@ -589,6 +592,51 @@ int GlobalConfig::GetPerBlockScriptValidationMaxBatchSize() const
     return mPerBlockScriptValidationMaxBatchSize;
 }
 
+bool GlobalConfig::SetCoinsPrefetchThreadsCount(
+    int coinsPrefetchThreadsCount,
+    std::string* error)
+{
+    if (coinsPrefetchThreadsCount < 0
+        || coinsPrefetchThreadsCount > MAX_COINS_PREFETCH_THREADS)
+    {
+        if(error)
+        {
+            *error =
+                strprintf(
+                    _("Coins prefetch threads count must be at least 0 and at "
+                      "most %d"), MAX_COINS_PREFETCH_THREADS);
+        }
+
+        return false;
+    }
+
+    mCoinsPrefetchThreadsCount = coinsPrefetchThreadsCount;
+
+    return true;
+}
+
+int GlobalConfig::GetCoinsPrefetchThreadsCount() const
+{
+    return mCoinsPrefetchThreadsCount;
+}
+
+bool GlobalConfig::SetMaxUndoWriteQueueSize(int64_t maxSizeMB, std::string* error)
+{
+    if (LessThanZero(maxSizeMB, error, "Undo write queue size cannot be less than zero."))
+    {
+        return false;
+    }
+
+    mMaxUndoWriteQueueSize = static_cast<uint64_t>(maxSizeMB) * ONE_MEGABYTE;
+
+    return true;
+}
+
+uint64_t GlobalConfig::GetMaxUndoWriteQueueSize() const
+{
+    return mMaxUndoWriteQueueSize;
+}
+
 bool GlobalConfig::SetMaxOpsPerScriptPolicy(int64_t maxOpsPerScriptPolicyIn, std::string* error)
 {
     if (LessThanZero(maxOpsPerScriptPolicyIn, error, "Policy value for MaxOpsPerScript cannot be less than zero."))
@@ -679,6 +727,23 @@ std::chrono::milliseconds GlobalConfig::GetMaxNonStdTxnValidationDuration() cons
     return mMaxNonStdTxnValidationDuration;
 }
 
+bool GlobalConfig::SetMaxStdTxnScriptCost(int64_t maxStdTxnScriptCostIn, std::string* err)
+{
+    if (LessThanZero(maxStdTxnScriptCostIn, err, "Standard transaction script cost cannot be configured with a negative value."))
+    {
+        return false;
+    }
+
+    mMaxStdTxnScriptCost = static_cast<uint64_t>(maxStdTxnScriptCostIn);
+
+    return true;
+}
+
+uint64_t GlobalConfig::GetMaxStdTxnScriptCost() const
+{
+    return mMaxStdTxnScriptCost;
+}
+
 /**
  * Compute the maximum number of sigops operations that can be contained in a block
  * given the block size as parameter. It is computed by multiplying the upper sigops limit
@@ -884,6 +949,16 @@ int DummyConfig::GetPerBlockScriptValidationMaxBatchSize() const
     return DEFAULT_SCRIPT_CHECK_MAX_BATCH_SIZE;
 }
 
+int DummyConfig::GetCoinsPrefetchThreadsCount() const
+{
+    return DEFAULT_COINS_PREFETCH_THREADS;
+}
+
+uint64_t DummyConfig::GetMaxUndoWriteQueueSize() const
+{
+    return DEFAULT_MAX_UNDO_WRITE_QUEUE_SIZE * ONE_MEGABYTE;
+}
+
 void GlobalConfig::SetMinFeePerKB(CFeeRate fee) {
     feePerKB = fee;
 }
@@ -114,6 +114,14 @@ public:
     virtual int GetPerBlockScriptValidatorThreadsCount() const = 0;
     virtual int GetPerBlockScriptValidationMaxBatchSize() const = 0;
 
+    virtual bool SetCoinsPrefetchThreadsCount(
+        int coinsPrefetchThreadsCount,
+        std::string* error = nullptr) = 0;
+    virtual int GetCoinsPrefetchThreadsCount() const = 0;
+
+    virtual bool SetMaxUndoWriteQueueSize(int64_t maxSizeMB, std::string* error = nullptr) = 0;
+    virtual uint64_t GetMaxUndoWriteQueueSize() const = 0;
+
     virtual bool SetMaxOpsPerScriptPolicy(int64_t maxOpsPerScriptPolicyIn, std::string* error) = 0;
 
     /** Sets the maximum policy number of sigops we're willing to relay/mine in a single tx */
@@ -131,6 +139,9 @@ public:
     virtual bool SetMaxNonStdTxnValidationDuration(int ms, std::string* err = nullptr) = 0;
     virtual std::chrono::milliseconds GetMaxNonStdTxnValidationDuration() const = 0;
 
+    virtual bool SetMaxStdTxnScriptCost(int64_t maxStdTxnScriptCostIn, std::string* err = nullptr) = 0;
+    virtual uint64_t GetMaxStdTxnScriptCost() const = 0;
+
     virtual bool SetMaxStackMemoryUsage(int64_t maxStackMemoryUsageConsensusIn, int64_t maxStackMemoryUsagePolicyIn, std::string* err = nullptr) = 0;
 
     virtual bool SetMaxScriptSizePolicy(int64_t maxScriptSizePolicyIn, std::string* err = nullptr) = 0;
@@ -264,6 +275,14 @@ public:
     int GetPerBlockScriptValidatorThreadsCount() const override;
     int GetPerBlockScriptValidationMaxBatchSize() const override;
 
+    bool SetCoinsPrefetchThreadsCount(
+        int coinsPrefetchThreadsCount,
+        std::string* error = nullptr) override;
+    int GetCoinsPrefetchThreadsCount() const override;
+
+    bool SetMaxUndoWriteQueueSize(int64_t maxSizeMB, std::string* error = nullptr) override;
+    uint64_t GetMaxUndoWriteQueueSize() const override;
+
     bool SetMaxOpsPerScriptPolicy(int64_t maxOpsPerScriptPolicyIn, std::string* error) override;
     uint64_t GetMaxOpsPerScript(bool isGenesisEnabled, bool consensus) const override;
 
@@ -282,6 +301,9 @@ public:
     bool SetMaxNonStdTxnValidationDuration(int ms, std::string* err = nullptr) override;
     std::chrono::milliseconds GetMaxNonStdTxnValidationDuration() const override;
 
+    bool SetMaxStdTxnScriptCost(int64_t maxStdTxnScriptCostIn, std::string* err = nullptr) override;
+    uint64_t GetMaxStdTxnScriptCost() const override;
+
     bool SetMaxStackMemoryUsage(int64_t maxStackMemoryUsageConsensusIn, int64_t maxStackMemoryUsagePolicyIn, std::string* err = nullptr) override;
     uint64_t GetMaxStackMemoryUsage(bool isGenesisEnabled, bool consensus) const override;
 
@@ -376,6 +398,10 @@ private:
     int mPerBlockScriptValidatorThreadsCount;
     int mPerBlockScriptValidationMaxBatchSize;
 
+    int mCoinsPrefetchThreadsCount;
+
+    uint64_t mMaxUndoWriteQueueSize;
+
     uint64_t maxOpsPerScriptPolicy;
 
     uint64_t maxTxSigOpsCountPolicy;
@@ -384,6 +410,7 @@ private:
 
     std::chrono::milliseconds mMaxStdTxnValidationDuration;
     std::chrono::milliseconds mMaxNonStdTxnValidationDuration;
+    uint64_t mMaxStdTxnScriptCost;
 
     uint64_t maxStackMemoryUsagePolicy;
     uint64_t maxStackMemoryUsageConsensus;
@@ -550,6 +577,25 @@ public:
     int GetMaxParallelBlocks() const override;
     int GetPerBlockScriptValidatorThreadsCount() const override;
     int GetPerBlockScriptValidationMaxBatchSize() const override;
+
+    bool SetCoinsPrefetchThreadsCount(
+        int coinsPrefetchThreadsCount,
+        std::string* error = nullptr) override
+    {
+        SetErrorMsg(error);
+
+        return false;
+    }
+    int GetCoinsPrefetchThreadsCount() const override;
+
+    bool SetMaxUndoWriteQueueSize(int64_t maxSizeMB, std::string* error = nullptr) override
+    {
+        SetErrorMsg(error);
+
+        return false;
+    }
+    uint64_t GetMaxUndoWriteQueueSize() const override;
+
     bool SetMaxStackMemoryUsage(int64_t maxStackMemoryUsageConsensusIn, int64_t maxStackMemoryUsagePolicyIn, std::string* err = nullptr)  override { return true; }
     uint64_t GetMaxStackMemoryUsage(bool isGenesisEnabled, bool consensus) const override { return UINT32_MAX; }
 
@@ -609,6 +655,17 @@ public:
         return DEFAULT_MAX_NON_STD_TXN_VALIDATION_DURATION;
     }
 
+    bool SetMaxStdTxnScriptCost(int64_t maxStdTxnScriptCostIn, std::string* err = nullptr) override
+    {
+        SetErrorMsg(err);
+
+        return false;
+    }
+    uint64_t GetMaxStdTxnScriptCost() const override
+    {
+        return DEFAULT_MAX_STD_TXN_SCRIPT_COST;
+    }
+
     bool SetMaxScriptSizePolicy(int64_t maxScriptSizePolicyIn, std::string* err = nullptr) override 
     {
         SetErrorMsg(err);
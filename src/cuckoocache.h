@@ -9,6 +9,7 @@
 #include <array>
 #include <atomic>
 #include <cmath>
+#include <cstdint>
 #include <cstring>
 #include <memory>
 #include <vector>
@@ -111,6 +112,19 @@ public:
     }
 };
 
+/** Counters describing how a cache has been used so far */
+struct stats {
+    //! Number of slots in the table
+    uint32_t size;
+    //! Number of slots holding elements that are not marked for erasure
+    uint32_t live;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t inserts;
+    //! Number of inserts that had to drop a live element
+    uint64_t evictions;
+};
+
 /**
  * cache implements a cache with properties similar to a cuckoo-set
  *
@@ -128,7 +142,10 @@ public:
  *  Write Operations:
  *      - setup()
  *      - setup_bytes()
+ *      - resize()
+ *      - resize_bytes()
  *      - insert()
+ *      - remove()
  *      - please_keep()
  *
  *  Synchronization Free Operations:
@@ -213,6 +230,16 @@ private:
      */
     const Hash hash_function;
 
+    /**
+     * Usage counters. hits and misses are updated by contains() which may be
+     * called concurrently so they are atomic; the others are only written
+     * under the write lock.
+     */
+    mutable std::atomic<uint64_t> hit_count{0};
+    mutable std::atomic<uint64_t> miss_count{0};
+    uint64_t insert_count = 0;
+    uint64_t eviction_count = 0;
+
     /**
      * compute_hashes is convenience for not having to write out this expression
      * everywhere we use the hash values of an Element.
@@ -345,6 +372,66 @@ public:
         return setup(bytes / sizeof(Element));
     }
 
+    /**
+     * resize changes the capacity of an already set up cache to new_size
+     * (rounded down to a power of two like in setup) and reinserts all
+     * elements that are not marked for erasure. Elements of the older epoch
+     * are reinserted first so that, when shrinking, the more recent ones
+     * survive. Usage counters are preserved.
+     * @param new_size the desired number of elements to store
+     * @returns the maximum number of elements storable
+     */
+    uint32_t resize(uint32_t new_size) {
+        std::vector<Element> old_table;
+        old_table.swap(table);
+        std::vector<bool> old_epoch_flags;
+        old_epoch_flags.swap(epoch_flags);
+        bit_packed_atomic_flags old_collection_flags(0);
+        std::swap(old_collection_flags, collection_flags);
+        const uint32_t old_size = size;
+
+        const uint32_t result = setup(new_size);
+        const uint64_t inserts = insert_count;
+        for (bool recent : {false, true}) {
+            for (uint32_t i = 0; i < old_size; ++i) {
+                if (!old_collection_flags.bit_is_set(i) &&
+                    old_epoch_flags[i] == recent) {
+                    insert(std::move(old_table[i]));
+                }
+            }
+        }
+        insert_count = inserts;
+        return result;
+    }
+
+    /**
+     * resize_bytes is the resize() counterpart of setup_bytes().
+     * @param bytes the approximate number of bytes to use for this data
+     * structure.
+     * @returns the maximum number of elements storable
+     */
+    uint32_t resize_bytes(size_t bytes) {
+        return resize(bytes / sizeof(Element));
+    }
+
+    /**
+     * get_stats returns the usage counters. Counting live elements scans the
+     * whole collection flags array so it should not be called on a hot path.
+     * Requires no concurrent Write.
+     */
+    stats get_stats() const {
+        uint32_t live = 0;
+        for (uint32_t i = 0; i < size; ++i) {
+            live += !collection_flags.bit_is_set(i);
+        }
+        return {size,
+                live,
+                hit_count.load(std::memory_order_relaxed),
+                miss_count.load(std::memory_order_relaxed),
+                insert_count,
+                eviction_count};
+    }
+
     /**
      * insert loops at most depth_limit times trying to insert a hash at various
      * locations in the table via a variant of the Cuckoo Algorithm with eight
@@ -367,6 +454,7 @@ public:
      */
     inline void insert(Element e) {
         epoch_check();
+        ++insert_count;
         uint32_t last_loc = invalid();
         bool last_epoch = true;
         std::array<uint32_t, 8> locs = compute_hashes(e);
@@ -415,6 +503,27 @@ public:
             // Recompute the locs -- unfortunately happens one too many times!
             locs = compute_hashes(e);
         }
+        // Ran out of depth, e is dropped
+        ++eviction_count;
+    }
+
+    /**
+     * remove discards an element right away. Unlike contains(e, true), which
+     * only allows the element to be collected on a later insert, contains(e,
+     * false) returns false afterwards. The slot is reset to a default
+     * constructed Element like the slots of a freshly set up table.
+     *
+     * @param e the element to remove
+     */
+    inline void remove(const Element &e) {
+        std::array<uint32_t, 8> locs = compute_hashes(e);
+        for (uint32_t loc : locs) {
+            if (table[loc] == e) {
+                table[loc] = Element();
+                allow_erase(loc);
+                epoch_flags[loc] = false;
+            }
+        }
     }
 
     /**
@@ -450,9 +559,11 @@ public:
                 if (erase) {
                     allow_erase(loc);
                 }
+                hit_count.fetch_add(1, std::memory_order_relaxed);
                 return true;
             }
         }
+        miss_count.fetch_add(1, std::memory_order_relaxed);
         return false;
     }
 };
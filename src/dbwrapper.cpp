@@ -15,6 +15,7 @@
 #include <leveldb/env.h>
 #include <leveldb/filter_policy.h>
 #include <memenv.h>
+#include <sstream>
 
 class CBitcoinLevelDBLogger : public leveldb::Logger {
 public:
@@ -74,14 +75,39 @@ public:
     }
 };
 
-static leveldb::Options GetOptions(size_t nCacheSize) {
+CDBWrapperProfile CDBWrapperProfile::FromArgs(const std::string &name) {
+    CDBWrapperProfile profile;
+    const std::string prefix = "-" + name + "db";
+    profile.nBlockSize = std::max<int64_t>(
+        1024, gArgs.GetArgAsBytes(prefix + "blocksize", profile.nBlockSize));
+    profile.nBloomBits = std::max<int64_t>(
+        0, gArgs.GetArg(prefix + "bloombits", profile.nBloomBits));
+    profile.nWriteBufferSize = std::max<int64_t>(
+        0, gArgs.GetArgAsBytes(prefix + "writebuffer",
+                               profile.nWriteBufferSize));
+    profile.nMaxOpenFiles =
+        gArgs.GetArg(prefix + "maxopenfiles", profile.nMaxOpenFiles);
+    profile.fCompression =
+        gArgs.GetBoolArg(prefix + "compression", profile.fCompression);
+    return profile;
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize,
+                                   const CDBWrapperProfile &profile) {
     leveldb::Options options;
     options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
     // up to two write buffers may be held in memory simultaneously
-    options.write_buffer_size = nCacheSize / 4;
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.write_buffer_size = profile.nWriteBufferSize
+                                    ? profile.nWriteBufferSize
+                                    : nCacheSize / 4;
+    options.block_size = profile.nBlockSize;
+    options.filter_policy =
+        profile.nBloomBits > 0
+            ? leveldb::NewBloomFilterPolicy(profile.nBloomBits)
+            : nullptr;
+    options.compression = profile.fCompression ? leveldb::kSnappyCompression
+                                               : leveldb::kNoCompression;
+    options.max_open_files = profile.nMaxOpenFiles;
     options.info_log = new CBitcoinLevelDBLogger();
     if (leveldb::kMajorVersion > 1 ||
         (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
@@ -93,13 +119,15 @@ static leveldb::Options GetOptions(size_t nCacheSize) {
 }
 
 CDBWrapper::CDBWrapper(const fs::path &path, size_t nCacheSize, bool fMemory,
-                       bool fWipe, bool obfuscate) {
+                       bool fWipe, bool obfuscate,
+                       const CDBWrapperProfile &profileIn)
+    : profile(profileIn) {
     penv = nullptr;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, profile);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -116,6 +144,12 @@ CDBWrapper::CDBWrapper(const fs::path &path, size_t nCacheSize, bool fMemory,
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+    LogPrint(BCLog::LEVELDB,
+             "LevelDB options for %s: block size %u, bloom bits %d, write "
+             "buffer %u, max open files %d, compression %d\n",
+             path.string(), options.block_size, profile.nBloomBits,
+             options.write_buffer_size, options.max_open_files,
+             profile.fCompression);
 
     if (gArgs.GetBoolArg("-forcecompactdb", false)) {
         LogPrintf("Starting database compaction of %s\n", path.string());
@@ -189,6 +223,32 @@ bool CDBWrapper::IsEmpty() {
     return !(it->Valid());
 }
 
+std::vector<CDBLevelStats> CDBWrapper::GetLevelStats() const {
+    std::vector<CDBLevelStats> levels;
+    std::string stats;
+    if (!GetProperty("leveldb.stats", stats)) {
+        return levels;
+    }
+
+    // Three header lines are followed by one line per non-empty level:
+    // level, files, size, compaction time, compaction read, compaction write
+    std::istringstream lines(stats);
+    std::string line;
+    for (int i = 0; i < 3; ++i) {
+        std::getline(lines, line);
+    }
+    while (std::getline(lines, line)) {
+        CDBLevelStats level;
+        std::istringstream fields(line);
+        if (fields >> level.nLevel >> level.nFiles >> level.dSizeMB >>
+            level.dCompactionSeconds >> level.dCompactionReadMB >>
+            level.dCompactionWriteMB) {
+            levels.push_back(level);
+        }
+    }
+    return levels;
+}
+
 CDBIterator::~CDBIterator() {
     delete piter;
 }
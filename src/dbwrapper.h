@@ -26,6 +26,38 @@ public:
 
 class CDBWrapper;
 
+/**
+ * LevelDB tuning parameters of a single database. Default values match the
+ * settings historically used for every database.
+ */
+struct CDBWrapperProfile {
+    //! Approximate size of user data packed per block (bytes)
+    size_t nBlockSize = 4 * 1024;
+    //! Bloom filter bits per key, 0 disables the filter
+    int nBloomBits = 10;
+    //! Size of the memtable (bytes), 0 to use a quarter of the cache size
+    size_t nWriteBufferSize = 0;
+    int nMaxOpenFiles = 64;
+    //! Use Snappy block compression (only if LevelDB was built with it)
+    bool fCompression = false;
+
+    /**
+     * Build a profile for database name (e.g. "chainstate") with any
+     * -<name>db* overrides given on the command line applied.
+     */
+    static CDBWrapperProfile FromArgs(const std::string &name);
+};
+
+/** Per level statistics as reported by LevelDB's "leveldb.stats" property */
+struct CDBLevelStats {
+    int nLevel = 0;
+    int nFiles = 0;
+    double dSizeMB = 0;
+    double dCompactionSeconds = 0;
+    double dCompactionReadMB = 0;
+    double dCompactionWriteMB = 0;
+};
+
 /**
  * These should be considered an implementation detail of the specific database.
  */
@@ -182,6 +214,9 @@ private:
     //! database options used
     leveldb::Options options;
 
+    //! tuning profile the options were built from
+    CDBWrapperProfile profile;
+
     //! options used when reading from the database
     leveldb::ReadOptions readoptions;
 
@@ -218,9 +253,11 @@ public:
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If
      * false, XOR
      *                        with a zero'd byte array.
+     * @param[in] profile     LevelDB tuning parameters.
      */
     CDBWrapper(const fs::path &path, size_t nCacheSize, bool fMemory = false,
-               bool fWipe = false, bool obfuscate = false);
+               bool fWipe = false, bool obfuscate = false,
+               const CDBWrapperProfile &profile = CDBWrapperProfile());
     ~CDBWrapper();
 
     template <typename K, typename V> bool Read(const K &key, V &value) const {
@@ -296,6 +333,21 @@ public:
      */
     bool IsEmpty();
 
+    const CDBWrapperProfile &GetProfile() const { return profile; }
+
+    /**
+     * Query a LevelDB property (e.g. "leveldb.stats"). Returns false if the
+     * property is not known.
+     */
+    bool GetProperty(const std::string &property, std::string &value) const {
+        return pdb->GetProperty(property, &value);
+    }
+
+    /**
+     * Number of files, size and compaction totals of every non-empty level.
+     */
+    std::vector<CDBLevelStats> GetLevelStats() const;
+
     template <typename K>
     size_t EstimateSize(const K &key_begin, const K &key_end) const {
         CDataStream ssKey1(SER_DISK, CLIENT_VERSION),
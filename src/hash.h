@@ -151,6 +151,12 @@ public:
         ctx.Write((const uint8_t *)pch, size);
     }
 
+    //! Hasher state of the data written so far
+    const CHash256 &GetState() const { return ctx; }
+
+    //! Continue hashing from a state returned by GetState()
+    void SetState(const CHash256 &state) { ctx = state; }
+
     // invalidates the object
     uint256 GetHash() {
         uint256 result;
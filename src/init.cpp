@@ -13,6 +13,7 @@
 #include "amount.h"
 #include "chain.h"
 #include "chainparams.h"
+#include "chainstate_warmup.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "config.h"
@@ -32,7 +33,9 @@
 #include "rpc/register.h"
 #include "rpc/server.h"
 #include "scheduler.h"
+#include "script/compiled_script.h"
 #include "script/scriptcache.h"
+#include "script/scriptprofile.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
 #include "taskcancellation.h"
@@ -40,6 +43,7 @@
 #include "torcontrol.h"
 #include "txdb.h"
 #include "txmempool.h"
+#include "txmempool_log.h"
 #include "txn_validation_config.h"
 #include "txn_validator.h"
 #include "ui_interface.h"
@@ -169,7 +173,6 @@ public:
     // the caller.
 };
 
-static CCoinsViewDB *pcoinsdbview = nullptr;
 static CCoinsViewErrorCatcher *pcoinscatcher = nullptr;
 static std::unique_ptr<ECCVerifyHandle> globalVerifyHandle;
 
@@ -224,13 +227,34 @@ void Shutdown() {
 
     StopTorControl();
     UnregisterNodeSignals(GetNodeSignals());
-    if (fDumpMempoolLater &&
+    if (g_mempoolLog) {
+        // Changes since the last snapshot are already in the mempool log
+        g_mempoolLog.reset();
+        mempool.getNonFinalPool().dumpMempool();
+    } else if (fDumpMempoolLater &&
         gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
-        DumpMempool();
+        // Logs of an earlier run must not be replayed on the new snapshot
+        if (DumpMempool()) {
+            try {
+                CTxMemPoolLog::RemoveLogs(GetDataDir());
+            } catch (const fs::filesystem_error &e) {
+                LogPrintf("Failed to remove mempool logs: %s\n", e.what());
+            }
+        }
     }
 
     {
         LOCK(cs_main);
+        if (pcoinsTip != nullptr &&
+            gArgs.GetArg("-preload", 0) == static_cast<int64_t>(ChainstateWarmupMode::HOT_COINS)) {
+            try {
+                DumpHotCoinsProfile(*pcoinsTip, mempool,
+                                    GetDataDir() / HOT_COINS_PROFILE_FILENAME,
+                                    DEFAULT_HOT_COINS_PROFILE_MAX_COINS);
+            } catch (const std::exception &e) {
+                LogPrintf("Failed to dump hot coins profile: %s\n", e.what());
+            }
+        }
         if (pcoinsTip != nullptr) {
             FlushStateToDisk();
         }
@@ -373,6 +397,34 @@ std::string HelpMessage(HelpMessageMode mode) {
                 "Maximum database write batch size in bytes (default: %u). The value may be given in bytes or with unit (B, kB, MB, GB).",
                 nDefaultDbBatchSize));
     }
+    if (showDebug) {
+        strUsage += HelpMessageOpt(
+            "-<db>dbblocksize=<n>",
+            strprintf("LevelDB block size of database <db>, which is either "
+                      "chainstate or blockindex (default: %u). The value may "
+                      "be given in bytes or with unit (B, kB, MB, GB).",
+                      CDBWrapperProfile().nBlockSize));
+        strUsage += HelpMessageOpt(
+            "-<db>dbbloombits=<n>",
+            strprintf("Bloom filter bits per key of database <db>, 0 to "
+                      "disable the filter (default: %d)",
+                      CDBWrapperProfile().nBloomBits));
+        strUsage += HelpMessageOpt(
+            "-<db>dbwritebuffer=<n>",
+            "LevelDB write buffer size of database <db> (default: a quarter "
+            "of the database cache). The value may be given in bytes or with "
+            "unit (B, kB, MB, GB).");
+        strUsage += HelpMessageOpt(
+            "-<db>dbmaxopenfiles=<n>",
+            strprintf("Maximum number of files LevelDB keeps open for "
+                      "database <db> (default: %d)",
+                      CDBWrapperProfile().nMaxOpenFiles));
+        strUsage += HelpMessageOpt(
+            "-<db>dbcompression",
+            strprintf("Compress blocks of database <db> with Snappy if "
+                      "LevelDB was built with Snappy support (default: %d)",
+                      CDBWrapperProfile().fCompression));
+    }
     strUsage += HelpMessageOpt(
         "-dbcache=<n>",
         strprintf(
@@ -434,12 +486,39 @@ std::string HelpMessage(HelpMessageMode mode) {
                        strprintf(_("Whether to save the mempool on shutdown "
                                    "and load on restart (default: %u)"),
                                  DEFAULT_PERSIST_MEMPOOL));
+    strUsage +=
+        HelpMessageOpt("-persistmempooltrustscripts",
+                       strprintf(_("Skip the policy flags script verification "
+                                   "of transactions loaded from the mempool "
+                                   "file if it was saved at the current chain "
+                                   "tip. Scripts are still verified against "
+                                   "the consensus flags (default: %u)"),
+                                 DEFAULT_PERSIST_MEMPOOL_TRUST_SCRIPTS));
+    strUsage +=
+        HelpMessageOpt("-persistmempoollog",
+                       strprintf(_("Continuously log changes of the mempool to "
+                                   "disk instead of saving it on shutdown, "
+                                   "requires -persistmempool (default: %u)"),
+                                 DEFAULT_PERSIST_MEMPOOL_LOG));
     strUsage += HelpMessageOpt(
         "-threadsperblock=<n>",
         strprintf(_("Set the number of script verification threads used when "
                     "validating single block (0 to %d, 0 = auto, default: %d)"),
                   MAX_SCRIPTCHECK_THREADS,
                   DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt(
+        "-coinsprefetchthreads=<n>",
+        strprintf(_("Set the number of threads loading inputs of a block "
+                    "from the coins database while the block is being "
+                    "checked (0 to %d, 0 = disabled, default: %d)"),
+                  MAX_COINS_PREFETCH_THREADS,
+                  DEFAULT_COINS_PREFETCH_THREADS));
+    strUsage += HelpMessageOpt(
+        "-maxundowritequeue=<n>",
+        strprintf(_("Set the maximum size in MB of undo data of connected "
+                    "blocks queued for writing to disk in the background "
+                    "(0 = write while connecting the block, default: %d)"),
+                  DEFAULT_MAX_UNDO_WRITE_QUEUE_SIZE));
     strUsage +=
         HelpMessageOpt(
             "-scriptvalidatormaxbatchsize=<n>",
@@ -473,9 +552,11 @@ std::string HelpMessage(HelpMessageMode mode) {
 
     strUsage += HelpMessageOpt(
         "-preload=<n>",
-            _("If n is set to 1, blockchain state will be preloaded into memory. If n is 0, no preload will happen. "
+            _("If n is set to 1, blockchain state will be preloaded into memory. "
+              "If n is set to 2, coins recorded in the hot coins profile on the previous shutdown will be loaded into the coins cache. "
+              "If n is 0, no preload will happen. "
               "Other values for n are not allowed. The default value is 0."
-              " This option is not supported on Windows operating systems.")
+              " Preload with n set to 1 is not supported on Windows operating systems.")
             );
 
     strUsage += HelpMessageOpt(
@@ -848,6 +929,18 @@ std::string HelpMessage(HelpMessageMode mode) {
             "-maxscriptcachesize=<n>",
             strprintf("Limit size of script cache to <n> MiB (default: %u). The value may be given in megabytes or with unit (B, KiB, MiB, GiB).",
                       DEFAULT_MAX_SCRIPT_CACHE_SIZE));
+        strUsage += HelpMessageOpt(
+            "-maxcompiledscriptcachesize=<n>",
+            strprintf("Limit size of the cache of decoded scripts of at least "
+                      "%u bytes to <n> MiB (0 to disable, default: %u). The "
+                      "value may be given in megabytes or with unit (B, KiB, MiB, GiB).",
+                      MIN_COMPILED_SCRIPT_SIZE, DEFAULT_MAX_COMPILED_SCRIPT_CACHE_SIZE));
+        strUsage += HelpMessageOpt(
+            "-slowscriptlogsize=<n>",
+            strprintf("Profile script verification and keep the <n> "
+                      "transactions whose scripts took the longest to verify "
+                      "(0 to disable, maximum: %u, default: %u)",
+                      MAX_SLOW_SCRIPT_LOG_SIZE, DEFAULT_SLOW_SCRIPT_LOG_SIZE));
         strUsage += HelpMessageOpt(
             "-maxtipage=<n>",
             strprintf("Maximum tip age in seconds to consider node in initial "
@@ -958,6 +1051,15 @@ std::string HelpMessage(HelpMessageMode mode) {
               " mempool (min 10ms, default: %dms)"),
             DEFAULT_MAX_NON_STD_TXN_VALIDATION_DURATION.count()));
 
+    strUsage += HelpMessageOpt(
+        "-maxstdtxscriptcost=<n>",
+        strprintf(
+            _("Set the deterministic script cost (weighted executed opcodes,"
+              " hashed bytes and signature checks) after which the validation"
+              " of a standard transaction is suspended and continued later"
+              " with the non-standard transactions (0 = unlimited, default: %u)"),
+            DEFAULT_MAX_STD_TXN_SCRIPT_COST));
+
     strUsage +=
         HelpMessageOpt("-maxtxsizepolicy=<n>",
             strprintf(_("Set maximum transaction size in bytes we relay and mine (default: %u MB, min: %u B, 0 = unlimited) after Genesis is activated. "
@@ -1053,6 +1155,13 @@ std::string HelpMessage(HelpMessageMode mode) {
         strprintf(_("Set the type of block assembler to use for mining. Supported options are "
                     "LEGACY or JOURNALING. (default: %s)"),
                   enum_cast<std::string>(mining::DEFAULT_BLOCK_ASSEMBLER_TYPE).c_str()));
+    strUsage += HelpMessageOpt(
+        "-packageselectionthreads=<n>",
+        strprintf(_("Set the number of threads the legacy block assembler uses to select "
+                    "packages of independent transactions, 0 to select all packages on the "
+                    "calling thread. Capped at the number of cores. The threads are started "
+                    "for each block template (default: %d)"),
+                  DEFAULT_PACKAGE_SELECTION_THREADS));
     strUsage += HelpMessageOpt( 
         "-jbamaxtxnbatch=<max batch size>",
         strprintf(_("Set the maximum number of transactions processed in a batch by the journaling block assembler "
@@ -1378,6 +1487,11 @@ void ThreadImport(const Config &config, std::vector<fs::path> vImportFiles, cons
     if (gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
         LoadMempool(config, shutdownToken);
         fDumpMempoolLater = !shutdownToken.IsCanceled();
+        if (fDumpMempoolLater &&
+            gArgs.GetBoolArg("-persistmempoollog", DEFAULT_PERSIST_MEMPOOL_LOG)) {
+            g_mempoolLog = std::make_unique<CTxMemPoolLog>(
+                mempool, GetDataDir(), [] { return DumpMempool(); });
+        }
     }
 }
 
@@ -1776,6 +1890,20 @@ bool AppInitParameterInteraction(Config &config) {
         return InitError(error);
     }
 
+    if(std::string error; !config.SetCoinsPrefetchThreadsCount(
+        gArgs.GetArg("-coinsprefetchthreads", DEFAULT_COINS_PREFETCH_THREADS),
+        &error))
+    {
+        return InitError(error);
+    }
+
+    if(std::string error; !config.SetMaxUndoWriteQueueSize(
+        gArgs.GetArg("-maxundowritequeue", DEFAULT_MAX_UNDO_WRITE_QUEUE_SIZE),
+        &error))
+    {
+        return InitError(error);
+    }
+
     if(std::string error; !config.SetMaxConcurrentAsyncTasksPerNode(
         gArgs.GetArg("-maxparallelblocksperpeer", DEFAULT_NODE_ASYNC_TASKS_LIMIT),
         &error))
@@ -2010,6 +2138,15 @@ bool AppInitParameterInteraction(Config &config) {
         return InitError(err);
     }
 
+    if(std::string err; !config.SetMaxStdTxnScriptCost(
+        gArgs.GetArg(
+            "-maxstdtxscriptcost",
+            static_cast<int64_t>(DEFAULT_MAX_STD_TXN_SCRIPT_COST)),
+        &err))
+    {
+        return InitError(err);
+    }
+
     if (!(config.GetMaxStdTxnValidationDuration() < config.GetMaxNonStdTxnValidationDuration())) {
         return InitError(
             strprintf("maxstdtxvalidationduration must be less than maxnonstdtxvalidationduration"));
@@ -2234,6 +2371,7 @@ void preloadChainStateThreadFunction()
 #ifndef WIN32
     auto path = boost::filesystem::canonical(GetDataDir() / "chainstate").string();
     LogPrintf("Preload started\n");
+    SetChainstateWarmupState(ChainstateWarmupMode::VMTOUCH, "running");
     try {
         auto start = std::chrono::system_clock::now();
         VMTouch vm;
@@ -2262,9 +2400,11 @@ void preloadChainStateThreadFunction()
         if (stillLoadedPercent < 90) {
             LogPrintf("WARNING: Only %d %% of data still present in memory after preloading. Increae amount of free RAM to get the benefits of preloading\n", stillLoadedPercent);
         }
+        SetChainstateWarmupState(ChainstateWarmupMode::VMTOUCH, "finished");
 
     }   catch(const std::runtime_error& ex) {
         LogPrintf("Error while preloading chain state: %s\n", ex.what());
+        SetChainstateWarmupState(ChainstateWarmupMode::VMTOUCH, "failed");
     }
 
 #else
@@ -2273,7 +2413,8 @@ void preloadChainStateThreadFunction()
 #endif
 }
 
-void preloadChainState(boost::thread_group &threadGroup)
+void preloadChainState(const Config &config, boost::thread_group &threadGroup,
+                       const task::CCancellationToken& shutdownToken)
 {
     int64_t preload;
     preload = gArgs.GetArg("-preload", 0);
@@ -2287,6 +2428,24 @@ void preloadChainState(boost::thread_group &threadGroup)
     {
         threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "preload", preloadChainStateThreadFunction));
     }
+    else if (preload == static_cast<int64_t>(ChainstateWarmupMode::HOT_COINS))
+    {
+        // Stop before the cache is full so that the warmup doesn't trigger a flush
+        size_t maxCacheUsage = nCoinCacheUsage / 10 * 9;
+        size_t nThreads = std::max(config.GetCoinsPrefetchThreadsCount(), 1);
+        threadGroup.create_thread(
+            [nThreads, maxCacheUsage, shutdownToken]
+            {
+                TraceThread(
+                    "preload",
+                    [nThreads, maxCacheUsage, shutdownToken]
+                    {
+                        WarmupFromHotCoinsProfile(
+                            *pcoinsTip, GetDataDir() / HOT_COINS_PROFILE_FILENAME,
+                            nThreads, maxCacheUsage, shutdownToken);
+                    });
+            });
+    }
     else
     {
         LogPrintf("Unknown value of -preload. No preloading will be done\n");
@@ -2341,6 +2500,8 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
 
     InitSignatureCache();
     InitScriptExecutionCache();
+    InitCompiledScriptCache();
+    InitSlowScriptLog();
 
     LogPrintf("Using %u threads for script verification\n",
               config.GetPerBlockScriptValidatorThreadsCount());
@@ -2849,7 +3010,7 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
         uiInterface.NotifyBlockTip.disconnect(BlockNotifyGenesisWait);
     }
 
-    preloadChainState(threadGroup);
+    preloadChainState(config, threadGroup, shutdownToken);
 
     // Step 11: start node
 
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include "persistent_vector.h"
 #include "primitives/block.h"
 
 class Config;
@@ -13,6 +14,9 @@ namespace mining
 
 /**
  * The CBlockTemplate is used during the assembly of a new block.
+ *
+ * Fees and sig op counts are persistent vectors, so an assembler can hand
+ * out its current values without copying them.
  */
 class CBlockTemplate {
 private:
@@ -23,8 +27,8 @@ public:
     CBlockTemplate(const CBlockRef& block) : mBlock{block} {}
     CBlockRef GetBlockRef() const { return mBlock; }
 
-    std::vector<Amount> vTxFees;
-    std::vector<int64_t> vTxSigOpsCount;
+    persistent_vector<Amount> vTxFees;
+    persistent_vector<int64_t> vTxSigOpsCount;
 };
 
 
@@ -2,6 +2,7 @@
 // Distributed under the Open BSV software license, see the accompanying file LICENSE.
 
 #include "candidates.h"
+#include "consensus/merkle.h"
 #include "utiltime.h"
 #include "validation.h"
 
@@ -28,6 +29,27 @@ CMiningCandidate::CMiningCandidate(MiningCandidateId id, const CBlockRef& block)
     mBlockCoinbase = block->vtx[0];
 }
 
+/**
+ * Get the merkle branch for the coinbase, which is the same for everyone
+ * mining this candidate so is only calculated once.
+ */
+const std::vector<uint256>& CMiningCandidate::GetMerkleProof() const
+{
+    std::call_once(mMerkleProofFlag,
+        [this]()
+        {
+            std::vector<uint256> leaves {};
+            leaves.reserve(mBlock->vtx.size());
+            for(const auto& txn : mBlock->vtx)
+            {
+                leaves.emplace_back(txn->GetHash());
+            }
+            mMerkleProof = ComputeMerkleBranch(leaves, 0);
+        }
+    );
+    return mMerkleProof;
+}
+
 
 /**
  * Create a new Mining Candidate. This is then ready for use by the BlockConstructor to construct a Candidate Block.
@@ -38,14 +60,40 @@ CMiningCandidate::CMiningCandidate(MiningCandidateId id, const CBlockRef& block)
 CMiningCandidateRef CMiningCandidateManager::Create(const CBlockRef& block)
 {
     // Create UUID for next candidate
-    MiningCandidateId nextId { mIdGenerator() };
+    MiningCandidateId nextId {};
+    {
+        std::lock_guard<std::mutex> lock {mIdGeneratorMutex};
+        nextId = mIdGenerator();
+    }
 
-    auto candidate = std::make_shared<CMiningCandidate>(CMiningCandidate(nextId, block));
-    std::lock_guard<std::mutex> lock {mMutex};
-    mCandidates[nextId] = candidate;
+    CMiningCandidateRef candidate { new CMiningCandidate(nextId, block) };
+    Shard& candidateShard { shard(nextId) };
+    std::lock_guard<std::mutex> lock {candidateShard.mMutex};
+    candidateShard.mCandidates[nextId] = candidate;
     return candidate;
 };
 
+/**
+ * Return the most recently created Mining Candidate if it is based on the given block and none of the fields
+ * unique to a candidate have changed since, otherwise create a new one. Concurrent callers asking for the same
+ * block get the same candidate, rather than each creating (and later calculating the merkle proof for) their own.
+ *
+ * @return a reference to the MiningCandidate.
+ */
+CMiningCandidateRef CMiningCandidateManager::GetOrCreate(const CBlockRef& block)
+{
+    std::lock_guard<std::mutex> lock {mLatestMutex};
+    if(mLatest && mLatest->mBlock == block && mLatest->mBlockTime == block->nTime &&
+       mLatest->mBlockBits == block->nBits && mLatest->mBlockVersion == block->nVersion &&
+       mLatest->mBlockCoinbase == block->vtx[0] && Get(mLatest->mId))
+    {
+        return mLatest;
+    }
+
+    mLatest = Create(block);
+    return mLatest;
+}
+
 /**
  * Lookup and return a reference to the requested MiningCandidate.
  *
@@ -55,9 +103,10 @@ CMiningCandidateRef CMiningCandidateManager::Get(const MiningCandidateId& candid
 {
     CMiningCandidateRef res {nullptr};
 
-    std::lock_guard<std::mutex> lock {mMutex};
-    auto candidateIt { mCandidates.find(candidateId) };
-    if(candidateIt != mCandidates.end())
+    const Shard& candidateShard { shard(candidateId) };
+    std::lock_guard<std::mutex> lock {candidateShard.mMutex};
+    auto candidateIt { candidateShard.mCandidates.find(candidateId) };
+    if(candidateIt != candidateShard.mCandidates.end())
     {
         res = candidateIt->second;
     }
@@ -65,6 +114,30 @@ CMiningCandidateRef CMiningCandidateManager::Get(const MiningCandidateId& candid
     return res;
 }
 
+/**
+ * Remove the requested MiningCandidate, if we have it.
+ */
+void CMiningCandidateManager::Remove(const MiningCandidateId& candidateId)
+{
+    Shard& candidateShard { shard(candidateId) };
+    std::lock_guard<std::mutex> lock {candidateShard.mMutex};
+    candidateShard.mCandidates.erase(candidateId);
+}
+
+/**
+ * Get the number of MiningCandidates we have.
+ */
+size_t CMiningCandidateManager::Size() const
+{
+    size_t size {0};
+    for(const Shard& candidateShard : mShards)
+    {
+        std::lock_guard<std::mutex> lock {candidateShard.mMutex};
+        size += candidateShard.mCandidates.size();
+    }
+    return size;
+}
+
 /**
  * Remove old candidate blocks. This frees up space.
  *
@@ -75,6 +148,7 @@ CMiningCandidateRef CMiningCandidateManager::Get(const MiningCandidateId& candid
 void CMiningCandidateManager::RemoveOldCandidates()
 {
     unsigned int height {0};
+    unsigned int prevHeight { mPrevHeight };
     int64_t tdiff {0};
 
     {
@@ -83,27 +157,41 @@ void CMiningCandidateManager::RemoveOldCandidates()
             return;
 
         height = static_cast<unsigned int>(chainActive.Height());
-        if(height <= mPrevHeight)
+        if(height <= prevHeight)
             return;
 
         tdiff = GetTime() - (chainActive.Tip()->nTime + NEW_CANDIDATE_INTERVAL);
     }
 
-    if(tdiff >= 0)
+    // Only one caller gets to clean out candidates for each new height
+    if(tdiff >= 0 && mPrevHeight.compare_exchange_strong(prevHeight, height))
     {
-        // Clean out mining candidates that are older than the discovered block.
-        std::lock_guard<std::mutex> lock {mMutex};
-        for(auto it = mCandidates.cbegin(); it != mCandidates.cend();)
+        // Clean out mining candidates that are older than the discovered block,
+        // holding only one shard at a time.
+        for(Shard& candidateShard : mShards)
         {
-            if(it->second->mBlock->GetHeightFromCoinbase() <= mPrevHeight)
-            {
-                it = mCandidates.erase(it);
-            }
-            else
+            std::lock_guard<std::mutex> lock {candidateShard.mMutex};
+            for(auto it = candidateShard.mCandidates.cbegin(); it != candidateShard.mCandidates.cend();)
             {
-                ++it;
+                if(it->second->mBlock->GetHeightFromCoinbase() <= prevHeight)
+                {
+                    it = candidateShard.mCandidates.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
             }
         }
-        mPrevHeight = height;
     }
 }
+
+// Get the shard for a candidate
+CMiningCandidateManager::Shard& CMiningCandidateManager::shard(const MiningCandidateId& candidateId)
+{
+    return mShards[boost::hash<MiningCandidateId>{}(candidateId) % NUM_SHARDS];
+}
+const CMiningCandidateManager::Shard& CMiningCandidateManager::shard(const MiningCandidateId& candidateId) const
+{
+    return mShards[boost::hash<MiningCandidateId>{}(candidateId) % NUM_SHARDS];
+}
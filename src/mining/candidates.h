@@ -6,9 +6,13 @@
 
 #include "primitives/block.h"
 
+#include <array>
 #include <atomic>
 #include <mutex>
+#include <unordered_map>
+#include <vector>
 
+#include <boost/functional/hash.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 
@@ -36,6 +40,9 @@ public:
     int32_t GetBlockVersion() const { return mBlockVersion; }
     CTransactionRef GetBlockCoinbase() const { return mBlockCoinbase; }
 
+    // Merkle branch for the coinbase, worked out the first time it's needed
+    const std::vector<uint256>& GetMerkleProof() const;
+
 private:
     CMiningCandidate(MiningCandidateId id, const CBlockRef& block);
 
@@ -50,37 +57,54 @@ private:
     uint32_t mBlockBits {};
     int32_t mBlockVersion {};
     CTransactionRef mBlockCoinbase {};
+
+    // Shared by everyone polling for this candidate
+    mutable std::once_flag mMerkleProofFlag {};
+    mutable std::vector<uint256> mMerkleProof {};
 };
 using CMiningCandidateRef = std::shared_ptr<CMiningCandidate>;
 
 
 /**
  * The mining candidate manager owns a collection of mining candidates.
+ *
+ * Candidates are looked up by many miners in parallel, so they are spread
+ * over a number of separately locked shards. Removing a candidate never
+ * affects callers that already hold a reference to it.
  */
 class CMiningCandidateManager {
 public:
     CMiningCandidateRef Create(const CBlockRef& block);
+    // Return the most recent candidate if it was created from the same block
+    // with the same header fields, otherwise create a new one
+    CMiningCandidateRef GetOrCreate(const CBlockRef& block);
     CMiningCandidateRef Get(const MiningCandidateId& candidateId) const;
 
-    void Remove(MiningCandidateId candidateId) {
-        std::lock_guard<std::mutex> lock(mMutex);
-        mCandidates.erase(candidateId);
-    };
-    size_t Size() const {
-        std::lock_guard<std::mutex> lock(mMutex);
-        return mCandidates.size();
-    };
+    void Remove(const MiningCandidateId& candidateId);
+    size_t Size() const;
 
     void RemoveOldCandidates();
 
 private:
-    mutable std::mutex mMutex {};   // we don't expect much concurrency, a simple exclusive mutex is sufficient
+    static constexpr size_t NUM_SHARDS = 16;
+
+    struct Shard
+    {
+        mutable std::mutex mMutex {};
+        std::unordered_map<MiningCandidateId, CMiningCandidateRef, boost::hash<MiningCandidateId>> mCandidates {};
+    };
+    Shard& shard(const MiningCandidateId& candidateId);
+    const Shard& shard(const MiningCandidateId& candidateId) const;
+
+    std::array<Shard, NUM_SHARDS> mShards {};
 
-    using CandidateMap = std::map<MiningCandidateId, CMiningCandidateRef>;
-    CandidateMap mCandidates {};
+    // The most recent candidate handed out by GetOrCreate
+    std::mutex mLatestMutex {};
+    CMiningCandidateRef mLatest {nullptr};
 
     std::atomic_uint mPrevHeight {0};
 
+    std::mutex mIdGeneratorMutex {};
     boost::uuids::random_generator mIdGenerator {};
 };
 
@@ -6,79 +6,78 @@
 #include <utiltime.h>
 #include <logging.h>
 
+#include <algorithm>
+
 using mining::CJournal;
 using mining::CJournalTester;
 using mining::CJournalChangeSet;
 using mining::CJournalEntry;
 using mining::CJournalPtr;
 
-// Copy constructor, only required by journal builder
-CJournal::CJournal(const CJournal& that)
+// When we get C++17 we should loose this redundant definition, until then it's required.
+constexpr size_t CJournal::CHUNK_SIZE;
+constexpr size_t CJournal::INDEX_SHARDS;
+
+namespace
 {
-    // Lock journal we are copying from, and copy its contents
-    std::shared_lock lock { that.mMtx };
-    mTransactions = that.mTransactions;
+    // Logs are only rebuilt to drop removed entries once there are at least
+    // this many, and at least as many as there are live entries.
+    constexpr size_t MIN_REMOVED_TO_COMPACT {1024};
 }
 
-// Get size of journal
-size_t CJournal::size() const
+// Constructor
+CJournal::CJournal()
+: mCurrentLog{std::make_shared<Log>()}, mTxnIndex{std::make_shared<TxnIndex>()}
 {
-    std::shared_lock lock { mMtx };
-    return mTransactions.size();
+    mLog = mCurrentLog.get();
+}
+
+// Take over the contents of the journal we replace, only required by journal
+// builder. It is no longer changed, but its readers carry on reading the log
+// we now write to, so it keeps hold of it until they are done.
+CJournal::CJournal(CJournal& predecessor)
+{
+    std::unique_lock lock { predecessor.mWriteMtx };
+    mCurrentLog = predecessor.mCurrentLog;
+    mLog = mCurrentLog.get();
+    mTxnIndex = predecessor.mTxnIndex;
+    mSize = predecessor.mSize.load();
+    mRemoved = predecessor.mRemoved;
+    mLastReorg = predecessor.mLastReorg;
 }
 
 // Apply changes to the journal
 void CJournal::applyChanges(const CJournalChangeSet& changeSet)
 {
-    std::unique_lock lock { mMtx };
-
-    using TransactionListByName = TransactionList::nth_index<0>::type;
-    using TransactionListByPosition = TransactionList::nth_index<1>::type;
-    TransactionListByName& index0 { mTransactions.get<0>() };
-    TransactionListByPosition& index1 { mTransactions.get<1>() };
+    std::unique_lock lock { mWriteMtx };
 
-    // For REORGs we need to remember the current start position
-    TransactionListByPosition::const_iterator begin1 {};
-    TransactionListByName::const_iterator begin0 {};
+    // Reorgs need to be added to the start of the journal, which we do by
+    // inserting them in front of the existing entries once we have them all.
+    int64_t startTime { GetTimeMicros() };
     bool isReorg { changeSet.getUpdateReason() == JournalUpdateReason::REORG };
-    if(isReorg)
-    {
-        begin1 = index1.begin();
-        begin0 = mTransactions.project<0>(begin1);
-    }
+    std::vector<CJournalEntry> front {};
+    std::unordered_map<TxId, size_t, std::hash<TxId>> frontIndex {};
 
     for(const auto& [ op, txn ] : changeSet.getChangeSet())
     {
         if(op == CJournalChangeSet::Operation::ADD)
         {
-            // Reorgs need to be added to the start of the journal, other reasons add to the end
             if(isReorg)
             {
-                index1.emplace(begin1, txn);
+                if(!checkTxnExists(txn.GetTxId()) && frontIndex.emplace(txn.GetTxId(), front.size()).second)
+                {
+                    front.emplace_back(txn);
+                }
             }
             else
             {
-                index1.emplace_back(txn);
+                addTxn(txn);
             }
         }
         else if(op == CJournalChangeSet::Operation::REMOVE)
         {
-            // Lookup txn
-            auto txnit { index0.find(txn.GetTxId()) };
-            if(txnit != index0.end())
-            {
-                // If this is a REORG and if we're erasing the first transaction in the journal
-                // then we need to update our saved iterator to the start of the list.
-                if(isReorg && txnit == begin0)
-                {
-                    ++begin1;
-                    begin0 = mTransactions.project<0>(begin1);
-                }
-
-                // Remove txn
-                index0.erase(txnit);
-            }
-            else
+            // Removing something this reorg added to the front
+            if(frontIndex.erase(txn.GetTxId()) == 0 && !removeTxn(txn.GetTxId()))
             {
                 LogPrint(BCLog::JOURNAL, "ERROR: Failed to find and remove txn %s from journal\n",
                     txn.getTxn()->GetId().ToString().c_str());
@@ -89,76 +88,313 @@ void CJournal::applyChanges(const CJournalChangeSet& changeSet)
     // Do we need to invalidate any observers after this change?
     if(!changeSet.getTailAppendOnly())
     {
+        if(isReorg)
+        {
+            // Skip reorg additions that were removed again
+            std::vector<CJournalEntry> live {};
+            for(size_t pos = 0; pos < front.size(); ++pos)
+            {
+                auto it { frontIndex.find(front[pos].GetTxId()) };
+                if(it != frontIndex.end() && it->second == pos)
+                {
+                    live.emplace_back(std::move(front[pos]));
+                }
+            }
+
+            size_t numErrors { checkReorgOrdering(live) };
+            prependTxns(live);
+            mLastReorg = { GetTime(), live.size(), GetTimeMicros() - startTime, numErrors };
+            LogPrint(BCLog::JOURNAL, "Inserted %d txns from reorg at the front of the journal in %d usec\n",
+                live.size(), mLastReorg.mDurationMicros);
+        }
+
+        // Drop removed entries from the log if they dominate it
+        if(mRemoved >= MIN_REMOVED_TO_COMPACT && mRemoved >= mSize)
+        {
+            replaceLog();
+        }
+
+        // Only bump the generation after changing the log, as readers check
+        // it before they look at the log
         mInvalidatingTime = GetTimeMicros();
+        ++mGeneration;
     }
+
+    reclaim();
 }
 
 // Checks if the transaction is added to journal
 bool CJournal::checkTxnExists(const TxId& txid) const
 {
-    std::shared_lock lock { mMtx };
-    const auto& getter = mTransactions.get<0>();
-    return getter.find(txid) != getter.end();
+    const IndexShard& indexShard { shard(txid) };
+    std::unique_lock lock { indexShard.mMtx };
+    return indexShard.mSlots.count(txid) != 0;
 }
 
-// Get start index for our underlying sequence
-CJournal::Index CJournal::ReadLock::begin() const
+// Details of the last reorg applied to the journal
+CJournal::ReorgStats CJournal::getLastReorgStats() const
 {
-    return Index { mJournal.get(), mJournal->index<1>().begin() };
+    std::unique_lock lock { mWriteMtx };
+    return mLastReorg;
 }
 
-// Get end index for our underlying sequence
-CJournal::Index CJournal::ReadLock::end() const
+// Append a txn to the log and index it - caller holds mWriteMtx
+void CJournal::addTxn(const CJournalEntry& txn)
 {
-    return Index { mJournal.get(), mJournal->index<1>().end() };
+    IndexShard& indexShard { shard(txn.GetTxId()) };
+    std::unique_lock lock { indexShard.mMtx };
+    if(indexShard.mSlots.count(txn.GetTxId()) == 0)
+    {
+        indexShard.mSlots.emplace(txn.GetTxId(), mCurrentLog->append(txn));
+        ++mSize;
+    }
 }
 
+// Mark a txn as removed in the log and unindex it - caller holds mWriteMtx
+bool CJournal::removeTxn(const TxId& txid)
+{
+    IndexShard& indexShard { shard(txid) };
+    std::unique_lock lock { indexShard.mMtx };
+    auto it { indexShard.mSlots.find(txid) };
+    if(it == indexShard.mSlots.end())
+    {
+        return false;
+    }
 
-/** Journal Index **/
+    it->second->mRemoved.store(true, std::memory_order_release);
+    indexShard.mSlots.erase(it);
+    --mSize;
+    ++mRemoved;
+    return true;
+}
 
-// Constructor
-CJournal::Index::Index(const CJournal* journal, const Underlying& begin)
-: mJournal{journal}, mValidTime{GetTimeMicros()}, mCurrItem{begin}
+// Count reorg txns that would be inserted ahead of one of their parents in
+// the journal - caller holds mWriteMtx
+size_t CJournal::checkReorgOrdering(const std::vector<CJournalEntry>& txns) const
 {
-    // Work out what to do for previous item pointer
-    if(mCurrItem == mJournal->index<1>().begin())
+    std::unordered_map<TxId, size_t, std::hash<TxId>> positions {};
+    for(size_t pos = 0; pos < txns.size(); ++pos)
     {
-        // Can't point before the start
-        mPrevItem = mJournal->index<1>().end();
+        positions.emplace(txns[pos].GetTxId(), pos);
     }
-    else if(mCurrItem == mJournal->index<1>().end())
+
+    size_t numErrors {0};
+    for(size_t pos = 0; pos < txns.size(); ++pos)
     {
-        if(!mJournal->index<1>().empty())
+        for(const CTxIn& input : txns[pos].getTxn()->vin)
         {
-            // Point 1 before the end
-            mPrevItem = mJournal->index<1>().end();
-            --mPrevItem;
+            // Parents must either come earlier in the reorg, or not be in the
+            // journal (which the reorg entries go in front of) at all
+            const TxId& parent { input.prevout.GetTxId() };
+            auto it { positions.find(parent) };
+            if(it == positions.end() ? checkTxnExists(parent) : it->second > pos)
+            {
+                LogPrint(BCLog::JOURNAL, "ERROR: Reorg txn %s would be ahead of its parent %s in the journal\n",
+                    txns[pos].GetTxId().ToString(), parent.ToString());
+                ++numErrors;
+                break;
+            }
         }
-        else
+    }
+
+    return numErrors;
+}
+
+// Insert txns in front of the entries in the log and index them - caller
+// holds mWriteMtx
+void CJournal::prependTxns(const std::vector<CJournalEntry>& txns)
+{
+    if(txns.empty())
+    {
+        return;
+    }
+
+    std::vector<Slot*> slots { mCurrentLog->prepend(txns) };
+    for(size_t i = 0; i < txns.size(); ++i)
+    {
+        IndexShard& indexShard { shard(txns[i].GetTxId()) };
+        std::unique_lock lock { indexShard.mMtx };
+        indexShard.mSlots.emplace(txns[i].GetTxId(), slots[i]);
+    }
+    mSize += txns.size();
+}
+
+// Replace the log with one holding just the live entries of the current
+// log - caller holds mWriteMtx
+void CJournal::replaceLog()
+{
+    std::shared_ptr<Log> log { std::make_shared<Log>() };
+    std::array<std::unordered_map<TxId, Slot*, std::hash<TxId>>, INDEX_SHARDS> slots {};
+    mCurrentLog->forEachSlot(
+        [&log, &slots](const Slot& slot)
         {
-            mPrevItem = mJournal->index<1>().end();
+            if(!slot.mRemoved)
+            {
+                TxId txid { slot.mEntry.GetTxId() };
+                slots[std::hash<TxId>{}(txid) % INDEX_SHARDS].emplace(txid, log->append(slot.mEntry));
+            }
         }
+    );
+
+    // Readers that already have the old log keep using it until it's reclaimed
+    mRetired.emplace_back(mEpoch.load(), std::move(mCurrentLog));
+    mCurrentLog = std::move(log);
+    mLog = mCurrentLog.get();
+    for(size_t i = 0; i < INDEX_SHARDS; ++i)
+    {
+        std::unique_lock lock { (*mTxnIndex)[i].mMtx };
+        (*mTxnIndex)[i].mSlots.swap(slots[i]);
     }
-    else
+    mSize = mCurrentLog->published();
+    mRemoved = 0;
+}
+
+// Advance the epoch as far as readers allow, and free any logs no reader
+// can still be using - caller holds mWriteMtx
+void CJournal::reclaim()
+{
+    if(mRetired.empty())
+    {
+        return;
+    }
+
+    // The epoch can move on once nobody is reading in the one before it
+    for(int i = 0; i < 2; ++i)
+    {
+        uint64_t epoch { mEpoch.load() };
+        if(mEpochReaders[(epoch + 1) % 2].load() != 0)
+        {
+            break;
+        }
+        mEpoch = epoch + 1;
+    }
+
+    uint64_t epoch { mEpoch.load() };
+    mRetired.erase(
+        std::remove_if(mRetired.begin(), mRetired.end(),
+            [epoch](const auto& retired) { return retired.first + 2 <= epoch; }),
+        mRetired.end());
+}
+
+// Register a reader in the current epoch
+uint64_t CJournal::enterEpoch()
+{
+    while(true)
+    {
+        uint64_t epoch { mEpoch.load() };
+        mEpochReaders[epoch % 2].fetch_add(1);
+        // If the epoch moved on before we registered, the writer may not
+        // have seen us.
+        if(mEpoch.load() == epoch)
+        {
+            return epoch;
+        }
+        mEpochReaders[epoch % 2].fetch_sub(1);
+    }
+}
+
+// Unregister a reader from the given epoch
+void CJournal::leaveEpoch(uint64_t epoch)
+{
+    mEpochReaders[epoch % 2].fetch_sub(1);
+}
+
+
+/** Journal log **/
+
+// Constructor
+CJournal::Log::Log()
+{
+    mChunks.emplace_back(std::make_unique<Chunk>());
+    mFronts.emplace_back(std::make_unique<Front>(Front{mChunks.back().get(), 0}));
+    mFront = mFronts.back().get();
+}
+
+// Append an entry and publish it to readers
+CJournal::Slot* CJournal::Log::append(const CJournalEntry& entry)
+{
+    size_t pos { mPublished.load(std::memory_order_relaxed) };
+    Chunk* chunk { mChunks.back().get() };
+    if(chunk->mSlots.size() == CHUNK_SIZE)
+    {
+        // Link in the new chunk before publishing anything in it
+        mChunks.emplace_back(std::make_unique<Chunk>());
+        chunk->mNext.store(mChunks.back().get(), std::memory_order_release);
+        chunk = mChunks.back().get();
+    }
+
+    chunk->mSlots.emplace_back(entry);
+    mPublished.store(pos + 1, std::memory_order_release);
+    return &chunk->mSlots.back();
+}
+
+// Insert entries in front of all others and publish them to readers. They go
+// in a chunk of their own linked to the current head, and readers that
+// started from an earlier front are unaffected.
+std::vector<CJournal::Slot*> CJournal::Log::prepend(const std::vector<CJournalEntry>& entries)
+{
+    const Front* oldFront { front() };
+    auto chunk { std::make_unique<Chunk>(entries.size()) };
+    std::vector<Slot*> slots {};
+    slots.reserve(entries.size());
+    for(const CJournalEntry& entry : entries)
     {
-        // Point 1 before current position
-        mPrevItem = mCurrItem;
-        --mPrevItem;
+        chunk->mSlots.emplace_back(entry);
+        slots.push_back(&chunk->mSlots.back());
     }
+    chunk->mNext.store(oldFront->mHead, std::memory_order_relaxed);
+
+    mFronts.emplace_back(std::make_unique<Front>(Front{chunk.get(), oldFront->mSize + entries.size()}));
+    mFrontChunks.emplace_back(std::move(chunk));
+    mFront.store(mFronts.back().get(), std::memory_order_release);
+    return slots;
+}
+
+
+/** Journal Index **/
+
+// Constructor
+CJournal::Index::Index(const CJournal* journal, const Log* log, const Log::Front* front, uint64_t generation, size_t pos)
+: mJournal{journal}, mLog{log}, mGeneration{generation}, mPos{pos}, mFrontSize{front->mSize}, mChunk{front->mHead}
+{
+    // Find the chunk our position is in, stopping at the end of the previous
+    // chunk if we're at the start of one that may not exist yet
+    mOffset = mPos;
+    while(mOffset > mChunk->mCapacity)
+    {
+        mOffset -= mChunk->mCapacity;
+        mChunk = mChunk->mNext.load(std::memory_order_acquire);
+    }
+
+    skipRemoved();
 }
 
 // Are we still valid?
 bool CJournal::Index::valid() const
 {
-    // We're valid if we were initialised after the last invalidating time
-    return ( mJournal && mValidTime > mJournal->getLastInvalidatingTime() );
+    // We're valid if there has been no invalidating change since we were
+    // created, and so we are still looking at the current log.
+    return ( mJournal && mGeneration == mJournal->mGeneration && mLog == mJournal->mLog );
+}
+
+// Get the entry at our position
+const CJournalEntry& CJournal::Index::at() const
+{
+    // If we previously stopped at the end of a full chunk, items are now in
+    // the next one
+    if(mOffset == mChunk->mCapacity)
+    {
+        return mChunk->mNext.load(std::memory_order_acquire)->mSlots[0].mEntry;
+    }
+    return mChunk->mSlots[mOffset].mEntry;
 }
 
 // Increment
 CJournal::Index& CJournal::Index::operator++()
 {
-    // Set previous to current, and move on current
-    mPrevItem = mCurrItem++;
+    ++mPos;
+    ++mOffset;
+    skipRemoved();
     return *this;
 }
 
@@ -173,24 +409,26 @@ void CJournal::Index::reset()
         throw std::runtime_error("Can't reset invalidated index");
     }
 
-    if(mCurrItem == mJournal->index<1>().end())
+    skipRemoved();
+}
+
+// Move forward past any removed entries
+void CJournal::Index::skipRemoved()
+{
+    size_t published { mFrontSize + mLog->published() };
+    while(mPos < published)
     {
-        if(mPrevItem != mJournal->index<1>().end())
+        if(mOffset == mChunk->mCapacity)
         {
-            Underlying prevNext { mPrevItem };
-            ++prevNext;
-            if(prevNext != mJournal->index<1>().end())
-            {
-                // New items have arrived, reset current pointer
-                mCurrItem = prevNext;
-            }
+            mChunk = mChunk->mNext.load(std::memory_order_acquire);
+            mOffset = 0;
         }
-        else if(!mJournal->index<1>().empty())
+        if(!mChunk->mSlots[mOffset].mRemoved.load(std::memory_order_acquire))
         {
-            // Previously the journal must have been empty, but now items have
-            // arrived. Reset current pointer.
-            mCurrItem = mJournal->index<1>().begin();
+            break;
         }
+        ++mPos;
+        ++mOffset;
     }
 }
 
@@ -199,13 +437,24 @@ void CJournal::Index::reset()
 
 // Standard constructor
 CJournal::ReadLock::ReadLock(const std::shared_ptr<CJournal>& journal)
-: mJournal{journal}, mLock{mJournal->mMtx}
+: mJournal{journal}, mEpoch{mJournal->enterEpoch()}
 {
+    // Readers check the generation before they look at the log, so if the
+    // log we see is replaced our indexes will be invalid.
+    mGeneration = mJournal->mGeneration;
+    mLog = mJournal->mLog;
+    mFront = mLog->front();
+}
+
+// Destructor
+CJournal::ReadLock::~ReadLock()
+{
+    release();
 }
 
 // Move constructor
 CJournal::ReadLock::ReadLock(ReadLock&& that)
-: mJournal{std::move(that.mJournal)}, mLock{std::move(that.mLock)}
+: mJournal{std::move(that.mJournal)}, mEpoch{that.mEpoch}, mGeneration{that.mGeneration}, mLog{that.mLog}, mFront{that.mFront}
 {
 }
 
@@ -214,15 +463,41 @@ CJournal::ReadLock& CJournal::ReadLock::operator=(ReadLock&& that)
 {
     if(this != &that)
     {
-        // Need to make sure the old lock gets unlocked before the old journal
+        // Need to make sure we leave our old epoch before the old journal
         // gets destroyed.
-        mLock = std::move(that.mLock);
+        release();
         mJournal = std::move(that.mJournal);
+        mEpoch = that.mEpoch;
+        mGeneration = that.mGeneration;
+        mLog = that.mLog;
+        mFront = that.mFront;
     }
 
     return *this;
 }
 
+// Get start index for our underlying sequence
+CJournal::Index CJournal::ReadLock::begin() const
+{
+    return Index { mJournal.get(), mLog, mFront, mGeneration, 0 };
+}
+
+// Get end index for our underlying sequence
+CJournal::Index CJournal::ReadLock::end() const
+{
+    return Index { mJournal.get(), mLog, mFront, mGeneration, mFront->mSize + mLog->published() };
+}
+
+// Leave our epoch, if we have one
+void CJournal::ReadLock::release()
+{
+    if(mJournal)
+    {
+        mJournal->leaveEpoch(mEpoch);
+        mJournal.reset();
+    }
+}
+
 
 /** Journal Tester **/
 
@@ -231,14 +506,11 @@ CJournalTester::CJournalTester(const CJournalPtr& journal)
     using TransactionListByPosition = TesterTransactionList::nth_index<1>::type;
     TransactionListByPosition& index1 { mTransactions.get<1>() };
 
-    // Lock journal while we copy it
-    std::shared_lock lock { journal->mMtx };
-
     // Rebuild the journal in our faster iterating (but slower updating) format.
-    const auto& journalIndex { journal->index<1>() };
-    for(auto it = journalIndex.begin(); it != journalIndex.end(); ++it)
+    CJournal::ReadLock lock { journal };
+    for(CJournal::Index it = lock.begin(); it != lock.end(); ++it)
     {
-        index1.emplace_back(*it);
+        index1.emplace_back(it.at());
     }
 }
 
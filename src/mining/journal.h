@@ -7,15 +7,17 @@
 #include <mining/journal_entry.h>
 
 #include <boost/multi_index_container.hpp>
-#include <boost/multi_index/identity.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/random_access_index.hpp>
 #include <boost/multi_index/mem_fun.hpp>
 
+#include <array>
 #include <atomic>
 #include <memory>
+#include <mutex>
 #include <ostream>
-#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace mining
 {
@@ -29,6 +31,18 @@ class CJournalTester;
 *
 * Transactions to be included in the next mining candidate can be fetched by
 * simply replaying the journal.
+*
+* The journal is an append-only log of entries split into fixed size chunks,
+* so that appending never moves an entry a reader might be looking at. Removed
+* entries are only marked as such, and transactions a reorg returns to the
+* mempool are inserted as new chunks in front of the existing ones. Once
+* removed entries dominate the log it is replaced with a compacted copy.
+* Readers never take a lock; replaced logs are freed by the writer once no
+* reader can still be using them (epoch based reclamation). A separate hash
+* index maps transactions to their slot in the log.
+*
+* When a new block arrives the journal builder replaces the journal with a
+* new one that takes over its log and index, so that is cheap too.
 */
 class CJournal final
 {
@@ -38,17 +52,19 @@ class CJournal final
   public:
 
     // Construction/destruction
-    CJournal() = default;
+    CJournal();
     ~CJournal() = default;
 
-    CJournal(const CJournal&);
+    // Take over the contents of the journal we replace
+    explicit CJournal(CJournal& predecessor);
 
+    CJournal(const CJournal&) = delete;
     CJournal& operator=(const CJournal&) = delete;
     CJournal(CJournal&&) = delete;
     CJournal& operator=(CJournal&&) = delete;
 
     // Get size of journal
-    size_t size() const;
+    size_t size() const { return mSize; }
 
     // Get time we were last updated by an invalidating change
     int64_t getLastInvalidatingTime() const { return mInvalidatingTime; }
@@ -63,80 +79,198 @@ class CJournal final
     // Checks if the transaction is added to journal
     bool checkTxnExists(const TxId& txid) const;
 
+    // Details of the last reorg applied to the journal
+    struct ReorgStats
+    {
+        // When it was applied
+        int64_t mTime {0};
+        // Number of transactions it inserted, and how long that took
+        size_t mNumTxns {0};
+        int64_t mDurationMicros {0};
+        // Number of inserted transactions found ahead of an ancestor
+        size_t mNumErrors {0};
+    };
+    ReorgStats getLastReorgStats() const;
+
   private:
 
-    // Protect our data structures
-    mutable std::shared_mutex mMtx {};
+    // Number of entries in each chunk of the log
+    static constexpr size_t CHUNK_SIZE {1024};
 
-    // The journal itself is a multi-index of transactions and the order they
-    // should be read/replayed from the journal.
-    using TransactionList = boost::multi_index_container<
-        CJournalEntry,
-        boost::multi_index::indexed_by<
-            // Unique transaction
-            boost::multi_index::ordered_unique<
-                boost::multi_index::const_mem_fun<CJournalEntry, const TxId, &CJournalEntry::GetTxId>
-            >,
-            // Order of replay
-            boost::multi_index::sequenced<>
-        >
-    >;
-    TransactionList mTransactions {};
+    // An entry in the log. Once published it is never moved or modified,
+    // apart from being marked as removed.
+    struct Slot
+    {
+        Slot(const CJournalEntry& entry) : mEntry{entry} {}
+        Slot(Slot&& that) : mEntry{std::move(that.mEntry)}, mRemoved{that.mRemoved.load()} {}
 
-    // Convenience accessor to fetch the given multi-index index
-    template<unsigned I>
-    const typename TransactionList::nth_index<I>::type& index() const
+        CJournalEntry mEntry;
+        std::atomic_bool mRemoved {false};
+    };
+
+    // A chunk of the log. Its slots are reserved up front so that adding to
+    // it never reallocates. Chunks inserted at the front hold fewer slots.
+    struct Chunk
+    {
+        explicit Chunk(size_t capacity = CHUNK_SIZE) : mCapacity{capacity} { mSlots.reserve(capacity); }
+
+        const size_t mCapacity;
+        std::vector<Slot> mSlots {};
+        std::atomic<const Chunk*> mNext {nullptr};
+    };
+
+    // The log of entries. Only the writer adds entries and walks over all
+    // slots, readers follow the chain of chunks from the head of the front
+    // they started with up to the number of published entries.
+    class Log final
     {
-        return mTransactions.get<I>();
-    }
+      public:
+        // The first chunk of the log and the number of entries inserted in
+        // front of the appended ones, which are published together
+        struct Front
+        {
+            const Chunk* mHead;
+            size_t mSize;
+        };
+
+        Log();
+
+        // Append an entry and publish it to readers
+        Slot* append(const CJournalEntry& entry);
+
+        // Insert entries in front of all others and publish them to readers
+        std::vector<Slot*> prepend(const std::vector<CJournalEntry>& entries);
+
+        // Call fn for every slot in order - writer only
+        template<typename Callable>
+        void forEachSlot(Callable fn) const
+        {
+            for(const Chunk* chunk = front()->mHead; chunk; chunk = chunk->mNext.load())
+            {
+                for(const Slot& slot : chunk->mSlots)
+                {
+                    fn(slot);
+                }
+            }
+        }
+
+        // Reader accessors
+        const Front* front() const { return mFront.load(std::memory_order_acquire); }
+        size_t published() const { return mPublished.load(std::memory_order_acquire); }
 
-    // Time of last invalidating change
+      private:
+        std::vector<std::unique_ptr<Chunk>> mChunks {};
+        std::vector<std::unique_ptr<Chunk>> mFrontChunks {};
+        std::vector<std::unique_ptr<Front>> mFronts {};
+        std::atomic<const Front*> mFront {nullptr};
+        // Number of appended entries published
+        std::atomic_size_t mPublished {0};
+    };
+
+    // Hash index of transactions to their position in the current log, split
+    // over separately locked shards.
+    static constexpr size_t INDEX_SHARDS {16};
+    struct IndexShard
+    {
+        mutable std::mutex mMtx {};
+        std::unordered_map<TxId, Slot*, std::hash<TxId>> mSlots {};
+    };
+    using TxnIndex = std::array<IndexShard, INDEX_SHARDS>;
+    IndexShard& shard(const TxId& txid) { return (*mTxnIndex)[std::hash<TxId>{}(txid) % INDEX_SHARDS]; }
+    const IndexShard& shard(const TxId& txid) const { return (*mTxnIndex)[std::hash<TxId>{}(txid) % INDEX_SHARDS]; }
+
+    // Writer operations - caller holds mWriteMtx
+    void addTxn(const CJournalEntry& txn);
+    bool removeTxn(const TxId& txid);
+    void prependTxns(const std::vector<CJournalEntry>& txns);
+    size_t checkReorgOrdering(const std::vector<CJournalEntry>& txns) const;
+    void replaceLog();
+    void reclaim();
+
+    // Reader epochs
+    uint64_t enterEpoch();
+    void leaveEpoch(uint64_t epoch);
+
+    // Serialises writers; readers never take it
+    mutable std::mutex mWriteMtx {};
+
+    // The current log, and its owners. A journal we replaced keeps hold of
+    // the log for its remaining readers.
+    std::atomic<const Log*> mLog {nullptr};
+    std::shared_ptr<Log> mCurrentLog {};
+
+    // Shared with the journal we replaced, so it still answers lookups
+    std::shared_ptr<TxnIndex> mTxnIndex {};
+
+    // Number of live and removed entries in the current log
+    std::atomic_size_t mSize {0};
+    size_t mRemoved {0};
+
+    // Replaced logs are freed once the epoch has advanced twice since they
+    // were retired, because by then every reader that might have seen them
+    // has finished.
+    std::atomic_uint64_t mEpoch {0};
+    std::array<std::atomic_uint64_t, 2> mEpochReaders {};
+    std::vector<std::pair<uint64_t, std::shared_ptr<Log>>> mRetired {};
+
+    // Time of last invalidating change, and a count of them
     std::atomic_int64_t mInvalidatingTime {0};
+    std::atomic_uint64_t mGeneration {0};
 
     // Are we still current?
     std::atomic_bool mCurrent {true};
 
+    // Protected by mWriteMtx
+    ReorgStats mLastReorg {};
+
   public:
 
-    // An index into our transaction list to read them in sequence and check
+    // An index into our transaction log to read them in sequence and check
     // whether our position in the sequence can still be considered valid.
-    // Indexes provide the funtionality we need that is missing from the
-    // (non random-access) iterators provided by the underlying boost
-    // multi-index container.
     //
-    // NOTE: It is only safe to test/read/update an Index while the journal
-    // it came from is locked by holding a ReadLock (see below).
+    // NOTE: An Index may only be tested while the journal it came from
+    // exists, and only be read or updated while it is valid or a ReadLock
+    // taken before it was invalidated is held (see below).
     class Index
     {
-        using Underlying = TransactionList::nth_index<1>::type::const_iterator;
-
       public:
         Index() = default;
-        Index(const CJournal* journal, const Underlying& begin);
+        Index(const CJournal* journal, const Log* log, const Log::Front* front, uint64_t generation, size_t pos);
 
         bool valid() const;
-        const CJournalEntry& at() const { return *mCurrItem; }
+        const CJournalEntry& at() const;
         void reset();
 
         Index& operator++();
-        bool operator==(const Index& that) { return (mCurrItem == that.mCurrItem); }
+        bool operator==(const Index& that) { return (mLog == that.mLog && mPos == that.mPos); }
         bool operator!=(const Index& that) { return !(*this == that); }
 
       private:
 
+        // Move forward past any removed entries
+        void skipRemoved();
+
         const CJournal* mJournal {nullptr};
-        int64_t mValidTime       {-1};
-        Underlying mCurrItem     {};
-        Underlying mPrevItem     {};
+        const Log* mLog          {nullptr};
+        uint64_t mGeneration     {0};
+        size_t mPos              {0};
+        // Number of front entries ahead of the appended ones
+        size_t mFrontSize        {0};
+
+        // Chunk and offset within it of our position. The offset is the
+        // chunk's capacity if we stopped at the end of a full chunk.
+        const Chunk* mChunk      {nullptr};
+        size_t mOffset           {0};
     };
 
-    // An RAII wrapper for holding a read lock on the journal
+    // An RAII wrapper for holding a read lock on the journal. It doesn't
+    // block writers, but keeps the log it reads alive until released.
     class ReadLock final
     {
       public:
         ReadLock() = default;
         ReadLock(const std::shared_ptr<CJournal>& journal);
-        ~ReadLock() = default;
+        ~ReadLock();
 
         ReadLock(const ReadLock&) = delete;
         ReadLock& operator=(const ReadLock&) = delete;
@@ -148,10 +282,13 @@ class CJournal final
         Index end() const;
 
       private:
-        // Order of declaration is important; we need the lock to be destroyed
-        // and the mutex unlocked before the journal that owns it.
+        void release();
+
         std::shared_ptr<CJournal> mJournal {};
-        std::shared_lock<std::shared_mutex> mLock {};
+        uint64_t mEpoch {0};
+        uint64_t mGeneration {0};
+        const Log* mLog {nullptr};
+        const Log::Front* mFront {nullptr};
     };
 
 };
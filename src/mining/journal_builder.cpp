@@ -41,9 +41,9 @@ void CJournalBuilder::clearJournal()
 void CJournalBuilder::applyChangeSet(const CJournalChangeSet& changeSet)
 {
     // If the cause of this change is a new block arriving or a reorg, then
-    // create a new journal based on the old journal. This is for no other
-    // reason than to maintain the desired model of having journals linked
-    // to blocks.
+    // create a new journal that takes over the contents of the old journal.
+    // This is for no other reason than to maintain the desired model of
+    // having journals linked to blocks.
     JournalUpdateReason updateReason { changeSet.getUpdateReason() };
     if(updateReason == JournalUpdateReason::NEW_BLOCK || updateReason == JournalUpdateReason::REORG)
     {
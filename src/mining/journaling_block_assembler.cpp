@@ -101,11 +101,12 @@ std::unique_ptr<CBlockTemplate> JournalingBlockAssembler::CreateNewBlock(const C
     bool isGenesisEnabled = IsGenesisEnabled(mConfig, chainActive.Height() + 1);
     bool sigOpCountError;
 
-    // Build template
+    // Build template. Our fees and sig op counts are shared with it rather
+    // than copied.
     std::unique_ptr<CBlockTemplate> blockTemplate { std::make_unique<CBlockTemplate>(block) };
     blockTemplate->vTxFees = mTxFees;
     blockTemplate->vTxSigOpsCount = mTxSigOpsCount;
-    blockTemplate->vTxFees[0] = -1 * mBlockFees;
+    blockTemplate->vTxFees.set(0, -1 * mBlockFees);
 
     int64_t txSigOpCount = static_cast<int64_t>(GetSigOpCountWithoutP2SH(*block->vtx[0], isGenesisEnabled, sigOpCountError));
     // This can happen if supplied coinbase scriptPubKeyIn contains multisig with too many public keys
@@ -115,7 +116,7 @@ std::unique_ptr<CBlockTemplate> JournalingBlockAssembler::CreateNewBlock(const C
     }
     else
     {
-        blockTemplate->vTxSigOpsCount[0] = txSigOpCount;
+        blockTemplate->vTxSigOpsCount.set(0, txSigOpCount);
     }
     // Can now update callers pindexPrev
     pindexPrev = pindexPrevNew;
@@ -253,8 +254,8 @@ void JournalingBlockAssembler::newBlock()
 
     // Add dummy coinbase as first transaction
     mBlockTxns.emplace_back();
-    mTxFees.emplace_back(Amount{-1});
-    mTxSigOpsCount.emplace_back(-1);
+    mTxFees.push_back(Amount{-1});
+    mTxSigOpsCount.push_back(-1);
 
     // Set updated flag
     mRecentlyUpdated = true;
@@ -303,8 +304,8 @@ bool JournalingBlockAssembler::addTransaction(const CBlockIndex* pindex)
 
     // Append next txn to the block template
     mBlockTxns.emplace_back(txn);
-    mTxFees.emplace_back(entry.getFee());
-    mTxSigOpsCount.emplace_back(entry.getSigOpsCount());
+    mTxFees.push_back(entry.getFee());
+    mTxSigOpsCount.push_back(entry.getSigOpsCount());
 
     // Update block accounting details
     mBlockSize = blockSizeWithTx;
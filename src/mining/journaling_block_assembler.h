@@ -62,8 +62,8 @@ class JournalingBlockAssembler : public BlockAssembler
     std::vector<CTransactionRef> mBlockTxns {};
     uint64_t mBlockSigOps {COINBASE_SIG_OPS};
     uint64_t mBlockSize {COINBASE_SIZE};
-    std::vector<Amount> mTxFees {};
-    std::vector<int64_t> mTxSigOpsCount {};
+    persistent_vector<Amount> mTxFees {};
+    persistent_vector<int64_t> mTxSigOpsCount {};
 
     // Chain context for the block
     int64_t mLockTimeCutoff {0};
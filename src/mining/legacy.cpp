@@ -20,6 +20,8 @@
 #include "primitives/transaction.h"
 #include "script/script_num.h"
 #include "script/standard.h"
+#include "task_helpers.h"
+#include "threadpool.h"
 #include "timedata.h"
 #include "txmempool.h"
 #include "util.h"
@@ -29,7 +31,11 @@
 #include "versionbits.h"
 
 #include <algorithm>
+#include <future>
+#include <optional>
 #include <queue>
+#include <set>
+#include <unordered_map>
 #include <utility>
 
 #include <boost/thread.hpp>
@@ -54,6 +60,416 @@ static const int MAX_COINBASE_SCRIPTSIG_SIZE = 100;
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
+namespace {
+using Snapshot = CPackageSelectionSnapshot;
+
+// Whether package a has a higher ancestor feerate than package b. This
+// matches the calculation in CompareTxMemPoolEntryByAncestorFee.
+bool HigherScore(const Snapshot::AncestorState &a, const TxId &aId,
+                 const Snapshot::AncestorState &b, const TxId &bId) {
+    double f1 = double(a.nModFees.GetSatoshis()) * double(b.nSize);
+    double f2 = double(a.nSize) * double(b.nModFees.GetSatoshis());
+    if (f1 == f2) {
+        return aId < bId;
+    }
+    return f1 > f2;
+}
+
+void RemoveFromAncestors(Snapshot::AncestorState &state,
+                         const Snapshot::Entry &ancestor) {
+    state.nSize -= ancestor.nTxSize;
+    state.nModFees -= ancestor.nModFee;
+    state.nSigOpCount -= ancestor.nSigOpCount;
+}
+
+// Selection state of the snapshot's entries. Selectors working on disjoint
+// sets of entries with no dependencies between them can share it, as each
+// of them only touches its own entries.
+struct SelectionState {
+    enum : uint8_t { IN_BLOCK = 1, MODIFIED = 2, FAILED = 4 };
+
+    explicit SelectionState(const Snapshot &snapshot)
+        : flags(snapshot.size(), 0), modified(snapshot.size()),
+          visited(snapshot.size(), 0) {
+        for (uint32_t i = 0; i < snapshot.size(); ++i) {
+            if (snapshot[i].fInBlock) {
+                flags[i] = IN_BLOCK;
+            } else if (snapshot[i].fModified) {
+                flags[i] = MODIFIED;
+                modified[i] = snapshot[i].ancestors;
+            }
+        }
+    }
+
+    std::vector<uint8_t> flags;
+    // Ancestor state of modified entries
+    std::vector<Snapshot::AncestorState> modified;
+    // Stamp of the last walk that visited an entry
+    std::vector<uint32_t> visited;
+};
+
+// Result of testing whether a package fits in the block
+enum class PackageTest { FITS, FAILED, GIVE_UP };
+
+/**
+ * Select packages by ancestor feerate from the candidates, which have to be
+ * in ancestor score order and include all descendants of any candidate.
+ *
+ * The package selection algorithm orders the candidates based on feerate of
+ * a transaction including all ancestors not yet in the block. As packages are
+ * selected we walk their descendants and store a modified ancestor state for
+ * them. Each time through the loop, we compare the best modified entry with
+ * the next candidate to decide what package to work on next.
+ *
+ * test(state) checks a package by its ancestor state, add(idx, package,
+ * state) adds the package of entry idx sorted in a valid order to the block
+ * and returns false if one of its transactions can't be added.
+ */
+template <typename TestFn, typename AddFn>
+void SelectPackages(const Snapshot &snapshot, SelectionState &state,
+                    const std::vector<uint32_t> &candidates,
+                    const CFeeRate &minFeeRate, TestFn test, AddFn add,
+                    int &nPackagesSelected, int &nDescendantsUpdated) {
+    auto txid = [&snapshot](uint32_t i) {
+        return snapshot[i].tx->GetId();
+    };
+    auto compare = [&state, &txid](uint32_t a, uint32_t b) {
+        return HigherScore(state.modified[a], txid(a), state.modified[b],
+                           txid(b));
+    };
+    // Modified entries sorted by their modified ancestor feerate
+    std::set<uint32_t, decltype(compare)> modifiedQueue(compare);
+    for (uint32_t i : candidates) {
+        if (state.flags[i] & SelectionState::MODIFIED) {
+            modifiedQueue.insert(i);
+        }
+    }
+    auto setFailed = [&](uint32_t i) {
+        modifiedQueue.erase(i);
+        state.flags[i] &= ~SelectionState::MODIFIED;
+        state.flags[i] |= SelectionState::FAILED;
+    };
+
+    uint32_t nStamp = 0;
+    std::vector<uint32_t> package;
+    std::vector<uint32_t> walk;
+
+    auto next = candidates.begin();
+    while (next != candidates.end() || !modifiedQueue.empty()) {
+        // Skip candidates that are already in the block, whose ancestor state
+        // is stale because an ancestor is in the block or that we've already
+        // failed to add.
+        if (next != candidates.end() && state.flags[*next] != 0) {
+            ++next;
+            continue;
+        }
+
+        // Determine which transaction to evaluate: the next candidate, or the
+        // best modified entry?
+        uint32_t idx;
+        bool fUsingModified = false;
+        if (next == candidates.end()) {
+            idx = *modifiedQueue.begin();
+            fUsingModified = true;
+        } else {
+            idx = *next;
+            if (!modifiedQueue.empty() &&
+                HigherScore(state.modified[*modifiedQueue.begin()],
+                            txid(*modifiedQueue.begin()),
+                            snapshot[idx].ancestors, txid(idx))) {
+                idx = *modifiedQueue.begin();
+                fUsingModified = true;
+            } else {
+                ++next;
+            }
+        }
+
+        const Snapshot::AncestorState packageState =
+            fUsingModified ? state.modified[idx] : snapshot[idx].ancestors;
+        if (packageState.nModFees < minFeeRate.GetFee(packageState.nSize)) {
+            // Everything else we might consider has a lower fee rate
+            return;
+        }
+
+        PackageTest result = test(packageState);
+        if (result != PackageTest::FITS) {
+            if (fUsingModified) {
+                // Since we always look at the best modified entry, we must
+                // erase failed entries so that we can consider the next best
+                // entry on the next loop iteration
+                setFailed(idx);
+            }
+            if (result == PackageTest::GIVE_UP) {
+                break;
+            }
+            continue;
+        }
+
+        // Collect the ancestors not yet in the block
+        ++nStamp;
+        package.assign(1, idx);
+        state.visited[idx] = nStamp;
+        for (size_t i = 0; i < package.size(); ++i) {
+            snapshot.ForEachParent(package[i], [&](uint32_t parent) {
+                if (state.visited[parent] != nStamp &&
+                    !(state.flags[parent] & SelectionState::IN_BLOCK)) {
+                    state.visited[parent] = nStamp;
+                    package.push_back(parent);
+                }
+            });
+        }
+
+        // Sort the package by ancestor count. If a transaction A depends on
+        // transaction B, then A's ancestor count must be greater than B's.
+        // So this is sufficient to validly order the transactions for block
+        // inclusion.
+        std::sort(package.begin(), package.end(),
+                  [&](uint32_t a, uint32_t b) {
+                      if (snapshot[a].nCountWithAncestors !=
+                          snapshot[b].nCountWithAncestors) {
+                          return snapshot[a].nCountWithAncestors <
+                                 snapshot[b].nCountWithAncestors;
+                      }
+                      return txid(a) < txid(b);
+                  });
+
+        if (!add(idx, package, packageState)) {
+            if (fUsingModified) {
+                setFailed(idx);
+            }
+            continue;
+        }
+
+        for (uint32_t i : package) {
+            if (state.flags[i] & SelectionState::MODIFIED) {
+                modifiedQueue.erase(i);
+            }
+            state.flags[i] = SelectionState::IN_BLOCK;
+        }
+        ++nPackagesSelected;
+
+        // Update the ancestor state of the descendants of the package
+        for (uint32_t added : package) {
+            ++nStamp;
+            walk.assign(1, added);
+            for (size_t i = 0; i < walk.size(); ++i) {
+                snapshot.ForEachChild(walk[i], [&](uint32_t child) {
+                    if (state.visited[child] != nStamp) {
+                        state.visited[child] = nStamp;
+                        walk.push_back(child);
+                    }
+                });
+            }
+            for (size_t i = 1; i < walk.size(); ++i) {
+                uint32_t desc = walk[i];
+                if (state.flags[desc] & SelectionState::IN_BLOCK) {
+                    continue;
+                }
+                ++nDescendantsUpdated;
+                if (state.flags[desc] & SelectionState::MODIFIED) {
+                    modifiedQueue.erase(desc);
+                } else {
+                    state.modified[desc] = snapshot[desc].ancestors;
+                    state.flags[desc] |= SelectionState::MODIFIED;
+                }
+                RemoveFromAncestors(state.modified[desc], snapshot[added]);
+                modifiedQueue.insert(desc);
+            }
+        }
+    }
+}
+
+} // namespace
+
+CPackageSelectionSnapshot::CPackageSelectionSnapshot(
+    const CTxMemPool &pool, const CTxMemPool::setEntries &inBlock,
+    int nHeight, bool fPriority) {
+    const auto &byScore = pool.mapTx.get<ancestor_score>();
+    entries.reserve(pool.mapTx.size());
+    std::unordered_map<const CTxMemPoolEntry *, uint32_t> indexes;
+    indexes.reserve(pool.mapTx.size());
+    std::vector<CTxMemPool::txiter> iters;
+    iters.reserve(pool.mapTx.size());
+
+    for (auto mi = byScore.begin(); mi != byScore.end(); ++mi) {
+        CTxMemPool::txiter it = pool.mapTx.project<0>(mi);
+        indexes.emplace(&*it, static_cast<uint32_t>(entries.size()));
+        iters.push_back(it);
+
+        Entry entry;
+        entry.tx = it->GetSharedTx();
+        entry.nFee = it->GetFee();
+        entry.nModFee = it->GetModifiedFee();
+        entry.nTxSize = it->GetTxSize();
+        entry.nSigOpCount = it->GetSigOpCount();
+        entry.nCountWithAncestors = it->GetCountWithAncestors();
+        entry.ancestors = {it->GetSizeWithAncestors(),
+                           it->GetModFeesWithAncestors(),
+                           it->GetSigOpCountWithAncestors()};
+        entry.dPriority = 0;
+        if (fPriority) {
+            entry.dPriority = it->GetPriority(nHeight);
+            Amount dummy;
+            pool.ApplyDeltasNL(it->GetTx().GetId(), entry.dPriority, dummy);
+        }
+        entry.fInBlock = inBlock.count(it) > 0;
+        entry.fModified = false;
+        entries.push_back(std::move(entry));
+    }
+
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+        entries[i].nParentsBegin = parents.size();
+        for (CTxMemPool::txiter parent : pool.GetMemPoolParentsNL(iters[i])) {
+            parents.push_back(indexes.at(&*parent));
+        }
+        entries[i].nParentsEnd = parents.size();
+        entries[i].nChildrenBegin = children.size();
+        for (CTxMemPool::txiter child : pool.GetMemPoolChildrenNL(iters[i])) {
+            children.push_back(indexes.at(&*child));
+        }
+        entries[i].nChildrenEnd = children.size();
+    }
+
+    // Remove transactions already in the block from the ancestor state of
+    // their descendants
+    std::vector<uint32_t> visited(entries.size(), 0);
+    std::vector<uint32_t> walk;
+    uint32_t nStamp = 0;
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+        if (!entries[i].fInBlock) {
+            continue;
+        }
+        ++nStamp;
+        walk.assign(1, i);
+        for (size_t w = 0; w < walk.size(); ++w) {
+            ForEachChild(walk[w], [&](uint32_t child) {
+                if (visited[child] != nStamp) {
+                    visited[child] = nStamp;
+                    walk.push_back(child);
+                }
+            });
+        }
+        for (size_t w = 1; w < walk.size(); ++w) {
+            Entry &desc = entries[walk[w]];
+            if (!desc.fInBlock) {
+                RemoveFromAncestors(desc.ancestors, entries[i]);
+                desc.fModified = true;
+            }
+        }
+    }
+}
+
+std::vector<std::vector<uint32_t>>
+CPackageSelectionSnapshot::GetComponents() const {
+    // Union-find over the dependencies between entries not in the block
+    std::vector<uint32_t> root(entries.size());
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+        root[i] = i;
+    }
+    auto find = [&root](uint32_t i) {
+        while (root[i] != i) {
+            root[i] = root[root[i]];
+            i = root[i];
+        }
+        return i;
+    };
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].fInBlock) {
+            continue;
+        }
+        ForEachParent(i, [&](uint32_t parent) {
+            if (!entries[parent].fInBlock) {
+                uint32_t a = find(i);
+                uint32_t b = find(parent);
+                if (a != b) {
+                    root[std::max(a, b)] = std::min(a, b);
+                }
+            }
+        });
+    }
+
+    std::vector<std::vector<uint32_t>> components;
+    std::unordered_map<uint32_t, size_t> componentOf;
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].fInBlock) {
+            continue;
+        }
+        auto inserted = componentOf.emplace(find(i), components.size());
+        if (inserted.second) {
+            components.emplace_back();
+        }
+        components[inserted.first->second].push_back(i);
+    }
+    return components;
+}
+
+std::vector<std::vector<CPackageSelectionSnapshot::Package>>
+CPackageSelectionSnapshot::SelectIndependentPackages(
+    const CFeeRate &minFeeRate, size_t nThreads,
+    int &nDescendantsUpdated) const {
+    nThreads = std::max<size_t>(nThreads, 1);
+
+    // Assign the groups to the threads, largest first to the least loaded
+    std::vector<std::vector<uint32_t>> components = GetComponents();
+    std::sort(components.begin(), components.end(),
+              [](const std::vector<uint32_t> &a,
+                 const std::vector<uint32_t> &b) {
+                  return a.size() > b.size();
+              });
+    std::vector<size_t> load(nThreads, 0);
+    std::vector<int> threadOf(entries.size(), -1);
+    for (const auto &component : components) {
+        int thread = std::min_element(load.begin(), load.end()) - load.begin();
+        load[thread] += component.size();
+        for (uint32_t i : component) {
+            threadOf[i] = thread;
+        }
+    }
+    std::vector<std::vector<uint32_t>> candidates(nThreads);
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+        if (threadOf[i] >= 0) {
+            candidates[threadOf[i]].push_back(i);
+        }
+    }
+
+    SelectionState state(*this);
+    auto select = [&](size_t thread, int &nUpdated) {
+        std::vector<Package> packages;
+        int nPackagesSelected = 0;
+        auto test = [](const AncestorState &) { return PackageTest::FITS; };
+        auto add = [&](uint32_t idx, const std::vector<uint32_t> &package,
+                       const AncestorState &ancestors) {
+            packages.push_back({package, ancestors, entries[idx].tx->GetId()});
+            return true;
+        };
+        SelectPackages(*this, state, candidates[thread], minFeeRate, test, add,
+                       nPackagesSelected, nUpdated);
+        return packages;
+    };
+
+    std::vector<std::vector<Package>> selections;
+    if (nThreads == 1) {
+        selections.push_back(select(0, nDescendantsUpdated));
+        return selections;
+    }
+
+    // The pool lives for this call only. Assemblers are created per block
+    // template and starting a few threads is cheap next to the selection.
+    std::vector<int> nUpdated(nThreads, 0);
+    CThreadPool<CQueueAdaptor> pool{"PackageSelection", nThreads};
+    std::vector<std::future<std::vector<Package>>> results;
+    for (size_t thread = 0; thread < nThreads; ++thread) {
+        results.push_back(make_task(pool, [&select, &nUpdated, thread]() {
+            return select(thread, nUpdated[thread]);
+        }));
+    }
+    for (size_t thread = 0; thread < nThreads; ++thread) {
+        selections.push_back(results[thread].get());
+        nDescendantsUpdated += nUpdated[thread];
+    }
+    return selections;
+}
+
 int64_t UpdateTime(CBlockHeader *pblock, const Config &config,
                    const CBlockIndex *pindexPrev) {
     int64_t nOldTime = pblock->nTime;
@@ -86,6 +502,12 @@ LegacyBlockAssembler::LegacyBlockAssembler(const Config &_config)
         blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
     }
 
+    // More threads than cores only add scheduling overhead
+    nPackageSelectionThreads = static_cast<int>(std::clamp<int64_t>(
+        gArgs.GetArg("-packageselectionthreads",
+                     DEFAULT_PACKAGE_SELECTION_THREADS),
+        0, std::max(1, GetNumCores())));
+
     LOCK(cs_main);
     nMaxGeneratedBlockSize = ComputeMaxGeneratedBlockSize(chainActive.Tip());
 }
@@ -110,91 +532,115 @@ LegacyBlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, CBlockIndex*
 {
     int64_t nTimeStart = GetTimeMicros();
 
-    resetBlock();
+    // Packages are selected without cs_main, so that mempool writers, which
+    // take cs_main first, aren't blocked while we select. If a block is
+    // connected in the meantime the selection is for a stale tip and we start
+    // again from the new one.
+    while (true) {
+        resetBlock();
 
-    pblocktemplate.reset(new CBlockTemplate());
-    if (!pblocktemplate.get()) {
-        return nullptr;
-    }
+        pblocktemplate.reset(new CBlockTemplate());
+        if (!pblocktemplate.get()) {
+            return nullptr;
+        }
 
-    // Pointer for convenience.
-    CBlockRef blockref = pblocktemplate->GetBlockRef();
-    pblock = blockref.get();
+        // Pointer for convenience.
+        CBlockRef blockref = pblocktemplate->GetBlockRef();
+        pblock = blockref.get();
 
-    // Add dummy coinbase tx as first transaction.
-    pblock->vtx.emplace_back();
-    // updated at end
-    pblocktemplate->vTxFees.push_back(Amount(-1));
-    // updated at end
-    pblocktemplate->vTxSigOpsCount.push_back(-1);
+        // Add dummy coinbase tx as first transaction.
+        pblock->vtx.emplace_back();
+        // updated at end
+        pblocktemplate->vTxFees.push_back(Amount(-1));
+        // updated at end
+        pblocktemplate->vTxSigOpsCount.push_back(-1);
 
-    LOCK(cs_main);
-    std::unique_lock lock(mempool.smtx);
-    CBlockIndex* pindexPrevNew = chainActive.Tip();
-    nHeight = pindexPrevNew->nHeight + 1;
+        CBlockIndex* pindexPrevNew = nullptr;
+        std::optional<CPackageSelectionSnapshot> snapshot;
+        {
+            LOCK(cs_main);
+            std::unique_lock lock(mempool.smtx);
+            pindexPrevNew = chainActive.Tip();
+            nHeight = pindexPrevNew->nHeight + 1;
+
+            nMaxGeneratedBlockSize = ComputeMaxGeneratedBlockSize(pindexPrevNew);
 
-    nMaxGeneratedBlockSize = ComputeMaxGeneratedBlockSize(pindexPrevNew);
+            nLockTimeCutoff =
+                (StandardNonFinalVerifyFlags(IsGenesisEnabled(mConfig, nHeight)) & LOCKTIME_MEDIAN_TIME_PAST)
+                    ? pindexPrevNew->GetMedianTimePast()
+                    : GetAdjustedTime();
 
-    nLockTimeCutoff =
-        (StandardNonFinalVerifyFlags(IsGenesisEnabled(mConfig, nHeight)) & LOCKTIME_MEDIAN_TIME_PAST)
-            ? pindexPrevNew->GetMedianTimePast()
-            : GetAdjustedTime();
+            addPriorityTxs();
 
-    addPriorityTxs();
-    int nPackagesSelected = 0;
-    int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+            // Select packages from a snapshot of the mempool, so that mempool
+            // writers only wait for it to be copied
+            snapshot.emplace(
+                mempool, inBlock, nHeight,
+                gArgs.GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY));
+        }
 
-    int64_t nTime1 = GetTimeMicros();
+        int nPackagesSelected = 0;
+        int nDescendantsUpdated = 0;
+        addPackageTxs(*snapshot, nPackagesSelected, nDescendantsUpdated);
 
-    nLastBlockTx = nBlockTx;
-    nLastBlockSize = nBlockSize;
+        int64_t nTime1 = GetTimeMicros();
 
-    FillBlockHeader(blockref, pindexPrevNew, scriptPubKeyIn);
+        LOCK(cs_main);
+        if (chainActive.Tip() != pindexPrevNew) {
+            LogPrint(BCLog::BENCH, "CreateNewBlock(): tip changed during "
+                                   "package selection, selecting again\n");
+            continue;
+        }
 
-    bool isGenesisEnabled = IsGenesisEnabled(mConfig, nHeight);
-    bool sigOpCountError;
+        nLastBlockTx = nBlockTx;
+        nLastBlockSize = nBlockSize;
 
-    pblocktemplate->vTxFees[0] = -1 * mBlockFees;
+        FillBlockHeader(blockref, pindexPrevNew, scriptPubKeyIn);
 
-    int64_t txSigOpCount = static_cast<int64_t>(GetSigOpCountWithoutP2SH(*pblock->vtx[0], isGenesisEnabled, sigOpCountError));
-    // This can happen if supplied coinbase scriptPubKeyIn contains multisig with too many public keys
-    if (sigOpCountError)
-    {
-        // invalid coinbase transaction, block creation will fail
-        pblocktemplate = nullptr;
-    }
-    else
-    {
-        pblocktemplate->vTxSigOpsCount[0] = txSigOpCount;
-    }
+        bool isGenesisEnabled = IsGenesisEnabled(mConfig, nHeight);
+        bool sigOpCountError;
 
-    uint64_t nSerializeSize = GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION);
-    LogPrintf("CreateNewBlock(): total size: %u txs: %u fees: %ld sigops %d\n",
-              nSerializeSize, nBlockTx, mBlockFees, nBlockSigOps);
+        pblocktemplate->vTxFees.set(0, -1 * mBlockFees);
 
-    // If required, check block validity
-    int64_t nTimeValidationStart { GetTimeMicros() };
-    if(mConfig.GetTestBlockCandidateValidity())
-    {
-        CValidationState state;
-        BlockValidationOptions validationOptions { false, false, true };
-        if (!TestBlockValidity(mConfig, state, *pblock, pindexPrevNew, validationOptions))
+        int64_t txSigOpCount = static_cast<int64_t>(GetSigOpCountWithoutP2SH(*pblock->vtx[0], isGenesisEnabled, sigOpCountError));
+        // This can happen if supplied coinbase scriptPubKeyIn contains multisig with too many public keys
+        if (sigOpCountError)
         {
-            throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s",
-                                               __func__, FormatStateMessage(state)));
+            // invalid coinbase transaction, block creation will fail
+            pblocktemplate = nullptr;
+        }
+        else
+        {
+            pblocktemplate->vTxSigOpsCount.set(0, txSigOpCount);
         }
-    }
 
-    int64_t nTimeEnd = GetTimeMicros();
-    LogPrint(
-        BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d "
-                      "updated descendants), validity: %.2fms (total %.2fms)\n",
-        0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated,
-        0.001 * (nTimeEnd - nTimeValidationStart), 0.001 * (nTimeEnd - nTimeStart));
+        uint64_t nSerializeSize = GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION);
+        LogPrintf("CreateNewBlock(): total size: %u txs: %u fees: %ld sigops %d\n",
+                  nSerializeSize, nBlockTx, mBlockFees, nBlockSigOps);
 
-    pindexPrev = pindexPrevNew;
-    return std::move(pblocktemplate);
+        // If required, check block validity
+        int64_t nTimeValidationStart { GetTimeMicros() };
+        if(mConfig.GetTestBlockCandidateValidity())
+        {
+            CValidationState state;
+            BlockValidationOptions validationOptions { false, false, true };
+            if (!TestBlockValidity(mConfig, state, *pblock, pindexPrevNew, validationOptions))
+            {
+                throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s",
+                                                   __func__, FormatStateMessage(state)));
+            }
+        }
+
+        int64_t nTimeEnd = GetTimeMicros();
+        LogPrint(
+            BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d "
+                          "updated descendants), validity: %.2fms (total %.2fms)\n",
+            0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated,
+            0.001 * (nTimeEnd - nTimeValidationStart), 0.001 * (nTimeEnd - nTimeStart));
+
+        pindexPrev = pindexPrevNew;
+        return std::move(pblocktemplate);
+    }
 }
 
 bool LegacyBlockAssembler::isStillDependent(CTxMemPool::txiter iter) {
@@ -206,18 +652,6 @@ bool LegacyBlockAssembler::isStillDependent(CTxMemPool::txiter iter) {
     return false;
 }
 
-void LegacyBlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries &testSet) {
-    for (CTxMemPool::setEntries::iterator iit = testSet.begin();
-         iit != testSet.end();) {
-        // Only test txs not already in the block.
-        if (inBlock.count(*iit)) {
-            testSet.erase(iit++);
-        } else {
-            iit++;
-        }
-    }
-}
-
 bool LegacyBlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOps) {
     auto blockSizeWithPackage = nBlockSize + packageSize;
     if (blockSizeWithPackage >= nMaxGeneratedBlockSize)
@@ -242,17 +676,17 @@ bool LegacyBlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigO
  * - Serialized size (in case -blockmaxsize is in use)
  */
 bool LegacyBlockAssembler::TestPackageTransactions(
-    const CTxMemPool::setEntries &package) {
+    const CPackageSelectionSnapshot &snapshot,
+    const std::vector<uint32_t> &package) {
     uint64_t nPotentialBlockSize = nBlockSize;
-    for (const CTxMemPool::txiter it : package) {
+    for (uint32_t i : package) {
         CValidationState state;
-        if (!ContextualCheckTransaction(mConfig, it->GetTx(), state, nHeight,
-                                        nLockTimeCutoff, false)) {
+        if (!ContextualCheckTransaction(mConfig, *snapshot[i].tx, state,
+                                        nHeight, nLockTimeCutoff, false)) {
             return false;
         }
 
-        uint64_t nTxSize =
-            ::GetSerializeSize(it->GetTx(), SER_NETWORK, PROTOCOL_VERSION);
+        uint64_t nTxSize = snapshot[i].nTxSize;
         if (nPotentialBlockSize + nTxSize >= nMaxGeneratedBlockSize) {
             return false;
         }
@@ -332,59 +766,26 @@ void LegacyBlockAssembler::AddToBlock(CTxMemPool::txiter iter) {
     }
 }
 
-int LegacyBlockAssembler::UpdatePackagesForAdded(
-    const CTxMemPool::setEntries &alreadyAdded,
-    indexed_modified_transaction_set &mapModifiedTx) {
-    int nDescendantsUpdated = 0;
-    for (const CTxMemPool::txiter it : alreadyAdded) {
-        CTxMemPool::setEntries descendants;
-        mempool.CalculateDescendantsNL(it, descendants);
-        // Insert all descendants (not yet in block) into the modified set.
-        for (CTxMemPool::txiter desc : descendants) {
-            if (alreadyAdded.count(desc)) {
-                continue;
-            }
-            ++nDescendantsUpdated;
-            modtxiter mit = mapModifiedTx.find(desc);
-            if (mit == mapModifiedTx.end()) {
-                CTxMemPoolModifiedEntry modEntry(desc);
-                modEntry.nSizeWithAncestors -= it->GetTxSize();
-                modEntry.nModFeesWithAncestors -= it->GetModifiedFee();
-                modEntry.nSigOpCountWithAncestors -= it->GetSigOpCount();
-                mapModifiedTx.insert(modEntry);
-            } else {
-                mapModifiedTx.modify(mit, update_for_parent_inclusion(it));
-            }
+void LegacyBlockAssembler::AddToBlock(const CPackageSelectionSnapshot &snapshot,
+                                      const std::vector<uint32_t> &package) {
+    bool fPrintPriority =
+        gArgs.GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
+    for (uint32_t i : package) {
+        const CPackageSelectionSnapshot::Entry &entry = snapshot[i];
+        pblock->vtx.emplace_back(entry.tx);
+        pblocktemplate->vTxFees.push_back(entry.nFee);
+        pblocktemplate->vTxSigOpsCount.push_back(entry.nSigOpCount);
+        nBlockSize += entry.nTxSize;
+        ++nBlockTx;
+        nBlockSigOps += entry.nSigOpCount;
+        mBlockFees += entry.nFee;
+
+        if (fPrintPriority) {
+            LogPrintf("priority %.1f fee %s txid %s\n", entry.dPriority,
+                      CFeeRate(entry.nModFee, entry.nTxSize).ToString(),
+                      entry.tx->GetId().ToString());
         }
     }
-    return nDescendantsUpdated;
-}
-
-// Skip entries in mapTx that are already in a block or are present in
-// mapModifiedTx (which implies that the mapTx ancestor state is stale due to
-// ancestor inclusion in the block). Also skip transactions that we've already
-// failed to add. This can happen if we consider a transaction in mapModifiedTx
-// and it fails: we can then potentially consider it again while walking mapTx.
-// It's currently guaranteed to fail again, but as a belt-and-suspenders check
-// we put it in failedTx and avoid re-evaluation, since the re-evaluation would
-// be using cached size/sigops/fee values that are not actually correct.
-bool LegacyBlockAssembler::SkipMapTxEntry(
-    CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx,
-    CTxMemPool::setEntries &failedTx) {
-    assert(it != mempool.mapTx.end());
-    return mapModifiedTx.count(it) || inBlock.count(it) || failedTx.count(it);
-}
-
-void LegacyBlockAssembler::SortForBlock(
-    const CTxMemPool::setEntries &package, CTxMemPool::txiter entry,
-    std::vector<CTxMemPool::txiter> &sortedEntries) {
-    // Sort package by ancestor count. If a transaction A depends on transaction
-    // B, then A's ancestor count must be greater than B's. So this is
-    // sufficient to validly order the transactions for block inclusion.
-    sortedEntries.clear();
-    sortedEntries.insert(sortedEntries.begin(), package.begin(), package.end());
-    std::sort(sortedEntries.begin(), sortedEntries.end(),
-              CompareTxIterByAncestorCount());
 }
 
 /**
@@ -394,33 +795,22 @@ void LegacyBlockAssembler::SortForBlock(
  * @param[out] nPackagesSelected    How many packages were selected
  * @param[out] nDescendantsUpdated  Number of descendant transactions updated
 */
-void LegacyBlockAssembler::addPackageTxs(int &nPackagesSelected,
-                                   int &nDescendantsUpdated) {
-
-    // selection algorithm orders the mempool based on feerate of a
-    // transaction including all unconfirmed ancestors. Since we don't remove
-    // transactions from the mempool as we select them for block inclusion, we
-    // need an alternate method of updating the feerate of a transaction with
-    // its not-yet-selected ancestors as we go. This is accomplished by
-    // walking the in-mempool descendants of selected transactions and storing
-    // a temporary modified state in mapModifiedTxs. Each time through the
-    // loop, we compare the best transaction in mapModifiedTxs with the next
-    // transaction in the mempool to decide what transaction package to work
-    // on next.
-
-    // mapModifiedTx will store sorted packages after they are modified because
-    // some of their txs are already in the block.
-    indexed_modified_transaction_set mapModifiedTx;
-    // Keep track of entries that failed inclusion, to avoid duplicate work.
-    CTxMemPool::setEntries failedTx;
-
-    // Start by adding all descendants of previously added txs to mapModifiedTx
-    // and modifying them for their already included ancestors.
-    UpdatePackagesForAdded(inBlock, mapModifiedTx);
-
-    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator
-        mi = mempool.mapTx.get<ancestor_score>().begin();
-    CTxMemPool::txiter iter;
+void LegacyBlockAssembler::addPackageTxs(
+    const CPackageSelectionSnapshot &snapshot, int &nPackagesSelected,
+    int &nDescendantsUpdated) {
+    if (nPackageSelectionThreads > 0) {
+        addPackageTxsParallel(snapshot, nPackageSelectionThreads,
+                              nPackagesSelected, nDescendantsUpdated);
+        return;
+    }
+
+    std::vector<uint32_t> candidates;
+    candidates.reserve(snapshot.size());
+    for (uint32_t i = 0; i < snapshot.size(); ++i) {
+        if (!snapshot[i].fInBlock) {
+            candidates.push_back(i);
+        }
+    }
 
     // Limit the number of attempts to add transactions to the block when it is
     // close to full; this is just a simple heuristic to finish quickly if the
@@ -428,120 +818,110 @@ void LegacyBlockAssembler::addPackageTxs(int &nPackagesSelected,
     const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
     int64_t nConsecutiveFailed = 0;
 
-    while (mi != mempool.mapTx.get<ancestor_score>().end() ||
-           !mapModifiedTx.empty()) {
-        // First try to find a new transaction in mapTx to evaluate.
-        if (mi != mempool.mapTx.get<ancestor_score>().end() &&
-            SkipMapTxEntry(mempool.mapTx.project<0>(mi), mapModifiedTx,
-                           failedTx)) {
-            ++mi;
-            continue;
+    auto test = [&](const CPackageSelectionSnapshot::AncestorState &state) {
+        if (TestPackage(state.nSize, state.nSigOpCount)) {
+            return PackageTest::FITS;
+        }
+        ++nConsecutiveFailed;
+        if (nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES &&
+            nBlockSize > nMaxGeneratedBlockSize - 1000) {
+            // Give up if we're close to full and haven't succeeded in a
+            // while.
+            return PackageTest::GIVE_UP;
         }
+        return PackageTest::FAILED;
+    };
+    auto add = [&](uint32_t, const std::vector<uint32_t> &package,
+                   const CPackageSelectionSnapshot::AncestorState &) {
+        // Test if all tx's are Final.
+        if (!TestPackageTransactions(snapshot, package)) {
+            return false;
+        }
+        // This transaction will make it in; reset the failed counter.
+        nConsecutiveFailed = 0;
+        AddToBlock(snapshot, package);
+        return true;
+    };
 
-        // Now that mi is not stale, determine which transaction to evaluate:
-        // the next entry from mapTx, or the best from mapModifiedTx?
-        bool fUsingModified = false;
+    SelectionState state(snapshot);
+    SelectPackages(snapshot, state, candidates, blockMinFeeRate, test, add,
+                   nPackagesSelected, nDescendantsUpdated);
+}
 
-        modtxscoreiter modit = mapModifiedTx.get<ancestor_score>().begin();
-        if (mi == mempool.mapTx.get<ancestor_score>().end()) {
-            // We're out of entries in mapTx; use the entry from mapModifiedTx
-            iter = modit->iter;
-            fUsingModified = true;
-        } else {
-            // Try to compare the mapTx entry to the mapModifiedTx entry.
-            iter = mempool.mapTx.project<0>(mi);
-            if (modit != mapModifiedTx.get<ancestor_score>().end() &&
-                CompareModifiedEntry()(*modit, CTxMemPoolModifiedEntry(iter))) {
-                // The best entry in mapModifiedTx has higher score than the one
-                // from mapTx. Switch which transaction (package) to consider
-                iter = modit->iter;
-                fUsingModified = true;
-            } else {
-                // Either no entry in mapModifiedTx, or it's worse than mapTx.
-                // Increment mi for the next loop iteration.
-                ++mi;
+/**
+ * Groups of transactions with no dependencies between them don't affect each
+ * other's package feerates, so we select the packages of each group on its
+ * own, without the block limits, and then merge them into the block in order
+ * of their feerate. While the block has room this gives the same block as
+ * selecting all packages at once.
+*/
+void LegacyBlockAssembler::addPackageTxsParallel(
+    const CPackageSelectionSnapshot &snapshot, size_t nThreads,
+    int &nPackagesSelected, int &nDescendantsUpdated) {
+    std::vector<std::vector<CPackageSelectionSnapshot::Package>> selections =
+        snapshot.SelectIndependentPackages(blockMinFeeRate, nThreads,
+                                           nDescendantsUpdated);
+
+    // Merge the packages into the block by their feerate
+    const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
+    int64_t nConsecutiveFailed = 0;
+    std::vector<bool> added(snapshot.size(), false);
+    std::vector<size_t> next(selections.size(), 0);
+    while (true) {
+        const CPackageSelectionSnapshot::Package *best = nullptr;
+        size_t bestSelection = 0;
+        for (size_t s = 0; s < selections.size(); ++s) {
+            if (next[s] == selections[s].size()) {
+                continue;
+            }
+            const CPackageSelectionSnapshot::Package &candidate =
+                selections[s][next[s]];
+            if (best == nullptr ||
+                HigherScore(candidate.ancestors, candidate.txid,
+                            best->ancestors, best->txid)) {
+                best = &candidate;
+                bestSelection = s;
             }
         }
-
-        // We skip mapTx entries that are inBlock, and mapModifiedTx shouldn't
-        // contain anything that is inBlock.
-        assert(!inBlock.count(iter));
-
-        uint64_t packageSize = iter->GetSizeWithAncestors();
-        Amount packageFees = iter->GetModFeesWithAncestors();
-        int64_t packageSigOps = iter->GetSigOpCountWithAncestors();
-        if (fUsingModified) {
-            packageSize = modit->nSizeWithAncestors;
-            packageFees = modit->nModFeesWithAncestors;
-            packageSigOps = modit->nSigOpCountWithAncestors;
+        if (best == nullptr) {
+            break;
         }
-
-        if (packageFees < blockMinFeeRate.GetFee(packageSize)) {
-            // Everything else we might consider has a lower fee rate
-            return;
+        ++next[bestSelection];
+
+        // Skip packages whose ancestors didn't make it into the block
+        bool fMissingAncestor = false;
+        for (uint32_t i : best->txns) {
+            snapshot.ForEachParent(i, [&](uint32_t parent) {
+                if (!snapshot[parent].fInBlock && !added[parent] &&
+                    std::find(best->txns.begin(), best->txns.end(), parent) ==
+                        best->txns.end()) {
+                    fMissingAncestor = true;
+                }
+            });
+        }
+        if (fMissingAncestor) {
+            continue;
         }
 
-        if (!TestPackage(packageSize, packageSigOps)) {
-            if (fUsingModified) {
-                // Since we always look at the best entry in mapModifiedTx, we
-                // must erase failed entries so that we can consider the next
-                // best entry on the next loop iteration
-                mapModifiedTx.get<ancestor_score>().erase(modit);
-                failedTx.insert(iter);
-            }
-
+        if (!TestPackage(best->ancestors.nSize,
+                         best->ancestors.nSigOpCount)) {
             ++nConsecutiveFailed;
-
             if (nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES &&
                 nBlockSize > nMaxGeneratedBlockSize - 1000) {
-                // Give up if we're close to full and haven't succeeded in a
-                // while.
                 break;
             }
             continue;
         }
-
-        CTxMemPool::setEntries ancestors;
-        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
-        std::string dummy;
-        mempool.CalculateMemPoolAncestorsNL(*iter,
-                                            ancestors,
-                                            nNoLimit,
-                                            nNoLimit,
-                                            nNoLimit,
-                                            nNoLimit,
-                                            dummy,
-                                            false);
-
-        onlyUnconfirmed(ancestors);
-        ancestors.insert(iter);
-
-        // Test if all tx's are Final.
-        if (!TestPackageTransactions(ancestors)) {
-            if (fUsingModified) {
-                mapModifiedTx.get<ancestor_score>().erase(modit);
-                failedTx.insert(iter);
-            }
+        if (!TestPackageTransactions(snapshot, best->txns)) {
             continue;
         }
 
-        // This transaction will make it in; reset the failed counter.
         nConsecutiveFailed = 0;
-
-        // Package can be added. Sort the entries in a valid order.
-        std::vector<CTxMemPool::txiter> sortedEntries;
-        SortForBlock(ancestors, iter, sortedEntries);
-
-        for (auto &entry : sortedEntries) {
-            AddToBlock(entry);
-            // Erase from the modified set, if present
-            mapModifiedTx.erase(entry);
+        AddToBlock(snapshot, best->txns);
+        for (uint32_t i : best->txns) {
+            added[i] = true;
         }
-
         ++nPackagesSelected;
-
-        // Update transactions that depend on each of these
-        nDescendantsUpdated += UpdatePackagesForAdded(ancestors, mapModifiedTx);
     }
 }
 
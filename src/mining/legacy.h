@@ -10,9 +10,6 @@
 #include "primitives/block.h"
 #include "txmempool.h"
 
-#include "boost/multi_index/ordered_index.hpp"
-#include "boost/multi_index_container.hpp"
-
 #include <cstdint>
 #include <memory>
 
@@ -25,99 +22,98 @@ class CWallet;
 
 static const bool DEFAULT_PRINTPRIORITY = false;
 
-// Container for tracking updates to ancestor feerate as we include (parent)
-// transactions in a block
-struct CTxMemPoolModifiedEntry {
-    CTxMemPoolModifiedEntry(CTxMemPool::txiter entry) {
-        iter = entry;
-        nSizeWithAncestors = entry->GetSizeWithAncestors();
-        nModFeesWithAncestors = entry->GetModFeesWithAncestors();
-        nSigOpCountWithAncestors = entry->GetSigOpCountWithAncestors();
-    }
-
-    CTxMemPool::txiter iter;
-    uint64_t nSizeWithAncestors;
-    Amount nModFeesWithAncestors;
-    int64_t nSigOpCountWithAncestors;
-};
+/** Default number of threads selecting packages, 0 for the calling thread */
+static const int DEFAULT_PACKAGE_SELECTION_THREADS = 0;
 
 /**
- * Comparator for CTxMemPool::txiter objects.
- * It simply compares the internal memory address of the CTxMemPoolEntry object
- * pointed to. This means it has no meaning, and is only useful for using them
- * as key in other indexes.
+ * A copy of the parts of the mempool that package selection looks at, so
+ * that packages can be selected without holding the mempool lock.
+ *
+ * Entries are stored in an array in ancestor score order. The parents and
+ * children of each entry are stored as ranges of indexes into that array.
  */
-struct CompareCTxMemPoolIter {
-    bool operator()(const CTxMemPool::txiter &a,
-                    const CTxMemPool::txiter &b) const {
-        return &(*a) < &(*b);
-    }
-};
-
-struct modifiedentry_iter {
-    typedef CTxMemPool::txiter result_type;
-    result_type operator()(const CTxMemPoolModifiedEntry &entry) const {
-        return entry.iter;
-    }
-};
-
-// This matches the calculation in CompareTxMemPoolEntryByAncestorFee,
-// except operating on CTxMemPoolModifiedEntry.
-// TODO: refactor to avoid duplication of this logic.
-struct CompareModifiedEntry {
-    bool operator()(const CTxMemPoolModifiedEntry &a,
-                    const CTxMemPoolModifiedEntry &b) const {
-        double f1 = double(b.nSizeWithAncestors *
-                           a.nModFeesWithAncestors.GetSatoshis());
-        double f2 = double(a.nSizeWithAncestors *
-                           b.nModFeesWithAncestors.GetSatoshis());
-        if (f1 == f2) {
-            return CTxMemPool::CompareIteratorByHash()(a.iter, b.iter);
+class CPackageSelectionSnapshot {
+public:
+    // Ancestor state of an entry, not counting ancestors that are already
+    // in the block
+    struct AncestorState {
+        uint64_t nSize;
+        Amount nModFees;
+        int64_t nSigOpCount;
+    };
+
+    struct Entry {
+        CTransactionRef tx;
+        Amount nFee;
+        Amount nModFee;
+        uint64_t nTxSize;
+        int64_t nSigOpCount;
+        uint64_t nCountWithAncestors;
+        AncestorState ancestors;
+        // Only set if -printpriority is set
+        double dPriority;
+        uint32_t nParentsBegin;
+        uint32_t nParentsEnd;
+        uint32_t nChildrenBegin;
+        uint32_t nChildrenEnd;
+        // Whether the entry was already in the block
+        bool fInBlock;
+        // Whether ancestors were already in the block
+        bool fModified;
+    };
+
+    /** Copy the mempool - caller holds the mempool lock */
+    CPackageSelectionSnapshot(const CTxMemPool &pool,
+                              const CTxMemPool::setEntries &inBlock,
+                              int nHeight, bool fPriority);
+
+    size_t size() const { return entries.size(); }
+    const Entry &operator[](uint32_t i) const { return entries[i]; }
+
+    template <typename Callable>
+    void ForEachParent(uint32_t i, Callable call) const {
+        for (uint32_t p = entries[i].nParentsBegin; p < entries[i].nParentsEnd;
+             ++p) {
+            call(parents[p]);
         }
-        return f1 > f2;
     }
-};
-
-// A comparator that sorts transactions based on number of ancestors.
-// This is sufficient to sort an ancestor package in an order that is valid
-// to appear in a block.
-struct CompareTxIterByAncestorCount {
-    bool operator()(const CTxMemPool::txiter &a,
-                    const CTxMemPool::txiter &b) const {
-        if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
-            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
-        return CTxMemPool::CompareIteratorByHash()(a, b);
+    template <typename Callable>
+    void ForEachChild(uint32_t i, Callable call) const {
+        for (uint32_t c = entries[i].nChildrenBegin;
+             c < entries[i].nChildrenEnd; ++c) {
+            call(children[c]);
+        }
     }
-};
 
-typedef boost::multi_index_container<
-    CTxMemPoolModifiedEntry,
-    boost::multi_index::indexed_by<
-        boost::multi_index::ordered_unique<modifiedentry_iter,
-                                           CompareCTxMemPoolIter>,
-        // sorted by modified ancestor fee rate
-        boost::multi_index::ordered_non_unique<
-            // Reuse same tag from CTxMemPool's similar index
-            boost::multi_index::tag<ancestor_score>,
-            boost::multi_index::identity<CTxMemPoolModifiedEntry>,
-            CompareModifiedEntry>>>
-    indexed_modified_transaction_set;
-
-typedef indexed_modified_transaction_set::nth_index<0>::type::iterator
-    modtxiter;
-typedef indexed_modified_transaction_set::index<ancestor_score>::type::iterator
-    modtxscoreiter;
-
-struct update_for_parent_inclusion {
-    update_for_parent_inclusion(CTxMemPool::txiter it) : iter(it) {}
-
-    void operator()(CTxMemPoolModifiedEntry &e) {
-        e.nModFeesWithAncestors -= iter->GetFee();
-        e.nSizeWithAncestors -= iter->GetTxSize();
-        e.nSigOpCountWithAncestors -= iter->GetSigOpCount();
-    }
+    /**
+     * Split the entries not in the block into groups with no dependencies
+     * between them. Each group is in ancestor score order.
+     */
+    std::vector<std::vector<uint32_t>> GetComponents() const;
+
+    // A package selected without block limits
+    struct Package {
+        // Transactions not yet in the block, in a valid order
+        std::vector<uint32_t> txns;
+        AncestorState ancestors;
+        // The transaction the package was selected for
+        TxId txid;
+    };
+
+    /**
+     * Select packages by ancestor feerate without block limits. The entries
+     * are split into nThreads sets of groups which are selected in parallel
+     * on a thread pool created for the call.
+     * Returns the packages of each set in the order they were selected.
+     */
+    std::vector<std::vector<Package>>
+    SelectIndependentPackages(const CFeeRate &minFeeRate, size_t nThreads,
+                              int &nDescendantsUpdated) const;
 
-    CTxMemPool::txiter iter;
+private:
+    std::vector<Entry> entries;
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> children;
 };
 
 /** Generate a new block, without valid proof-of-work */
@@ -130,6 +126,8 @@ private:
 
     // Configuration parameters for the block size
     CFeeRate blockMinFeeRate;
+    // Number of threads selecting packages
+    int nPackageSelectionThreads;
 
     // Information on the current status of the block
     uint64_t nBlockSize;
@@ -169,7 +167,8 @@ private:
     /** Add transactions based on feerate including unconfirmed ancestors
      * Increments nPackagesSelected / nDescendantsUpdated with corresponding
      * statistics from the package selection (for logging statistics). */
-    void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated);
+    void addPackageTxs(const CPackageSelectionSnapshot &snapshot,
+                       int &nPackagesSelected, int &nDescendantsUpdated);
 
     // helper function for addPriorityTxs
     /** Test if tx will still "fit" in the block */
@@ -178,29 +177,23 @@ private:
     bool isStillDependent(CTxMemPool::txiter iter);
 
     // helper functions for addPackageTxs()
-    /** Remove confirmed (inBlock) entries from given set */
-    void onlyUnconfirmed(CTxMemPool::setEntries &testSet);
     /** Test if a new package would "fit" in the block */
     bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost);
     /** Perform checks on each transaction in a package:
      * locktime, serialized size (if necessary)
      * These checks should always succeed, and they're here
      * only as an extra check in case of suboptimal node configuration */
-    bool TestPackageTransactions(const CTxMemPool::setEntries &package);
-    /** Return true if given transaction from mapTx has already been evaluated,
-     * or if the transaction's cached data in mapTx is incorrect. */
-    bool SkipMapTxEntry(CTxMemPool::txiter it,
-                        indexed_modified_transaction_set &mapModifiedTx,
-                        CTxMemPool::setEntries &failedTx);
-    /** Sort the package in an order that is valid to appear in a block */
-    void SortForBlock(const CTxMemPool::setEntries &package,
-                      CTxMemPool::txiter entry,
-                      std::vector<CTxMemPool::txiter> &sortedEntries);
-    /** Add descendants of given transactions to mapModifiedTx with ancestor
-     * state updated assuming given transactions are inBlock. Returns number
-     * of updated descendants. */
-    int UpdatePackagesForAdded(const CTxMemPool::setEntries &alreadyAdded,
-                               indexed_modified_transaction_set &mapModifiedTx);
+    bool TestPackageTransactions(const CPackageSelectionSnapshot &snapshot,
+                                 const std::vector<uint32_t> &package);
+    /** Add a package from the snapshot to the block */
+    void AddToBlock(const CPackageSelectionSnapshot &snapshot,
+                    const std::vector<uint32_t> &package);
+    /** Add transactions based on feerate including unconfirmed ancestors,
+     * selecting packages of independent groups of transactions in parallel
+     * and then merging them by feerate */
+    void addPackageTxsParallel(const CPackageSelectionSnapshot &snapshot,
+                               size_t nThreads, int &nPackagesSelected,
+                               int &nDescendantsUpdated);
 };
 
 /** Modify the extranonce in a block */
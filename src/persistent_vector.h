@@ -0,0 +1,152 @@
+// Copyright (c) 2019 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef BITCOIN_PERSISTENT_VECTOR_H
+#define BITCOIN_PERSISTENT_VECTOR_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+/**
+ * A vector whose copies share their elements.
+ *
+ * Elements are stored in fixed size chunks, so copying a vector only copies a
+ * reference to its list of chunks. Copies can keep appending to a chunk they
+ * share as long as nobody else has appended to it past their own end; the
+ * first one to do so claims the rest of the chunk and the others take a copy
+ * of it. Modifying an element copies its chunk if it's shared.
+ *
+ * Copies may be used from different threads, but like std::vector a single
+ * instance must not be modified while it's being read.
+ */
+template <typename T, size_t N = 4096> class persistent_vector {
+private:
+    struct chunk {
+        chunk() = default;
+        chunk(const chunk &other, size_t count) : used(count) {
+            std::copy(other.items.begin(), other.items.begin() + count,
+                      items.begin());
+        }
+
+        std::array<T, N> items{};
+        // Number of slots claimed by any of the vectors sharing this chunk
+        std::atomic<size_t> used{0};
+    };
+    using chunk_list = std::vector<std::shared_ptr<chunk>>;
+
+    std::shared_ptr<chunk_list> chunks{std::make_shared<chunk_list>()};
+    size_t _size{0};
+
+    // Make sure we are the only user of our list of chunks
+    chunk_list &unshare_chunks() {
+        if (chunks.use_count() > 1) {
+            size_t count = (_size + N - 1) / N;
+            chunks = std::make_shared<chunk_list>(chunks->begin(),
+                                                  chunks->begin() + count);
+        }
+        return *chunks;
+    }
+
+    // Make sure we are the only user of the chunk holding pos
+    chunk &unshare_chunk(size_t pos) {
+        std::shared_ptr<chunk> &c = unshare_chunks()[pos / N];
+        if (c.use_count() > 1) {
+            size_t count = std::min(N, _size - pos / N * N);
+            c = std::make_shared<chunk>(*c, count);
+        }
+        return *c;
+    }
+
+public:
+    typedef T value_type;
+    typedef size_t size_type;
+    typedef const T &const_reference;
+
+    class const_iterator {
+        const persistent_vector *vec{nullptr};
+        size_t pos{0};
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T *pointer;
+        typedef const T &reference;
+
+        const_iterator() = default;
+        const_iterator(const persistent_vector *vec_, size_t pos_)
+            : vec(vec_), pos(pos_) {}
+        const T &operator*() const { return (*vec)[pos]; }
+        const T *operator->() const { return &(*vec)[pos]; }
+        const_iterator &operator++() {
+            ++pos;
+            return *this;
+        }
+        const_iterator operator++(int) {
+            const_iterator copy(*this);
+            ++pos;
+            return copy;
+        }
+        bool operator==(const const_iterator &x) const { return pos == x.pos; }
+        bool operator!=(const const_iterator &x) const { return pos != x.pos; }
+    };
+
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    const T &operator[](size_t pos) const {
+        return (*chunks)[pos / N]->items[pos % N];
+    }
+
+    /**
+     * Copies the chunk holding pos if it's shared. There is deliberately no
+     * mutable operator[], so that reading through a non-const vector never
+     * copies chunks.
+     */
+    void set(size_t pos, const T &value) {
+        assert(pos < _size);
+        unshare_chunk(pos).items[pos % N] = value;
+    }
+
+    const T &back() const { return (*this)[_size - 1]; }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, _size); }
+
+    void push_back(const T &value) {
+        size_t offset = _size % N;
+        if (offset == 0) {
+            std::shared_ptr<chunk> c = std::make_shared<chunk>();
+            c->items[0] = value;
+            c->used = 1;
+            unshare_chunks().push_back(std::move(c));
+        } else {
+            // Claim the next slot of our last chunk, unless another copy
+            // already has
+            chunk *c = (*chunks)[_size / N].get();
+            size_t expected = offset;
+            if (!c->used.compare_exchange_strong(expected, offset + 1)) {
+                std::shared_ptr<chunk> copy =
+                    std::make_shared<chunk>(*c, offset);
+                copy->used = offset + 1;
+                c = copy.get();
+                unshare_chunks()[_size / N] = std::move(copy);
+            }
+            c->items[offset] = value;
+        }
+        ++_size;
+    }
+
+    void clear() {
+        chunks = std::make_shared<chunk_list>();
+        _size = 0;
+    }
+};
+
+#endif // BITCOIN_PERSISTENT_VECTOR_H
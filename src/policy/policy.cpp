@@ -238,7 +238,9 @@ std::optional<bool> AreInputsStandard(
             
             // isGenesisEnabled is set to false, because TX_SCRIPTHASH is not supported after genesis
             bool sigOpCountError;
-            CScript subscript(stack.back().begin(), stack.back().end());
+            const bsv::span<const uint8_t> serializedScript = stack.back().GetElement();
+            CScript subscript(serializedScript.data(),
+                              serializedScript.data() + serializedScript.size());
             uint64_t nSigOpCount = subscript.GetSigOpCount(true, false, sigOpCountError);
             if (sigOpCountError || nSigOpCount > MAX_P2SH_SIGOPS) {
                 return false;
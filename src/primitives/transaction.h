@@ -7,6 +7,7 @@
 #define BITCOIN_PRIMITIVES_TRANSACTION_H
 
 #include "amount.h"
+#include "hash.h"
 #include "script/script.h"
 #include "serialize.h"
 #include "uint256.h"
@@ -394,9 +395,52 @@ static inline CTransactionRef MakeTransactionRef(Tx &&txIn) {
     return std::make_shared<const CTransaction>(std::forward<Tx>(txIn));
 }
 
+/**
+ * SHA256 state of a SIGHASH_FORKID signature hash preimage after its
+ * scriptCode has been written. SignatureHash() reuses it while signatures of
+ * the same input are checked against the same scriptCode, i.e. until an
+ * OP_CODESEPARATOR changes it, instead of rehashing a possibly very large
+ * scriptCode for every signature.
+ *
+ * Copies start empty so that every owner of a PrecomputedTransactionData
+ * (e.g. every CScriptCheck) gets its own cache. An instance must not be used
+ * from several threads at the same time.
+ */
+class CSighashMidstateCache {
+public:
+    CSighashMidstateCache() = default;
+    CSighashMidstateCache(const CSighashMidstateCache &) {}
+    CSighashMidstateCache &operator=(const CSighashMidstateCache &) {
+        return *this;
+    }
+
+    /**
+     * Return the hasher state if it was stored for exactly the same preimage
+     * prefix (version, hashPrevouts, hashSequence, prevout and scriptCode),
+     * nullptr otherwise.
+     */
+    const CHash256 *Get(int32_t nVersion, const uint256 &hashPrevouts,
+                        const uint256 &hashSequence, const COutPoint &prevout,
+                        const CScript &scriptCode) const;
+
+    void Set(int32_t nVersion, const uint256 &hashPrevouts,
+             const uint256 &hashSequence, const COutPoint &prevout,
+             const CScript &scriptCode, const CHash256 &state) const;
+
+private:
+    mutable bool fValid = false;
+    mutable int32_t nVersion = 0;
+    mutable uint256 hashPrevouts;
+    mutable uint256 hashSequence;
+    mutable COutPoint prevout;
+    mutable CScript scriptCode;
+    mutable CHash256 state;
+};
+
 /** Precompute sighash midstate to avoid quadratic hashing */
 struct PrecomputedTransactionData {
     uint256 hashPrevouts, hashSequence, hashOutputs;
+    CSighashMidstateCache scriptCodeMidstate;
 
     PrecomputedTransactionData() = default;
     PrecomputedTransactionData(const PrecomputedTransactionData&) = default;
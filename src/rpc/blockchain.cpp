@@ -10,12 +10,14 @@
 #include "blockfileinfostore.h"
 #include "chain.h"
 #include "chainparams.h"
+#include "chainstate_warmup.h"
 #include "checkpoints.h"
 #include "coins.h"
 #include "config.h"
 #include "consensus/validation.h"
 #include "core_io.h"
 #include "hash.h"
+#include "mining/journal.h"
 #include "mining/journal_builder.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
@@ -25,9 +27,11 @@
 #include "sync.h"
 #include "taskcancellation.h"
 #include "txmempool.h"
+#include "txdb.h"
 #include "txn_validator.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "utxo_snapshot.h"
 #include "validation.h"
 #include "init.h"
 
@@ -1395,6 +1399,331 @@ UniValue gettxoutsetinfo(const Config &config, const JSONRPCRequest &request) {
     return ret;
 }
 
+static fs::path GetSnapshotPath(const UniValue &param) {
+    fs::path path = fs::path(param.get_str());
+    if (path.is_relative()) {
+        path = GetDataDir() / path;
+    }
+    return path;
+}
+
+UniValue dumptxoutset(const Config &config, const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrite the unspent transaction output set to a snapshot file "
+            "that can be imported with loadtxoutset.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"   (string, required) path of the snapshot file; "
+            "relative paths are relative to the data directory\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\": n,          (numeric) The height of the snapshot "
+            "base block\n"
+            "  \"bestblock\": \"hex\", (string) The snapshot base block hash\n"
+            "  \"coins_written\": n,   (numeric) The number of coins written\n"
+            "  \"chunks\": n,          (numeric) The number of chunks written\n"
+            "  \"path\": \"path\"      (string) The absolute path of the "
+            "snapshot file\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("dumptxoutset", "\"utxo.dat\"") +
+            HelpExampleRpc("dumptxoutset", "\"utxo.dat\""));
+    }
+
+    fs::path path = GetSnapshotPath(request.params[0]);
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           path.string() + " already exists");
+    }
+
+    CUTXOSnapshotMetadata metadata;
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    {
+        // Flushing and creating the cursor under cs_main guarantees that the
+        // cursor sees the UTXO set of exactly one block.
+        LOCK(cs_main);
+        FlushStateToDisk();
+        pcursor.reset(pcoinsTip->Cursor());
+        BlockMap::iterator it =
+            mapBlockIndex.find(pcursor->GetBestBlock());
+        if (it == mapBlockIndex.end()) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR,
+                               "Block of the UTXO set not found");
+        }
+        const CBlockIndex *pindex = it->second;
+        metadata.hashBaseBlock = pindex->GetBlockHash();
+        metadata.nBaseHeight = pindex->nHeight;
+        metadata.nBaseChainTx = pindex->nChainTx;
+    }
+
+    try {
+        DumpUTXOSnapshot(*pcursor, metadata, path, GetShutdownToken());
+    } catch (const std::exception &e) {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", int64_t(metadata.nBaseHeight)));
+    ret.push_back(Pair("bestblock", metadata.hashBaseBlock.GetHex()));
+    ret.push_back(Pair("coins_written", int64_t(metadata.nCoins)));
+    ret.push_back(Pair("chunks", int64_t(metadata.nChunks)));
+    ret.push_back(Pair("path", path.string()));
+    return ret;
+}
+
+UniValue loadtxoutset(const Config &config, const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() < 1 ||
+        request.params.size() > 2) {
+        throw std::runtime_error(
+            "loadtxoutset \"path\" ( threads )\n"
+            "\nLoad the unspent transaction output set from a snapshot file "
+            "created by dumptxoutset and continue syncing from the snapshot "
+            "base block.\n"
+            "Only allowed on a node whose chain tip is still the genesis "
+            "block. Header of the snapshot base block must already be known "
+            "and part of the best header chain. Blocks below the snapshot "
+            "base are never downloaded or validated, so the node can't "
+            "reorganise below it.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"   (string, required) path of the snapshot file; "
+            "relative paths are relative to the data directory\n"
+            "2. threads    (numeric, optional, default=" +
+            std::to_string(DEFAULT_UTXO_SNAPSHOT_LOAD_THREADS) +
+            ") number of threads used to decode and write coins\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\": n,          (numeric) The height of the snapshot "
+            "base block\n"
+            "  \"bestblock\": \"hex\", (string) The snapshot base block hash\n"
+            "  \"coins_loaded\": n     (numeric) The number of coins loaded\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("loadtxoutset", "\"utxo.dat\"") +
+            HelpExampleRpc("loadtxoutset", "\"utxo.dat\", 8"));
+    }
+
+    fs::path path = GetSnapshotPath(request.params[0]);
+    int threads = DEFAULT_UTXO_SNAPSHOT_LOAD_THREADS;
+    if (request.params.size() > 1) {
+        threads = request.params[1].get_int();
+        if (threads < 1) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER,
+                               "threads must be positive");
+        }
+    }
+
+    CUTXOSnapshotMetadata metadata;
+    try {
+        metadata = ReadUTXOSnapshotMetadata(path);
+    } catch (const std::exception &e) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, e.what());
+    }
+
+    // Hold cs_main for the whole load so no block can be connected on top of
+    // the partially written coins database.
+    LOCK(cs_main);
+
+    if (chainActive.Height() != 0 || GetSnapshotBase() != nullptr) {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "UTXO snapshot can only be loaded into a node "
+                           "whose chain tip is the genesis block");
+    }
+
+    BlockMap::iterator it = mapBlockIndex.find(metadata.hashBaseBlock);
+    if (it == mapBlockIndex.end()) {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "Header of snapshot base block " +
+                               metadata.hashBaseBlock.GetHex() +
+                               " not known; wait for headers to sync");
+    }
+    CBlockIndex *pindex = it->second;
+    if (pindex->nHeight != metadata.nBaseHeight ||
+        !pindex->IsValid(BlockValidity::TREE) ||
+        pindex->nStatus.isInvalid() || pindexBestHeader == nullptr ||
+        pindexBestHeader->GetAncestor(pindex->nHeight) != pindex) {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "Snapshot base block is not part of the best "
+                           "valid header chain");
+    }
+
+    FlushStateToDisk();
+    try {
+        LoadUTXOSnapshot(*pcoinsdbview, path, metadata, threads,
+                         GetShutdownToken());
+    } catch (const std::exception &e) {
+        throw JSONRPCError(RPC_DATABASE_ERROR,
+                           std::string(e.what()) +
+                               ". Coins database is now inconsistent; restart "
+                               "with -reindex-chainstate");
+    }
+
+    if (!ActivateSnapshotBase(config, pindex, metadata.nBaseChainTx)) {
+        throw JSONRPCError(RPC_DATABASE_ERROR,
+                           "Failed to activate snapshot base block");
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", int64_t(metadata.nBaseHeight)));
+    ret.push_back(Pair("bestblock", metadata.hashBaseBlock.GetHex()));
+    ret.push_back(Pair("coins_loaded", int64_t(metadata.nCoins)));
+    return ret;
+}
+
+static UniValue DBStatsToJSON(const CDBWrapper &db) {
+    UniValue ret(UniValue::VOBJ);
+
+    const CDBWrapperProfile &profile = db.GetProfile();
+    UniValue profileJSON(UniValue::VOBJ);
+    profileJSON.push_back(Pair("blocksize", uint64_t(profile.nBlockSize)));
+    profileJSON.push_back(Pair("bloombits", profile.nBloomBits));
+    profileJSON.push_back(
+        Pair("writebuffer", uint64_t(profile.nWriteBufferSize)));
+    profileJSON.push_back(Pair("maxopenfiles", profile.nMaxOpenFiles));
+    profileJSON.push_back(Pair("compression", profile.fCompression));
+    ret.push_back(Pair("profile", profileJSON));
+
+    std::string memoryUsage;
+    if (db.GetProperty("leveldb.approximate-memory-usage", memoryUsage)) {
+        ret.push_back(Pair("approximate_memory_usage",
+                           atoi64(memoryUsage)));
+    }
+
+    UniValue levels(UniValue::VARR);
+    double dReadMB = 0;
+    double dWriteMB = 0;
+    for (const CDBLevelStats &level : db.GetLevelStats()) {
+        UniValue levelJSON(UniValue::VOBJ);
+        levelJSON.push_back(Pair("level", level.nLevel));
+        levelJSON.push_back(Pair("files", level.nFiles));
+        levelJSON.push_back(Pair("size_mb", level.dSizeMB));
+        levelJSON.push_back(
+            Pair("compaction_time", level.dCompactionSeconds));
+        levelJSON.push_back(Pair("compaction_read_mb", level.dCompactionReadMB));
+        levelJSON.push_back(
+            Pair("compaction_write_mb", level.dCompactionWriteMB));
+        levels.push_back(levelJSON);
+        dReadMB += level.dCompactionReadMB;
+        dWriteMB += level.dCompactionWriteMB;
+    }
+    ret.push_back(Pair("levels", levels));
+    ret.push_back(Pair("compaction_read_mb", dReadMB));
+    ret.push_back(Pair("compaction_write_mb", dWriteMB));
+
+    std::string stats;
+    if (db.GetProperty("leveldb.stats", stats)) {
+        ret.push_back(Pair("stats", stats));
+    }
+    return ret;
+}
+
+UniValue getdbstats(const Config &config, const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 0) {
+        throw std::runtime_error(
+            "getdbstats\n"
+            "\nReturns LevelDB internal statistics and the active tuning "
+            "profile of the chainstate and block index databases.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"chainstate\": {              (json object) Coins database\n"
+            "    \"profile\": {               (json object) Active options\n"
+            "      \"blocksize\": n,          (numeric) Block size in bytes\n"
+            "      \"bloombits\": n,          (numeric) Bloom filter bits "
+            "per key\n"
+            "      \"writebuffer\": n,        (numeric) Write buffer size in "
+            "bytes, 0 if derived from the cache size\n"
+            "      \"maxopenfiles\": n,       (numeric) Maximum number of "
+            "open files\n"
+            "      \"compression\": true|false (boolean) Snappy compression "
+            "requested\n"
+            "    },\n"
+            "    \"approximate_memory_usage\": n, (numeric) Memory used by "
+            "block cache and memtables in bytes\n"
+            "    \"levels\": [                (json array) Non-empty levels\n"
+            "      {\n"
+            "        \"level\": n,            (numeric) Level number\n"
+            "        \"files\": n,            (numeric) Number of table files\n"
+            "        \"size_mb\": x.x,        (numeric) Size of the level\n"
+            "        \"compaction_time\": x.x, (numeric) Seconds spent "
+            "compacting into this level\n"
+            "        \"compaction_read_mb\": x.x, (numeric) Data read by "
+            "compactions\n"
+            "        \"compaction_write_mb\": x.x (numeric) Data written by "
+            "compactions\n"
+            "      }, ...\n"
+            "    ],\n"
+            "    \"compaction_read_mb\": x.x,  (numeric) Total over all "
+            "levels\n"
+            "    \"compaction_write_mb\": x.x, (numeric) Total over all "
+            "levels\n"
+            "    \"stats\": \"...\"             (string) Raw leveldb.stats "
+            "output\n"
+            "  },\n"
+            "  \"blockindex\": {...}          (json object) Block index "
+            "database, same fields as chainstate\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getdbstats", "") +
+            HelpExampleRpc("getdbstats", ""));
+    }
+
+    LOCK(cs_main);
+
+    UniValue ret(UniValue::VOBJ);
+    if (pcoinsdbview) {
+        ret.push_back(Pair("chainstate", DBStatsToJSON(pcoinsdbview->GetDB())));
+    }
+    if (pblocktree) {
+        ret.push_back(Pair("blockindex", DBStatsToJSON(*pblocktree)));
+    }
+    return ret;
+}
+
+UniValue getchainstatewarmupinfo(const Config &config,
+                                 const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 0) {
+        throw std::runtime_error(
+            "getchainstatewarmupinfo\n"
+            "\nReturns progress of the chainstate preload selected with "
+            "-preload.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"mode\": \"xxxx\",      (string) \"none\", \"vmtouch\" or "
+            "\"hotcoins\"\n"
+            "  \"state\": \"xxxx\",     (string) \"not started\", "
+            "\"running\", \"finished\", \"failed\" or \"canceled\"\n"
+            "  \"total\": n,          (numeric) Number of outpoints in the hot "
+            "coins profile\n"
+            "  \"processed\": n,      (numeric) Number of outpoints looked up "
+            "so far\n"
+            "  \"loaded\": n,         (numeric) Number of coins loaded into "
+            "the coins cache\n"
+            "  \"progress\": x.xxx,   (numeric) Fraction of the profile "
+            "processed\n"
+            "  \"duration_ms\": n     (numeric) Time spent preloading in "
+            "milliseconds\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getchainstatewarmupinfo", "") +
+            HelpExampleRpc("getchainstatewarmupinfo", ""));
+    }
+
+    CChainstateWarmupStatus status = GetChainstateWarmupStatus();
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("mode", ChainstateWarmupModeToString(status.mode)));
+    ret.push_back(Pair("state", status.state));
+    ret.push_back(Pair("total", status.nTotal));
+    ret.push_back(Pair("processed", status.nProcessed));
+    ret.push_back(Pair("loaded", status.nLoaded));
+    ret.push_back(Pair("progress",
+                       status.nTotal ? double(status.nProcessed) / status.nTotal
+                                     : 0.0));
+    ret.push_back(Pair("duration_ms", status.nDurationMillis));
+    return ret;
+}
+
 UniValue gettxout(const Config &config, const JSONRPCRequest &request) {
     if (request.fHelp || request.params.size() < 2 ||
         request.params.size() > 3) {
@@ -1792,6 +2121,26 @@ UniValue mempoolInfoToJSON(const Config& config) {
         Pair("mempoolminfee",
              ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK())));
 
+    if (g_connman) {
+        const auto& txValidator = g_connman->getTxnValidator();
+        const auto statsToJSON =
+            [](const CTxnValidator::ValidationStats& stats, bool fStd) {
+                UniValue obj(UniValue::VOBJ);
+                obj.push_back(Pair("txns", stats.nTxns));
+                obj.push_back(
+                    Pair("cputime", stats.nCPUTimeMicros * 0.001));
+                if (fStd) {
+                    obj.push_back(Pair("parked", stats.nParkedTxns));
+                }
+                return obj;
+            };
+        ret.push_back(Pair("stdtxnvalidation",
+                           statsToJSON(txValidator->GetStdValidationStats(), true)));
+        ret.push_back(
+            Pair("nonstdtxnvalidation",
+                 statsToJSON(txValidator->GetNonStdValidationStats(), false)));
+    }
+
     return ret;
 }
 
@@ -1814,8 +2163,23 @@ UniValue getmempoolinfo(const Config &config, const JSONRPCRequest &request) {
             "the non-final mempool\n"
             "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage "
             "for the mempool\n"
-            "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee for tx to "
+            "  \"mempoolminfee\": xxxxx,      (numeric) Minimum fee for tx to "
             "be accepted\n"
+            "  \"stdtxnvalidation\": {       (json object) Validation of "
+            "standard priority transactions\n"
+            "    \"txns\": xxxxx,             (numeric) Validated transactions\n"
+            "    \"cputime\": x.xxx,          (numeric) CPU time in "
+            "milliseconds spent validating them\n"
+            "    \"parked\": xxxxx            (numeric) Transactions moved to "
+            "the non-standard queue because they exceeded the validation time "
+            "or -maxstdtxscriptcost\n"
+            "  },\n"
+            "  \"nonstdtxnvalidation\": {    (json object) Validation of "
+            "non-standard priority transactions\n"
+            "    \"txns\": xxxxx,             (numeric) Validated transactions\n"
+            "    \"cputime\": x.xxx           (numeric) CPU time in "
+            "milliseconds spent validating them\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getmempoolinfo", "") +
@@ -2500,13 +2864,32 @@ UniValue checkjournal(const Config &config, const JSONRPCRequest &request) {
                                  "True if check passed, False otherwise\n"
                                  "  \"errors\": xxxxx,             (string) If "
                                  "check failed, a string listing the errors\n"
+                                 "  \"checktime\": xxxxx,          (numeric) "
+                                 "Time taken by the check in microseconds\n"
+                                 "  \"lastreorg\": {               (json "
+                                 "object) The last reorg applied to the "
+                                 "journal\n"
+                                 "    \"time\": xxxxx,             (numeric) "
+                                 "When it was applied, in seconds since epoch "
+                                 "(0 if there was none)\n"
+                                 "    \"txns\": xxxxx,             (numeric) "
+                                 "Number of transactions it returned to the "
+                                 "journal\n"
+                                 "    \"duration\": xxxxx,         (numeric) "
+                                 "Time taken to apply it in microseconds\n"
+                                 "    \"errors\": xxxxx,           (numeric) "
+                                 "Number of transactions it placed ahead of "
+                                 "one of their parents\n"
+                                 "  }\n"
                                  "}\n"
                                  "\nExamples:\n" +
                                  HelpExampleCli("checkjournal", "") +
                                  HelpExampleRpc("checkjournal", ""));
     }
 
+    int64_t nStart = GetTimeMicros();
     std::string checkResult{mempool.CheckJournal()};
+    int64_t nCheckTime = GetTimeMicros() - nStart;
 
     UniValue result{UniValue::VOBJ};
     if (checkResult.empty()) {
@@ -2515,6 +2898,17 @@ UniValue checkjournal(const Config &config, const JSONRPCRequest &request) {
         result.push_back(Pair("ok", false));
         result.push_back(Pair("errors", checkResult));
     }
+    result.push_back(Pair("checktime", nCheckTime));
+
+    mining::CJournal::ReorgStats reorg{mempool.getJournalBuilder()
+                                           .getCurrentJournal()
+                                           ->getLastReorgStats()};
+    UniValue lastReorg{UniValue::VOBJ};
+    lastReorg.push_back(Pair("time", reorg.mTime));
+    lastReorg.push_back(Pair("txns", uint64_t(reorg.mNumTxns)));
+    lastReorg.push_back(Pair("duration", reorg.mDurationMicros));
+    lastReorg.push_back(Pair("errors", uint64_t(reorg.mNumErrors)));
+    result.push_back(Pair("lastreorg", lastReorg));
 
     return result;
 }
@@ -2679,6 +3073,10 @@ static const CRPCCommand commands[] = {
     { "blockchain",         "getrawnonfinalmempool",  getrawnonfinalmempool,  true,  {} },
     { "blockchain",         "gettxout",               gettxout,               true,  {"txid","n","include_mempool"} },
     { "blockchain",         "gettxoutsetinfo",        gettxoutsetinfo,        true,  {} },
+    { "blockchain",         "dumptxoutset",           dumptxoutset,           true,  {"path"} },
+    { "blockchain",         "loadtxoutset",           loadtxoutset,           true,  {"path","threads"} },
+    { "blockchain",         "getdbstats",             getdbstats,             true,  {} },
+    { "blockchain",         "getchainstatewarmupinfo", getchainstatewarmupinfo, true, {} },
     { "blockchain",         "pruneblockchain",        pruneblockchain,        true,  {"height"} },
     { "blockchain",         "verifychain",            verifychain,            true,  {"checklevel","nblocks"} },
     { "blockchain",         "preciousblock",          preciousblock,          true,  {"blockhash"} },
@@ -97,6 +97,8 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"fundrawtransaction", 1, "options"},
     {"gettxout", 1, "n"},
     {"gettxout", 2, "include_mempool"},
+    {"loadtxoutset", 1, "threads"},
+    {"setverificationcachesize", 1, "size"},
     {"gettxoutproof", 0, "txids"},
     {"lockunspent", 0, "unlock"},
     {"lockunspent", 1, "transactions"},
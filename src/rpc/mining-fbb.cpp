@@ -113,8 +113,8 @@ CMiningCandidateRef mkblocktemplate(const Config& config, bool coinbaseRequired)
     UpdateTime(pblock, config, pindexPrev);
     pblock->nNonce = 0;
 
-    // Create candidate and return it
-    CMiningCandidateRef candidate  { mining::CMiningFactory::GetCandidateManager().Create(blockref) };
+    // Create candidate, or share the one already created for this block, and return it
+    CMiningCandidateRef candidate  { mining::CMiningFactory::GetCandidateManager().GetOrCreate(blockref) };
     return candidate;
 }
 
@@ -185,9 +185,8 @@ UniValue MkMiningCandidateJson(bool coinbaseRequired, CMiningCandidateRef &candi
     ret.push_back(Pair("sizeWithoutCoinbase", static_cast<uint64_t>(block->GetSizeWithoutCoinbase())));
 
     // merkleProof:
-    std::vector<uint256> brancharr = GetMerkleProofBranches(block);
     UniValue merkleProof(UniValue::VARR);
-    for (const auto &i : brancharr)
+    for (const auto &i : candidate->GetMerkleProof())
     {
         merkleProof.push_back(i.GetHex());
     }
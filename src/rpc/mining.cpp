@@ -20,7 +20,9 @@
 #include "primitives/transaction.h"
 #include "pow.h"
 #include "rpc/blockchain.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/server.h"
+#include "rpc/text_writer.h"
 #include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -31,6 +33,7 @@
 
 #include <cstdint>
 #include <memory>
+#include <unordered_map>
 
 using mining::CBlockTemplate;
 
@@ -336,122 +339,21 @@ static UniValue BIP22ValidationResult(const Config &config,
     return "valid?";
 }
 
-static UniValue getblocktemplate(const Config &config,
-                                 const JSONRPCRequest &request) {
-    if (request.fHelp || request.params.size() > 1) {
-        throw std::runtime_error(
-            "getblocktemplate ( TemplateRequest )\n"
-            "\nIf the request parameters include a 'mode' key, that is used to "
-            "explicitly select between the default 'template' request or a "
-            "'proposal'.\n"
-            "It returns data needed to construct a block to work on.\n"
-            "For full specification, see BIPs 22, 23, 9, and 145:\n"
-            "    "
-            "https://github.com/bitcoin/bips/blob/master/bip-0022.mediawiki\n"
-            "    "
-            "https://github.com/bitcoin/bips/blob/master/bip-0023.mediawiki\n"
-            "    "
-            "https://github.com/bitcoin/bips/blob/master/"
-            "bip-0009.mediawiki#getblocktemplate_changes\n"
-            "    "
-            "https://github.com/bitcoin/bips/blob/master/bip-0145.mediawiki\n"
-
-            "\nArguments:\n"
-            "1. template_request         (json object, optional) A json object "
-            "in the following spec\n"
-            "     {\n"
-            "       \"mode\":\"template\"    (string, optional) This must be "
-            "set to \"template\", \"proposal\" (see BIP 23), or omitted\n"
-            "       \"capabilities\":[     (array, optional) A list of "
-            "strings\n"
-            "           \"support\"          (string) client side supported "
-            "feature, 'longpoll', 'coinbasetxn', 'coinbasevalue', 'proposal', "
-            "'serverlist', 'workid'\n"
-            "           ,...\n"
-            "       ]\n"
-            "     }\n"
-            "\n"
-
-            "\nResult:\n"
-            "{\n"
-            "  \"version\" : n,                    (numeric) The preferred "
-            "block version\n"
-            "  \"previousblockhash\" : \"xxxx\",     (string) The hash of "
-            "current highest block\n"
-            "  \"transactions\" : [                (array) contents of "
-            "non-coinbase transactions that should be included in the next "
-            "block\n"
-            "      {\n"
-            "         \"data\" : \"xxxx\",             (string) transaction "
-            "data encoded in hexadecimal (byte-for-byte)\n"
-            "         \"txid\" : \"xxxx\",             (string) transaction id "
-            "encoded in little-endian hexadecimal\n"
-            "         \"hash\" : \"xxxx\",             (string) hash encoded "
-            "in little-endian hexadecimal (including witness data)\n"
-            "         \"depends\" : [                (array) array of numbers "
-            "\n"
-            "             n                          (numeric) transactions "
-            "before this one (by 1-based index in 'transactions' list) that "
-            "must be present in the final block if this one is\n"
-            "             ,...\n"
-            "         ],\n"
-            "         \"fee\": n,                    (numeric) difference in "
-            "value between transaction inputs and outputs (in Satoshis); for "
-            "coinbase transactions, this is a negative Number of the total "
-            "collected block fees (ie, not including the block subsidy); if "
-            "key is not present, fee is unknown and clients MUST NOT assume "
-            "there isn't one\n"
-            "         \"sigops\" : n,                (numeric) total SigOps "
-            "cost, as counted for purposes of block limits; if key is not "
-            "present, sigop cost is unknown and clients MUST NOT assume it is "
-            "zero\n"
-            "         \"required\" : true|false      (boolean) if provided and "
-            "true, this transaction must be in the final block\n"
-            "      }\n"
-            "      ,...\n"
-            "  ],\n"
-            "  \"coinbaseaux\" : {                 (json object) data that "
-            "should be included in the coinbase's scriptSig content\n"
-            "      \"flags\" : \"xx\"                  (string) key name is to "
-            "be ignored, and value included in scriptSig\n"
-            "  },\n"
-            "  \"coinbasevalue\" : n,              (numeric) maximum allowable "
-            "input to coinbase transaction, including the generation award and "
-            "transaction fees (in Satoshis)\n"
-            "  \"coinbasetxn\" : { ... },          (json object) information "
-            "for coinbase transaction\n"
-            "  \"target\" : \"xxxx\",                (string) The hash target\n"
-            "  \"mintime\" : xxx,                  (numeric) The minimum "
-            "timestamp appropriate for next block time in seconds since epoch "
-            "(Jan 1 1970 GMT)\n"
-            "  \"mutable\" : [                     (array of string) list of "
-            "ways the block template may be changed \n"
-            "     \"value\"                          (string) A way the block "
-            "template may be changed, e.g. 'time', 'transactions', "
-            "'prevblock'\n"
-            "     ,...\n"
-            "  ],\n"
-            "  \"noncerange\" : \"00000000ffffffff\",(string) A range of valid "
-            "nonces\n"
-            "  \"sigoplimit\" : n,                 (numeric) limit of sigops "
-            "in blocks\n"
-            "  \"sizelimit\" : n,                  (numeric) limit of block "
-            "size\n"
-            "  \"curtime\" : ttt,                  (numeric) current timestamp "
-            "in seconds since epoch (Jan 1 1970 GMT)\n"
-            "  \"bits\" : \"xxxxxxxx\",              (string) compressed "
-            "target of next block\n"
-            "  \"height\" : n                      (numeric) The height of the "
-            "next block\n"
-            "}\n"
-
-            "\nExamples:\n" +
-            HelpExampleCli("getblocktemplate", "") +
-            HelpExampleRpc("getblocktemplate", ""));
-    }
-
+void getblocktemplate(const Config &config, const JSONRPCRequest &request,
+                      CTextWriter &textWriter, bool processedInBatch,
+                      std::function<void()> httpCallback) {
     LOCK(cs_main);
 
+    // Results other than a template are written out in one go
+    auto writeResult = [&](const UniValue &result) {
+        if (!processedInBatch) {
+            httpCallback();
+        }
+        textWriter.Write("{\"result\": " + result.write() + ", \"error\": " +
+                         NullUniValue.write() + ", \"id\": " +
+                         request.id.write() + "}");
+    };
+
     std::string strMode = "template";
     UniValue lpval = NullUniValue;
     std::set<std::string> setClientRules;
@@ -485,25 +387,25 @@ static UniValue getblocktemplate(const Config &config,
             if (mi != mapBlockIndex.end()) {
                 CBlockIndex *pindex = mi->second;
                 if (pindex->IsValid(BlockValidity::SCRIPTS)) {
-                    return "duplicate";
+                    return writeResult("duplicate");
                 }
                 if (pindex->nStatus.isInvalid()) {
-                    return "duplicate-invalid";
+                    return writeResult("duplicate-invalid");
                 }
-                return "duplicate-inconclusive";
+                return writeResult("duplicate-inconclusive");
             }
 
             CBlockIndex *const pindexPrev = chainActive.Tip();
             // TestBlockValidity only supports blocks built on the current Tip
             if (block.hashPrevBlock != pindexPrev->GetBlockHash()) {
-                return "inconclusive-not-best-prevblk";
+                return writeResult("inconclusive-not-best-prevblk");
             }
             CValidationState state;
             BlockValidationOptions validationOptions =
                 BlockValidationOptions(false, true);
             TestBlockValidity(config, state, block, pindexPrev,
                               validationOptions);
-            return BIP22ValidationResult(config, state);
+            return writeResult(BIP22ValidationResult(config, state));
         }
     }
 
@@ -612,83 +514,222 @@ static UniValue getblocktemplate(const Config &config,
     UpdateTime(pblock, config, pindexPrev);
     pblock->nNonce = 0;
 
-    UniValue aCaps(UniValue::VARR);
-    aCaps.push_back("proposal");
+    arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
+    auto defaultmaxBlockSize = config.GetChainParams().GetDefaultBlockSizeParams().maxGeneratedBlockSizeAfter;
+
+    if (!processedInBatch) {
+        httpCallback();
+    }
 
-    UniValue transactions(UniValue::VARR);
-    std::map<uint256, int64_t> setTxIndex;
-    int i = 0;
-    for (const auto &it : pblock->vtx) {
-        const CTransaction &tx = *it;
-        uint256 txId = tx.GetId();
-        setTxIndex[txId] = i++;
+    // Transactions are written out one at a time as we go, so the response
+    // never has to be held in memory as a whole.
+    textWriter.Write("{\"result\": ");
+    CJSONWriter jWriter(textWriter, false);
+    jWriter.writeBeginObject();
+
+    jWriter.writeBeginArray("capabilities");
+    jWriter.pushV("proposal", false);
+    jWriter.writeEndArray();
+    jWriter.pushKV("version", pblock->nVersion);
+    jWriter.pushKV("previousblockhash", pblock->hashPrevBlock.GetHex());
+
+    jWriter.writeBeginArray("transactions");
+    std::unordered_map<TxId, int64_t, SaltedTxidHasher> setTxIndex;
+    setTxIndex.reserve(pblock->vtx.size());
+    for (size_t i = 0; i < pblock->vtx.size(); ++i) {
+        const CTransaction &tx = *pblock->vtx[i];
+        TxId txId = tx.GetId();
+        setTxIndex[txId] = i;
 
         if (tx.IsCoinBase()) {
             continue;
         }
 
-        UniValue entry(UniValue::VOBJ);
+        jWriter.writeBeginObject();
 
-        entry.push_back(Pair("data", EncodeHexTx(tx)));
-        entry.push_back(Pair("txid", txId.GetHex()));
-        entry.push_back(Pair("hash", tx.GetHash().GetHex()));
+        jWriter.pushK("data");
+        jWriter.pushQuote(true, false);
+        EncodeHexTx(tx, jWriter.getWriter());
+        jWriter.pushQuote(false);
+        jWriter.pushKV("txid", txId.GetHex());
+        jWriter.pushKV("hash", tx.GetHash().GetHex());
 
-        UniValue deps(UniValue::VARR);
+        jWriter.writeBeginArray("depends");
+        std::string delimiter;
         for (const CTxIn &in : tx.vin) {
-            if (setTxIndex.count(in.prevout.GetTxId())) {
-                deps.push_back(setTxIndex[in.prevout.GetTxId()]);
+            auto it = setTxIndex.find(in.prevout.GetTxId());
+            if (it != setTxIndex.end()) {
+                jWriter.getWriter().Write(delimiter + i64tostr(it->second));
+                delimiter = ",";
             }
         }
-        entry.push_back(Pair("depends", deps));
+        jWriter.writeEndArray();
 
-        int index_in_template = i - 1;
-        entry.push_back(Pair(
-            "fee", pblocktemplate->vTxFees[index_in_template].GetSatoshis()));
-        int64_t nTxSigOps = pblocktemplate->vTxSigOpsCount[index_in_template];
-        entry.push_back(Pair("sigops", nTxSigOps));
+        jWriter.pushKV("fee", pblocktemplate->vTxFees[i].GetSatoshis());
+        jWriter.pushKV("sigops", pblocktemplate->vTxSigOpsCount[i], false);
 
-        transactions.push_back(entry);
+        jWriter.writeEndObject(i < pblock->vtx.size() - 1);
     }
+    jWriter.writeEndArray();
 
-    UniValue aux(UniValue::VOBJ);
-    aux.push_back(
-        Pair("flags", HexStr(COINBASE_FLAGS.begin(), COINBASE_FLAGS.end())));
+    jWriter.writeBeginObject("coinbaseaux");
+    jWriter.pushKV("flags", HexStr(COINBASE_FLAGS.begin(), COINBASE_FLAGS.end()),
+                   false);
+    jWriter.writeEndObject();
 
-    arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
+    jWriter.pushKV("coinbasevalue",
+                   pblock->vtx[0]->vout[0].nValue.GetSatoshis());
+    jWriter.pushKV("longpollid", chainActive.Tip()->GetBlockHash().GetHex() +
+                                     i64tostr(nTransactionsUpdatedLast));
+    jWriter.pushKV("target", hashTarget.GetHex());
+    jWriter.pushKV("mintime", pindexPrev->GetMedianTimePast() + 1);
 
-    UniValue aMutable(UniValue::VARR);
-    aMutable.push_back("time");
-    aMutable.push_back("transactions");
-    aMutable.push_back("prevblock");
-
-    UniValue result(UniValue::VOBJ);
-    result.push_back(Pair("capabilities", aCaps));
-    result.push_back(Pair("version", pblock->nVersion));
-    result.push_back(Pair("previousblockhash", pblock->hashPrevBlock.GetHex()));
-    result.push_back(Pair("transactions", transactions));
-    result.push_back(Pair("coinbaseaux", aux));
-    result.push_back(
-        Pair("coinbasevalue",
-             (int64_t)pblock->vtx[0]->vout[0].nValue.GetSatoshis()));
-    result.push_back(Pair("longpollid",
-                          chainActive.Tip()->GetBlockHash().GetHex() +
-                              i64tostr(nTransactionsUpdatedLast)));
-    result.push_back(Pair("target", hashTarget.GetHex()));
-    result.push_back(
-        Pair("mintime", (int64_t)pindexPrev->GetMedianTimePast() + 1));
-    result.push_back(Pair("mutable", aMutable));
-    result.push_back(Pair("noncerange", "00000000ffffffff"));
+    jWriter.writeBeginArray("mutable");
+    jWriter.pushV("time");
+    jWriter.pushV("transactions");
+    jWriter.pushV("prevblock", false);
+    jWriter.writeEndArray();
+    jWriter.pushKV("noncerange", "00000000ffffffff");
 
-    auto defaultmaxBlockSize = config.GetChainParams().GetDefaultBlockSizeParams().maxGeneratedBlockSizeAfter;
     // FIXME: Allow for mining block greater than 1M.
-    result.push_back(
-        Pair("sigoplimit", INT64_MAX));
-    result.push_back(Pair("sizelimit", defaultmaxBlockSize));
-    result.push_back(Pair("curtime", pblock->GetBlockTime()));
-    result.push_back(Pair("bits", strprintf("%08x", pblock->nBits)));
-    result.push_back(Pair("height", (int64_t)(pindexPrev->nHeight + 1)));
-
-    return result;
+    jWriter.pushKV("sigoplimit", INT64_MAX);
+    jWriter.pushKV("sizelimit", static_cast<int64_t>(defaultmaxBlockSize));
+    jWriter.pushKV("curtime", pblock->GetBlockTime());
+    jWriter.pushKV("bits", strprintf("%08x", pblock->nBits));
+    jWriter.pushKV("height", static_cast<int64_t>(pindexPrev->nHeight + 1),
+                   false);
+
+    jWriter.writeEndObject(false);
+    jWriter.flush();
+
+    textWriter.Write(", \"error\": " + NullUniValue.write() +
+                     ", \"id\": " + request.id.write() + "}");
+}
+
+static void getblocktemplate(const Config &config,
+                             const JSONRPCRequest &request,
+                             HTTPRequest &httpReq, bool processedInBatch) {
+    if (request.fHelp || request.params.size() > 1) {
+        throw std::runtime_error(
+            "getblocktemplate ( TemplateRequest )\n"
+            "\nIf the request parameters include a 'mode' key, that is used to "
+            "explicitly select between the default 'template' request or a "
+            "'proposal'.\n"
+            "It returns data needed to construct a block to work on.\n"
+            "For full specification, see BIPs 22, 23, 9, and 145:\n"
+            "    "
+            "https://github.com/bitcoin/bips/blob/master/bip-0022.mediawiki\n"
+            "    "
+            "https://github.com/bitcoin/bips/blob/master/bip-0023.mediawiki\n"
+            "    "
+            "https://github.com/bitcoin/bips/blob/master/"
+            "bip-0009.mediawiki#getblocktemplate_changes\n"
+            "    "
+            "https://github.com/bitcoin/bips/blob/master/bip-0145.mediawiki\n"
+
+            "\nArguments:\n"
+            "1. template_request         (json object, optional) A json object "
+            "in the following spec\n"
+            "     {\n"
+            "       \"mode\":\"template\"    (string, optional) This must be "
+            "set to \"template\", \"proposal\" (see BIP 23), or omitted\n"
+            "       \"capabilities\":[     (array, optional) A list of "
+            "strings\n"
+            "           \"support\"          (string) client side supported "
+            "feature, 'longpoll', 'coinbasetxn', 'coinbasevalue', 'proposal', "
+            "'serverlist', 'workid'\n"
+            "           ,...\n"
+            "       ]\n"
+            "     }\n"
+            "\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"version\" : n,                    (numeric) The preferred "
+            "block version\n"
+            "  \"previousblockhash\" : \"xxxx\",     (string) The hash of "
+            "current highest block\n"
+            "  \"transactions\" : [                (array) contents of "
+            "non-coinbase transactions that should be included in the next "
+            "block\n"
+            "      {\n"
+            "         \"data\" : \"xxxx\",             (string) transaction "
+            "data encoded in hexadecimal (byte-for-byte)\n"
+            "         \"txid\" : \"xxxx\",             (string) transaction id "
+            "encoded in little-endian hexadecimal\n"
+            "         \"hash\" : \"xxxx\",             (string) hash encoded "
+            "in little-endian hexadecimal (including witness data)\n"
+            "         \"depends\" : [                (array) array of numbers "
+            "\n"
+            "             n                          (numeric) transactions "
+            "before this one (by 1-based index in 'transactions' list) that "
+            "must be present in the final block if this one is\n"
+            "             ,...\n"
+            "         ],\n"
+            "         \"fee\": n,                    (numeric) difference in "
+            "value between transaction inputs and outputs (in Satoshis); for "
+            "coinbase transactions, this is a negative Number of the total "
+            "collected block fees (ie, not including the block subsidy); if "
+            "key is not present, fee is unknown and clients MUST NOT assume "
+            "there isn't one\n"
+            "         \"sigops\" : n,                (numeric) total SigOps "
+            "cost, as counted for purposes of block limits; if key is not "
+            "present, sigop cost is unknown and clients MUST NOT assume it is "
+            "zero\n"
+            "         \"required\" : true|false      (boolean) if provided and "
+            "true, this transaction must be in the final block\n"
+            "      }\n"
+            "      ,...\n"
+            "  ],\n"
+            "  \"coinbaseaux\" : {                 (json object) data that "
+            "should be included in the coinbase's scriptSig content\n"
+            "      \"flags\" : \"xx\"                  (string) key name is to "
+            "be ignored, and value included in scriptSig\n"
+            "  },\n"
+            "  \"coinbasevalue\" : n,              (numeric) maximum allowable "
+            "input to coinbase transaction, including the generation award and "
+            "transaction fees (in Satoshis)\n"
+            "  \"coinbasetxn\" : { ... },          (json object) information "
+            "for coinbase transaction\n"
+            "  \"target\" : \"xxxx\",                (string) The hash target\n"
+            "  \"mintime\" : xxx,                  (numeric) The minimum "
+            "timestamp appropriate for next block time in seconds since epoch "
+            "(Jan 1 1970 GMT)\n"
+            "  \"mutable\" : [                     (array of string) list of "
+            "ways the block template may be changed \n"
+            "     \"value\"                          (string) A way the block "
+            "template may be changed, e.g. 'time', 'transactions', "
+            "'prevblock'\n"
+            "     ,...\n"
+            "  ],\n"
+            "  \"noncerange\" : \"00000000ffffffff\",(string) A range of valid "
+            "nonces\n"
+            "  \"sigoplimit\" : n,                 (numeric) limit of sigops "
+            "in blocks\n"
+            "  \"sizelimit\" : n,                  (numeric) limit of block "
+            "size\n"
+            "  \"curtime\" : ttt,                  (numeric) current timestamp "
+            "in seconds since epoch (Jan 1 1970 GMT)\n"
+            "  \"bits\" : \"xxxxxxxx\",              (string) compressed "
+            "target of next block\n"
+            "  \"height\" : n                      (numeric) The height of the "
+            "next block\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getblocktemplate", "") +
+            HelpExampleRpc("getblocktemplate", ""));
+    }
+
+    CHttpTextWriter httpWriter(httpReq);
+    getblocktemplate(config, request, httpWriter, processedInBatch, [&httpReq] {
+        httpReq.WriteHeader("Content-Type", "application/json");
+        httpReq.StartWritingChunks(HTTP_OK);
+    });
+    httpWriter.Flush();
+    if (!processedInBatch) {
+        httpReq.StopWritingChunks();
+    }
 }
 
 class submitblock_StateCatcher : public CValidationInterface {
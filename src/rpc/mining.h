@@ -14,6 +14,8 @@
 class Config;
 class CBlock;
 class CReserveScript;
+class CTextWriter;
+class JSONRPCRequest;
 
 /** Generate blocks (mine) */
 UniValue generateBlocks(const Config& config,
@@ -24,4 +26,11 @@ UniValue processBlock(const Config& config,
 	const std::shared_ptr<CBlock>& block,
 	std::function<bool(const Config&, const std::shared_ptr<CBlock>&)> performBlockOperation);
 
+/** Write the response to getblocktemplate, calling httpCallback before the first output */
+void getblocktemplate(const Config& config,
+                      const JSONRPCRequest& request,
+                      CTextWriter& textWriter,
+                      bool processedInBatch,
+                      std::function<void()> httpCallback);
+
 #endif
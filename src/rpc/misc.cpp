@@ -14,6 +14,9 @@
 #include "policy/policy.h"
 #include "rpc/blockchain.h"
 #include "rpc/server.h"
+#include "script/compiled_script.h"
+#include "script/scriptcache.h"
+#include "script/sigcache.h"
 #include "timedata.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -656,6 +659,151 @@ static UniValue getmemoryinfo(const Config &config,
     return obj;
 }
 
+static UniValue CacheStatsToJSON(const CuckooCache::stats &stats) {
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("size", uint64_t(stats.size)));
+    obj.push_back(Pair("bytes", uint64_t(stats.size) * sizeof(uint256)));
+    obj.push_back(Pair("entries", uint64_t(stats.live)));
+    obj.push_back(Pair("occupancy",
+                       stats.size ? double(stats.live) / stats.size : 0.0));
+    obj.push_back(Pair("hits", stats.hits));
+    obj.push_back(Pair("misses", stats.misses));
+    uint64_t lookups = stats.hits + stats.misses;
+    obj.push_back(Pair("hitrate", lookups ? double(stats.hits) / lookups : 0.0));
+    obj.push_back(Pair("inserts", stats.inserts));
+    obj.push_back(Pair("evictions", stats.evictions));
+    return obj;
+}
+
+static UniValue
+CompiledScriptCacheStatsToJSON(const CCompiledScriptCache::Stats &stats) {
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("bytes", uint64_t(stats.nMemoryUsage)));
+    obj.push_back(Pair("maxbytes", uint64_t(stats.nMaxMemoryUsage)));
+    obj.push_back(Pair("entries", uint64_t(stats.nEntries)));
+    obj.push_back(Pair("hits", stats.nHits));
+    obj.push_back(Pair("misses", stats.nMisses));
+    uint64_t lookups = stats.nHits + stats.nMisses;
+    obj.push_back(
+        Pair("hitrate", lookups ? double(stats.nHits) / lookups : 0.0));
+    obj.push_back(Pair("inserts", stats.nInserts));
+    obj.push_back(Pair("evictions", stats.nEvictions));
+    return obj;
+}
+
+static UniValue getverificationcacheinfo(const Config &config,
+                                         const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 0) {
+        throw std::runtime_error(
+            "getverificationcacheinfo\n"
+            "Returns usage statistics of the signature and script execution "
+            "caches.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"sigcache\": {             (json object) Valid signature "
+            "cache\n"
+            "    \"size\": xxxxx,          (numeric) Number of slots\n"
+            "    \"bytes\": xxxxx,         (numeric) Memory used by the "
+            "slots\n"
+            "    \"entries\": xxxxx,       (numeric) Number of slots holding "
+            "entries that are not marked for erasure\n"
+            "    \"occupancy\": x.xxx,     (numeric) entries / size\n"
+            "    \"hits\": xxxxx,          (numeric) Lookups that found an "
+            "entry\n"
+            "    \"misses\": xxxxx,        (numeric) Lookups that didn't find "
+            "an entry\n"
+            "    \"hitrate\": x.xxx,       (numeric) hits / (hits + misses)\n"
+            "    \"inserts\": xxxxx,       (numeric) Number of inserts\n"
+            "    \"evictions\": xxxxx      (numeric) Inserts that had to drop "
+            "a live entry\n"
+            "  },\n"
+            "  \"invalidsigcache\": {...}, (json object) Invalid signature "
+            "cache\n"
+            "  \"scriptcache\": {...},     (json object) Script execution "
+            "cache\n"
+            "  \"compiledscriptcache\": {  (json object) Cache of decoded "
+            "scripts\n"
+            "    \"bytes\": xxxxx,         (numeric) Memory used by the "
+            "cached scripts\n"
+            "    \"maxbytes\": xxxxx,      (numeric) Memory limit, 0 if the "
+            "cache is disabled\n"
+            "    \"entries\": xxxxx,       (numeric) Number of cached scripts\n"
+            "    \"hits\": xxxxx,          (numeric) Lookups that found a "
+            "script\n"
+            "    \"misses\": xxxxx,        (numeric) Lookups that had to "
+            "decode the script\n"
+            "    \"hitrate\": x.xxx,       (numeric) hits / (hits + misses)\n"
+            "    \"inserts\": xxxxx,       (numeric) Number of inserts\n"
+            "    \"evictions\": xxxxx      (numeric) Least recently used "
+            "scripts dropped to stay within the limit\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getverificationcacheinfo", "") +
+            HelpExampleRpc("getverificationcacheinfo", ""));
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("sigcache", CacheStatsToJSON(GetSignatureCacheStats())));
+    obj.push_back(Pair("invalidsigcache",
+                       CacheStatsToJSON(GetInvalidSignatureCacheStats())));
+    obj.push_back(
+        Pair("scriptcache", CacheStatsToJSON(GetScriptExecutionCacheStats())));
+    obj.push_back(Pair("compiledscriptcache",
+                       CompiledScriptCacheStatsToJSON(
+                           GetCompiledScriptCache().GetStats())));
+    return obj;
+}
+
+static UniValue setverificationcachesize(const Config &config,
+                                         const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 2) {
+        throw std::runtime_error(
+            "setverificationcachesize \"cache\" size\n"
+            "Resizes a signature, script execution or compiled script cache "
+            "without restarting the node. Entries are rehashed into the new "
+            "table; when shrinking, the most recently inserted entries are "
+            "kept. The compiled script cache keeps the most recently used "
+            "scripts and is disabled with size 0.\n"
+            "\nArguments:\n"
+            "1. \"cache\"     (string, required) \"sigcache\", "
+            "\"invalidsigcache\", \"scriptcache\" or \"compiledscriptcache\"\n"
+            "2. size         (numeric, required) New size in MiB\n"
+            "\nResult:\n"
+            "{...}          (json object) Statistics of the resized cache as "
+            "returned by getverificationcacheinfo\n"
+            "\nExamples:\n" +
+            HelpExampleCli("setverificationcachesize", "\"sigcache\" 256") +
+            HelpExampleRpc("setverificationcachesize", "\"sigcache\", 256"));
+    }
+
+    const std::string cache = request.params[0].get_str();
+    const int64_t nSize = request.params[1].get_int64();
+    if (nSize < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Size must not be negative");
+    }
+    const size_t nBytes = static_cast<size_t>(nSize) * ONE_MEBIBYTE;
+
+    if (cache == "sigcache") {
+        ResizeSignatureCache(nBytes);
+        return CacheStatsToJSON(GetSignatureCacheStats());
+    }
+    if (cache == "invalidsigcache") {
+        ResizeInvalidSignatureCache(nBytes);
+        return CacheStatsToJSON(GetInvalidSignatureCacheStats());
+    }
+    if (cache == "scriptcache") {
+        ResizeScriptExecutionCache(nBytes);
+        return CacheStatsToJSON(GetScriptExecutionCacheStats());
+    }
+    if (cache == "compiledscriptcache") {
+        GetCompiledScriptCache().Configure(nBytes, MIN_COMPILED_SCRIPT_SIZE);
+        return CompiledScriptCacheStatsToJSON(
+            GetCompiledScriptCache().GetStats());
+    }
+    throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown cache " + cache);
+}
+
 static UniValue echo(const Config &config, const JSONRPCRequest &request) {
     if (request.fHelp) {
         throw std::runtime_error(
@@ -676,6 +824,8 @@ static const CRPCCommand commands[] = {
     //  ------------------- ------------------------  ----------------------  ----------
     { "control",            "getinfo",                getinfo,                true,  {} }, /* uses wallet if enabled */
     { "control",            "getmemoryinfo",          getmemoryinfo,          true,  {} },
+    { "control",            "getverificationcacheinfo", getverificationcacheinfo, true, {} },
+    { "control",            "setverificationcachesize", setverificationcachesize, true, {"cache","size"} },
     { "util",               "validateaddress",        validateaddress,        true,  {"address"} }, /* uses wallet if enabled */
     { "util",               "createmultisig",         createmultisig,         true,  {"nrequired","keys"} },
     { "util",               "verifymessage",          verifymessage,          true,  {"address","signature","message"} },
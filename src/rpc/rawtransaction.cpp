@@ -20,12 +20,13 @@
 #include "rpc/server.h"
 #include "rpc/tojson.h"
 #include "script/script_error.h"
+#include "script/scriptprofile.h"
 #include "script/sign.h"
 #include "script/standard.h"
-#include "taskcancellation.h"
 #include "txmempool.h"
 #include "txn_validator.h"
 #include "uint256.h"
+#include "util.h"
 #include "utilstrencodings.h"
 #include "validation.h"
 #ifdef ENABLE_WALLET
@@ -724,6 +725,119 @@ static UniValue decodescript(const Config &config,
     return r;
 }
 
+static UniValue ScriptProfileToJSON(const ScriptProfile &profile,
+                                    int64_t nTimeMicros) {
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("time", nTimeMicros * 0.001));
+    result.push_back(Pair("opcodes", profile.nOpcodes));
+    result.push_back(Pair("hashedbytes", profile.nHashedBytes));
+    result.push_back(Pair("sigchecks", profile.nSigChecks));
+    result.push_back(Pair("bignumops", profile.nBigNumOps));
+    return result;
+}
+
+static UniValue TxScriptProfileToJSON(const CTxScriptProfile &profile,
+                                      bool fInputs) {
+    UniValue result =
+        ScriptProfileToJSON(profile.GetTotal(), profile.GetTotalTimeMicros());
+    result.push_back(Pair("txid", profile.txid.GetHex()));
+    if (!fInputs) {
+        result.push_back(Pair("inputs", uint64_t(profile.inputs.size())));
+        return result;
+    }
+
+    UniValue inputs(UniValue::VARR);
+    for (const CInputScriptProfile &input : profile.inputs) {
+        UniValue entry = ScriptProfileToJSON(input.profile, input.nTimeMicros);
+        entry.push_back(Pair("verified", input.fVerified));
+        entry.push_back(Pair("valid", input.fValid));
+        if (input.fVerified && !input.fValid) {
+            entry.push_back(Pair("error", ScriptErrorString(input.error)));
+        }
+        inputs.push_back(entry);
+    }
+    result.push_back(Pair("inputs", inputs));
+    return result;
+}
+
+static UniValue getscriptprofile(const Config &config,
+                                 const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() > 1) {
+        throw std::runtime_error(
+            "getscriptprofile ( \"txid\" )\n"
+            "\nWithout arguments, returns the transactions whose scripts took "
+            "the longest to verify during mempool acceptance and block "
+            "connection. The number of logged transactions is set with "
+            "-slowscriptlogsize.\n"
+            "With a txid, verifies the scripts of the transaction again with "
+            "profiling enabled. The transaction must be in the mempool or in "
+            "the active chain (requires -txindex or an unspent output in the "
+            "same transaction). Signatures are verified without the signature "
+            "cache.\n"
+            "\nArguments:\n"
+            "1. \"txid\"      (string, optional) The transaction id\n"
+            "\nResult (without txid):\n"
+            "[\n"
+            "  {\n"
+            "    \"time\" : x.xxx,        (numeric) Time spent verifying "
+            "the scripts in milliseconds\n"
+            "    \"opcodes\" : n,         (numeric) Number of executed "
+            "opcodes\n"
+            "    \"hashedbytes\" : n,     (numeric) Number of bytes hashed "
+            "by hashing opcodes\n"
+            "    \"sigchecks\" : n,       (numeric) Number of checked "
+            "signatures\n"
+            "    \"bignumops\" : n,       (numeric) Number of numeric "
+            "opcodes evaluated with big numbers\n"
+            "    \"txid\" : \"id\",       (string) The transaction id\n"
+            "    \"inputs\" : n           (numeric) Number of inputs\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nResult (with txid):\n"
+            "{\n"
+            "  \"time\", \"opcodes\", \"hashedbytes\", \"sigchecks\", "
+            "\"bignumops\" : totals as above\n"
+            "  \"txid\" : \"id\",         (string) The transaction id\n"
+            "  \"inputs\" : [           (array of json objects)\n"
+            "     {\n"
+            "       \"time\", \"opcodes\", \"hashedbytes\", \"sigchecks\", "
+            "\"bignumops\" : as above\n"
+            "       \"verified\" : true|false, (boolean) False if "
+            "verification was canceled\n"
+            "       \"valid\" : true|false,    (boolean) Result of the "
+            "script verification\n"
+            "       \"error\" : \"msg\"        (string) Script error if "
+            "the input is not valid\n"
+            "     }\n"
+            "     ,...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getscriptprofile", "") +
+            HelpExampleCli("getscriptprofile", "\"mytxid\"") +
+            HelpExampleRpc("getscriptprofile", "\"mytxid\""));
+    }
+
+    if (request.params.size() == 0 || request.params[0].isNull()) {
+        UniValue result(UniValue::VARR);
+        for (const CTxScriptProfile &profile :
+             GetSlowScriptLog().GetEntries()) {
+            result.push_back(TxScriptProfileToJSON(profile, false));
+        }
+        return result;
+    }
+
+    const TxId txid(ParseHashV(request.params[0], "txid"));
+    auto profile = ProfileTransactionScripts(config, txid, GetShutdownToken());
+    if (!profile) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                           "No such mempool or blockchain transaction, or the "
+                           "outputs it spends are not available");
+    }
+    return TxScriptProfileToJSON(*profile, true);
+}
+
 /**
  * Pushes a JSON object for script verification or signing errors to vErrorsRet.
  */
@@ -1059,65 +1173,35 @@ static UniValue signrawtransaction(const Config &config,
     // Script verification errors.
     UniValue vErrors(UniValue::VARR);
 
-    // Use CTransaction for the constant parts of the transaction to avoid
-    // rehashing.
-    const CTransaction txConst(mergedTx);
-
     bool genesisEnabled = IsGenesisEnabled(config, chainActive.Height() + 1);
 
-    // Sign what we can:
-    for (size_t i = 0; i < mergedTx.vin.size(); i++) {
-        CTxIn &txin = mergedTx.vin[i];
+    // Collect the outputs spent by the inputs while holding cs_main, the
+    // inputs themselves are signed in parallel.
+    std::vector<std::optional<SpentOutput>> spentOutputs;
+    spentOutputs.reserve(mergedTx.vin.size());
+    for (const CTxIn &txin : mergedTx.vin) {
         const Coin &coin = view.AccessCoin(txin.prevout);
         if (coin.IsSpent()) {
-            TxInErrorToJSON(txin, vErrors, "Input not found or already spent");
+            spentOutputs.emplace_back();
             continue;
         }
 
-        const CScript &prevPubKey = coin.GetTxOut().scriptPubKey;
-        const Amount amount = coin.GetTxOut().nValue;
-
-        bool utxoAfterGenesis = IsGenesisEnabled(config, coin, chainActive.Height() + 1); 
-
-        SignatureData sigdata;
-        // Only sign SIGHASH_SINGLE if there's a corresponding output:
-        if ((sigHashType.getBaseType() != BaseSigHashType::SINGLE) ||
-            (i < mergedTx.vout.size())) {
-            ProduceSignature(config, true, MutableTransactionSignatureCreator(
-                                 &keystore, &mergedTx, i, amount, sigHashType),
-                             genesisEnabled, utxoAfterGenesis, prevPubKey, sigdata);
-        }
-
-        // ... and merge in other signatures:
-        for (const CMutableTransaction &txv : txVariants) {
-            if (txv.vin.size() > i) {
-                sigdata = CombineSignatures(
-                    config, 
-                    true,
-                    prevPubKey,
-                    TransactionSignatureChecker(&txConst, i, amount), sigdata,
-                    DataFromTransaction(txv, i),
-                    utxoAfterGenesis);
-            }
-        }
+        spentOutputs.push_back(SpentOutput{
+            coin.GetTxOut(),
+            IsGenesisEnabled(config, coin, chainActive.Height() + 1)});
+    }
 
-        UpdateTransaction(mergedTx, i, sigdata);
-
-        ScriptError serror = SCRIPT_ERR_OK;
-        auto source = task::CCancellationSource::Make();
-        auto res =
-            VerifyScript(
-                config,
-                true,
-                source->GetToken(),
-                txin.scriptSig,
-                prevPubKey,
-                StandardScriptVerifyFlags(genesisEnabled, utxoAfterGenesis),
-                TransactionSignatureChecker(&txConst, i, amount),
-                &serror);
-        if (!res.value())
-        {
-            TxInErrorToJSON(txin, vErrors, ScriptErrorString(serror));
+    // Sign what we can:
+    std::vector<std::optional<ScriptError>> inputErrors =
+        SignTransactionInputs(config, keystore, genesisEnabled, mergedTx,
+                              spentOutputs, txVariants, sigHashType,
+                              GetNumCores());
+    for (size_t i = 0; i < mergedTx.vin.size(); i++) {
+        const CTxIn &txin = mergedTx.vin[i];
+        if (!inputErrors[i]) {
+            TxInErrorToJSON(txin, vErrors, "Input not found or already spent");
+        } else if (*inputErrors[i] != SCRIPT_ERR_OK) {
+            TxInErrorToJSON(txin, vErrors, ScriptErrorString(*inputErrors[i]));
         }
     }
 
@@ -1576,6 +1660,7 @@ static const CRPCCommand commands[] = {
     { "rawtransactions",    "createrawtransaction",   createrawtransaction,   true,  {"inputs","outputs","locktime"} },
     { "rawtransactions",    "decoderawtransaction",   decoderawtransaction,   true,  {"hexstring"} },
     { "rawtransactions",    "decodescript",           decodescript,           true,  {"hexstring"} },
+    { "rawtransactions",    "getscriptprofile",       getscriptprofile,       true,  {"txid"} },
     { "rawtransactions",    "sendrawtransaction",     sendrawtransaction,     false, {"hexstring","allowhighfees","dontcheckfee"} },
     { "rawtransactions",    "sendrawtransactions",    sendrawtransactions,    false, {"inputs"} },
     { "rawtransactions",    "signrawtransaction",     signrawtransaction,     false, {"hexstring","prevtxs","privkeys","sighashtype"} }, /* uses wallet if enabled */
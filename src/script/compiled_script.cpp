@@ -0,0 +1,285 @@
+// Copyright (c) 2020 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "script/compiled_script.h"
+
+#include "script/interpreter.h"
+
+#include <algorithm>
+#include <string_view>
+
+namespace
+{
+    size_t GetPushHeaderSize(opcodetype opcode)
+    {
+        switch(opcode)
+        {
+            case OP_PUSHDATA1:
+                return 2;
+            case OP_PUSHDATA2:
+                return 3;
+            case OP_PUSHDATA4:
+                return 5;
+            default:
+                return 1;
+        }
+    }
+
+    size_t HashScript(const uint8_t* data, size_t size)
+    {
+        return std::hash<std::string_view>{}(
+            std::string_view{reinterpret_cast<const char*>(data), size});
+    }
+}
+
+CCompiledScript::CCompiledScript(const CScript& script)
+    : scriptBytes(script.begin(), script.end())
+{
+    // Running totals used to summarize the instructions between a
+    // conditional opcode and its jump target
+    std::vector<uint32_t> opCounts {0};
+    std::vector<uint32_t> preGenesisEffects {0};
+    std::vector<uint32_t> postGenesisEffects {0};
+
+    // Open conditionals: instruction index of the last OP_IF, OP_NOTIF or
+    // OP_ELSE and whether the conditional already has an OP_ELSE
+    std::vector<std::pair<uint32_t, bool>> conditionals;
+
+    CScript::const_iterator pc = script.begin();
+    while(pc < script.end())
+    {
+        const CScript::const_iterator start = pc;
+        opcodetype opcode;
+        if(!script.GetOp(pc, opcode))
+        {
+            break;
+        }
+
+        Instruction instruction;
+        instruction.opcode = static_cast<uint8_t>(opcode);
+        instruction.offset = static_cast<uint32_t>(start - script.begin());
+        if(opcode <= OP_PUSHDATA4)
+        {
+            instruction.dataOffset = instruction.offset + GetPushHeaderSize(opcode);
+        }
+        else
+        {
+            instruction.dataOffset = instruction.offset + 1;
+        }
+        instruction.dataSize = static_cast<uint32_t>(pc - script.begin()) - instruction.dataOffset;
+
+        const uint32_t index = static_cast<uint32_t>(instructions.size());
+        bool fPreGenesisEffect =
+            instruction.dataSize > MAX_SCRIPT_ELEMENT_SIZE_BEFORE_GENESIS ||
+            IsOpcodeDisabled(opcode) ||
+            opcode == OP_VERIF || opcode == OP_VERNOTIF;
+        bool fPostGenesisEffect = false;
+
+        // Sets the jump target of the innermost open conditional
+        const auto setJump = [&](uint32_t target)
+        {
+            Instruction& from = instructions[conditionals.back().first];
+            const uint32_t begin = conditionals.back().first + 1;
+            from.jump = target;
+            from.nJumpOps = opCounts[target] - opCounts[begin];
+            if(preGenesisEffects[target] == preGenesisEffects[begin])
+            {
+                from.jumpFlags |= Instruction::JUMP_BEFORE_GENESIS;
+            }
+            if(postGenesisEffects[target] == postGenesisEffects[begin])
+            {
+                from.jumpFlags |= Instruction::JUMP_AFTER_GENESIS;
+            }
+        };
+
+        switch(opcode)
+        {
+            case OP_IF:
+            case OP_NOTIF:
+                conditionals.emplace_back(index, false);
+                break;
+            case OP_ELSE:
+                if(!conditionals.empty())
+                {
+                    // After Genesis a second OP_ELSE fails the script even if
+                    // it is not executed
+                    fPostGenesisEffect = conditionals.back().second;
+                    setJump(index);
+                    conditionals.back() = {index, true};
+                }
+                break;
+            case OP_ENDIF:
+                if(!conditionals.empty())
+                {
+                    setJump(index);
+                    conditionals.pop_back();
+                }
+                break;
+            default:
+                break;
+        }
+
+        instructions.push_back(instruction);
+        opCounts.push_back(opCounts.back() + (opcode > OP_16 ? 1 : 0));
+        preGenesisEffects.push_back(preGenesisEffects.back() + (fPreGenesisEffect ? 1 : 0));
+        postGenesisEffects.push_back(postGenesisEffects.back() + (fPostGenesisEffect ? 1 : 0));
+    }
+    instructions.shrink_to_fit();
+}
+
+bool CCompiledScript::IsCompiledFrom(const CScript& script) const
+{
+    return script.size() == scriptBytes.size() &&
+           std::equal(script.begin(), script.end(), scriptBytes.begin());
+}
+
+size_t CCompiledScript::DynamicMemoryUsage() const
+{
+    return sizeof(*this) +
+           scriptBytes.capacity() +
+           instructions.capacity() * sizeof(Instruction);
+}
+
+void CCompiledScriptCache::Configure(size_t nMaxMemoryUsage, size_t nMinScriptSize)
+{
+    mMinScriptSize = nMinScriptSize;
+    mMaxMemoryUsage = nMaxMemoryUsage;
+    Evict(nMaxMemoryUsage);
+}
+
+std::shared_ptr<const CCompiledScript> CCompiledScriptCache::Get(const CScript& script)
+{
+    // Most scripts are small, so reject them before hashing or locking
+    const size_t nMaxMemoryUsage {mMaxMemoryUsage.load(std::memory_order_relaxed)};
+    if(nMaxMemoryUsage == 0 ||
+       script.size() < mMinScriptSize.load(std::memory_order_relaxed))
+    {
+        return nullptr;
+    }
+
+    const size_t key {HashScript(script.data(), script.size())};
+    Shard& shard {mShards[key % NUM_SHARDS]};
+    {
+        std::lock_guard lock {shard.mutex};
+        auto [begin, end] = shard.index.equal_range(key);
+        for(auto it = begin; it != end; ++it)
+        {
+            Entry& entry {*it->second};
+            if(entry.compiled->IsCompiledFrom(script))
+            {
+                entry.nLastUse = ++mUseCounter;
+                shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+                mHits.fetch_add(1, std::memory_order_relaxed);
+                return entry.compiled;
+            }
+        }
+    }
+    mMisses.fetch_add(1, std::memory_order_relaxed);
+
+    // Other threads may compile the same script in the meantime, in which
+    // case the cache holds more than one copy until they are evicted
+    auto compiled = std::make_shared<const CCompiledScript>(script);
+    const size_t nMemoryUsage {compiled->DynamicMemoryUsage()};
+    if(nMemoryUsage > nMaxMemoryUsage)
+    {
+        return compiled;
+    }
+
+    {
+        std::lock_guard lock {shard.mutex};
+        shard.entries.push_front({key, ++mUseCounter, compiled});
+        shard.index.emplace(key, shard.entries.begin());
+        mMemoryUsage += nMemoryUsage;
+        ++mEntries;
+    }
+    mInserts.fetch_add(1, std::memory_order_relaxed);
+
+    // The new entry is the most recently used one so it is evicted last
+    Evict(mMaxMemoryUsage);
+    return compiled;
+}
+
+void CCompiledScriptCache::Evict(size_t nMaxMemoryUsage)
+{
+    while(mMemoryUsage > nMaxMemoryUsage)
+    {
+        // Each shard is ordered by last use so the least recently used entry
+        // of the cache is the oldest entry of one of the shards
+        Shard* oldest {nullptr};
+        uint64_t nOldestUse {0};
+        for(Shard& shard : mShards)
+        {
+            std::lock_guard lock {shard.mutex};
+            if(!shard.entries.empty() &&
+               (oldest == nullptr || shard.entries.back().nLastUse < nOldestUse))
+            {
+                oldest = &shard;
+                nOldestUse = shard.entries.back().nLastUse;
+            }
+        }
+        if(oldest == nullptr)
+        {
+            break;
+        }
+
+        // Another thread may have used or evicted the entry in the meantime,
+        // in which case this evicts a slightly newer one
+        std::lock_guard lock {oldest->mutex};
+        if(!oldest->entries.empty() && mMemoryUsage > nMaxMemoryUsage)
+        {
+            EvictOldestUnlocked(*oldest);
+        }
+    }
+}
+
+void CCompiledScriptCache::EvictOldestUnlocked(Shard& shard)
+{
+    const Entry& entry {shard.entries.back()};
+    auto [begin, end] = shard.index.equal_range(entry.key);
+    for(auto it = begin; it != end; ++it)
+    {
+        if(it->second == std::prev(shard.entries.end()))
+        {
+            shard.index.erase(it);
+            break;
+        }
+    }
+    mMemoryUsage -= entry.compiled->DynamicMemoryUsage();
+    --mEntries;
+    mEvictions.fetch_add(1, std::memory_order_relaxed);
+    shard.entries.pop_back();
+}
+
+void CCompiledScriptCache::Clear()
+{
+    for(Shard& shard : mShards)
+    {
+        std::lock_guard lock {shard.mutex};
+        for(const Entry& entry : shard.entries)
+        {
+            mMemoryUsage -= entry.compiled->DynamicMemoryUsage();
+        }
+        mEntries -= shard.entries.size();
+        shard.entries.clear();
+        shard.index.clear();
+    }
+}
+
+CCompiledScriptCache::Stats CCompiledScriptCache::GetStats() const
+{
+    Stats stats;
+    stats.nEntries = mEntries;
+    stats.nMemoryUsage = mMemoryUsage;
+    stats.nMaxMemoryUsage = mMaxMemoryUsage;
+    stats.nHits = mHits;
+    stats.nMisses = mMisses;
+    stats.nInserts = mInserts;
+    stats.nEvictions = mEvictions;
+    return stats;
+}
+
+CCompiledScriptCache& GetCompiledScriptCache()
+{
+    static CCompiledScriptCache cache;
+    return cache;
+}
@@ -0,0 +1,180 @@
+// Copyright (c) 2020 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef BITCOIN_SCRIPT_COMPILED_SCRIPT_H
+#define BITCOIN_SCRIPT_COMPILED_SCRIPT_H
+
+#include "script/script.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Default memory limit of the compiled script cache in MiB
+static const unsigned int DEFAULT_MAX_COMPILED_SCRIPT_CACHE_SIZE = 64;
+// Smaller scripts are decoded on every evaluation
+static const size_t MIN_COMPILED_SCRIPT_SIZE = 1024;
+
+/**
+ * Script decoded into instructions once so that evaluating it again doesn't
+ * have to parse the pushes.
+ *
+ * Conditional opcodes also store the position of the matching OP_ELSE or
+ * OP_ENDIF and a summary of the instructions in between, which allows
+ * EvalScript to jump over a branch that is not executed instead of stepping
+ * through it.
+ */
+class CCompiledScript
+{
+public:
+    static constexpr uint32_t NO_JUMP = UINT32_MAX;
+
+    class Instruction
+    {
+    public:
+        opcodetype GetOpcode() const { return static_cast<opcodetype>(opcode); }
+        // Position of the opcode in the script
+        uint32_t GetOffset() const { return offset; }
+        // Position following the instruction
+        uint32_t GetEnd() const { return dataOffset + dataSize; }
+
+        bsv::span<const uint8_t> GetData(const CScript& script) const
+        {
+            return {script.data() + dataOffset, dataSize};
+        }
+
+        /**
+         * Index of the matching OP_ELSE or OP_ENDIF of OP_IF, OP_NOTIF and
+         * OP_ELSE, or NO_JUMP.
+         */
+        uint32_t GetJump() const { return jump; }
+        // Opcodes between this instruction and the jump target that count
+        // towards the op count limit
+        uint32_t GetJumpOpCount() const { return nJumpOps; }
+
+        /**
+         * Whether the instructions up to the jump target, if not executed,
+         * have no effect other than on the op count.
+         */
+        bool CanJump(bool utxoAfterGenesis) const
+        {
+            return jump != NO_JUMP &&
+                   (jumpFlags & (utxoAfterGenesis ? JUMP_AFTER_GENESIS : JUMP_BEFORE_GENESIS));
+        }
+
+    private:
+        friend class CCompiledScript;
+
+        static constexpr uint8_t JUMP_BEFORE_GENESIS = 1;
+        static constexpr uint8_t JUMP_AFTER_GENESIS = 2;
+
+        uint32_t offset {0};
+        uint32_t dataOffset {0};
+        uint32_t dataSize {0};
+        uint32_t jump {NO_JUMP};
+        uint32_t nJumpOps {0};
+        uint8_t opcode {OP_INVALIDOPCODE};
+        uint8_t jumpFlags {0};
+    };
+
+    explicit CCompiledScript(const CScript& script);
+
+    /**
+     * Decoded instructions. If the script can't be decoded to the end, the
+     * instructions stop before the first one that can't be decoded.
+     */
+    const std::vector<Instruction>& GetInstructions() const { return instructions; }
+
+    // Whether this was compiled from the given script
+    bool IsCompiledFrom(const CScript& script) const;
+
+    size_t DynamicMemoryUsage() const;
+
+private:
+    std::vector<uint8_t> scriptBytes;
+    std::vector<Instruction> instructions;
+};
+
+/**
+ * Cache of compiled scripts keyed by the script. Only scripts of at least a
+ * minimum size are compiled as decoding them is otherwise cheaper than a
+ * lookup. The least recently used scripts are evicted when the cache reaches
+ * its memory limit. The cache is disabled until a memory limit is set.
+ *
+ * Entries are spread over shards with a mutex each so that script checking
+ * threads looking up different scripts don't contend on a single lock.
+ */
+class CCompiledScriptCache
+{
+public:
+    struct Stats
+    {
+        size_t nEntries {0};
+        size_t nMemoryUsage {0};
+        size_t nMaxMemoryUsage {0};
+        uint64_t nHits {0};
+        uint64_t nMisses {0};
+        uint64_t nInserts {0};
+        uint64_t nEvictions {0};
+    };
+
+    void Configure(size_t nMaxMemoryUsage, size_t nMinScriptSize);
+
+    /**
+     * Returns the compiled script, compiling and inserting it on a miss.
+     * Returns nullptr if the script is not cached because of its size or
+     * because the cache is disabled.
+     */
+    std::shared_ptr<const CCompiledScript> Get(const CScript& script);
+
+    void Clear();
+
+    Stats GetStats() const;
+
+private:
+    struct Entry
+    {
+        size_t key;
+        // Value of mUseCounter when the entry was last returned
+        uint64_t nLastUse;
+        std::shared_ptr<const CCompiledScript> compiled;
+    };
+    using entry_list = std::list<Entry>;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        // Most recently used first
+        entry_list entries;
+        std::unordered_multimap<size_t, entry_list::iterator> index;
+    };
+
+    static constexpr size_t NUM_SHARDS {16};
+
+    // Evicts the least recently used entries of all shards until the memory
+    // usage is within the limit
+    void Evict(size_t nMaxMemoryUsage);
+    void EvictOldestUnlocked(Shard& shard);
+
+    std::array<Shard, NUM_SHARDS> mShards;
+
+    std::atomic<size_t> mMaxMemoryUsage {0};
+    std::atomic<size_t> mMinScriptSize {0};
+    std::atomic<uint64_t> mUseCounter {0};
+
+    std::atomic<size_t> mEntries {0};
+    std::atomic<size_t> mMemoryUsage {0};
+    std::atomic<uint64_t> mHits {0};
+    std::atomic<uint64_t> mMisses {0};
+    std::atomic<uint64_t> mInserts {0};
+    std::atomic<uint64_t> mEvictions {0};
+};
+
+CCompiledScriptCache& GetCompiledScriptCache();
+
+#endif // BITCOIN_SCRIPT_COMPILED_SCRIPT_H
@@ -129,7 +129,8 @@ namespace bsv
         return true;
     }
 
-    inline bool MinimallyEncode(std::vector<uint8_t>& data)
+    template<typename T>
+    inline bool MinimallyEncode(T& data)
     {
         if(data.size() == 0)
         {
@@ -11,6 +11,7 @@
 #include "crypto/sha256.h"
 #include "primitives/transaction.h"
 #include "pubkey.h"
+#include "script/compiled_script.h"
 #include "script/int_serialization.h"
 #include "script/script.h"
 #include "script/script_num.h"
@@ -19,6 +20,8 @@
 #include "consensus/consensus.h"
 #include "script_config.h"
 
+#include <cstring>
+
 namespace {
 
 inline bool set_success(ScriptError *ret) {
@@ -104,7 +107,7 @@ static valtype LShift(const valtype &x, int n) {
     return result; 
 } 
 
-bool CastToBool(const valtype &vch) {
+bool CastToBool(bsv::span<const uint8_t> vch) {
     for (size_t i = 0; i < vch.size(); i++) {
         if (vch[i] != 0) {
             // Can be negative zero
@@ -117,7 +120,7 @@ bool CastToBool(const valtype &vch) {
     return false;
 }
 
-static bool IsCompressedOrUncompressedPubKey(const valtype &vchPubKey) {
+static bool IsCompressedOrUncompressedPubKey(bsv::span<const uint8_t> vchPubKey) {
     if (vchPubKey.size() < 33) {
         //  Non-canonical public key: too short
         return false;
@@ -139,7 +142,7 @@ static bool IsCompressedOrUncompressedPubKey(const valtype &vchPubKey) {
     return true;
 }
 
-static bool IsCompressedPubKey(const valtype &vchPubKey) {
+static bool IsCompressedPubKey(bsv::span<const uint8_t> vchPubKey) {
     if (vchPubKey.size() != 33) {
         //  Non-canonical public key: invalid length for compressed key
         return false;
@@ -162,7 +165,7 @@ static bool IsCompressedPubKey(const valtype &vchPubKey) {
  *
  * This function is consensus-critical since BIP66.
  */
-static bool IsValidSignatureEncoding(const std::vector<uint8_t> &sig) {
+static bool IsValidSignatureEncoding(bsv::span<const uint8_t> sig) {
     // Format: 0x30 [total-length] 0x02 [R-length] [R] 0x02 [S-length] [S]
     // [sighash]
     // * total-length: 1-byte length descriptor of everything that follows,
@@ -231,7 +234,7 @@ static bool IsValidSignatureEncoding(const std::vector<uint8_t> &sig) {
     return true;
 }
 
-static bool IsLowDERSignature(const valtype &vchSig, ScriptError *serror) {
+static bool IsLowDERSignature(bsv::span<const uint8_t> vchSig, ScriptError *serror) {
     if (!IsValidSignatureEncoding(vchSig)) {
         return set_error(serror, SCRIPT_ERR_SIG_DER);
     }
@@ -243,7 +246,7 @@ static bool IsLowDERSignature(const valtype &vchSig, ScriptError *serror) {
     return true;
 }
 
-static SigHashType GetHashType(const valtype &vchSig) {
+static SigHashType GetHashType(bsv::span<const uint8_t> vchSig) {
     if (vchSig.size() == 0) {
         return SigHashType(0);
     }
@@ -251,17 +254,17 @@ static SigHashType GetHashType(const valtype &vchSig) {
     return SigHashType(vchSig[vchSig.size() - 1]);
 }
 
-static void CleanupScriptCode(CScript &scriptCode,
-                              const std::vector<uint8_t> &vchSig,
-                              uint32_t flags) {
+void CleanupScriptCode(CScript &scriptCode,
+                       bsv::span<const uint8_t> vchSig,
+                       uint32_t flags) {
     // Drop the signature in scripts when SIGHASH_FORKID is not used.
     SigHashType sigHashType = GetHashType(vchSig);
     if (!(flags & SCRIPT_ENABLE_SIGHASH_FORKID) || !sigHashType.hasForkId()) {
-        scriptCode.FindAndDelete(CScript(vchSig));
+        scriptCode.FindAndDelete(CScript(valtype(vchSig.begin(), vchSig.end())));
     }
 }
 
-bool CheckSignatureEncoding(const std::vector<uint8_t> &vchSig, uint32_t flags,
+bool CheckSignatureEncoding(bsv::span<const uint8_t> vchSig, uint32_t flags,
                             ScriptError *serror) {
     // Empty signature. Not strictly DER encoded, but allowed to provide a
     // compact way to provide an invalid signature for use with CHECK(MULTI)SIG
@@ -294,8 +297,8 @@ bool CheckSignatureEncoding(const std::vector<uint8_t> &vchSig, uint32_t flags,
     return true;
 }
 
-static bool CheckPubKeyEncoding(const valtype &vchPubKey, uint32_t flags,
-                                ScriptError *serror) {
+bool CheckPubKeyEncoding(bsv::span<const uint8_t> vchPubKey, uint32_t flags,
+                         ScriptError *serror) {
     if ((flags & SCRIPT_VERIFY_STRICTENC) != 0 &&
         !IsCompressedOrUncompressedPubKey(vchPubKey)) {
         return set_error(serror, SCRIPT_ERR_PUBKEYTYPE);
@@ -309,7 +312,7 @@ static bool CheckPubKeyEncoding(const valtype &vchPubKey, uint32_t flags,
     return true;
 }
 
-static bool CheckMinimalPush(const valtype &data, opcodetype opcode) {
+bool CheckMinimalPush(const valtype &data, opcodetype opcode) {
     if (data.size() == 0) {
         // Could have used OP_0.
         return opcode == OP_0;
@@ -338,7 +341,7 @@ static bool CheckMinimalPush(const valtype &data, opcodetype opcode) {
     return true;
 }
 
-static bool IsOpcodeDisabled(opcodetype opcode) {
+bool IsOpcodeDisabled(opcodetype opcode) {
     switch (opcode) {
         case OP_2MUL:
         case OP_2DIV:
@@ -356,6 +359,148 @@ static bool IsInvalidBranchingOpcode(opcodetype opcode) {
     return opcode == OP_VERNOTIF || opcode == OP_VERIF;
 }
 
+/**
+ * Post-Genesis numeric opcodes on operands of up to
+ * CFixedScriptNum::MAXIMUM_ELEMENT_SIZE bytes are evaluated without bsv::bint.
+ * Returns std::nullopt if an operand or the result doesn't fit, or if the
+ * divisor is zero, in which case the opcode must be evaluated with CScriptNum.
+ */
+static std::optional<valtype> EvalFixedWidthNumOp(opcodetype opcode,
+                                                  bsv::span<const uint8_t> arg,
+                                                  bool fRequireMinimal,
+                                                  size_t maxScriptNumLength) {
+    std::optional<CFixedScriptNum> bn{
+        CFixedScriptNum::Decode(arg, fRequireMinimal, maxScriptNumLength)};
+    if (!bn) {
+        return std::nullopt;
+    }
+
+    switch (opcode) {
+        case OP_1ADD:
+            if (!bn->Add(CFixedScriptNum{1})) {
+                return std::nullopt;
+            }
+            break;
+        case OP_1SUB:
+            if (!bn->Sub(CFixedScriptNum{1})) {
+                return std::nullopt;
+            }
+            break;
+        case OP_NEGATE:
+            bn->Negate();
+            break;
+        case OP_ABS:
+            bn->Abs();
+            break;
+        case OP_NOT:
+            return bn->IsZero() ? valtype{1} : valtype{};
+        case OP_0NOTEQUAL:
+            return bn->IsZero() ? valtype{} : valtype{1};
+        default:
+            assert(!"invalid opcode");
+            break;
+    }
+    return bn->getvch();
+}
+
+static std::optional<valtype> EvalFixedWidthNumOp(opcodetype opcode,
+                                                  bsv::span<const uint8_t> arg1,
+                                                  bsv::span<const uint8_t> arg2,
+                                                  bool fRequireMinimal,
+                                                  size_t maxScriptNumLength) {
+    std::optional<CFixedScriptNum> bn1{
+        CFixedScriptNum::Decode(arg1, fRequireMinimal, maxScriptNumLength)};
+    if (!bn1) {
+        return std::nullopt;
+    }
+    const std::optional<CFixedScriptNum> bn2{
+        CFixedScriptNum::Decode(arg2, fRequireMinimal, maxScriptNumLength)};
+    if (!bn2) {
+        return std::nullopt;
+    }
+
+    const auto boolean = [](bool fValue) {
+        return fValue ? valtype{1} : valtype{};
+    };
+    switch (opcode) {
+        case OP_ADD:
+            if (!bn1->Add(*bn2)) {
+                return std::nullopt;
+            }
+            break;
+        case OP_SUB:
+            if (!bn1->Sub(*bn2)) {
+                return std::nullopt;
+            }
+            break;
+        case OP_MUL:
+            if (!bn1->Mul(*bn2)) {
+                return std::nullopt;
+            }
+            break;
+        case OP_DIV:
+            if (bn2->IsZero()) {
+                return std::nullopt;
+            }
+            bn1->Div(*bn2);
+            break;
+        case OP_MOD:
+            if (bn2->IsZero()) {
+                return std::nullopt;
+            }
+            bn1->Mod(*bn2);
+            break;
+        case OP_BOOLAND:
+            return boolean(!bn1->IsZero() && !bn2->IsZero());
+        case OP_BOOLOR:
+            return boolean(!bn1->IsZero() || !bn2->IsZero());
+        case OP_NUMEQUAL:
+        case OP_NUMEQUALVERIFY:
+            return boolean(*bn1 == *bn2);
+        case OP_NUMNOTEQUAL:
+            return boolean(*bn1 != *bn2);
+        case OP_LESSTHAN:
+            return boolean(*bn1 < *bn2);
+        case OP_GREATERTHAN:
+            return boolean(*bn1 > *bn2);
+        case OP_LESSTHANOREQUAL:
+            return boolean(*bn1 <= *bn2);
+        case OP_GREATERTHANOREQUAL:
+            return boolean(*bn1 >= *bn2);
+        case OP_MIN:
+            return (*bn1 < *bn2 ? bn1 : bn2)->getvch();
+        case OP_MAX:
+            return (*bn1 > *bn2 ? bn1 : bn2)->getvch();
+        default:
+            assert(!"invalid opcode");
+            break;
+    }
+    return bn1->getvch();
+}
+
+static std::optional<valtype> EvalFixedWidthWithin(bsv::span<const uint8_t> x,
+                                                   bsv::span<const uint8_t> min,
+                                                   bsv::span<const uint8_t> max,
+                                                   bool fRequireMinimal,
+                                                   size_t maxScriptNumLength) {
+    const std::optional<CFixedScriptNum> bn1{
+        CFixedScriptNum::Decode(x, fRequireMinimal, maxScriptNumLength)};
+    if (!bn1) {
+        return std::nullopt;
+    }
+    const std::optional<CFixedScriptNum> bn2{
+        CFixedScriptNum::Decode(min, fRequireMinimal, maxScriptNumLength)};
+    if (!bn2) {
+        return std::nullopt;
+    }
+    const std::optional<CFixedScriptNum> bn3{
+        CFixedScriptNum::Decode(max, fRequireMinimal, maxScriptNumLength)};
+    if (!bn3) {
+        return std::nullopt;
+    }
+    return (*bn2 <= *bn1 && *bn1 < *bn3) ? valtype{1} : valtype{};
+}
+
 inline bool IsValidMaxOpsPerScript(uint64_t nOpCount,
                                    const CScriptConfig &config,
                                    bool isGenesisEnabled, bool consensus)
@@ -375,7 +520,8 @@ std::optional<bool> EvalScript(
     long& ipc,
     std::vector<bool>& vfExec,
     std::vector<bool>& vfElse,
-    ScriptError* serror)
+    ScriptError* serror,
+    ScriptProfile* profile)
 {
     static const CScriptNum bnZero(0);
     static const CScriptNum bnOne(1);
@@ -403,10 +549,37 @@ std::optional<bool> EvalScript(
     // if OP_RETURN is found in executed branches after genesis is activated,
     // we still have to check if the rest of the script is valid
     bool nonTopLevelReturnAfterGenesis = false;
+
+    // Large scripts that are evaluated repeatedly are decoded once and
+    // executed from the cached instructions
+    const std::shared_ptr<const CCompiledScript> compiled {
+        GetCompiledScriptCache().Get(script)};
+    size_t nInstruction {0};
+
+    // Jumps from the conditional opcode that was just evaluated to the
+    // matching OP_ELSE or OP_ENDIF if the branch in between is not executed
+    // and stepping through it could only count its opcodes.
+    const auto skipNotExecutedBranch = [&]()
+    {
+        if (!compiled || nonTopLevelReturnAfterGenesis ||
+            !count(vfExec.begin(), vfExec.end(), false)) {
+            return;
+        }
+        const auto& instructions = compiled->GetInstructions();
+        const CCompiledScript::Instruction& instruction = instructions[nInstruction - 1];
+        if (!instruction.CanJump(utxo_after_genesis) ||
+            !IsValidMaxOpsPerScript(nOpCount + instruction.GetJumpOpCount(),
+                                    config, utxo_after_genesis, consensus)) {
+            return;
+        }
+        nOpCount += instruction.GetJumpOpCount();
+        nInstruction = instruction.GetJump();
+        pc = script.begin() + instructions[nInstruction].GetOffset();
+    };
     
     try {
         while (pc < pend) {
-            if (token.IsCanceled())
+            if (token.IsCanceled() || (profile && profile->IsOverCostLimit()))
             {
                 return {};
             }
@@ -414,7 +587,17 @@ std::optional<bool> EvalScript(
             //
             // Read instruction
             //
-            if (!script.GetOp(pc, opcode, vchPushValue)) {
+            if (compiled) {
+                const auto& instructions = compiled->GetInstructions();
+                if (nInstruction == instructions.size()) {
+                    return set_error(serror, SCRIPT_ERR_BAD_OPCODE);
+                }
+                const CCompiledScript::Instruction& instruction = instructions[nInstruction++];
+                const auto data = instruction.GetData(script);
+                opcode = instruction.GetOpcode();
+                vchPushValue.assign(data.begin(), data.end());
+                pc = script.begin() + instruction.GetEnd();
+            } else if (!script.GetOp(pc, opcode, vchPushValue)) {
                 return set_error(serror, SCRIPT_ERR_BAD_OPCODE);
             }
             ipc = pc - script.begin();
@@ -426,6 +609,9 @@ std::optional<bool> EvalScript(
 
             // Do not execute instructions if Genesis OP_RETURN was found in executed branches.
             bool fExec = !count(vfExec.begin(), vfExec.end(), false) && (!nonTopLevelReturnAfterGenesis || opcode == OP_RETURN);
+            if (profile && (fExec || (OP_IF <= opcode && opcode <= OP_ENDIF))) {
+                ++profile->nOpcodes;
+            }
 
             //
             // Check opcode limits.
@@ -608,7 +794,7 @@ std::optional<bool> EvalScript(
                                 return set_error(
                                     serror, SCRIPT_ERR_UNBALANCED_CONDITIONAL);
                             }
-                            LimitedVector &vch = stack.stacktop(-1);
+                            const LimitedVector &vch = stack.stacktop(-1);
                             if (flags & SCRIPT_VERIFY_MINIMALIF) {
                                 if (vch.size() > 1) {
                                     return set_error(serror,
@@ -627,6 +813,7 @@ std::optional<bool> EvalScript(
                         }
                         vfExec.push_back(fValue);
                         vfElse.push_back(false);
+                        skipNotExecutedBranch();
                     } break;
 
                     case OP_ELSE: {
@@ -637,6 +824,7 @@ std::optional<bool> EvalScript(
                         }
                         vfExec.back() = !vfExec.back();
                         vfElse.back() = true;
+                        skipNotExecutedBranch();
                     } break;
 
                     case OP_ENDIF: {
@@ -917,20 +1105,22 @@ std::optional<bool> EvalScript(
                         }
 
                         // To avoid allocating, we modify vch1 in place.
+                        uint8_t* out = vch1.begin();
+                        const auto in = vch2.GetElement();
                         switch (opcode) {
                             case OP_AND:
-                                for (size_t i = 0; i < vch1.size(); ++i) {
-                                    vch1[i] &= vch2[i];
+                                for (size_t i = 0; i < in.size(); ++i) {
+                                    out[i] &= in[i];
                                 }
                                 break;
                             case OP_OR:
-                                for (size_t i = 0; i < vch1.size(); ++i) {
-                                    vch1[i] |= vch2[i];
+                                for (size_t i = 0; i < in.size(); ++i) {
+                                    out[i] |= in[i];
                                 }
                                 break;
                             case OP_XOR:
-                                for (size_t i = 0; i < vch1.size(); ++i) {
-                                    vch1[i] ^= vch2[i];
+                                for (size_t i = 0; i < in.size(); ++i) {
+                                    out[i] ^= in[i];
                                 }
                                 break;
                             default:
@@ -948,9 +1138,9 @@ std::optional<bool> EvalScript(
                         }
                         LimitedVector &vch1 = stack.stacktop(-1);
                         // To avoid allocating, we modify vch1 in place
-                        for(size_t i=0; i<vch1.size(); i++)
+                        for(uint8_t& byte : vch1)
                         {
-                            vch1[i] = ~vch1[i];
+                            byte = ~byte;
                         }
                     } break;
 
@@ -975,7 +1165,7 @@ std::optional<bool> EvalScript(
 
                         stack.pop_back();
                         stack.pop_back();
-                        auto values{vch1.GetElement()};
+                        valtype values(vch1.begin(), vch1.end());
 
                         if(n >= values.size() * bits_per_byte)
                             fill(begin(values), end(values), 0);
@@ -1016,7 +1206,7 @@ std::optional<bool> EvalScript(
 
                         stack.pop_back();
                         stack.pop_back();
-                        auto values{vch1.GetElement()};
+                        valtype values(vch1.begin(), vch1.end());
 
                         if(n >= values.size() * bits_per_byte)
                             fill(begin(values), end(values), 0);
@@ -1048,7 +1238,7 @@ std::optional<bool> EvalScript(
                             LimitedVector &vch1 = stack.stacktop(-2);
                             LimitedVector &vch2 = stack.stacktop(-1);
 
-                            bool fEqual = (vch1.GetElement() == vch2.GetElement());
+                            bool fEqual = (vch1 == vch2);
                             // OP_NOTEQUAL is disabled because it would be too
                             // easy to say something like n != 1 and have some
                             // wiseguy pass in 1 with extra zero bytes after it
@@ -1084,6 +1274,18 @@ std::optional<bool> EvalScript(
                                 serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                         }
                         const auto &top{stack.stacktop(-1).GetElement()};
+                        if (utxo_after_genesis) {
+                            std::optional<valtype> result{EvalFixedWidthNumOp(
+                                opcode, top, fRequireMinimal, maxScriptNumLength)};
+                            if (result) {
+                                stack.pop_back();
+                                stack.push_back(*result);
+                                break;
+                            }
+                        }
+                        if (profile && utxo_after_genesis) {
+                            ++profile->nBigNumOps;
+                        }
                         CScriptNum bn{top, fRequireMinimal,
                                       maxScriptNumLength,
                                       utxo_after_genesis};
@@ -1146,84 +1348,97 @@ std::optional<bool> EvalScript(
                         const auto& arg_2 = stack.stacktop(-2);                        
                         const auto& arg_1 = stack.stacktop(-1);
 
-                        CScriptNum bn1(arg_2.GetElement(), fRequireMinimal,
-                                       maxScriptNumLength,
-                                       utxo_after_genesis);
-                        CScriptNum bn2(arg_1.GetElement(), fRequireMinimal,
-                                       maxScriptNumLength,
-                                       utxo_after_genesis);
-                        CScriptNum bn;
-                        switch (opcode) {
-                            case OP_ADD:
-                                bn = bn1 + bn2;
-                                break;
-
-                            case OP_SUB:
-                                bn = bn1 - bn2;
-                                break;
-
-                            case OP_MUL:
-                                bn = bn1 * bn2;
-                                break;
-
-                            case OP_DIV:
-                                // denominator must not be 0
-                                if (bn2 == bnZero) {
-                                    return set_error(serror,
-                                                     SCRIPT_ERR_DIV_BY_ZERO);
-                                }
-                                bn = bn1 / bn2;
-                                break;
-
-                            case OP_MOD:
-                                // divisor must not be 0
-                                if (bn2 == bnZero) {
-                                    return set_error(serror,
-                                                     SCRIPT_ERR_MOD_BY_ZERO);
-                                }
-                                bn = bn1 % bn2;
-                                break;
-
-                            case OP_BOOLAND:
-                                bn = (bn1 != bnZero && bn2 != bnZero);
-                                break;
-                            case OP_BOOLOR:
-                                bn = (bn1 != bnZero || bn2 != bnZero);
-                                break;
-                            case OP_NUMEQUAL:
-                                bn = (bn1 == bn2);
-                                break;
-                            case OP_NUMEQUALVERIFY:
-                                bn = (bn1 == bn2);
-                                break;
-                            case OP_NUMNOTEQUAL:
-                                bn = (bn1 != bn2);
-                                break;
-                            case OP_LESSTHAN:
-                                bn = (bn1 < bn2);
-                                break;
-                            case OP_GREATERTHAN:
-                                bn = (bn1 > bn2);
-                                break;
-                            case OP_LESSTHANOREQUAL:
-                                bn = (bn1 <= bn2);
-                                break;
-                            case OP_GREATERTHANOREQUAL:
-                                bn = (bn1 >= bn2);
-                                break;
-                            case OP_MIN:
-                                bn = (bn1 < bn2 ? bn1 : bn2);
-                                break;
-                            case OP_MAX:
-                                bn = (bn1 > bn2 ? bn1 : bn2);
-                                break;
-                            default:
-                                assert(!"invalid opcode");
-                                break;
+                        std::optional<valtype> result;
+                        if (utxo_after_genesis) {
+                            result = EvalFixedWidthNumOp(opcode, arg_2.GetElement(),
+                                                         arg_1.GetElement(),
+                                                         fRequireMinimal,
+                                                         maxScriptNumLength);
+                        }
+                        if (!result) {
+                            if (profile && utxo_after_genesis) {
+                                ++profile->nBigNumOps;
+                            }
+                            CScriptNum bn1(arg_2.GetElement(), fRequireMinimal,
+                                           maxScriptNumLength,
+                                           utxo_after_genesis);
+                            CScriptNum bn2(arg_1.GetElement(), fRequireMinimal,
+                                           maxScriptNumLength,
+                                           utxo_after_genesis);
+                            CScriptNum bn;
+                            switch (opcode) {
+                                case OP_ADD:
+                                    bn = bn1 + bn2;
+                                    break;
+
+                                case OP_SUB:
+                                    bn = bn1 - bn2;
+                                    break;
+
+                                case OP_MUL:
+                                    bn = bn1 * bn2;
+                                    break;
+
+                                case OP_DIV:
+                                    // denominator must not be 0
+                                    if (bn2 == bnZero) {
+                                        return set_error(serror,
+                                                         SCRIPT_ERR_DIV_BY_ZERO);
+                                    }
+                                    bn = bn1 / bn2;
+                                    break;
+
+                                case OP_MOD:
+                                    // divisor must not be 0
+                                    if (bn2 == bnZero) {
+                                        return set_error(serror,
+                                                         SCRIPT_ERR_MOD_BY_ZERO);
+                                    }
+                                    bn = bn1 % bn2;
+                                    break;
+
+                                case OP_BOOLAND:
+                                    bn = (bn1 != bnZero && bn2 != bnZero);
+                                    break;
+                                case OP_BOOLOR:
+                                    bn = (bn1 != bnZero || bn2 != bnZero);
+                                    break;
+                                case OP_NUMEQUAL:
+                                    bn = (bn1 == bn2);
+                                    break;
+                                case OP_NUMEQUALVERIFY:
+                                    bn = (bn1 == bn2);
+                                    break;
+                                case OP_NUMNOTEQUAL:
+                                    bn = (bn1 != bn2);
+                                    break;
+                                case OP_LESSTHAN:
+                                    bn = (bn1 < bn2);
+                                    break;
+                                case OP_GREATERTHAN:
+                                    bn = (bn1 > bn2);
+                                    break;
+                                case OP_LESSTHANOREQUAL:
+                                    bn = (bn1 <= bn2);
+                                    break;
+                                case OP_GREATERTHANOREQUAL:
+                                    bn = (bn1 >= bn2);
+                                    break;
+                                case OP_MIN:
+                                    bn = (bn1 < bn2 ? bn1 : bn2);
+                                    break;
+                                case OP_MAX:
+                                    bn = (bn1 > bn2 ? bn1 : bn2);
+                                    break;
+                                default:
+                                    assert(!"invalid opcode");
+                                    break;
+                            }
+                            result = bn.getvch();
                         }
                         stack.pop_back();
                         stack.pop_back();
-                        stack.push_back(bn.getvch());
+                        stack.push_back(*result);
 
                         if (opcode == OP_NUMEQUALVERIFY) {
                             if (CastToBool(stack.stacktop(-1).GetElement())) {
@@ -1243,26 +1458,38 @@ std::optional<bool> EvalScript(
                         }
 
                         const auto& top_3{stack.stacktop(-3).GetElement()};
-                        const CScriptNum bn1{
-                            top_3, fRequireMinimal,
-                            maxScriptNumLength,
-                            utxo_after_genesis};
                         const auto& top_2{stack.stacktop(-2).GetElement()};
-                        const CScriptNum bn2{
-                            top_2, fRequireMinimal,
-                            maxScriptNumLength,
-                            utxo_after_genesis};
                         const auto& top_1{stack.stacktop(-1).GetElement()};
-                        const CScriptNum bn3{
-                            top_1, fRequireMinimal,
-                            maxScriptNumLength,
-                            utxo_after_genesis};
-                        const bool fValue = (bn2 <= bn1 && bn1 < bn3);
+                        std::optional<valtype> result;
+                        if (utxo_after_genesis) {
+                            result = EvalFixedWidthWithin(top_3, top_2, top_1,
+                                                          fRequireMinimal,
+                                                          maxScriptNumLength);
+                        }
+                        if (!result) {
+                            if (profile && utxo_after_genesis) {
+                                ++profile->nBigNumOps;
+                            }
+                            const CScriptNum bn1{
+                                top_3, fRequireMinimal,
+                                maxScriptNumLength,
+                                utxo_after_genesis};
+                            const CScriptNum bn2{
+                                top_2, fRequireMinimal,
+                                maxScriptNumLength,
+                                utxo_after_genesis};
+                            const CScriptNum bn3{
+                                top_1, fRequireMinimal,
+                                maxScriptNumLength,
+                                utxo_after_genesis};
+                            const bool fValue = (bn2 <= bn1 && bn1 < bn3);
+                            result = fValue ? vchTrue : vchFalse;
+                        }
                         stack.pop_back();
                         stack.pop_back();
                         stack.pop_back();
 
-                        stack.push_back(fValue ? vchTrue : vchFalse);
+                        stack.push_back(*result);
                     } break;
 
                     //
@@ -1280,6 +1507,9 @@ std::optional<bool> EvalScript(
                         }
 
                         LimitedVector &vch = stack.stacktop(-1);
+                        if (profile) {
+                            profile->nHashedBytes += vch.size();
+                        }
                         valtype vchHash((opcode == OP_RIPEMD160 ||
                                          opcode == OP_SHA1 ||
                                          opcode == OP_HASH160)
@@ -1338,7 +1568,11 @@ std::optional<bool> EvalScript(
                         // Remove signature for pre-fork scripts
                         CleanupScriptCode(scriptCode, vchSig.GetElement(), flags);
 
-                        bool fSuccess = checker.CheckSig(vchSig.GetElement(), vchPubKey.GetElement(),
+                        if (profile) {
+                            ++profile->nSigChecks;
+                        }
+                        bool fSuccess = checker.CheckSig(valtype(vchSig.GetElement().begin(), vchSig.GetElement().end()),
+                                                         valtype(vchPubKey.GetElement().begin(), vchPubKey.GetElement().end()),
                                                          scriptCode, flags & SCRIPT_ENABLE_SIGHASH_FORKID);
 
                         if (!fSuccess && (flags & SCRIPT_VERIFY_NULLFAIL) &&
@@ -1449,7 +1683,11 @@ std::optional<bool> EvalScript(
                             }
 
                             // Check signature
-                            bool fOk = checker.CheckSig(vchSig.GetElement(), vchPubKey.GetElement(),
+                            if (profile) {
+                                ++profile->nSigChecks;
+                            }
+                            bool fOk = checker.CheckSig(valtype(vchSig.GetElement().begin(), vchSig.GetElement().end()),
+                                                        valtype(vchPubKey.GetElement().begin(), vchPubKey.GetElement().end()),
                                                         scriptCode, flags & SCRIPT_ENABLE_SIGHASH_FORKID);
 
                             if (fOk) {
@@ -1557,10 +1795,10 @@ std::optional<bool> EvalScript(
 
                         const auto position{n.to_size_t_limited()};
 
-                        // Prepare the results in their own buffer as `data`
-                        // will be invalidated.
-                        valtype n1(data.begin(), data.begin() + position);
-                        valtype n2(data.begin() + position, data.end());
+                        // Prepare the results before `data` is invalidated.
+                        // Large results share the buffer of `data`.
+                        LimitedVector n1{data.slice(0, position)};
+                        LimitedVector n2{data.slice(position, data.size() - position)};
 
                         stack.pop_back();
                         stack.pop_back();
@@ -1694,12 +1932,13 @@ std::optional<bool> EvalScript(
     const CScript& script,
     uint32_t flags,
     const BaseSignatureChecker& checker,
-    ScriptError* serror)
+    ScriptError* serror,
+    ScriptProfile* profile)
 {
     LimitedStack altstack {stack.makeChildStack()};
     long ipc{0};
     std::vector<bool> vfExec, vfElse;
-    return EvalScript(config, consensus, token, stack, script, flags, checker, altstack, ipc, vfExec, vfElse, serror);
+    return EvalScript(config, consensus, token, stack, script, flags, checker, altstack, ipc, vfExec, vfElse, serror, profile);
 }
 
 namespace {
@@ -1850,6 +2089,40 @@ PrecomputedTransactionData::PrecomputedTransactionData(
     hashOutputs = GetOutputsHash(txTo);
 }
 
+const CHash256 *CSighashMidstateCache::Get(int32_t nVersionIn,
+                                           const uint256 &hashPrevoutsIn,
+                                           const uint256 &hashSequenceIn,
+                                           const COutPoint &prevoutIn,
+                                           const CScript &scriptCodeIn) const {
+    if (!fValid || nVersion != nVersionIn || hashPrevouts != hashPrevoutsIn ||
+        hashSequence != hashSequenceIn || prevout != prevoutIn ||
+        scriptCode.size() != scriptCodeIn.size() ||
+        std::memcmp(scriptCode.data(), scriptCodeIn.data(),
+                    scriptCode.size()) != 0) {
+        return nullptr;
+    }
+    return &state;
+}
+
+void CSighashMidstateCache::Set(int32_t nVersionIn,
+                                const uint256 &hashPrevoutsIn,
+                                const uint256 &hashSequenceIn,
+                                const COutPoint &prevoutIn,
+                                const CScript &scriptCodeIn,
+                                const CHash256 &stateIn) const {
+    fValid = true;
+    nVersion = nVersionIn;
+    hashPrevouts = hashPrevoutsIn;
+    hashSequence = hashSequenceIn;
+    prevout = prevoutIn;
+    scriptCode = scriptCodeIn;
+    state = stateIn;
+}
+
+// Below this size comparing and copying the scriptCode for the midstate cache
+// costs about as much as hashing it.
+static const size_t MIN_SCRIPTCODE_SIZE_FOR_MIDSTATE = 1024;
+
 uint256 SignatureHash(const CScript &scriptCode, const CTransaction &txTo,
                       unsigned int nIn, SigHashType sigHashType,
                       const Amount amount,
@@ -1879,17 +2152,35 @@ uint256 SignatureHash(const CScript &scriptCode, const CTransaction &txTo,
             hashOutputs = ss.GetHash();
         }
 
+        const COutPoint &prevout = txTo.vin[nIn].prevout;
+        const bool useMidstate =
+            cache && scriptCode.size() >= MIN_SCRIPTCODE_SIZE_FOR_MIDSTATE;
+        const CHash256 *midstate =
+            useMidstate ? cache->scriptCodeMidstate.Get(
+                              txTo.nVersion, hashPrevouts, hashSequence,
+                              prevout, scriptCode)
+                        : nullptr;
+
         CHashWriter ss(SER_GETHASH, 0);
-        // Version
-        ss << txTo.nVersion;
-        // Input prevouts/nSequence (none/all, depending on flags)
-        ss << hashPrevouts;
-        ss << hashSequence;
-        // The input being signed (replacing the scriptSig with scriptCode +
-        // amount). The prevout may already be contained in hashPrevout, and the
-        // nSequence may already be contain in hashSequence.
-        ss << txTo.vin[nIn].prevout;
-        ss << scriptCode;
+        if (midstate) {
+            ss.SetState(*midstate);
+        } else {
+            // Version
+            ss << txTo.nVersion;
+            // Input prevouts/nSequence (none/all, depending on flags)
+            ss << hashPrevouts;
+            ss << hashSequence;
+            // The input being signed (replacing the scriptSig with scriptCode +
+            // amount). The prevout may already be contained in hashPrevout, and
+            // the nSequence may already be contain in hashSequence.
+            ss << prevout;
+            ss << scriptCode;
+            if (useMidstate) {
+                cache->scriptCodeMidstate.Set(txTo.nVersion, hashPrevouts,
+                                              hashSequence, prevout, scriptCode,
+                                              ss.GetState());
+            }
+        }
         ss << amount.GetSatoshis();
         ss << txTo.vin[nIn].nSequence;
         // Outputs (none/one/all, depending on flags)
@@ -1932,24 +2223,38 @@ bool TransactionSignatureChecker::VerifySignature(
     return pubkey.Verify(sighash, vchSig);
 }
 
-bool TransactionSignatureChecker::CheckSig(
+bool TransactionSignatureChecker::GetSignatureHash(
     const std::vector<uint8_t> &vchSigIn, const std::vector<uint8_t> &vchPubKey,
-    const CScript &scriptCode, bool enabledSighashForkid) const {
-    CPubKey pubkey(vchPubKey);
+    const CScript &scriptCode, bool enabledSighashForkid,
+    std::vector<uint8_t> &vchSig, CPubKey &pubkey, uint256 &sighash) const {
+    pubkey = CPubKey(vchPubKey);
     if (!pubkey.IsValid()) {
         return false;
     }
 
     // Hash type is one byte tacked on to the end of the signature
-    std::vector<uint8_t> vchSig(vchSigIn);
+    vchSig = vchSigIn;
     if (vchSig.empty()) {
         return false;
     }
     SigHashType sigHashType = GetHashType(vchSig);
     vchSig.pop_back();
 
-    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, sigHashType, amount,
-                                    this->txdata, enabledSighashForkid);
+    sighash = SignatureHash(scriptCode, *txTo, nIn, sigHashType, amount,
+                            this->txdata, enabledSighashForkid);
+    return true;
+}
+
+bool TransactionSignatureChecker::CheckSig(
+    const std::vector<uint8_t> &vchSigIn, const std::vector<uint8_t> &vchPubKey,
+    const CScript &scriptCode, bool enabledSighashForkid) const {
+    std::vector<uint8_t> vchSig;
+    CPubKey pubkey;
+    uint256 sighash;
+    if (!GetSignatureHash(vchSigIn, vchPubKey, scriptCode, enabledSighashForkid,
+                          vchSig, pubkey, sighash)) {
+        return false;
+    }
 
     if (!VerifySignature(vchSig, pubkey, sighash)) {
         return false;
@@ -2054,7 +2359,8 @@ std::optional<bool> VerifyScript(
     const CScript& scriptPubKey,
     uint32_t flags,
     const BaseSignatureChecker& checker,
-    ScriptError* serror)
+    ScriptError* serror,
+    ScriptProfile* profile)
 {
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
 
@@ -2069,7 +2375,7 @@ std::optional<bool> VerifyScript(
 
     LimitedStack stack(config.GetMaxStackMemoryUsage(flags & SCRIPT_UTXO_AFTER_GENESIS, consensus));
     LimitedStack stackCopy(config.GetMaxStackMemoryUsage(flags & SCRIPT_UTXO_AFTER_GENESIS, consensus));
-    if (auto res = EvalScript(config, consensus, token, stack, scriptSig, flags, checker, serror);
+    if (auto res = EvalScript(config, consensus, token, stack, scriptSig, flags, checker, serror, profile);
         !res.has_value() || !res.value())
     {
         return res;
@@ -2077,7 +2383,7 @@ std::optional<bool> VerifyScript(
     if ((flags & SCRIPT_VERIFY_P2SH)  && !(flags & SCRIPT_UTXO_AFTER_GENESIS)) {
         stackCopy = stack.makeRootStackCopy();
     }
-    if (auto res = EvalScript(config, consensus, token, stack, scriptPubKey, flags, checker, serror);
+    if (auto res = EvalScript(config, consensus, token, stack, scriptPubKey, flags, checker, serror, profile);
         !res.has_value() || !res.value())
     {
         return res;
@@ -2109,11 +2415,12 @@ std::optional<bool> VerifyScript(
         // EvalScript above would return false.
         assert(!stack.empty());
 
-        const valtype& pubKeySerialized = stack.back().GetElement();
-        CScript pubKey2(pubKeySerialized.begin(), pubKeySerialized.end());
+        const bsv::span<const uint8_t> pubKeySerialized = stack.back().GetElement();
+        CScript pubKey2(pubKeySerialized.data(),
+                        pubKeySerialized.data() + pubKeySerialized.size());
         stack.pop_back();
 
-        if (auto res = EvalScript(config, consensus, token, stack, pubKey2, flags, checker, serror);
+        if (auto res = EvalScript(config, consensus, token, stack, pubKey2, flags, checker, serror, profile);
             !res.has_value() || !res.value())
         {
             return res;
@@ -11,6 +11,7 @@
 #include "script_error.h"
 #include "sighashtype.h"
 #include "limitedstack.h"
+#include "span.h"
 
 #include <cstdint>
 #include <optional>
@@ -28,8 +29,16 @@ namespace task
   class CCancellationToken;
 }
 
-bool CheckSignatureEncoding(const std::vector<uint8_t> &vchSig, uint32_t flags,
+bool CheckSignatureEncoding(bsv::span<const uint8_t> vchSig, uint32_t flags,
                             ScriptError *serror);
+bool CheckPubKeyEncoding(bsv::span<const uint8_t> vchPubKey, uint32_t flags,
+                         ScriptError *serror);
+bool CheckMinimalPush(const std::vector<uint8_t> &data, opcodetype opcode);
+bool IsOpcodeDisabled(opcodetype opcode);
+
+/** Removes the signature from scriptCode if it is not signed with SIGHASH_FORKID. */
+void CleanupScriptCode(CScript &scriptCode, bsv::span<const uint8_t> vchSig,
+                       uint32_t flags);
 
 uint256 SignatureHash(const CScript &scriptCode, const CTransaction &txTo,
                       unsigned int nIn, SigHashType sigHashType,
@@ -45,6 +54,18 @@ public:
         return false;
     }
 
+    /**
+     * Same as CheckSig, but for a signature that the script can't succeed
+     * without. Checkers may postpone verifying the signature and return true,
+     * in which case they must report an invalid signature by other means.
+     */
+    virtual bool CheckSigDeferrable(const std::vector<uint8_t> &scriptSig,
+                                    const std::vector<uint8_t> &vchPubKey,
+                                    const CScript &scriptCode,
+                                    bool enabledSighashForkid) const {
+        return CheckSig(scriptSig, vchPubKey, scriptCode, enabledSighashForkid);
+    }
+
     virtual bool CheckLockTime(const CScriptNum &nLockTime) const {
         return false;
     }
@@ -68,6 +89,16 @@ protected:
                                  const CPubKey &vchPubKey,
                                  const uint256 &sighash) const;
 
+    /**
+     * Parses the arguments of CheckSig and computes the signature hash.
+     * Returns false if the signature can't be valid.
+     */
+    bool GetSignatureHash(const std::vector<uint8_t> &vchSigIn,
+                          const std::vector<uint8_t> &vchPubKey,
+                          const CScript &scriptCode, bool enabledSighashForkid,
+                          std::vector<uint8_t> &vchSig, CPubKey &pubkey,
+                          uint256 &sighash) const;
+
 public:
     TransactionSignatureChecker(const CTransaction *txToIn, unsigned int nInIn,
                                 const Amount amountIn)
@@ -93,6 +124,54 @@ public:
         : TransactionSignatureChecker(&txTo, nInIn, amount), txTo(*txToIn) {}
 };
 
+/**
+ * Weights of the work counted in ScriptProfile in its deterministic cost.
+ * A unit of cost is roughly the time it takes to execute a simple opcode.
+ */
+static const uint64_t SCRIPT_COST_PER_OPCODE = 1;
+static const uint64_t SCRIPT_HASHED_BYTES_PER_COST = 16;
+static const uint64_t SCRIPT_COST_PER_SIGCHECK = 1000;
+static const uint64_t SCRIPT_COST_PER_BIGNUM_OP = 4;
+
+/**
+ * Work done by the interpreter while evaluating scripts. Collected by
+ * EvalScript and VerifyScript when a profile is passed in.
+ */
+struct ScriptProfile {
+    // Executed opcodes, including pushes
+    uint64_t nOpcodes = 0;
+    // Bytes hashed by OP_RIPEMD160, OP_SHA1, OP_SHA256, OP_HASH160 and OP_HASH256
+    uint64_t nHashedBytes = 0;
+    // Signatures passed to the signature checker
+    uint64_t nSigChecks = 0;
+    // Numeric opcodes evaluated with bsv::bint
+    uint64_t nBigNumOps = 0;
+
+    // If not 0, EvalScript stops as if it was cancelled once GetCost()
+    // exceeds the limit. Not summed by operator+=.
+    uint64_t nCostLimit = 0;
+
+    // Deterministic cost of the work, independent of the machine and load
+    uint64_t GetCost() const {
+        return nOpcodes * SCRIPT_COST_PER_OPCODE +
+               nHashedBytes / SCRIPT_HASHED_BYTES_PER_COST +
+               nSigChecks * SCRIPT_COST_PER_SIGCHECK +
+               nBigNumOps * SCRIPT_COST_PER_BIGNUM_OP;
+    }
+
+    bool IsOverCostLimit() const {
+        return nCostLimit != 0 && GetCost() > nCostLimit;
+    }
+
+    ScriptProfile &operator+=(const ScriptProfile &other) {
+        nOpcodes += other.nOpcodes;
+        nHashedBytes += other.nHashedBytes;
+        nSigChecks += other.nSigChecks;
+        nBigNumOps += other.nBigNumOps;
+        return *this;
+    }
+};
+
 /**
 * EvalScript function evaluates scripts against predefined limits that are
 * set by either policy rules or consensus rules. Consensus parameter determines if
@@ -112,7 +191,8 @@ std::optional<bool> EvalScript(
     long& ipc,
     std::vector<bool>& vfExec,
     std::vector<bool>& vfElse,
-    ScriptError* error = nullptr);
+    ScriptError* error = nullptr,
+    ScriptProfile* profile = nullptr);
 std::optional<bool> EvalScript(
     const CScriptConfig& config,
     bool consensus,
@@ -121,7 +201,8 @@ std::optional<bool> EvalScript(
     const CScript& script,
     uint32_t flags,
     const BaseSignatureChecker& checker,
-    ScriptError* error = nullptr);
+    ScriptError* error = nullptr,
+    ScriptProfile* profile = nullptr);
 std::optional<bool> VerifyScript(
     const CScriptConfig& config,
     bool consensus,
@@ -130,6 +211,7 @@ std::optional<bool> VerifyScript(
     const CScript& scriptPubKey,
     uint32_t flags,
     const BaseSignatureChecker& checker,
-    ScriptError* serror = nullptr);
+    ScriptError* serror = nullptr,
+    ScriptProfile* profile = nullptr);
 
 #endif // BITCOIN_SCRIPT_INTERPRETER_H
@@ -7,120 +7,250 @@
 #include "crypto/sha256.h"
 #include "script/int_serialization.h"
 #include "hash.h"
+#include <algorithm>
 #include <iostream>
 
-LimitedVector::LimitedVector(const valtype& stackElementIn, LimitedStack& stackIn) : stackElement(stackElementIn), stack(stackIn)
+LimitedVector::LimitedVector(bsv::span<const uint8_t> stackElementIn, LimitedStack& stackIn) : stack(stackIn)
 {
+    if (stackElementIn.size() > LARGE_STACK_ELEMENT_SIZE)
+    {
+        sharedElement = std::make_shared<valtype>(stackElementIn.begin(), stackElementIn.end());
+        sharedSize = stackElementIn.size();
+    }
+    else
+    {
+        stackElement.assign(stackElementIn.begin(), stackElementIn.end());
+    }
+}
+
+const uint8_t* LimitedVector::data() const
+{
+    return sharedElement ? sharedElement->data() + sharedOffset : stackElement.data();
 }
 
-const valtype& LimitedVector::GetElement() const
+void LimitedVector::makeUnique()
 {
-    return stackElement;
+    if (sharedElement &&
+        (sharedElement.use_count() > 1 || sharedOffset != 0 || sharedSize != sharedElement->size()))
+    {
+        sharedElement = std::make_shared<valtype>(data(), data() + sharedSize);
+        sharedOffset = 0;
+    }
+}
+
+void LimitedVector::makeInline()
+{
+    if (sharedElement && sharedSize <= LARGE_STACK_ELEMENT_SIZE)
+    {
+        stackElement.assign(data(), data() + sharedSize);
+        sharedElement.reset();
+        sharedOffset = 0;
+        sharedSize = 0;
+    }
 }
 
-valtype& LimitedVector::GetElementNonConst()
+bsv::span<const uint8_t> LimitedVector::GetElement() const
 {
-    return stackElement;
+    return {data(), size()};
 }
 
 size_t LimitedVector::size() const
 {
-    return stackElement.size();
+    return sharedElement ? sharedSize : stackElement.size();
 }
 
 bool LimitedVector::empty() const
 {
-    return stackElement.empty();
+    return size() == 0;
 }
 
 uint8_t& LimitedVector::operator[](uint64_t pos)
 {
-    return stackElement[pos];
+    return begin()[pos];
 }
 
 const uint8_t& LimitedVector::operator[](uint64_t pos) const
 {
-    return stackElement[pos];
+    return data()[pos];
 }
 
 void LimitedVector::push_back(uint8_t element)
 {
     stack.get().increaseCombinedStackSize(1);
-    stackElement.push_back(element);
+    if (sharedElement)
+    {
+        makeUnique();
+        sharedElement->push_back(element);
+        ++sharedSize;
+    }
+    else
+    {
+        stackElement.push_back(element);
+    }
 }
 
 void LimitedVector::append(const LimitedVector& second)
 {
     stack.get().increaseCombinedStackSize(second.size());
-    stackElement.insert(stackElement.end(), second.begin(), second.end());
+
+    if (sharedElement && sharedElement == second.sharedElement &&
+        sharedOffset + sharedSize == second.sharedOffset)
+    {
+        // Adjacent slices of the same buffer (e.g. OP_SPLIT followed by OP_CAT) are joined
+        // without copying.
+        sharedSize += second.sharedSize;
+    }
+    else if (sharedElement && sharedElement.use_count() == 1 && &second != this &&
+             sharedOffset + sharedSize == sharedElement->size())
+    {
+        // Nobody else uses the buffer so we can append in place.
+        sharedElement->insert(sharedElement->end(), second.begin(), second.end());
+        sharedSize += second.size();
+    }
+    else if (size() + second.size() > LARGE_STACK_ELEMENT_SIZE)
+    {
+        auto joined = std::make_shared<valtype>();
+        joined->reserve(size() + second.size());
+        joined->insert(joined->end(), data(), data() + size());
+        joined->insert(joined->end(), second.data(), second.data() + second.size());
+        stackElement.clear();
+        sharedElement = std::move(joined);
+        sharedOffset = 0;
+        sharedSize = sharedElement->size();
+    }
+    else
+    {
+        makeInline();
+        stackElement.insert(stackElement.end(), second.begin(), second.end());
+    }
 }
 
 void LimitedVector::padRight(size_t size, uint8_t signbit)
 {
-    if (size > stackElement.size())
+    if (size > this->size())
     {
-        size_t sizeDifference = size - stackElement.size();
+        size_t sizeDifference = size - this->size();
 
         stack.get().increaseCombinedStackSize(sizeDifference);
 
-        stackElement.resize(size, 0x00);
-        stackElement.back() = signbit;
+        if (!sharedElement && size > LARGE_STACK_ELEMENT_SIZE)
+        {
+            sharedElement = std::make_shared<valtype>(stackElement.begin(), stackElement.end());
+            sharedSize = stackElement.size();
+            stackElement.clear();
+        }
+
+        if (sharedElement)
+        {
+            makeUnique();
+            sharedElement->resize(size, 0x00);
+            sharedSize = size;
+        }
+        else
+        {
+            stackElement.resize(size);
+        }
+        back() = signbit;
+    }
+}
+
+LimitedVector LimitedVector::slice(size_t offset, size_t length) const
+{
+    if (offset + length > size())
+    {
+        throw std::invalid_argument("Invalid argument - slice is out of element bounds.");
+    }
+
+    // Only slices that cover at least half of the buffer share it. Memory held by the stack
+    // therefore never exceeds twice its combined size, while repeatedly splitting off the
+    // front or the back of a large element is still linear in the element size.
+    if (sharedElement && length > LARGE_STACK_ELEMENT_SIZE &&
+        2 * length >= sharedElement->capacity())
+    {
+        LimitedVector result{*this};
+        result.sharedOffset += offset;
+        result.sharedSize = length;
+        return result;
     }
+
+    return LimitedVector{{data() + offset, length}, stack};
 }
 
-valtype::iterator LimitedVector::begin()
+uint8_t* LimitedVector::begin()
 {
-    return stackElement.begin();
+    if (sharedElement)
+    {
+        makeUnique();
+        return sharedElement->data();
+    }
+    return stackElement.data();
 }
 
-valtype::iterator LimitedVector::end()
+uint8_t* LimitedVector::end()
 {
-    return stackElement.end();
+    return begin() + size();
 }
 
-const valtype::const_iterator LimitedVector::begin() const
+const uint8_t* LimitedVector::begin() const
 {
-    return stackElement.begin();
+    return data();
 }
 
-const valtype::const_iterator LimitedVector::end() const
+const uint8_t* LimitedVector::end() const
 {
-    return stackElement.end();
+    return data() + size();
 }
 
 uint8_t& LimitedVector::front()
 {
-    return stackElement.front();
+    return *begin();
 }
 
 uint8_t& LimitedVector::back()
 {
-    return stackElement.back();
+    return *(end() - 1);
 }
 
 const uint8_t& LimitedVector::front() const
 {
-    return stackElement.front();
+    return *begin();
 }
 
 const uint8_t& LimitedVector::back() const
 {
-    return stackElement.back();
+    return *(end() - 1);
 }
 
 bool LimitedVector::MinimallyEncode()
 {
-    stack.get().decreaseCombinedStackSize(stackElement.size());
-    bool successfulEncoding = bsv::MinimallyEncode(stackElement);
-    stack.get().increaseCombinedStackSize(stackElement.size());
+    stack.get().decreaseCombinedStackSize(size());
+    bool successfulEncoding;
+    if (sharedElement)
+    {
+        makeUnique();
+        successfulEncoding = bsv::MinimallyEncode(*sharedElement);
+        sharedSize = sharedElement->size();
+        makeInline();
+    }
+    else
+    {
+        successfulEncoding = bsv::MinimallyEncode(stackElement);
+    }
+    stack.get().increaseCombinedStackSize(size());
 
     return successfulEncoding;
 }
 
 bool LimitedVector::IsMinimallyEncoded(uint64_t maxSize) const
 {
-    return bsv::IsMinimallyEncoded(stackElement, maxSize);
+    return bsv::IsMinimallyEncoded(GetElement(), maxSize);
 }
+
+bool operator==(const LimitedVector& a, const LimitedVector& b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
 const LimitedStack& LimitedVector::getStack() const
 {
     return stack.get();
@@ -151,7 +281,7 @@ bool LimitedStack::operator==(const LimitedStack& other) const
 
     for (size_t i = 0; i < stack.size(); i++)
     {
-        if (stack.at(i).GetElement() != other.at(i).GetElement())
+        if (stack.at(i) != other.at(i))
         {
             return false;
         }
@@ -325,7 +455,8 @@ void  LimitedStack::MoveToValtypes(std::vector<valtype>& valtypes)
     for (LimitedVector& it : stack)
     {
         decreaseCombinedStackSize(it.size() + LimitedVector::ELEMENT_OVERHEAD);
-        valtypes.push_back(std::move(it.GetElementNonConst()));
+        const LimitedVector& element = it;
+        valtypes.emplace_back(element.begin(), element.end());
     }
 
     stack.clear();
@@ -4,13 +4,28 @@
 #ifndef BITCOIN_SCRIPT_LIMITEDSTACK_H
 #define BITCOIN_SCRIPT_LIMITEDSTACK_H
 
+#include "prevector.h"
+#include "span.h"
+
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <stdexcept>
 #include <vector>
 
 typedef std::vector<uint8_t> valtype;
 
+// Number of bytes a stack element can hold without a heap allocation. Large enough for
+// script numbers, hashes, public keys (33/65 bytes) and DER signatures with sighash byte
+// (up to 73 bytes), which make up nearly all elements pushed by standard scripts.
+static constexpr unsigned int STACK_ELEMENT_INLINE_SIZE = 80;
+typedef prevector<STACK_ELEMENT_INLINE_SIZE, uint8_t> stackelement;
+
+// Stack elements larger than this are kept in reference counted buffers that are shared by
+// copies of the element and by OP_SPLIT results, so that they are not copied on every
+// OP_DUP, OP_PICK, OP_SPLIT or OP_CAT.
+static constexpr size_t LARGE_STACK_ELEMENT_SIZE = 4096;
+
 class stack_overflow_error : public std::overflow_error
 {
 public:
@@ -25,21 +40,35 @@ class LimitedStack;
 class LimitedVector
 {
 private:
-    valtype stackElement;
+    // Element data is either held in stackElement or, for large elements, is the range
+    // [sharedOffset, sharedOffset + sharedSize) of sharedElement. Shared buffers are copied
+    // before they are modified, unless this is their only user.
+    stackelement stackElement;
+    std::shared_ptr<valtype> sharedElement;
+    size_t sharedOffset = 0;
+    size_t sharedSize = 0;
     std::reference_wrapper<LimitedStack> stack;
 
-    LimitedVector(const valtype& stackElementIn, LimitedStack& stackIn);
+    LimitedVector(bsv::span<const uint8_t> stackElementIn, LimitedStack& stackIn);
+
+    const uint8_t* data() const;
+
+    // Makes this element the only user of its data so that it can be modified in place.
+    void makeUnique();
+
+    // Moves the data of a shared element that is no longer large into stackElement.
+    void makeInline();
 
-    // WARNING: modifying returned element will NOT adjust stack size
-    valtype& GetElementNonConst();
 public:
 
     // Memory usage of one stack element (without data). This is a consensus rule. Do not change.
     // It prevents someone from creating stack with millions of empty elements.
     static constexpr unsigned int ELEMENT_OVERHEAD = 32;
 
-    // Warning: returned reference is invalidated if parent stack is modified.
-    const valtype& GetElement() const;
+    // Warning: returned span is invalidated if parent stack is modified.
+    bsv::span<const uint8_t> GetElement() const;
+    // Non-const accessors copy a shared buffer first, so read through a const
+    // reference or GetElement() to avoid the copy.
     uint8_t& front();
     uint8_t& back();
     const uint8_t& front() const;
@@ -54,11 +83,15 @@ public:
     void append(const LimitedVector& second);
     void padRight(size_t size, uint8_t signbit);
 
-    std::vector<uint8_t>::iterator begin();
-    std::vector<uint8_t>::iterator end();
+    // Returns element (of the same stack) with bytes [offset, offset + length) of this element.
+    // The result must still be pushed to the stack to be accounted for.
+    LimitedVector slice(size_t offset, size_t length) const;
+
+    uint8_t* begin();
+    uint8_t* end();
 
-    const std::vector<uint8_t>::const_iterator begin() const;
-    const std::vector<uint8_t>::const_iterator end() const;
+    const uint8_t* begin() const;
+    const uint8_t* end() const;
 
     bool MinimallyEncode();
     bool IsMinimallyEncoded(uint64_t maxSize) const;
@@ -68,6 +101,12 @@ public:
     friend class LimitedStack;
 };
 
+bool operator==(const LimitedVector& a, const LimitedVector& b);
+inline bool operator!=(const LimitedVector& a, const LimitedVector& b)
+{
+    return !(a == b);
+}
+
 class LimitedStack
 {
 private:
@@ -5,6 +5,7 @@
 // LICENSE.
 #include "script_num.h"
 
+#include <algorithm>
 #include <iostream>
 #include <iterator>
 
@@ -298,3 +299,361 @@ vector<uint8_t> CScriptNum::getvch() const
     // clang-format on
 }
 
+std::optional<CFixedScriptNum>
+CFixedScriptNum::Decode(bsv::span<const uint8_t> span,
+                        bool fRequireMinimal,
+                        const size_t nMaxNumSize)
+{
+    if(span.size() > nMaxNumSize)
+    {
+        throw scriptnum_overflow_error("script number overflow");
+    }
+    if(fRequireMinimal && !bsv::IsMinimallyEncoded(span, nMaxNumSize))
+    {
+        throw scriptnum_minencode_error("non-minimally encoded script number");
+    }
+    if(span.size() > MAXIMUM_ELEMENT_SIZE)
+    {
+        return std::nullopt;
+    }
+
+    CFixedScriptNum n;
+    if(span.empty())
+    {
+        return n;
+    }
+
+    const size_t last{span.size() - 1};
+    for(size_t i = 0; i < last; ++i)
+    {
+        n.limbs[i / 4] |= uint32_t{span[i]} << (8 * (i % 4));
+    }
+    n.limbs[last / 4] |= uint32_t{span[last] & 0x7fu} << (8 * (last % 4));
+    n.nLimbs = last / 4 + 1;
+    n.negative = span[last] & 0x80;
+    n.Normalize();
+    return n;
+}
+
+void CFixedScriptNum::Normalize()
+{
+    while(nLimbs > 0 && limbs[nLimbs - 1] == 0)
+    {
+        --nLimbs;
+    }
+    if(nLimbs == 0)
+    {
+        negative = false;
+    }
+}
+
+int CFixedScriptNum::CompareMagnitude(const CFixedScriptNum& a,
+                                      const CFixedScriptNum& b)
+{
+    if(a.nLimbs != b.nLimbs)
+    {
+        return a.nLimbs < b.nLimbs ? -1 : 1;
+    }
+    for(size_t i = a.nLimbs; i-- > 0;)
+    {
+        if(a.limbs[i] != b.limbs[i])
+        {
+            return a.limbs[i] < b.limbs[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+bool CFixedScriptNum::AddMagnitude(const CFixedScriptNum& other)
+{
+    const size_t n{std::max(nLimbs, other.nLimbs)};
+    uint64_t carry{0};
+    for(size_t i = 0; i < n; ++i)
+    {
+        carry += uint64_t{limbs[i]} + other.limbs[i];
+        limbs[i] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+    nLimbs = n;
+    if(carry)
+    {
+        if(n == MAX_LIMBS)
+        {
+            return false;
+        }
+        limbs[nLimbs++] = static_cast<uint32_t>(carry);
+    }
+    return true;
+}
+
+// Precondition: magnitude of other is not larger
+void CFixedScriptNum::SubMagnitude(const CFixedScriptNum& other)
+{
+    int64_t borrow{0};
+    for(size_t i = 0; i < nLimbs; ++i)
+    {
+        const int64_t diff{int64_t{limbs[i]} - other.limbs[i] - borrow};
+        borrow = diff < 0;
+        limbs[i] = static_cast<uint32_t>(diff);
+    }
+    assert(borrow == 0);
+    Normalize();
+}
+
+bool CFixedScriptNum::Add(const CFixedScriptNum& other)
+{
+    if(negative == other.negative)
+    {
+        return AddMagnitude(other);
+    }
+
+    if(CompareMagnitude(*this, other) >= 0)
+    {
+        SubMagnitude(other);
+    }
+    else
+    {
+        CFixedScriptNum result{other};
+        result.SubMagnitude(*this);
+        *this = result;
+    }
+    return true;
+}
+
+bool CFixedScriptNum::Sub(const CFixedScriptNum& other)
+{
+    CFixedScriptNum negated{other};
+    negated.Negate();
+    return Add(negated);
+}
+
+bool CFixedScriptNum::Mul(const CFixedScriptNum& other)
+{
+    if(nLimbs + other.nLimbs > MAX_LIMBS + 1)
+    {
+        return false;
+    }
+
+    std::array<uint32_t, 2 * MAX_LIMBS> product{};
+    for(size_t i = 0; i < nLimbs; ++i)
+    {
+        uint64_t carry{0};
+        for(size_t j = 0; j < other.nLimbs; ++j)
+        {
+            carry += uint64_t{limbs[i]} * other.limbs[j] + product[i + j];
+            product[i + j] = static_cast<uint32_t>(carry);
+            carry >>= 32;
+        }
+        product[i + other.nLimbs] = static_cast<uint32_t>(carry);
+    }
+
+    size_t n{nLimbs + other.nLimbs};
+    while(n > 0 && product[n - 1] == 0)
+    {
+        --n;
+    }
+    if(n > MAX_LIMBS)
+    {
+        return false;
+    }
+
+    std::copy(product.begin(), product.begin() + MAX_LIMBS, limbs.begin());
+    nLimbs = n;
+    negative = negative != other.negative && n != 0;
+    return true;
+}
+
+// Schoolbook long division of magnitudes (Knuth, TAOCP Vol. 2, 4.3.1,
+// Algorithm D) leaving either the quotient or the remainder in *this.
+void CFixedScriptNum::DivModMagnitude(const CFixedScriptNum& divisor,
+                                      const bool remainder)
+{
+    assert(divisor.nLimbs > 0);
+
+    if(CompareMagnitude(*this, divisor) < 0)
+    {
+        if(!remainder)
+        {
+            *this = CFixedScriptNum{};
+        }
+        return;
+    }
+
+    constexpr uint64_t base{uint64_t{1} << 32};
+    const size_t m{nLimbs};
+    const size_t n{divisor.nLimbs};
+    limbs_type quotient{};
+
+    if(n == 1)
+    {
+        const uint64_t d{divisor.limbs[0]};
+        uint64_t rem{0};
+        for(size_t j = m; j-- > 0;)
+        {
+            const uint64_t current{rem * base + limbs[j]};
+            quotient[j] = static_cast<uint32_t>(current / d);
+            rem = current % d;
+        }
+        if(remainder)
+        {
+            limbs = limbs_type{static_cast<uint32_t>(rem)};
+        }
+        else
+        {
+            limbs = quotient;
+        }
+        Normalize();
+        return;
+    }
+
+    // Normalize so that the top bit of the divisor is set
+    int shift{0};
+    while(!(divisor.limbs[n - 1] & (uint32_t{1} << (31 - shift))))
+    {
+        ++shift;
+    }
+
+    limbs_type vn{};
+    for(size_t i = n - 1; i > 0; --i)
+    {
+        vn[i] = (divisor.limbs[i] << shift) |
+                static_cast<uint32_t>(uint64_t{divisor.limbs[i - 1]} >> (32 - shift));
+    }
+    vn[0] = divisor.limbs[0] << shift;
+
+    std::array<uint32_t, MAX_LIMBS + 1> un{};
+    un[m] = static_cast<uint32_t>(uint64_t{limbs[m - 1]} >> (32 - shift));
+    for(size_t i = m - 1; i > 0; --i)
+    {
+        un[i] = (limbs[i] << shift) |
+                static_cast<uint32_t>(uint64_t{limbs[i - 1]} >> (32 - shift));
+    }
+    un[0] = limbs[0] << shift;
+
+    for(size_t j = m - n + 1; j-- > 0;)
+    {
+        // Estimate the quotient digit from the top two digits
+        const uint64_t top{uint64_t{un[j + n]} * base + un[j + n - 1]};
+        uint64_t qhat{top / vn[n - 1]};
+        uint64_t rhat{top % vn[n - 1]};
+        while(qhat >= base || qhat * vn[n - 2] > rhat * base + un[j + n - 2])
+        {
+            --qhat;
+            rhat += vn[n - 1];
+            if(rhat >= base)
+            {
+                break;
+            }
+        }
+
+        // Multiply and subtract
+        int64_t borrow{0};
+        uint64_t carry{0};
+        for(size_t i = 0; i < n; ++i)
+        {
+            const uint64_t p{qhat * vn[i] + carry};
+            carry = p >> 32;
+            const int64_t t{int64_t{un[i + j]} - static_cast<uint32_t>(p) - borrow};
+            un[i + j] = static_cast<uint32_t>(t);
+            borrow = t < 0;
+        }
+        const int64_t t{int64_t{un[j + n]} - static_cast<int64_t>(carry) - borrow};
+        un[j + n] = static_cast<uint32_t>(t);
+
+        // Estimate was one too large, add back
+        if(t < 0)
+        {
+            --qhat;
+            uint64_t c{0};
+            for(size_t i = 0; i < n; ++i)
+            {
+                c += uint64_t{un[i + j]} + vn[i];
+                un[i + j] = static_cast<uint32_t>(c);
+                c >>= 32;
+            }
+            un[j + n] += static_cast<uint32_t>(c);
+        }
+        quotient[j] = static_cast<uint32_t>(qhat);
+    }
+
+    if(remainder)
+    {
+        limbs = limbs_type{};
+        for(size_t i = 0; i < n - 1; ++i)
+        {
+            limbs[i] = (un[i] >> shift) |
+                       static_cast<uint32_t>((uint64_t{un[i + 1]} << (32 - shift)));
+        }
+        limbs[n - 1] = un[n - 1] >> shift;
+        nLimbs = n;
+    }
+    else
+    {
+        limbs = quotient;
+        nLimbs = m - n + 1;
+    }
+    Normalize();
+}
+
+void CFixedScriptNum::Div(const CFixedScriptNum& other)
+{
+    const bool resultNegative{negative != other.negative};
+    DivModMagnitude(other, false);
+    negative = resultNegative && nLimbs != 0;
+}
+
+void CFixedScriptNum::Mod(const CFixedScriptNum& other)
+{
+    const bool resultNegative{negative};
+    DivModMagnitude(other, true);
+    negative = resultNegative && nLimbs != 0;
+}
+
+bool operator==(const CFixedScriptNum& a, const CFixedScriptNum& b)
+{
+    return a.negative == b.negative &&
+           CFixedScriptNum::CompareMagnitude(a, b) == 0;
+}
+
+bool operator<(const CFixedScriptNum& a, const CFixedScriptNum& b)
+{
+    if(a.negative != b.negative)
+    {
+        return a.negative;
+    }
+    const int cmp{CFixedScriptNum::CompareMagnitude(a, b)};
+    return a.negative ? cmp > 0 : cmp < 0;
+}
+
+vector<uint8_t> CFixedScriptNum::getvch() const
+{
+    vector<uint8_t> result;
+    if(nLimbs == 0)
+    {
+        return result;
+    }
+
+    result.reserve(nLimbs * sizeof(uint32_t) + 1);
+    for(size_t i = 0; i < nLimbs; ++i)
+    {
+        for(size_t b = 0; b < sizeof(uint32_t); ++b)
+        {
+            result.push_back(static_cast<uint8_t>(limbs[i] >> (8 * b)));
+        }
+    }
+    while(result.back() == 0)
+    {
+        result.pop_back();
+    }
+
+    // The most significant bit of the last byte is the sign bit
+    if(result.back() & 0x80)
+    {
+        result.push_back(negative ? 0x80 : 0x00);
+    }
+    else if(negative)
+    {
+        result.back() |= 0x80;
+    }
+    return result;
+}
@@ -6,8 +6,10 @@
 
 #pragma once
 
+#include <array>
 #include <cassert>
 #include <iosfwd>
+#include <optional>
 #include <stdexcept>
 #include <variant>
 #include <vector>
@@ -178,3 +180,80 @@ inline CScriptNum operator&(CScriptNum a, int64_t b)
 
 std::ostream& operator<<(std::ostream&, const CScriptNum&);
 
+/**
+ * Signed integer of up to 512 bits held inline (sign and magnitude).
+ *
+ * Used by the interpreter to evaluate post-Genesis numeric opcodes without the
+ * heap allocations done by bsv::bint for every operation. Operations whose
+ * result would not fit report failure, in which case the caller falls back to
+ * CScriptNum with bsv::bint.
+ */
+class CFixedScriptNum
+{
+public:
+    // Longest serialized operand that can be held
+    static constexpr size_t MAXIMUM_ELEMENT_SIZE = 64;
+
+    CFixedScriptNum() = default;
+    explicit CFixedScriptNum(uint32_t n) : limbs{n}, nLimbs(n != 0 ? 1 : 0) {}
+
+    // Performs the same checks and throws the same exceptions as the
+    // CScriptNum constructor. Returns std::nullopt if the element is longer
+    // than MAXIMUM_ELEMENT_SIZE.
+    static std::optional<CFixedScriptNum> Decode(bsv::span<const uint8_t>,
+                                                 bool fRequireMinimal,
+                                                 size_t nMaxNumSize);
+
+    // Return false (leaving the value unspecified) if the result doesn't fit
+    bool Add(const CFixedScriptNum&);
+    bool Sub(const CFixedScriptNum&);
+    bool Mul(const CFixedScriptNum&);
+
+    // Truncating division and remainder with the sign of the dividend, as
+    // done by bsv::bint. Precondition: divisor is not zero.
+    void Div(const CFixedScriptNum&);
+    void Mod(const CFixedScriptNum&);
+
+    void Negate() { negative = !negative && nLimbs != 0; }
+    void Abs() { negative = false; }
+
+    bool IsZero() const { return nLimbs == 0; }
+
+    friend bool operator==(const CFixedScriptNum&, const CFixedScriptNum&);
+    friend bool operator<(const CFixedScriptNum&, const CFixedScriptNum&);
+
+    // Minimally encoded script number
+    std::vector<uint8_t> getvch() const;
+
+private:
+    static constexpr size_t MAX_LIMBS = MAXIMUM_ELEMENT_SIZE / sizeof(uint32_t);
+    using limbs_type = std::array<uint32_t, MAX_LIMBS>;
+
+    static int CompareMagnitude(const CFixedScriptNum&, const CFixedScriptNum&);
+    bool AddMagnitude(const CFixedScriptNum&);
+    void SubMagnitude(const CFixedScriptNum&);
+    void DivModMagnitude(const CFixedScriptNum&, bool remainder);
+    void Normalize();
+
+    // Little-endian magnitude; limbs at and above nLimbs are zero
+    limbs_type limbs{};
+    size_t nLimbs{0};
+    bool negative{false};
+};
+
+inline bool operator!=(const CFixedScriptNum& a, const CFixedScriptNum& b)
+{
+    return !(a == b);
+}
+inline bool operator>(const CFixedScriptNum& a, const CFixedScriptNum& b)
+{
+    return b < a;
+}
+inline bool operator<=(const CFixedScriptNum& a, const CFixedScriptNum& b)
+{
+    return !(b < a);
+}
+inline bool operator>=(const CFixedScriptNum& a, const CFixedScriptNum& b)
+{
+    return !(a < b);
+}
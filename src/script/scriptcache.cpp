@@ -8,6 +8,7 @@
 #include "cuckoocache.h"
 #include "primitives/transaction.h"
 #include "random.h"
+#include "script/compiled_script.h"
 #include "script/sigcache.h"
 #include "sync.h"
 #include "util.h"
@@ -40,6 +41,17 @@ void InitScriptExecutionCache()
     InitScriptExecutionCacheUnlocked();
 }
 
+void InitCompiledScriptCache()
+{
+    size_t nMaxMemoryUsage =
+        std::min(static_cast<uint64_t>(std::max(int64_t(0),
+                          gArgs.GetArgAsBytes("-maxcompiledscriptcachesize",
+                                       DEFAULT_MAX_COMPILED_SCRIPT_CACHE_SIZE, ONE_MEBIBYTE))),
+                 MAX_MAX_SCRIPT_CACHE_SIZE * ONE_MEBIBYTE);
+    GetCompiledScriptCache().Configure(nMaxMemoryUsage, MIN_COMPILED_SCRIPT_SIZE);
+    LogPrintf("Using %zu MiB for compiled script cache\n", nMaxMemoryUsage >> 20);
+}
+
 void ClearCache() 
 {
     std::lock_guard lock{cs_script_cache};
@@ -47,6 +59,26 @@ void ClearCache()
     InitScriptExecutionCacheUnlocked();
 }
 
+uint32_t ResizeScriptExecutionCache(size_t nBytes)
+{
+    nBytes = std::min<size_t>(nBytes, MAX_MAX_SCRIPT_CACHE_SIZE * ONE_MEBIBYTE);
+    uint32_t nElems;
+    {
+        std::lock_guard lock{cs_script_cache};
+        nElems = scriptExecutionCache->resize_bytes(nBytes);
+    }
+    LogPrintf("Resized script execution cache to %zu MiB, able to store %zu "
+              "elements\n",
+              (nElems * sizeof(uint256)) >> 20, nElems);
+    return nElems;
+}
+
+CuckooCache::stats GetScriptExecutionCacheStats()
+{
+    std::lock_guard lock{cs_script_cache};
+    return scriptExecutionCache->get_stats();
+}
+
 uint256 GetScriptCacheKey(const CTransaction &tx, uint32_t flags) {
     uint256 key;
     // We only use the first 19 bytes of nonce to avoid a second SHA round -
@@ -70,4 +102,9 @@ bool IsKeyInScriptCache(uint256 key, bool erase) {
 void AddKeyInScriptCache(uint256 key) {
     std::lock_guard lock{cs_script_cache};
     scriptExecutionCache->insert(key);
-}
\ No newline at end of file
+}
+
+void RemoveKeyFromScriptCache(uint256 key) {
+    std::lock_guard lock{cs_script_cache};
+    scriptExecutionCache->remove(key);
+}
@@ -5,6 +5,7 @@
 #ifndef BITCOIN_SCRIPT_SCRIPTCACHE_H
 #define BITCOIN_SCRIPT_SCRIPTCACHE_H
 
+#include "cuckoocache.h"
 #include "uint256.h"
 
 #include <cstdint>
@@ -21,9 +22,24 @@ static const int64_t MAX_MAX_SCRIPT_CACHE_SIZE = 16384;
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
+/**
+ * Initializes the cache of compiled scripts with -maxcompiledscriptcachesize
+ */
+void InitCompiledScriptCache();
+
 /** Clear cache content */
 void ClearCache();
 
+/**
+ * Change the size of the script execution cache to approximately nBytes
+ * (capped at -maxscriptcachesize's maximum) while keeping the cached entries
+ * that fit. Returns the number of elements the cache is able to store.
+ */
+uint32_t ResizeScriptExecutionCache(size_t nBytes);
+
+/** Usage counters of the script execution cache */
+CuckooCache::stats GetScriptExecutionCacheStats();
+
 /** Compute the cache key for a given transaction and flags. */
 uint256 GetScriptCacheKey(const CTransaction &tx, uint32_t flags);
 
@@ -33,4 +49,7 @@ bool IsKeyInScriptCache(uint256 key, bool erase);
 /** Add an entry in the cache. */
 void AddKeyInScriptCache(uint256 key);
 
+/** Remove an entry from the cache so that later lookups miss it. */
+void RemoveKeyFromScriptCache(uint256 key);
+
 #endif // BITCOIN_SCRIPT_SCRIPTCACHE_H
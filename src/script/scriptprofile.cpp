@@ -0,0 +1,144 @@
+// Copyright (c) 2020 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "script/scriptprofile.h"
+
+#include "util.h"
+
+#include <algorithm>
+
+ScriptProfile CTxScriptProfile::GetTotal() const
+{
+    ScriptProfile total {};
+    for(const CInputScriptProfile& input : inputs)
+    {
+        total += input.profile;
+    }
+    return total;
+}
+
+int64_t CTxScriptProfile::GetTotalTimeMicros() const
+{
+    int64_t total {0};
+    for(const CInputScriptProfile& input : inputs)
+    {
+        total += input.nTimeMicros;
+    }
+    return total;
+}
+
+CTxScriptProfileCollector::CTxScriptProfileCollector(const TxId& txid, size_t nInputs)
+{
+    mProfile.txid = txid;
+    mProfile.inputs.resize(nInputs);
+}
+
+CTxScriptProfileCollector::~CTxScriptProfileCollector()
+{
+    GetSlowScriptLog().Add(std::move(mProfile));
+}
+
+void CTxScriptProfileCollector::Add(size_t nIn, const CInputScriptProfile& input)
+{
+    std::lock_guard lock {mMutex};
+    mProfile.inputs.at(nIn) = input;
+}
+
+void CSlowScriptLog::SetMaxEntries(size_t nMaxEntries)
+{
+    std::lock_guard lock {mMutex};
+    mMaxEntries = nMaxEntries;
+    if(mEntries.size() > nMaxEntries)
+    {
+        std::sort(mEntries.begin(), mEntries.end(),
+            [](const CTxScriptProfile& a, const CTxScriptProfile& b)
+            {
+                return a.GetTotalTimeMicros() > b.GetTotalTimeMicros();
+            });
+        mEntries.resize(nMaxEntries);
+    }
+}
+
+void CSlowScriptLog::Add(CTxScriptProfile&& profile)
+{
+    const int64_t nTimeMicros {profile.GetTotalTimeMicros()};
+    const ScriptProfile total {profile.GetTotal()};
+    const TxId txid {profile.txid};
+    const size_t nInputs {profile.inputs.size()};
+    {
+        std::lock_guard lock {mMutex};
+        if(mMaxEntries == 0)
+        {
+            return;
+        }
+
+        auto it = std::find_if(mEntries.begin(), mEntries.end(),
+            [&txid](const CTxScriptProfile& entry)
+            {
+                return entry.txid == txid;
+            });
+        if(it == mEntries.end() && mEntries.size() < mMaxEntries)
+        {
+            mEntries.push_back(std::move(profile));
+        }
+        else
+        {
+            if(it == mEntries.end())
+            {
+                it = std::min_element(mEntries.begin(), mEntries.end(),
+                    [](const CTxScriptProfile& a, const CTxScriptProfile& b)
+                    {
+                        return a.GetTotalTimeMicros() < b.GetTotalTimeMicros();
+                    });
+            }
+            if(it->GetTotalTimeMicros() >= nTimeMicros)
+            {
+                return;
+            }
+            *it = std::move(profile);
+        }
+    }
+
+    LogPrint(BCLog::BENCH,
+        "Slow script: txid %s, %u inputs, %.2fms, %u opcodes, %u bytes hashed, "
+        "%u signature checks, %u big number operations\n",
+        txid.ToString(), nInputs, nTimeMicros * 0.001,
+        total.nOpcodes, total.nHashedBytes, total.nSigChecks, total.nBigNumOps);
+}
+
+std::vector<CTxScriptProfile> CSlowScriptLog::GetEntries() const
+{
+    std::vector<CTxScriptProfile> entries;
+    {
+        std::lock_guard lock {mMutex};
+        entries = mEntries;
+    }
+    std::sort(entries.begin(), entries.end(),
+        [](const CTxScriptProfile& a, const CTxScriptProfile& b)
+        {
+            return a.GetTotalTimeMicros() > b.GetTotalTimeMicros();
+        });
+    return entries;
+}
+
+void InitSlowScriptLog()
+{
+    const size_t nMaxEntries {
+        static_cast<size_t>(
+            std::clamp<int64_t>(
+                gArgs.GetArg("-slowscriptlogsize", DEFAULT_SLOW_SCRIPT_LOG_SIZE),
+                0,
+                MAX_SLOW_SCRIPT_LOG_SIZE))};
+    GetSlowScriptLog().SetMaxEntries(nMaxEntries);
+    if(nMaxEntries > 0)
+    {
+        LogPrintf("Script profiling enabled, keeping the %u slowest transactions\n",
+                  nMaxEntries);
+    }
+}
+
+CSlowScriptLog& GetSlowScriptLog()
+{
+    static CSlowScriptLog log;
+    return log;
+}
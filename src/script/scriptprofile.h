@@ -0,0 +1,94 @@
+// Copyright (c) 2020 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef BITCOIN_SCRIPT_SCRIPTPROFILE_H
+#define BITCOIN_SCRIPT_SCRIPTPROFILE_H
+
+#include "primitives/transaction.h"
+#include "script/interpreter.h"
+#include "script/script_error.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/** Default for -slowscriptlogsize, 0 disables script profiling */
+static const size_t DEFAULT_SLOW_SCRIPT_LOG_SIZE = 0;
+/** Maximum for -slowscriptlogsize */
+static const size_t MAX_SLOW_SCRIPT_LOG_SIZE = 1000;
+
+/** Script execution cost of a single transaction input */
+struct CInputScriptProfile
+{
+    ScriptProfile profile {};
+    int64_t nTimeMicros {0};
+    bool fVerified {false};
+    bool fValid {false};
+    ScriptError error {SCRIPT_ERR_UNKNOWN_ERROR};
+};
+
+/** Script execution cost of a transaction */
+struct CTxScriptProfile
+{
+    TxId txid {};
+    std::vector<CInputScriptProfile> inputs {};
+
+    ScriptProfile GetTotal() const;
+    int64_t GetTotalTimeMicros() const;
+};
+
+/**
+ * Collects the input profiles of a transaction while its script checks run,
+ * possibly on several script validation threads. The transaction is added to
+ * the slow script log once the last check that holds the collector is
+ * destroyed.
+ */
+class CTxScriptProfileCollector
+{
+public:
+    CTxScriptProfileCollector(const TxId& txid, size_t nInputs);
+    ~CTxScriptProfileCollector();
+
+    CTxScriptProfileCollector(const CTxScriptProfileCollector&) = delete;
+    CTxScriptProfileCollector& operator=(const CTxScriptProfileCollector&) = delete;
+
+    void Add(size_t nIn, const CInputScriptProfile& input);
+
+private:
+    std::mutex mMutex;
+    CTxScriptProfile mProfile;
+};
+
+/**
+ * Keeps the transactions whose scripts took the longest to verify during
+ * mempool acceptance and block connection.
+ */
+class CSlowScriptLog
+{
+public:
+    void SetMaxEntries(size_t nMaxEntries);
+    bool IsEnabled() const { return mMaxEntries > 0; }
+
+    /**
+     * Add the transaction if it is slower than the fastest one in the log.
+     * A transaction that is already in the log keeps the slower of the two
+     * profiles.
+     */
+    void Add(CTxScriptProfile&& profile);
+
+    /** Logged transactions ordered from the slowest */
+    std::vector<CTxScriptProfile> GetEntries() const;
+
+private:
+    std::atomic<size_t> mMaxEntries {0};
+    mutable std::mutex mMutex;
+    std::vector<CTxScriptProfile> mEntries;
+};
+
+/** Initializes the slow script log from -slowscriptlogsize */
+void InitSlowScriptLog();
+
+CSlowScriptLog& GetSlowScriptLog();
+
+#endif // BITCOIN_SCRIPT_SCRIPTPROFILE_H
@@ -14,6 +14,8 @@
 
 #include <boost/thread.hpp>
 
+#include <optional>
+
 namespace {
 
 /**
@@ -57,6 +59,29 @@ public:
         return setInvalid.contains(entry, erase);
     }
 
+    /**
+     * Look up several entries while holding the lock only once. Entries found
+     * in the valid or invalid cache get their result set.
+     */
+    void Get(const std::vector<uint256> &entries, const std::vector<bool> &erase,
+             std::vector<std::optional<bool>> &results) {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (setValid.contains(entries[i], erase[i])) {
+                results[i] = true;
+            } else if (setInvalid.contains(entries[i], erase[i])) {
+                results[i] = false;
+            }
+        }
+    }
+
+    void Set(std::vector<uint256> &entries) {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        for (uint256 &entry : entries) {
+            setValid.insert(entry);
+        }
+    }
+
     void Set(uint256 &entry) {
         boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
         setValid.insert(entry);
@@ -70,6 +95,26 @@ public:
     uint32_t setup_bytes(size_t n) { return setValid.setup_bytes(n); }
 
     uint32_t setup_bytes_invalid(size_t n) { return setInvalid.setup_bytes(n); }
+
+    uint32_t resize_bytes(size_t n) {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        return setValid.resize_bytes(n);
+    }
+
+    uint32_t resize_bytes_invalid(size_t n) {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        return setInvalid.resize_bytes(n);
+    }
+
+    CuckooCache::stats GetStats() {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        return setValid.get_stats();
+    }
+
+    CuckooCache::stats GetStatsInvalid() {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        return setInvalid.get_stats();
+    }
 };
 
 /**
@@ -98,6 +143,31 @@ void InitSignatureCache() {
     initCache("-maxinvalidsigcachesize", DEFAULT_INVALID_MAX_SIG_CACHE_SIZE, "invalid ", signatureCache, &CSignatureCache::setup_bytes_invalid);
 }
 
+uint32_t ResizeSignatureCache(size_t nBytes) {
+    nBytes = std::min<size_t>(nBytes, MAX_MAX_SIG_CACHE_SIZE * ONE_MEBIBYTE);
+    uint32_t nElems = signatureCache.resize_bytes(nBytes);
+    LogPrintf("Resized signature cache to %zu MiB, able to store %zu elements\n",
+              (nElems * sizeof(uint256)) >> 20, nElems);
+    return nElems;
+}
+
+uint32_t ResizeInvalidSignatureCache(size_t nBytes) {
+    nBytes = std::min<size_t>(nBytes, MAX_MAX_SIG_CACHE_SIZE * ONE_MEBIBYTE);
+    uint32_t nElems = signatureCache.resize_bytes_invalid(nBytes);
+    LogPrintf("Resized invalid signature cache to %zu MiB, able to store %zu "
+              "elements\n",
+              (nElems * sizeof(uint256)) >> 20, nElems);
+    return nElems;
+}
+
+CuckooCache::stats GetSignatureCacheStats() {
+    return signatureCache.GetStats();
+}
+
+CuckooCache::stats GetInvalidSignatureCacheStats() {
+    return signatureCache.GetStatsInvalid();
+}
+
 
 bool CachingTransactionSignatureChecker::VerifySignature(
     const std::vector<uint8_t> &vchSig, const CPubKey &pubkey,
@@ -122,3 +192,64 @@ bool CachingTransactionSignatureChecker::VerifySignature(
     }
     return true;
 }
+
+void CSignatureBatch::Add(std::vector<uint8_t> vchSig, const CPubKey &pubkey,
+                          const uint256 &sighash, bool store) {
+    entries.push_back({std::move(vchSig), pubkey, sighash, store});
+}
+
+bool CSignatureBatch::Verify() {
+    std::vector<uint256> cacheEntries(entries.size());
+    std::vector<bool> erase(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const Entry &e = entries[i];
+        signatureCache.ComputeEntry(cacheEntries[i], e.sighash, e.vchSig,
+                                    e.pubkey);
+        erase[i] = !e.store;
+    }
+    std::vector<std::optional<bool>> cached(entries.size());
+    signatureCache.Get(cacheEntries, erase, cached);
+
+    bool fValid = true;
+    std::vector<uint256> newEntries;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (cached[i].has_value()) {
+            if (!cached[i].value()) {
+                fValid = false;
+                break;
+            }
+            continue;
+        }
+
+        const Entry &e = entries[i];
+        if (!e.pubkey.Verify(e.sighash, e.vchSig)) {
+            signatureCache.SetInvalid(cacheEntries[i]);
+            fValid = false;
+            break;
+        }
+        if (e.store) {
+            newEntries.push_back(cacheEntries[i]);
+        }
+    }
+    if (!newEntries.empty()) {
+        signatureCache.Set(newEntries);
+    }
+
+    entries.clear();
+    return fValid;
+}
+
+bool BatchingTransactionSignatureChecker::CheckSigDeferrable(
+    const std::vector<uint8_t> &vchSigIn, const std::vector<uint8_t> &vchPubKey,
+    const CScript &scriptCode, bool enabledSighashForkid) const {
+    std::vector<uint8_t> vchSig;
+    CPubKey pubkey;
+    uint256 sighash;
+    if (!GetSignatureHash(vchSigIn, vchPubKey, scriptCode, enabledSighashForkid,
+                          vchSig, pubkey, sighash)) {
+        return false;
+    }
+
+    batch.Add(std::move(vchSig), pubkey, sighash, store);
+    return true;
+}
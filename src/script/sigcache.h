@@ -6,6 +6,8 @@
 #ifndef BITCOIN_SCRIPT_SIGCACHE_H
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
+#include "cuckoocache.h"
+#include "pubkey.h"
 #include "script/interpreter.h"
 
 #include <vector>
@@ -23,8 +25,6 @@ static const unsigned int DEFAULT_INVALID_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
 
-class CPubKey;
-
 /**
  * We're hashing a nonce into the entries themselves, so we don't need extra
  * blinding in the set hash computation.
@@ -46,7 +46,7 @@ public:
 };
 
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker {
-private:
+protected:
     bool store;
 
 public:
@@ -62,6 +62,72 @@ public:
                          const uint256 &sighash) const override;
 };
 
+/**
+ * Signatures collected from several script checks to be verified together
+ * once all the scripts have been evaluated. Signature cache lookups for the
+ * whole batch are done at once before the remaining signatures are verified.
+ */
+class CSignatureBatch {
+private:
+    struct Entry {
+        std::vector<uint8_t> vchSig;
+        CPubKey pubkey;
+        uint256 sighash;
+        bool store;
+    };
+    std::vector<Entry> entries;
+
+public:
+    void Add(std::vector<uint8_t> vchSig, const CPubKey &pubkey,
+             const uint256 &sighash, bool store);
+
+    /**
+     * Verify and remove all the signatures in the batch. Returns false if any
+     * of them is invalid.
+     */
+    bool Verify();
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+};
+
+/**
+ * Signature checker that adds the signatures scripts can't succeed without to
+ * a batch instead of verifying them.
+ */
+class BatchingTransactionSignatureChecker
+    : public CachingTransactionSignatureChecker {
+private:
+    CSignatureBatch &batch;
+
+public:
+    BatchingTransactionSignatureChecker(const CTransaction *txToIn,
+                                        unsigned int nInIn, const Amount amount,
+                                        bool storeIn,
+                                        PrecomputedTransactionData &txdataIn,
+                                        CSignatureBatch &batchIn)
+        : CachingTransactionSignatureChecker(txToIn, nInIn, amount, storeIn,
+                                             txdataIn),
+          batch(batchIn) {}
+
+    bool CheckSigDeferrable(const std::vector<uint8_t> &vchSigIn,
+                            const std::vector<uint8_t> &vchPubKey,
+                            const CScript &scriptCode,
+                            bool enabledSighashForkid) const override;
+};
+
 void InitSignatureCache();
 
+/**
+ * Change the size of the signature caches to approximately nBytes (capped at
+ * -maxsigcachesize's maximum) while keeping the cached entries that fit.
+ * Returns the number of elements the cache is able to store.
+ */
+uint32_t ResizeSignatureCache(size_t nBytes);
+uint32_t ResizeInvalidSignatureCache(size_t nBytes);
+
+/** Usage counters of the signature caches */
+CuckooCache::stats GetSignatureCacheStats();
+CuckooCache::stats GetInvalidSignatureCacheStats();
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
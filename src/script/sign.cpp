@@ -10,18 +10,30 @@
 #include "policy/policy.h"
 #include "primitives/transaction.h"
 #include "script/standard.h"
+#include "task_helpers.h"
 #include "taskcancellation.h"
+#include "threadpool.h"
 #include "uint256.h"
 #include "config.h"
 #include "validation.h"
 
+#include <algorithm>
+
 TransactionSignatureCreator::TransactionSignatureCreator(
     const CKeyStore *keystoreIn, const CTransaction *txToIn, unsigned int nInIn,
     const Amount amountIn, SigHashType sigHashTypeIn)
     : BaseSignatureCreator(keystoreIn), txTo(txToIn), nIn(nInIn),
-      amount(amountIn), sigHashType(sigHashTypeIn),
+      amount(amountIn), sigHashType(sigHashTypeIn), txdata(nullptr),
       checker(txTo, nIn, amountIn) {}
 
+TransactionSignatureCreator::TransactionSignatureCreator(
+    const CKeyStore *keystoreIn, const CTransaction *txToIn, unsigned int nInIn,
+    const Amount amountIn, SigHashType sigHashTypeIn,
+    const PrecomputedTransactionData &txdataIn)
+    : BaseSignatureCreator(keystoreIn), txTo(txToIn), nIn(nInIn),
+      amount(amountIn), sigHashType(sigHashTypeIn), txdata(&txdataIn),
+      checker(txTo, nIn, amountIn, txdataIn) {}
+
 bool TransactionSignatureCreator::CreateSig(std::vector<uint8_t> &vchSig,
                                             const CKeyID &address,
                                             const CScript &scriptCode) const {
@@ -30,7 +42,8 @@ bool TransactionSignatureCreator::CreateSig(std::vector<uint8_t> &vchSig,
         return false;
     }
 
-    uint256 hash = SignatureHash(scriptCode, *txTo, nIn, sigHashType, amount);
+    uint256 hash =
+        SignatureHash(scriptCode, *txTo, nIn, sigHashType, amount, txdata);
     if (!key.Sign(hash, vchSig)) {
         return false;
     }
@@ -406,3 +419,122 @@ bool DummySignatureCreator::CreateSig(std::vector<uint8_t> &vchSig,
     vchSig[6 + 33 + 32] = SIGHASH_ALL | SIGHASH_FORKID;
     return true;
 }
+
+namespace {
+/**
+ * Sign and verify inputs [nBegin, nEnd) of txTo. Returns the resulting
+ * signature data and verification result of each input in the range.
+ */
+std::vector<std::pair<SignatureData, std::optional<ScriptError>>>
+SignInputRange(const Config &config, const CKeyStore &keystore,
+               bool genesisEnabled, const CTransaction &txTo,
+               const PrecomputedTransactionData &txdata,
+               const std::vector<std::optional<SpentOutput>> &spentOutputs,
+               const std::vector<CMutableTransaction> &txVariants,
+               SigHashType sigHashType, size_t nBegin, size_t nEnd) {
+    std::vector<std::pair<SignatureData, std::optional<ScriptError>>> results;
+    results.reserve(nEnd - nBegin);
+    auto source = task::CCancellationSource::Make();
+
+    for (size_t i = nBegin; i < nEnd; ++i) {
+        results.emplace_back(SignatureData(txTo.vin[i].scriptSig),
+                             std::nullopt);
+        if (!spentOutputs[i]) {
+            continue;
+        }
+
+        const CScript &prevPubKey = spentOutputs[i]->txout.scriptPubKey;
+        const Amount amount = spentOutputs[i]->txout.nValue;
+        const bool utxoAfterGenesis = spentOutputs[i]->utxoAfterGenesis;
+        const TransactionSignatureChecker checker(&txTo, i, amount, txdata);
+
+        SignatureData sigdata;
+        // Only sign SIGHASH_SINGLE if there's a corresponding output:
+        if ((sigHashType.getBaseType() != BaseSigHashType::SINGLE) ||
+            (i < txTo.vout.size())) {
+            ProduceSignature(config, true,
+                             TransactionSignatureCreator(&keystore, &txTo, i,
+                                                         amount, sigHashType,
+                                                         txdata),
+                             genesisEnabled, utxoAfterGenesis, prevPubKey,
+                             sigdata);
+        }
+
+        // ... and merge in other signatures:
+        for (const CMutableTransaction &txv : txVariants) {
+            if (txv.vin.size() > i) {
+                sigdata = CombineSignatures(config, true, prevPubKey, checker,
+                                            sigdata,
+                                            DataFromTransaction(txv, i),
+                                            utxoAfterGenesis);
+            }
+        }
+
+        ScriptError serror = SCRIPT_ERR_OK;
+        auto res = VerifyScript(
+            config, true, source->GetToken(), sigdata.scriptSig, prevPubKey,
+            StandardScriptVerifyFlags(genesisEnabled, utxoAfterGenesis),
+            checker, &serror);
+        results.back() = {std::move(sigdata),
+                          res.value() ? SCRIPT_ERR_OK : serror};
+    }
+
+    return results;
+}
+} // namespace
+
+std::vector<std::optional<ScriptError>> SignTransactionInputs(
+    const Config &config, const CKeyStore &keystore, bool genesisEnabled,
+    CMutableTransaction &mtx,
+    const std::vector<std::optional<SpentOutput>> &spentOutputs,
+    const std::vector<CMutableTransaction> &txVariants,
+    SigHashType sigHashType, size_t nThreads) {
+    assert(spentOutputs.size() == mtx.vin.size());
+
+    // Use CTransaction for the constant parts of the transaction to avoid
+    // rehashing. Signature hashes don't commit to scriptSigs so the inputs
+    // can be signed against it independently.
+    const CTransaction txConst(mtx);
+    const PrecomputedTransactionData txdata(txConst);
+
+    // Keep a few batches per thread so that slow inputs (e.g. multisig) don't
+    // leave the other threads idle, but don't go below a batch size for which
+    // the task overhead would dominate.
+    static constexpr size_t MIN_BATCH_SIZE = 16;
+    const size_t nInputs = mtx.vin.size();
+    nThreads = std::max<size_t>(nThreads, 1);
+    const size_t nBatchSize =
+        std::max(MIN_BATCH_SIZE, nInputs / (nThreads * 4) + 1);
+
+    std::vector<std::future<
+        std::vector<std::pair<SignatureData, std::optional<ScriptError>>>>>
+        batches;
+    std::optional<CThreadPool<CQueueAdaptor>> pool;
+    if (nThreads > 1 && nInputs > nBatchSize) {
+        pool.emplace("TxSigning", std::min(nThreads, nInputs / nBatchSize + 1));
+    }
+
+    for (size_t nBegin = 0; nBegin < nInputs; nBegin += nBatchSize) {
+        const size_t nEnd = std::min(nInputs, nBegin + nBatchSize);
+        // Each batch gets its own copy of the precomputed data because its
+        // midstate cache can't be shared between threads.
+        auto sign = [&, nBegin, nEnd, txdata]() {
+            return SignInputRange(config, keystore, genesisEnabled, txConst,
+                                  txdata, spentOutputs, txVariants,
+                                  sigHashType, nBegin, nEnd);
+        };
+        batches.push_back(pool ? make_task(*pool, sign)
+                               : std::async(std::launch::deferred, sign));
+    }
+
+    std::vector<std::optional<ScriptError>> errors;
+    errors.reserve(nInputs);
+    for (auto &batch : batches) {
+        for (auto &[sigdata, error] : batch.get()) {
+            UpdateTransaction(mtx, errors.size(), sigdata);
+            errors.push_back(error);
+        }
+    }
+
+    return errors;
+}
@@ -9,6 +9,8 @@
 #include "script/interpreter.h"
 #include "script/sighashtype.h"
 
+#include <optional>
+
 class CKeyID;
 class CKeyStore;
 class CMutableTransaction;
@@ -37,6 +39,7 @@ class TransactionSignatureCreator : public BaseSignatureCreator {
     unsigned int nIn;
     Amount amount;
     SigHashType sigHashType;
+    const PrecomputedTransactionData *txdata;
     const TransactionSignatureChecker checker;
 
 public:
@@ -44,6 +47,11 @@ public:
                                 const CTransaction *txToIn, unsigned int nInIn,
                                 const Amount amountIn,
                                 SigHashType sigHashTypeIn = SigHashType());
+    TransactionSignatureCreator(const CKeyStore *keystoreIn,
+                                const CTransaction *txToIn, unsigned int nInIn,
+                                const Amount amountIn,
+                                SigHashType sigHashTypeIn,
+                                const PrecomputedTransactionData &txdataIn);
     const BaseSignatureChecker &Checker() const override { return checker; }
     bool CreateSig(std::vector<uint8_t> &vchSig, const CKeyID &keyid,
                    const CScript &scriptCode) const override;
@@ -107,4 +115,27 @@ SignatureData DataFromTransaction(const CMutableTransaction &tx,
 void UpdateTransaction(CMutableTransaction &tx, unsigned int nIn,
                        const SignatureData &data);
 
+/** Output spent by an input of a transaction signed by SignTransactionInputs. */
+struct SpentOutput {
+    CTxOut txout;
+    bool utxoAfterGenesis;
+};
+
+/**
+ * Sign all inputs of a transaction whose spent outputs are known, merge in the
+ * signatures found in txVariants and verify the result with the standard
+ * flags. Signature hashes of an input don't depend on the scriptSigs of the
+ * other inputs, so inputs are signed and verified in batches on up to
+ * nThreads threads that share the precomputed hashes of the transaction.
+ *
+ * Returns the verification result of each input: std::nullopt if its spent
+ * output is unknown, SCRIPT_ERR_OK if it is fully signed.
+ */
+std::vector<std::optional<ScriptError>> SignTransactionInputs(
+    const Config &config, const CKeyStore &keystore, bool genesisEnabled,
+    CMutableTransaction &mtx,
+    const std::vector<std::optional<SpentOutput>> &spentOutputs,
+    const std::vector<CMutableTransaction> &txVariants,
+    SigHashType sigHashType, size_t nThreads);
+
 #endif // BITCOIN_SCRIPT_SIGN_H
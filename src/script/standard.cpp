@@ -8,10 +8,13 @@
 
 #include "pubkey.h"
 #include "script/script.h"
+#include "script_config.h"
 #include "util.h"
 #include "utilstrencodings.h"
 #include "int_serialization.h"
 
+#include <algorithm>
+
 typedef std::vector<uint8_t> valtype;
 
 bool fAcceptDatacarrier = DEFAULT_ACCEPT_DATACARRIER;
@@ -200,6 +203,231 @@ bool Solver(const CScript &scriptPubKey,
     return false;
 }
 
+namespace {
+
+bool SetError(ScriptError* serror, ScriptError error) {
+    if (serror) {
+        *serror = error;
+    }
+    return error == SCRIPT_ERR_OK;
+}
+
+/**
+ * Check that every push in the script is one that EvalScript executes
+ * regardless of flags. If pushes is not null, the pushed values are returned
+ * and any other opcode fails the check.
+ */
+bool CheckPushes(const CScript& script, std::vector<valtype>* pushes) {
+    opcodetype opcode;
+    valtype data;
+    for (CScript::const_iterator pc = script.begin(); pc < script.end();) {
+        if (!script.GetOp(pc, opcode, data)) {
+            return false;
+        }
+        if (opcode > OP_PUSHDATA4) {
+            if (pushes) {
+                return false;
+            }
+            continue;
+        }
+        if (data.size() > MAX_SCRIPT_ELEMENT_SIZE_BEFORE_GENESIS ||
+            !CheckMinimalPush(data, opcode)) {
+            return false;
+        }
+        if (pushes) {
+            pushes->push_back(std::move(data));
+        }
+    }
+    return true;
+}
+
+// OP_CHECKSIG without the stack. Returns false if script evaluation fails.
+bool EvalCheckSig(const valtype& vchSig, const valtype& vchPubKey,
+                  const CScript& scriptPubKey, uint32_t flags,
+                  const BaseSignatureChecker& checker, ScriptError* serror,
+                  bool& fSuccess) {
+    if (!CheckSignatureEncoding(vchSig, flags, serror) ||
+        !CheckPubKeyEncoding(vchPubKey, flags, serror)) {
+        return false;
+    }
+
+    CScript scriptCode{scriptPubKey};
+    CleanupScriptCode(scriptCode, vchSig, flags);
+
+    // The scripts handled here fail if the signature is not valid
+    fSuccess = checker.CheckSigDeferrable(vchSig, vchPubKey, scriptCode,
+                                          flags & SCRIPT_ENABLE_SIGHASH_FORKID);
+    if (!fSuccess && (flags & SCRIPT_VERIFY_NULLFAIL) && !vchSig.empty()) {
+        return SetError(serror, SCRIPT_ERR_SIG_NULLFAIL);
+    }
+    return true;
+}
+
+// OP_CHECKMULTISIG without the stack. Signatures and keys are checked in the
+// same order as done by EvalScript, which starts with the last ones.
+bool EvalCheckMultiSig(const std::vector<valtype>& vchSigs,
+                       const std::vector<valtype>& vchPubKeys,
+                       const CScript& scriptPubKey, uint32_t flags,
+                       const BaseSignatureChecker& checker,
+                       ScriptError* serror, bool& fSuccess) {
+    CScript scriptCode{scriptPubKey};
+    for (auto it = vchSigs.rbegin(); it != vchSigs.rend(); ++it) {
+        CleanupScriptCode(scriptCode, *it, flags);
+    }
+
+    auto itSig = vchSigs.rbegin();
+    auto itPubKey = vchPubKeys.rbegin();
+    size_t nSigsCount = vchSigs.size();
+    size_t nKeysCount = vchPubKeys.size();
+    fSuccess = true;
+    while (fSuccess && nSigsCount > 0) {
+        if (!CheckSignatureEncoding(*itSig, flags, serror) ||
+            !CheckPubKeyEncoding(*itPubKey, flags, serror)) {
+            return false;
+        }
+
+        if (checker.CheckSig(*itSig, *itPubKey, scriptCode,
+                             flags & SCRIPT_ENABLE_SIGHASH_FORKID)) {
+            ++itSig;
+            --nSigsCount;
+        }
+        ++itPubKey;
+        --nKeysCount;
+
+        if (nSigsCount > nKeysCount) {
+            fSuccess = false;
+        }
+    }
+
+    if (!fSuccess && (flags & SCRIPT_VERIFY_NULLFAIL)) {
+        for (const valtype& vchSig : vchSigs) {
+            if (!vchSig.empty()) {
+                return SetError(serror, SCRIPT_ERR_SIG_NULLFAIL);
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+std::optional<bool> VerifyStandardScript(const CScriptConfig& config,
+                                         bool consensus,
+                                         const CScript& scriptSig,
+                                         const CScript& scriptPubKey,
+                                         uint32_t flags,
+                                         const BaseSignatureChecker& checker,
+                                         ScriptError* serror) {
+    // If FORKID is enabled, we also ensure strict encoding.
+    if (flags & SCRIPT_ENABLE_SIGHASH_FORKID) {
+        flags |= SCRIPT_VERIFY_STRICTENC;
+    }
+    const bool genesisEnabled = (flags & SCRIPT_UTXO_AFTER_GENESIS) != 0;
+
+    txnouttype whichType;
+    std::vector<valtype> vSolutions;
+    if (!Solver(scriptPubKey, genesisEnabled, whichType, vSolutions)) {
+        return std::nullopt;
+    }
+
+    // Number of values expected in scriptSig and opcodes counted by EvalScript
+    size_t nPushes;
+    uint64_t nOpCount;
+    switch (whichType) {
+        case TX_PUBKEY:
+            nPushes = 1;
+            nOpCount = 1;
+            break;
+        case TX_PUBKEYHASH:
+            nPushes = 2;
+            nOpCount = 4;
+            break;
+        case TX_MULTISIG: {
+            // Only the OP_1 .. OP_16 forms of the counts are handled
+            const auto nSigsOpcode = static_cast<opcodetype>(scriptPubKey.front());
+            const auto nKeysOpcode =
+                static_cast<opcodetype>(scriptPubKey[scriptPubKey.size() - 2]);
+            if (nSigsOpcode < OP_1 || nSigsOpcode > OP_16 ||
+                nKeysOpcode < OP_1 || nKeysOpcode > OP_16) {
+                return std::nullopt;
+            }
+            const uint64_t nKeysCount = vSolutions.size() - 2;
+            if (nKeysCount > config.GetMaxPubKeysPerMultiSig(genesisEnabled, consensus)) {
+                return std::nullopt;
+            }
+            // Dummy element followed by the signatures
+            nPushes = CScript::DecodeOP_N(nSigsOpcode) + 1;
+            nOpCount = nKeysCount + 1;
+            break;
+        }
+        default:
+            return std::nullopt;
+    }
+
+    const uint64_t maxScriptSize = config.GetMaxScriptSize(genesisEnabled, consensus);
+    if (scriptSig.size() > maxScriptSize || scriptPubKey.size() > maxScriptSize ||
+        nOpCount > config.GetMaxOpsPerScript(genesisEnabled, consensus)) {
+        return std::nullopt;
+    }
+
+    std::vector<valtype> stack;
+    if (!CheckPushes(scriptSig, &stack) || stack.size() != nPushes ||
+        !CheckPushes(scriptPubKey, nullptr)) {
+        return std::nullopt;
+    }
+
+    // Upper bound of the stack memory used by EvalScript
+    const uint64_t maxStackMemoryUsage =
+        2 * (scriptSig.size() + scriptPubKey.size()) +
+        LimitedVector::ELEMENT_OVERHEAD * (nPushes + vSolutions.size() + 2);
+    if (maxStackMemoryUsage > config.GetMaxStackMemoryUsage(genesisEnabled, consensus)) {
+        return std::nullopt;
+    }
+
+    bool fSuccess = false;
+    switch (whichType) {
+        case TX_PUBKEY:
+            if (!EvalCheckSig(stack[0], vSolutions[0], scriptPubKey, flags,
+                              checker, serror, fSuccess)) {
+                return false;
+            }
+            break;
+        case TX_PUBKEYHASH: {
+            const uint160 hash = Hash160(stack[1].begin(), stack[1].end());
+            if (!std::equal(hash.begin(), hash.end(), vSolutions[0].begin(),
+                            vSolutions[0].end())) {
+                return SetError(serror, SCRIPT_ERR_EQUALVERIFY);
+            }
+            if (!EvalCheckSig(stack[0], stack[1], scriptPubKey, flags,
+                              checker, serror, fSuccess)) {
+                return false;
+            }
+            break;
+        }
+        case TX_MULTISIG: {
+            const std::vector<valtype> vchSigs(stack.begin() + 1, stack.end());
+            const std::vector<valtype> vchPubKeys(vSolutions.begin() + 1,
+                                                  vSolutions.end() - 1);
+            if (!EvalCheckMultiSig(vchSigs, vchPubKeys, scriptPubKey, flags,
+                                   checker, serror, fSuccess)) {
+                return false;
+            }
+            // A bug causes CHECKMULTISIG to consume one extra argument.
+            if ((flags & SCRIPT_VERIFY_NULLDUMMY) && !stack[0].empty()) {
+                return SetError(serror, SCRIPT_ERR_SIG_NULLDUMMY);
+            }
+            break;
+        }
+        default:
+            assert(!"unexpected script type");
+    }
+
+    if (!fSuccess) {
+        return SetError(serror, SCRIPT_ERR_EVAL_FALSE);
+    }
+    return SetError(serror, SCRIPT_ERR_OK);
+}
+
 bool ExtractDestination(const CScript &scriptPubKey, bool isGenesisEnabled,
                         CTxDestination &addressRet) {
     std::vector<valtype> vSolutions;
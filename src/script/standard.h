@@ -12,6 +12,7 @@
 #include <boost/variant.hpp>
 
 #include <cstdint>
+#include <optional>
 
 static const bool DEFAULT_ACCEPT_DATACARRIER = true;
 
@@ -82,6 +83,27 @@ bool IsValidDestination(const CTxDestination &dest);
 bool Solver(const CScript& scriptPubKey, bool genesisEnabled, txnouttype& typeRet,
     std::vector<std::vector<uint8_t>>& vSolutionsRet);
 
+/**
+ * Verify scriptSig against a P2PK, P2PKH or bare multisig scriptPubKey with a
+ * straight-line routine instead of running both scripts through EvalScript.
+ *
+ * Returns std::nullopt if the scripts are not handled (scriptPubKey doesn't
+ * match one of the templates, scriptSig is not a plain push of the expected
+ * arguments, or the configured limits could be hit) in which case they must be
+ * verified with VerifyScript. Otherwise returns the same result and sets the
+ * same error as VerifyScript.
+ *
+ * P2PK and P2PKH signatures are checked with CheckSigDeferrable since these
+ * scripts fail whenever the signature is not valid.
+ */
+std::optional<bool> VerifyStandardScript(const CScriptConfig& config,
+                                         bool consensus,
+                                         const CScript& scriptSig,
+                                         const CScript& scriptPubKey,
+                                         uint32_t flags,
+                                         const BaseSignatureChecker& checker,
+                                         ScriptError* serror = nullptr);
+
 /*
  * Extract a single destination from P2PK, P2PKH, P2SH
  */
@@ -0,0 +1,143 @@
+// Copyright (c) 2019 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "chainstate_warmup.h"
+
+#include "coins.h"
+#include "config.h"
+#include "mining/journal_change_set.h"
+#include "taskcancellation.h"
+#include "test/test_bitcoin.h"
+#include "txdb.h"
+#include "txmempool.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+namespace
+{
+    mining::CJournalChangeSetPtr nullChangeSet {nullptr};
+
+    std::vector<COutPoint> PopulateCoins(CCoinsView& view, size_t nCoins)
+    {
+        std::vector<COutPoint> outpoints {};
+        CCoinsViewCache cache { &view };
+        for(size_t i = 0; i < nCoins; ++i)
+        {
+            CTxOut txout {};
+            txout.nValue = Amount(int64_t(1 + InsecureRandRange(1000000)));
+            txout.scriptPubKey.assign(25, uint8_t(0));
+            COutPoint outpoint { TxId(InsecureRand256()), static_cast<uint32_t>(InsecureRandRange(3)) };
+            cache.AddCoin(outpoint, Coin(txout, 1, false), false, GlobalConfig::GetConfig().GetGenesisActivationHeight());
+            outpoints.push_back(outpoint);
+        }
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_REQUIRE(cache.Flush());
+        return outpoints;
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(chainstate_warmup_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(dump_and_warmup)
+{
+    CCoinsViewDB view { 1 << 20, true };
+    std::vector<COutPoint> outpoints { PopulateCoins(view, 3000) };
+
+    // Coins touched by validation before shutdown
+    CCoinsViewCache tip { &view };
+    for(size_t i = 0; i < 2000; ++i)
+    {
+        BOOST_CHECK(tip.HaveCoin(outpoints[i]));
+    }
+    // Spent coins are not worth preloading
+    BOOST_CHECK(tip.SpendCoin(outpoints[0]));
+
+    // Confirmed input of a mempool transaction
+    CTxMemPool pool {};
+    CMutableTransaction tx {};
+    tx.vin.emplace_back(outpoints[2500]);
+    tx.vout.emplace_back(Amount(1), CScript());
+    pool.AddUnchecked(tx.GetId(), TestMemPoolEntryHelper{}.FromTx(tx), nullChangeSet);
+
+    fs::path path { pathTemp / HOT_COINS_PROFILE_FILENAME };
+    BOOST_CHECK_EQUAL(DumpHotCoinsProfile(tip, pool, path, DEFAULT_HOT_COINS_PROFILE_MAX_COINS), 2000U);
+    BOOST_CHECK(fs::exists(path));
+
+    auto source = task::CCancellationSource::Make();
+    CCoinsViewCache cold { &view };
+    WarmupFromHotCoinsProfile(cold, path, 4, std::numeric_limits<size_t>::max(), source->GetToken());
+
+    BOOST_CHECK_EQUAL(cold.GetCacheSize(), 2000U);
+    BOOST_CHECK(!cold.HaveCoinInCache(outpoints[0]));
+    BOOST_CHECK(cold.HaveCoinInCache(outpoints[1]));
+    BOOST_CHECK(cold.HaveCoinInCache(outpoints[2500]));
+    BOOST_CHECK(!cold.HaveCoinInCache(outpoints[2999]));
+
+    CChainstateWarmupStatus status { GetChainstateWarmupStatus() };
+    BOOST_CHECK(status.mode == ChainstateWarmupMode::HOT_COINS);
+    BOOST_CHECK_EQUAL(status.state, "finished");
+    BOOST_CHECK_EQUAL(status.nTotal, 2000U);
+    BOOST_CHECK_EQUAL(status.nProcessed, 2000U);
+    BOOST_CHECK_EQUAL(status.nLoaded, 2000U);
+
+    // Profile limited to fewer coins keeps mempool inputs first
+    BOOST_CHECK_EQUAL(DumpHotCoinsProfile(tip, pool, path, 1), 1U);
+    CCoinsViewCache limited { &view };
+    WarmupFromHotCoinsProfile(limited, path, 1, std::numeric_limits<size_t>::max(), source->GetToken());
+    BOOST_CHECK_EQUAL(limited.GetCacheSize(), 1U);
+    BOOST_CHECK(limited.HaveCoinInCache(outpoints[2500]));
+}
+
+BOOST_AUTO_TEST_CASE(warmup_limits)
+{
+    CCoinsViewDB view { 1 << 20, true };
+    std::vector<COutPoint> outpoints { PopulateCoins(view, 3000) };
+
+    CCoinsViewCache tip { &view };
+    for(const COutPoint& outpoint : outpoints)
+    {
+        BOOST_CHECK(tip.HaveCoin(outpoint));
+    }
+    CTxMemPool pool {};
+    fs::path path { pathTemp / HOT_COINS_PROFILE_FILENAME };
+    DumpHotCoinsProfile(tip, pool, path, DEFAULT_HOT_COINS_PROFILE_MAX_COINS);
+
+    // Warmup stops once the cache reaches the memory limit
+    auto source = task::CCancellationSource::Make();
+    CCoinsViewCache small { &view };
+    WarmupFromHotCoinsProfile(small, path, 2, 1, source->GetToken());
+    BOOST_CHECK_EQUAL(small.GetCacheSize(), 0U);
+    BOOST_CHECK_EQUAL(GetChainstateWarmupStatus().state, "finished");
+
+    // Canceled warmup doesn't load anything
+    source->Cancel();
+    CCoinsViewCache canceled { &view };
+    WarmupFromHotCoinsProfile(canceled, path, 2, std::numeric_limits<size_t>::max(), source->GetToken());
+    BOOST_CHECK_EQUAL(canceled.GetCacheSize(), 0U);
+    BOOST_CHECK_EQUAL(GetChainstateWarmupStatus().state, "canceled");
+
+    // Missing profile
+    auto active = task::CCancellationSource::Make();
+    WarmupFromHotCoinsProfile(canceled, pathTemp / "missing.dat", 2, std::numeric_limits<size_t>::max(), active->GetToken());
+    BOOST_CHECK_EQUAL(GetChainstateWarmupStatus().state, "failed");
+}
+
+BOOST_AUTO_TEST_CASE(warmup_after_flush)
+{
+    CCoinsViewDB view { 1 << 20, true };
+    std::vector<COutPoint> outpoints { PopulateCoins(view, 10) };
+
+    // Coin spent and flushed after being prefetched stays spent
+    CCoinsViewCache tip { &view };
+    BOOST_CHECK_EQUAL(tip.Prefetch(outpoints), outpoints.size());
+    BOOST_CHECK(tip.SpendCoin(outpoints[0]));
+    tip.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(tip.Flush());
+    BOOST_CHECK(!tip.HaveCoin(outpoints[0]));
+    BOOST_CHECK_EQUAL(tip.Prefetch(outpoints), outpoints.size() - 1);
+    BOOST_CHECK(!tip.HaveCoin(outpoints[0]));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
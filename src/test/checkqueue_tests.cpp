@@ -8,6 +8,7 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/thread/thread.hpp>
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <future>
@@ -57,6 +58,42 @@ namespace
         void swap(CDummyValidator& check) {/**/}
     };
 
+    /**
+     * Validator that defers its result to the batch when run by the queue
+     */
+    struct CBatchedValidator
+    {
+        struct CBatch
+        {
+            std::vector<bool> results;
+
+            bool Verify()
+            {
+                ++verifyCount;
+                bool fOk = std::find(results.begin(), results.end(), false) == results.end();
+                results.clear();
+                return fOk;
+            }
+        };
+        using batch_type = CBatch;
+
+        std::optional<bool> operator()(const task::CCancellationToken&)
+        {
+            return mResult;
+        }
+
+        std::optional<bool> operator()(const task::CCancellationToken&, CBatch& batch)
+        {
+            batch.results.push_back(mResult);
+            return true;
+        }
+
+        void swap(CBatchedValidator& check) { std::swap(mResult, check.mResult); }
+
+        bool mResult = true;
+        static inline std::atomic<int> verifyCount = 0;
+    };
+
     struct CCancellingValidator
     {
         std::optional<bool> operator()(const task::CCancellationToken& token)
@@ -157,6 +194,30 @@ BOOST_AUTO_TEST_CASE(premature_validation_cancellation)
     BOOST_CHECK(!result.has_value());
 }
 
+BOOST_AUTO_TEST_CASE(batched_validation)
+{
+    boost::thread_group threadGroup;
+    CCheckQueue<CBatchedValidator> check{4, threadGroup, 2, ""};
+
+    for(bool fValid : {true, false, true})
+    {
+        std::vector<CBatchedValidator> checks(100);
+        checks[50].mResult = fValid;
+        CBatchedValidator::verifyCount = 0;
+
+        auto source = task::CCancellationSource::Make();
+        check.StartCheckingSession(source->GetToken());
+        check.Add(checks);
+        auto result = check.Wait();
+
+        BOOST_CHECK_EQUAL(result.value(), fValid);
+        BOOST_CHECK_GT(CBatchedValidator::verifyCount.load(), 0);
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
 BOOST_AUTO_TEST_CASE(check_queue_pool_termination)
 {
     boost::thread_group threadGroup;
@@ -928,4 +928,54 @@ BOOST_AUTO_TEST_CASE(coin_write) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(coins_prefetch) {
+    CCoinsViewTest base;
+    std::vector<COutPoint> outpoints;
+    {
+        CCoinsViewCacheTest filler(&base);
+        for (uint32_t n = 0; n < 10; ++n) {
+            COutPoint outpoint(TxId(InsecureRand256()), n);
+            CTxOut txout(Amount(int64_t(n + 1)), CScript() << OP_TRUE);
+            filler.AddCoin(outpoint, Coin(txout, 1, false), false, 0);
+            outpoints.push_back(outpoint);
+        }
+        filler.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(filler.Flush());
+    }
+
+    CCoinsViewCacheTest cache(&base);
+    // Coin already spent in the cache must not be resurrected by prefetching
+    BOOST_CHECK(cache.SpendCoin(outpoints[0]));
+    // Outpoint that doesn't exist anywhere
+    COutPoint missing(TxId(InsecureRand256()), 0);
+    std::vector<COutPoint> prefetch = outpoints;
+    prefetch.push_back(missing);
+
+    BOOST_CHECK_EQUAL(cache.Prefetch(prefetch), outpoints.size() - 1);
+    cache.SelfTest();
+
+    BOOST_CHECK(!cache.HaveCoinInCache(missing));
+    BOOST_CHECK(cache.AccessCoin(outpoints[0]).IsSpent());
+    BOOST_CHECK(cache.map().at(outpoints[0]).flags & CCoinsCacheEntry::DIRTY);
+    for (size_t i = 1; i < outpoints.size(); ++i) {
+        BOOST_CHECK(cache.HaveCoinInCache(outpoints[i]));
+        BOOST_CHECK_EQUAL(cache.map().at(outpoints[i]).flags, 0);
+        BOOST_CHECK_EQUAL(cache.AccessCoin(outpoints[i]).GetTxOut().nValue,
+                          Amount(int64_t(i + 1)));
+    }
+
+    // Prefetching again is a no-op
+    size_t usage = cache.DynamicMemoryUsage();
+    BOOST_CHECK_EQUAL(cache.Prefetch(prefetch), 0U);
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), usage);
+    cache.SelfTest();
+
+    // Only unspent coins are reported as cached
+    std::vector<COutPoint> cached = cache.GetCachedOutpoints(outpoints.size());
+    BOOST_CHECK_EQUAL(cached.size(), outpoints.size() - 1);
+    BOOST_CHECK(std::find(cached.begin(), cached.end(), outpoints[0]) ==
+                cached.end());
+    BOOST_CHECK_EQUAL(cache.GetCachedOutpoints(3).size(), 3U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,317 @@
+// Copyright (c) 2020 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "script/compiled_script.h"
+
+#include "config.h"
+#include "consensus/consensus.h"
+#include "script/interpreter.h"
+#include "script/limitedstack.h"
+#include "taskcancellation.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <thread>
+
+namespace
+{
+    struct EvalResult
+    {
+        std::optional<bool> result;
+        ScriptError error;
+        LimitedStack stack;
+    };
+
+    EvalResult Eval(const CScript& script, uint32_t flags)
+    {
+        const Config& config = GlobalConfig::GetConfig();
+        auto source = task::CCancellationSource::Make();
+        EvalResult res {{}, SCRIPT_ERR_OK, LimitedStack(UINT32_MAX)};
+        res.result = EvalScript(
+            config, true, source->GetToken(), res.stack, script, flags,
+            BaseSignatureChecker{}, &res.error);
+        return res;
+    }
+
+    // Evaluates the script with and without the compiled script cache
+    void CheckSameResult(CCompiledScriptCache& cache, const CScript& script)
+    {
+        for(uint32_t flags : {0U, static_cast<uint32_t>(SCRIPT_UTXO_AFTER_GENESIS)})
+        {
+            cache.Configure(0, 0);
+            const EvalResult expected {Eval(script, flags)};
+            cache.Configure(10 * ONE_MEBIBYTE, 0);
+            const EvalResult compiled {Eval(script, flags)};
+            // Second evaluation uses the cached script
+            const EvalResult cached {Eval(script, flags)};
+
+            for(const EvalResult* res : {&compiled, &cached})
+            {
+                BOOST_CHECK(res->result == expected.result);
+                BOOST_CHECK_EQUAL(res->error, expected.error);
+                BOOST_CHECK(res->stack == expected.stack);
+            }
+        }
+    }
+
+    CScript RandomScript()
+    {
+        static const std::vector<opcodetype> opcodes {
+            OP_0, OP_1, OP_2, OP_16, OP_IF, OP_NOTIF, OP_ELSE, OP_ENDIF,
+            OP_IF, OP_NOTIF, OP_ELSE, OP_ENDIF, OP_DUP, OP_DROP, OP_ADD,
+            OP_VERIFY, OP_RETURN, OP_2MUL, OP_VERIF, OP_SHA256, OP_NOP,
+            OP_CHECKSIG, OP_CODESEPARATOR, OP_INVALIDOPCODE};
+
+        CScript script;
+        const int nSize = InsecureRandRange(40);
+        for(int i = 0; i < nSize; ++i)
+        {
+            switch(InsecureRandRange(10))
+            {
+                case 0:
+                    script << std::vector<uint8_t>(
+                        InsecureRandBool() ? 3 : MAX_SCRIPT_ELEMENT_SIZE_BEFORE_GENESIS + 1, 0x01);
+                    break;
+                case 1:
+                    // Enough skipped opcodes to exceed the op count limit
+                    // before Genesis
+                    for(int j = 0; j < 100; ++j)
+                    {
+                        script << OP_NOP;
+                    }
+                    break;
+                default:
+                    script << opcodes[InsecureRandRange(opcodes.size())];
+                    break;
+            }
+        }
+        return script;
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(compiled_script_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(compile_instructions)
+{
+    const std::vector<uint8_t> data {1, 2, 3};
+    const CScript script =
+        CScript() << OP_1 << data
+                  << OP_IF << OP_DUP << OP_DROP
+                  << OP_ELSE << OP_1 << OP_IF << OP_NOP << OP_ENDIF
+                  << OP_ENDIF;
+    const CCompiledScript compiled {script};
+    BOOST_CHECK(compiled.IsCompiledFrom(script));
+    BOOST_CHECK(!compiled.IsCompiledFrom(CScript() << OP_1));
+
+    const auto& instructions = compiled.GetInstructions();
+    BOOST_REQUIRE_EQUAL(instructions.size(), 11U);
+
+    BOOST_CHECK_EQUAL(instructions[1].GetOpcode(), 3);
+    BOOST_CHECK_EQUAL(instructions[1].GetOffset(), 1U);
+    BOOST_CHECK_EQUAL(instructions[1].GetEnd(), 5U);
+    const auto push = instructions[1].GetData(script);
+    BOOST_CHECK(std::vector<uint8_t>(push.begin(), push.end()) == data);
+    BOOST_CHECK_EQUAL(instructions[2].GetData(script).size(), 0U);
+    BOOST_CHECK_EQUAL(instructions[2].GetEnd(), 6U);
+
+    // OP_IF jumps to OP_ELSE over OP_DUP and OP_DROP
+    BOOST_CHECK_EQUAL(instructions[2].GetJump(), 5U);
+    BOOST_CHECK_EQUAL(instructions[2].GetJumpOpCount(), 2U);
+    BOOST_CHECK(instructions[2].CanJump(false));
+    BOOST_CHECK(instructions[2].CanJump(true));
+
+    // OP_ELSE jumps to the outer OP_ENDIF over the nested conditional
+    BOOST_CHECK_EQUAL(instructions[5].GetJump(), 10U);
+    BOOST_CHECK_EQUAL(instructions[5].GetJumpOpCount(), 3U);
+    BOOST_CHECK_EQUAL(instructions[7].GetJump(), 9U);
+
+    // Other instructions don't jump
+    BOOST_CHECK_EQUAL(instructions[3].GetJump(), CCompiledScript::NO_JUMP);
+    BOOST_CHECK(!instructions[3].CanJump(false));
+    BOOST_CHECK_EQUAL(instructions[10].GetJump(), CCompiledScript::NO_JUMP);
+}
+
+BOOST_AUTO_TEST_CASE(compile_jump_conditions)
+{
+    {
+        // Disabled opcodes fail the script before Genesis even if they are
+        // not executed
+        const CCompiledScript compiled {
+            CScript() << OP_0 << OP_IF << OP_2MUL << OP_ENDIF};
+        BOOST_CHECK(!compiled.GetInstructions()[1].CanJump(false));
+        BOOST_CHECK(compiled.GetInstructions()[1].CanJump(true));
+    }
+    {
+        // After Genesis a second OP_ELSE fails the script
+        const CCompiledScript compiled {
+            CScript() << OP_0 << OP_IF << OP_0 << OP_IF << OP_ELSE << OP_ELSE
+                      << OP_ENDIF << OP_ENDIF};
+        BOOST_CHECK(compiled.GetInstructions()[1].CanJump(false));
+        BOOST_CHECK(!compiled.GetInstructions()[1].CanJump(true));
+        // The second OP_ELSE itself is only the jump target of the first one
+        BOOST_CHECK(compiled.GetInstructions()[4].CanJump(true));
+    }
+    {
+        // Conditionals without OP_ENDIF have no jump target
+        const CCompiledScript compiled {CScript() << OP_0 << OP_IF << OP_NOP};
+        BOOST_CHECK_EQUAL(compiled.GetInstructions()[1].GetJump(), CCompiledScript::NO_JUMP);
+    }
+    {
+        // Instructions stop before a truncated push
+        CScript script = CScript() << OP_0 << OP_IF << OP_ENDIF;
+        script.push_back(OP_PUSHDATA1);
+        script.push_back(10);
+        const CCompiledScript compiled {script};
+        BOOST_CHECK_EQUAL(compiled.GetInstructions().size(), 3U);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(cache)
+{
+    CCompiledScriptCache cache;
+    const CScript script1 = CScript() << std::vector<uint8_t>(100, 0x01) << OP_DROP;
+    const CScript script2 = CScript() << std::vector<uint8_t>(200, 0x01) << OP_DROP;
+    const CScript small = CScript() << OP_1;
+
+    // Disabled until configured
+    BOOST_CHECK(cache.Get(script1) == nullptr);
+
+    cache.Configure(ONE_MEBIBYTE, 10);
+    BOOST_CHECK(cache.Get(small) == nullptr);
+    const auto compiled1 = cache.Get(script1);
+    BOOST_REQUIRE(compiled1);
+    BOOST_CHECK(compiled1->IsCompiledFrom(script1));
+    BOOST_CHECK(cache.Get(script1) == compiled1);
+    const auto compiled2 = cache.Get(script2);
+    BOOST_REQUIRE(compiled2);
+    BOOST_CHECK(compiled2 != compiled1);
+
+    auto stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 2U);
+    BOOST_CHECK_EQUAL(stats.nHits, 1U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 2U);
+    BOOST_CHECK_EQUAL(stats.nInserts, 2U);
+    BOOST_CHECK_EQUAL(stats.nMemoryUsage,
+                      compiled1->DynamicMemoryUsage() + compiled2->DynamicMemoryUsage());
+
+    // Shrinking the cache evicts the least recently used script
+    cache.Get(script1);
+    cache.Configure(compiled1->DynamicMemoryUsage(), 10);
+    stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 1U);
+    BOOST_CHECK_EQUAL(stats.nEvictions, 1U);
+    BOOST_CHECK(cache.Get(script1) == compiled1);
+
+    // Scripts larger than the cache are compiled but not inserted
+    const auto uncached = cache.Get(script2);
+    BOOST_REQUIRE(uncached);
+    BOOST_CHECK(uncached != compiled2);
+    stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 1U);
+    BOOST_CHECK_EQUAL(stats.nInserts, 2U);
+
+    // Inserting evicts to stay within the limit
+    cache.Configure(compiled2->DynamicMemoryUsage(), 10);
+    cache.Get(script2);
+    stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 1U);
+    BOOST_CHECK_EQUAL(stats.nEvictions, 2U);
+    BOOST_CHECK_EQUAL(stats.nMemoryUsage, compiled2->DynamicMemoryUsage());
+
+    cache.Configure(ONE_MEBIBYTE, 10);
+    cache.Get(script1);
+    cache.Clear();
+    stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 0U);
+    BOOST_CHECK_EQUAL(stats.nMemoryUsage, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_cache)
+{
+    CCompiledScriptCache cache;
+    std::vector<CScript> scripts;
+    for(int i = 0; i < 64; ++i)
+    {
+        scripts.push_back(CScript() << std::vector<uint8_t>(100 + i, 0x01) << OP_DROP);
+    }
+    const size_t nMaxMemoryUsage {
+        16 * CCompiledScript {scripts.back()}.DynamicMemoryUsage()};
+    cache.Configure(nMaxMemoryUsage, 10);
+
+    std::atomic<int> failures {0};
+    std::vector<std::thread> threads;
+    for(int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&, t]
+        {
+            for(int i = 0; i < 2000; ++i)
+            {
+                const CScript& script = scripts[(i * (t + 1)) % scripts.size()];
+                const auto compiled = cache.Get(script);
+                if(!compiled || !compiled->IsCompiledFrom(script))
+                {
+                    ++failures;
+                }
+            }
+        });
+    }
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    BOOST_CHECK_EQUAL(failures, 0);
+    const auto stats = cache.GetStats();
+    BOOST_CHECK_LE(stats.nMemoryUsage, nMaxMemoryUsage);
+    BOOST_CHECK_EQUAL(stats.nHits + stats.nMisses, 8000U);
+    BOOST_CHECK_EQUAL(stats.nInserts - stats.nEvictions, stats.nEntries);
+
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 0U);
+    BOOST_CHECK_EQUAL(cache.GetStats().nMemoryUsage, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(eval_compiled_script)
+{
+    CCompiledScriptCache& cache = GetCompiledScriptCache();
+
+    std::vector<CScript> scripts {
+        CScript() << OP_1 << OP_IF << OP_2 << OP_ELSE << OP_3 << OP_ENDIF,
+        CScript() << OP_0 << OP_IF << OP_2 << OP_ELSE << OP_3 << OP_ENDIF,
+        CScript() << OP_0 << OP_NOTIF << OP_0 << OP_IF << OP_ELSE << OP_1 << OP_ENDIF << OP_ENDIF,
+        CScript() << OP_0 << OP_IF << OP_2MUL << OP_ENDIF << OP_1,
+        CScript() << OP_0 << OP_IF << OP_VERIF << OP_ENDIF << OP_1,
+        CScript() << OP_0 << OP_IF << OP_1 << OP_ELSE << OP_2 << OP_ELSE << OP_3 << OP_ENDIF,
+        CScript() << OP_1 << OP_IF << OP_0 << OP_IF << OP_ELSE << OP_ELSE << OP_ENDIF << OP_ENDIF,
+        CScript() << OP_1 << OP_IF << OP_RETURN << OP_0 << OP_IF << OP_2MUL << OP_ENDIF << OP_ENDIF,
+        CScript() << OP_0 << OP_IF << std::vector<uint8_t>(MAX_SCRIPT_ELEMENT_SIZE_BEFORE_GENESIS + 1, 0x01) << OP_ENDIF,
+        CScript() << OP_0 << OP_IF << OP_ENDIF << OP_ENDIF,
+        CScript() << OP_0 << OP_IF << OP_ELSE,
+    };
+
+    // Op count limit is checked when jumping over a branch
+    CScript manyOps = CScript() << OP_0 << OP_IF;
+    for(int i = 0; i < 250; ++i)
+    {
+        manyOps << OP_NOP;
+    }
+    manyOps << OP_ENDIF << OP_1;
+    scripts.push_back(manyOps);
+
+    for(const CScript& script : scripts)
+    {
+        CheckSameResult(cache, script);
+    }
+
+    for(int i = 0; i < 2000; ++i)
+    {
+        CheckSameResult(cache, RandomScript());
+    }
+
+    cache.Configure(0, 0);
+    cache.Clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -371,4 +371,78 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations) {
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
 }
 
+BOOST_AUTO_TEST_CASE(cuckoocache_stats_and_resize) {
+    local_rand_ctx = FastRandomContext(true);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    uint32_t size = cc.setup(1 << 12);
+    std::vector<uint256> hashes(size / 4);
+    for (uint256 &h : hashes) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    uint256 missing;
+    insecure_GetRandHash(missing);
+    BOOST_CHECK(cc.contains(hashes[0], false));
+    BOOST_CHECK(!cc.contains(missing, false));
+
+    CuckooCache::stats stats = cc.get_stats();
+    BOOST_CHECK_EQUAL(stats.size, size);
+    BOOST_CHECK_EQUAL(stats.live, hashes.size());
+    BOOST_CHECK_EQUAL(stats.hits, 1U);
+    BOOST_CHECK_EQUAL(stats.misses, 1U);
+    BOOST_CHECK_EQUAL(stats.inserts, hashes.size());
+    BOOST_CHECK_EQUAL(stats.evictions, 0U);
+
+    // Growing keeps every entry and the counters
+    BOOST_CHECK_EQUAL(cc.resize(size * 4), size * 4);
+    for (const uint256 &h : hashes) {
+        BOOST_CHECK(cc.contains(h, false));
+    }
+    stats = cc.get_stats();
+    BOOST_CHECK_EQUAL(stats.size, size * 4);
+    BOOST_CHECK_EQUAL(stats.live, hashes.size());
+    BOOST_CHECK_EQUAL(stats.inserts, hashes.size());
+
+    // Erased entries are not carried over
+    BOOST_CHECK(cc.contains(hashes[0], true));
+    cc.resize(size);
+    BOOST_CHECK(!cc.contains(hashes[0], false));
+    BOOST_CHECK_EQUAL(cc.get_stats().live, hashes.size() - 1);
+
+    // Shrinking below the number of entries drops some of them
+    cc.resize(hashes.size() / 4);
+    stats = cc.get_stats();
+    BOOST_CHECK_EQUAL(stats.size, hashes.size() / 4);
+    BOOST_CHECK(stats.live <= stats.size);
+    BOOST_CHECK(stats.evictions > 0);
+}
+
+/**
+ * Removed elements are no longer found, unlike elements that are only allowed
+ * to be erased.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_remove) {
+    local_rand_ctx = FastRandomContext(true);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup_bytes(1 << 20);
+    std::vector<uint256> hashes(100);
+    for (uint256 &h : hashes) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+
+    cc.remove(hashes[0]);
+    BOOST_CHECK(!cc.contains(hashes[0], false));
+    BOOST_CHECK(cc.contains(hashes[1], true));
+    BOOST_CHECK(cc.contains(hashes[1], false));
+    BOOST_CHECK_EQUAL(cc.get_stats().live, hashes.size() - 2);
+
+    // Removing a missing element is a no-op
+    cc.remove(hashes[0]);
+    BOOST_CHECK_EQUAL(cc.get_stats().live, hashes.size() - 2);
+
+    cc.insert(hashes[0]);
+    BOOST_CHECK(cc.contains(hashes[0], false));
+}
+
 BOOST_AUTO_TEST_SUITE_END();
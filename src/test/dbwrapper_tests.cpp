@@ -321,4 +321,55 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_profile) {
+    CDBWrapperProfile defaults = CDBWrapperProfile::FromArgs("test");
+    BOOST_CHECK_EQUAL(defaults.nBlockSize, 4096U);
+    BOOST_CHECK_EQUAL(defaults.nBloomBits, 10);
+    BOOST_CHECK_EQUAL(defaults.nWriteBufferSize, 0U);
+    BOOST_CHECK_EQUAL(defaults.nMaxOpenFiles, 64);
+    BOOST_CHECK(!defaults.fCompression);
+
+    gArgs.ForceSetArg("-testdbblocksize", "16kB");
+    gArgs.ForceSetArg("-testdbbloombits", "0");
+    gArgs.ForceSetArg("-testdbwritebuffer", "65536");
+    gArgs.ForceSetArg("-testdbmaxopenfiles", "100");
+    gArgs.ForceSetArg("-testdbcompression", "1");
+    CDBWrapperProfile profile = CDBWrapperProfile::FromArgs("test");
+    gArgs.ClearArg("-testdbblocksize");
+    gArgs.ClearArg("-testdbbloombits");
+    gArgs.ClearArg("-testdbwritebuffer");
+    gArgs.ClearArg("-testdbmaxopenfiles");
+    gArgs.ClearArg("-testdbcompression");
+    BOOST_CHECK_EQUAL(profile.nBlockSize, 16000U);
+    BOOST_CHECK_EQUAL(profile.nBloomBits, 0);
+    BOOST_CHECK_EQUAL(profile.nWriteBufferSize, 65536U);
+    BOOST_CHECK_EQUAL(profile.nMaxOpenFiles, 100);
+    BOOST_CHECK(profile.fCompression);
+
+    // Database without a bloom filter and with a small write buffer so
+    // writes end up in table files
+    fs::path ph = fs::temp_directory_path() / fs::unique_path();
+    CDBWrapper dbw(ph, (1 << 20), true, false, false, profile);
+    BOOST_CHECK_EQUAL(dbw.GetProfile().nWriteBufferSize, 65536U);
+    for (uint32_t i = 0; i < 2000; ++i) {
+        BOOST_CHECK(dbw.Write(i, InsecureRand256()));
+    }
+    dbw.CompactRange(uint32_t(0), uint32_t(2000));
+
+    uint256 res;
+    BOOST_CHECK(dbw.Read(uint32_t(1000), res));
+    BOOST_CHECK(!dbw.Read(uint32_t(3000), res));
+
+    std::string value;
+    BOOST_CHECK(dbw.GetProperty("leveldb.stats", value));
+    BOOST_CHECK(!dbw.GetProperty("leveldb.unknown", value));
+    std::vector<CDBLevelStats> levels = dbw.GetLevelStats();
+    BOOST_REQUIRE(!levels.empty());
+    int files = 0;
+    for (const CDBLevelStats &level : levels) {
+        files += level.nFiles;
+    }
+    BOOST_CHECK(files > 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -22,6 +22,14 @@ namespace
         txn.nLockTime = lockTime++;
         return { MakeTransactionRef(std::move(txn)), std::make_shared<AncestorDescendantCounts>(1, 1), Amount{0}, 0 };
     }
+
+    // Generate a new transaction spending the given one
+    CJournalEntry NewChildTxn(const CJournalEntry& parent)
+    {
+        CMutableTransaction txn {};
+        txn.vin.emplace_back(COutPoint { parent.GetTxId(), 0 });
+        return { MakeTransactionRef(std::move(txn)), std::make_shared<AncestorDescendantCounts>(2, 1), Amount{0}, 0 };
+    }
 }
 
 namespace mining
@@ -189,5 +197,168 @@ BOOST_AUTO_TEST_CASE(TestJournalReorg)
     BOOST_CHECK_EQUAL(CJournalTester{journal}.checkTxnOrdering(ops2[3].second, ops[1].second), CJournalTester::TxnOrder::BEFORE);
 }
 
+BOOST_AUTO_TEST_CASE(TestJournalCompaction)
+{
+    // Create builder to manage journals
+    CJournalBuilderPtr builder { std::make_unique<CJournalBuilder>() };
+    CJournalPtr journal { builder->getCurrentJournal() };
+
+    // Add enough txns to span several chunks of the log
+    std::vector<CJournalEntry> txns {};
+    for(size_t i = 0; i < 5000; ++i)
+    {
+        txns.push_back(NewTxn());
+    }
+    CJournalChangeSetPtr changeSet { builder->getNewChangeSet(JournalUpdateReason::NEW_TXN) };
+    for(const auto& txn : txns)
+    {
+        changeSet->addOperation(CJournalChangeSet::Operation::ADD, txn);
+    }
+    changeSet.reset();
+    BOOST_CHECK_EQUAL(journal->size(), txns.size());
+
+    // A reader reading while most txns are removed
+    CJournal::ReadLock lock { journal };
+    CJournal::Index index { lock.begin() };
+    changeSet = builder->getNewChangeSet(JournalUpdateReason::REMOVE_TXN);
+    for(size_t i = 0; i < txns.size(); ++i)
+    {
+        if(i % 10 != 0)
+        {
+            changeSet->addOperation(CJournalChangeSet::Operation::REMOVE, txns[i]);
+        }
+    }
+    changeSet.reset();
+    BOOST_CHECK_EQUAL(journal->size(), txns.size() / 10);
+    BOOST_CHECK(!index.valid());
+
+    // The replaced log is kept while the reader holds it. Removals made
+    // before it was replaced are skipped, but all remaining txns are there.
+    size_t count {0};
+    size_t next {0};
+    for(; index != lock.end(); ++index)
+    {
+        while(next < txns.size() && txns[next].GetTxId() != index.at().GetTxId())
+        {
+            BOOST_CHECK(next % 10 != 0);
+            ++next;
+        }
+        BOOST_CHECK(next < txns.size());
+        if(next++ % 10 == 0)
+        {
+            ++count;
+        }
+    }
+    BOOST_CHECK_EQUAL(count, txns.size() / 10);
+
+    // New readers only see the remaining txns in order
+    lock = CJournal::ReadLock { journal };
+    count = 0;
+    for(index = lock.begin(); index != lock.end(); ++index)
+    {
+        BOOST_CHECK(index.at().GetTxId() == txns[count * 10].GetTxId());
+        ++count;
+    }
+    BOOST_CHECK_EQUAL(count, txns.size() / 10);
+    BOOST_CHECK_EQUAL(CJournalTester{journal}.journalSize(), txns.size() / 10);
+    BOOST_CHECK_EQUAL(CJournalTester{journal}.checkTxnOrdering(txns[0], txns[10]), CJournalTester::TxnOrder::BEFORE);
+    BOOST_CHECK_EQUAL(CJournalTester{journal}.checkTxnOrdering(txns[1], txns[10]), CJournalTester::TxnOrder::NOTFOUND);
+
+    // Appending resumes after the end of the new log
+    BOOST_CHECK(index.valid());
+    changeSet = builder->getNewChangeSet(JournalUpdateReason::NEW_TXN);
+    changeSet->addOperation(CJournalChangeSet::Operation::ADD, txns[1]);
+    changeSet.reset();
+    index.reset();
+    BOOST_CHECK(index != lock.end());
+    BOOST_CHECK(index.at().GetTxId() == txns[1].GetTxId());
+    BOOST_CHECK(++index == lock.end());
+}
+
+BOOST_AUTO_TEST_CASE(TestJournalReorgPrepend)
+{
+    // Create builder to manage journals
+    CJournalBuilderPtr builder { std::make_unique<CJournalBuilder>() };
+    CJournalPtr journal { builder->getCurrentJournal() };
+
+    // Add enough txns to span several chunks of the log
+    std::vector<CJournalEntry> txns {};
+    for(size_t i = 0; i < 3000; ++i)
+    {
+        txns.push_back(NewTxn());
+    }
+    CJournalChangeSetPtr changeSet { builder->getNewChangeSet(JournalUpdateReason::NEW_TXN) };
+    for(const auto& txn : txns)
+    {
+        changeSet->addOperation(CJournalChangeSet::Operation::ADD, txn);
+    }
+    changeSet.reset();
+
+    // A reader of the old journal while a reorg returns txns to the mempool
+    CJournal::ReadLock oldLock { journal };
+    CJournalEntry parent { NewTxn() };
+    CJournalEntry child { NewChildTxn(parent) };
+    changeSet = builder->getNewChangeSet(JournalUpdateReason::REORG);
+    changeSet->addOperation(CJournalChangeSet::Operation::ADD, child);
+    changeSet->addOperation(CJournalChangeSet::Operation::ADD, parent);
+    changeSet->addOperation(CJournalChangeSet::Operation::REMOVE, txns[1]);
+    changeSet.reset();
+    BOOST_CHECK(!journal->getCurrent());
+
+    // The old journal's reader still sees the contents it started with,
+    // apart from removals
+    size_t count {0};
+    for(CJournal::Index index { oldLock.begin() }; index != oldLock.end(); ++index)
+    {
+        BOOST_CHECK(index.at().GetTxId() != parent.GetTxId());
+        ++count;
+    }
+    BOOST_CHECK_EQUAL(count, txns.size() - 1);
+
+    // The new journal has the reorg txns in front, parents first
+    journal = builder->getCurrentJournal();
+    BOOST_CHECK_EQUAL(journal->size(), txns.size() + 1);
+    CJournalTester tester { journal };
+    BOOST_CHECK_EQUAL(tester.journalSize(), txns.size() + 1);
+    BOOST_CHECK_EQUAL(tester.checkTxnOrdering(parent, child), CJournalTester::TxnOrder::BEFORE);
+    BOOST_CHECK_EQUAL(tester.checkTxnOrdering(child, txns[0]), CJournalTester::TxnOrder::BEFORE);
+    BOOST_CHECK_EQUAL(tester.checkTxnOrdering(txns[0], txns.back()), CJournalTester::TxnOrder::BEFORE);
+    BOOST_CHECK(!tester.checkTxnExists(txns[1]));
+
+    CJournal::ReorgStats stats { journal->getLastReorgStats() };
+    BOOST_CHECK_EQUAL(stats.mNumTxns, 2U);
+    BOOST_CHECK_EQUAL(stats.mNumErrors, 0U);
+    BOOST_CHECK(stats.mTime != 0);
+
+    // Removing a reorg txn and appending more are seen by new readers
+    changeSet = builder->getNewChangeSet(JournalUpdateReason::REMOVE_TXN);
+    changeSet->addOperation(CJournalChangeSet::Operation::REMOVE, parent);
+    changeSet.reset();
+    CJournalEntry last { NewTxn() };
+    changeSet = builder->getNewChangeSet(JournalUpdateReason::NEW_TXN);
+    changeSet->addOperation(CJournalChangeSet::Operation::ADD, last);
+    changeSet.reset();
+    CJournal::ReadLock lock { journal };
+    CJournal::Index index { lock.begin() };
+    BOOST_CHECK(index.at().GetTxId() == child.GetTxId());
+    count = 0;
+    for(; index != lock.end(); ++index)
+    {
+        ++count;
+    }
+    BOOST_CHECK_EQUAL(count, txns.size() + 1);
+
+    // A reorg txn whose parent is already in the journal is reported
+    CJournalEntry orphan { NewChildTxn(txns[2]) };
+    changeSet = builder->getNewChangeSet(JournalUpdateReason::REORG);
+    changeSet->addOperation(CJournalChangeSet::Operation::ADD, orphan);
+    changeSet.reset();
+    journal = builder->getCurrentJournal();
+    stats = journal->getLastReorgStats();
+    BOOST_CHECK_EQUAL(stats.mNumTxns, 1U);
+    BOOST_CHECK_EQUAL(stats.mNumErrors, 1U);
+    BOOST_CHECK_EQUAL(CJournalTester{journal}.checkTxnOrdering(orphan, child), CJournalTester::TxnOrder::BEFORE);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
@@ -5,6 +5,7 @@
 #include "test/test_bitcoin.h"
 #include "script/limitedstack.h"
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
 
 typedef std::vector<uint8_t> valtype;
 
@@ -63,8 +64,8 @@ BOOST_AUTO_TEST_CASE(limitedstack_erase_test) {
         limitedStack.erase(-3, -1);
 
         BOOST_CHECK_EQUAL(limitedStack.size(), 2);
-        BOOST_CHECK_EQUAL(limitedStack.at(0).GetElement().at(0), 0xab);
-        BOOST_CHECK_EQUAL(limitedStack.at(1).GetElement().at(0), 0xab);
+        BOOST_CHECK_EQUAL(limitedStack.at(0).GetElement()[0], 0xab);
+        BOOST_CHECK_EQUAL(limitedStack.at(1).GetElement()[0], 0xab);
     }
 
     ////////// LimitedStack erase(int index) check //////////
@@ -74,9 +75,9 @@ BOOST_AUTO_TEST_CASE(limitedstack_erase_test) {
         limitedStack.erase(-3);
 
         BOOST_CHECK_EQUAL(limitedStack.size(), 3);
-        BOOST_CHECK_EQUAL(limitedStack.at(0).GetElement().at(0), 0xab);
-        BOOST_CHECK_EQUAL(limitedStack.at(1).GetElement().at(0), 0xef);
-        BOOST_CHECK_EQUAL(limitedStack.at(2).GetElement().at(0), 0xab);
+        BOOST_CHECK_EQUAL(limitedStack.at(0).GetElement()[0], 0xab);
+        BOOST_CHECK_EQUAL(limitedStack.at(1).GetElement()[0], 0xef);
+        BOOST_CHECK_EQUAL(limitedStack.at(2).GetElement()[0], 0xab);
     }
 }
 
@@ -128,8 +129,8 @@ BOOST_AUTO_TEST_CASE(limitedstack_swap_test) {
         size_t size_before_swap = limitedStack.size();
         limitedStack.swapElements(0, 1);
 
-        BOOST_CHECK_EQUAL(limitedStack.at(0).GetElement().at(0), 0xcd);
-        BOOST_CHECK_EQUAL(limitedStack.at(1).GetElement().at(0), 0xab);
+        BOOST_CHECK_EQUAL(limitedStack.at(0).GetElement()[0], 0xcd);
+        BOOST_CHECK_EQUAL(limitedStack.at(1).GetElement()[0], 0xab);
         BOOST_CHECK_EQUAL(size_combined_before_swap, limitedStack.getCombinedStackSize());
         BOOST_CHECK_EQUAL(size_before_swap, limitedStack.size());
     }
@@ -175,10 +176,10 @@ BOOST_AUTO_TEST_CASE(limitedstack_movetoptostack_test) {
         BOOST_CHECK_EQUAL(limitedStack_child.getCombinedStackSize(), size_parent);
         BOOST_CHECK_EQUAL(limitedStack_child.getCombinedStackSize(), size_child);
 
-        BOOST_CHECK_EQUAL(limitedStack_child.at(0).GetElement().at(0), 0xef);
-        BOOST_CHECK_EQUAL(limitedStack_child.at(0).GetElement().at(1), 0x12);
-        BOOST_CHECK_EQUAL(limitedStack_child.at(1).GetElement().at(0), 0xab);
-        BOOST_CHECK_EQUAL(limitedStack_child.at(1).GetElement().at(1), 0xcd);
+        BOOST_CHECK_EQUAL(limitedStack_child.at(0).GetElement()[0], 0xef);
+        BOOST_CHECK_EQUAL(limitedStack_child.at(0).GetElement()[1], 0x12);
+        BOOST_CHECK_EQUAL(limitedStack_child.at(1).GetElement()[0], 0xab);
+        BOOST_CHECK_EQUAL(limitedStack_child.at(1).GetElement()[1], 0xcd);
 
         BOOST_CHECK_EQUAL(limitedStack_child.getCombinedStackSize(), 2 * (limitedStack_child.size() + LimitedVector::ELEMENT_OVERHEAD));
         BOOST_CHECK_EQUAL(limitedStack_parent.size(), 0);
@@ -225,9 +226,9 @@ BOOST_AUTO_TEST_CASE(limitedvector_append_test) {
         limitedVector1.append(limitedVector2);
 
         BOOST_CHECK_EQUAL(limitedVector1.size(), size_before + 2);
-        BOOST_CHECK_EQUAL(limitedVector1.GetElement().at(0), 0xef);
-        BOOST_CHECK_EQUAL(limitedVector1.GetElement().at(1), 0xab);
-        BOOST_CHECK_EQUAL(limitedVector1.GetElement().at(2), 0xcd);
+        BOOST_CHECK_EQUAL(limitedVector1.GetElement()[0], 0xef);
+        BOOST_CHECK_EQUAL(limitedVector1.GetElement()[1], 0xab);
+        BOOST_CHECK_EQUAL(limitedVector1.GetElement()[2], 0xcd);
     }
 }
 
@@ -263,4 +264,120 @@ BOOST_AUTO_TEST_CASE(limitedvector_padright_test) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(limitedvector_inline_storage_test) {
+    ////////// Elements crossing the inline storage size check //////////
+    {
+        LimitedStack limitedStack(1000);
+        valtype inlineElement(STACK_ELEMENT_INLINE_SIZE, 0xab);
+        valtype heapElement(STACK_ELEMENT_INLINE_SIZE + 1, 0xcd);
+
+        limitedStack.push_back(inlineElement);
+        limitedStack.push_back(heapElement);
+        BOOST_CHECK_EQUAL(limitedStack.getCombinedStackSize(),
+                          2 * LimitedVector::ELEMENT_OVERHEAD + inlineElement.size() + heapElement.size());
+
+        // Growing an inline element moves it to the heap without changing the accounting
+        LimitedVector &limitedVector1 = limitedStack.stacktop(-2);
+        limitedVector1.push_back(0xef);
+        BOOST_CHECK_EQUAL(limitedVector1.size(), STACK_ELEMENT_INLINE_SIZE + 1);
+        BOOST_CHECK_EQUAL(limitedVector1.GetElement()[0], 0xab);
+        BOOST_CHECK_EQUAL(limitedVector1.GetElement().back(), 0xef);
+        BOOST_CHECK_EQUAL(limitedStack.getCombinedStackSize(),
+                          2 * LimitedVector::ELEMENT_OVERHEAD + 2 * (STACK_ELEMENT_INLINE_SIZE + 1));
+
+        LimitedVector limitedVector2 = limitedStack.stacktop(-1);
+        limitedStack.pop_back();
+        limitedStack.stacktop(-1).append(limitedVector2);
+        BOOST_CHECK_EQUAL(limitedStack.size(), 1);
+        BOOST_CHECK_EQUAL(limitedStack.getCombinedStackSize(),
+                          LimitedVector::ELEMENT_OVERHEAD + 2 * (STACK_ELEMENT_INLINE_SIZE + 1));
+
+        std::vector<valtype> valtypeVector;
+        limitedStack.MoveToValtypes(valtypeVector);
+        BOOST_CHECK_EQUAL(limitedStack.getCombinedStackSize(), 0);
+        BOOST_REQUIRE_EQUAL(valtypeVector.size(), 1);
+        BOOST_CHECK_EQUAL(valtypeVector[0].size(), 2 * (STACK_ELEMENT_INLINE_SIZE + 1));
+        BOOST_CHECK_EQUAL(valtypeVector[0][STACK_ELEMENT_INLINE_SIZE], 0xef);
+        BOOST_CHECK_EQUAL(valtypeVector[0].back(), 0xcd);
+    }
+}
+
+static bool Equal(bsv::span<const uint8_t> a, bsv::span<const uint8_t> b)
+{
+    return std::equal(a.begin(), a.end(), b.begin(), b.end());
+}
+
+BOOST_AUTO_TEST_CASE(limitedvector_shared_storage_test) {
+    ////////// Splitting and joining large elements check //////////
+    {
+        const size_t size = 4 * LARGE_STACK_ELEMENT_SIZE;
+        LimitedStack limitedStack(10 * size);
+        valtype element(size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            element[i] = static_cast<uint8_t>(i);
+        }
+        limitedStack.push_back(element);
+
+        // Large halves share the buffer but are still fully accounted for
+        const LimitedVector& data = limitedStack.stacktop(-1);
+        LimitedVector first = data.slice(0, size / 2);
+        LimitedVector second = data.slice(size / 2, size / 2);
+        limitedStack.pop_back();
+        limitedStack.push_back(first);
+        limitedStack.push_back(second);
+        BOOST_CHECK_EQUAL(limitedStack.getCombinedStackSize(), 2 * LimitedVector::ELEMENT_OVERHEAD + size);
+        BOOST_CHECK(Equal(limitedStack.stacktop(-2).GetElement(), bsv::span<const uint8_t>(element.data(), size / 2)));
+        BOOST_CHECK(Equal(limitedStack.stacktop(-1).GetElement(), bsv::span<const uint8_t>(element.data() + size / 2, size / 2)));
+
+        // Small slices are copied
+        LimitedVector small = limitedStack.stacktop(-1).slice(1, 10);
+        BOOST_CHECK(Equal(small.GetElement(), bsv::span<const uint8_t>(element.data() + size / 2 + 1, 10)));
+        BOOST_CHECK_THROW(limitedStack.stacktop(-1).slice(1, size / 2), std::invalid_argument);
+
+        // Reading a copy doesn't copy the shared data
+        limitedStack.push_back(limitedStack.stacktop(-1));
+        const LimitedVector& copy = limitedStack.stacktop(-1);
+        BOOST_CHECK_EQUAL(copy[0], element[size / 2]);
+        BOOST_CHECK_EQUAL(copy.back(), element[size - 1]);
+        BOOST_CHECK(copy.GetElement().data() == limitedStack.stacktop(-2).GetElement().data());
+
+        // Modifying a copy doesn't affect the original
+        limitedStack.stacktop(-1).front() = 0xff;
+        limitedStack.stacktop(-1).padRight(size, 0x80);
+        BOOST_CHECK(limitedStack.stacktop(-1).GetElement().data() != limitedStack.stacktop(-2).GetElement().data());
+        BOOST_CHECK_EQUAL(limitedStack.stacktop(-2).GetElement()[0], element[size / 2]);
+        BOOST_CHECK_EQUAL(limitedStack.stacktop(-2).size(), size / 2);
+        BOOST_CHECK_EQUAL(limitedStack.stacktop(-1).GetElement()[0], 0xff);
+        BOOST_CHECK_EQUAL(limitedStack.stacktop(-1).GetElement().back(), 0x80);
+        BOOST_CHECK(limitedStack.stacktop(-1) != limitedStack.stacktop(-2));
+        limitedStack.pop_back();
+        BOOST_CHECK_EQUAL(limitedStack.getCombinedStackSize(), 2 * LimitedVector::ELEMENT_OVERHEAD + size);
+
+        // Joining the halves gives back the original element
+        LimitedVector secondCopy = limitedStack.stacktop(-1);
+        limitedStack.pop_back();
+        limitedStack.stacktop(-1).append(secondCopy);
+        BOOST_CHECK_EQUAL(limitedStack.getCombinedStackSize(), LimitedVector::ELEMENT_OVERHEAD + size);
+        BOOST_CHECK(Equal(limitedStack.stacktop(-1).GetElement(), bsv::span<const uint8_t>(element)));
+
+        // Appending to a large element crossing the threshold
+        limitedStack.push_back(valtype(LARGE_STACK_ELEMENT_SIZE, 0x01));
+        limitedStack.push_back(valtype(1, 0x02));
+        LimitedVector last = limitedStack.stacktop(-1);
+        limitedStack.pop_back();
+        limitedStack.stacktop(-1).append(last);
+        BOOST_CHECK_EQUAL(limitedStack.stacktop(-1).size(), LARGE_STACK_ELEMENT_SIZE + 1);
+        BOOST_CHECK_EQUAL(limitedStack.stacktop(-1).GetElement().back(), 0x02);
+        BOOST_CHECK_EQUAL(limitedStack.getCombinedStackSize(),
+                          2 * LimitedVector::ELEMENT_OVERHEAD + size + LARGE_STACK_ELEMENT_SIZE + 1);
+
+        std::vector<valtype> valtypeVector;
+        limitedStack.MoveToValtypes(valtypeVector);
+        BOOST_REQUIRE_EQUAL(valtypeVector.size(), 2);
+        BOOST_CHECK(valtypeVector[0] == element);
+        BOOST_CHECK_EQUAL(valtypeVector[1].size(), LARGE_STACK_ELEMENT_SIZE + 1);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1,11 +1,31 @@
 // Copyright (c) 2019 Bitcoin Association.
 // Distributed under the Open BSV software license, see the accompanying file LICENSE.
 
+#include "consensus/merkle.h"
 #include "mining/candidates.h"
 #include "test/test_bitcoin.h"
 
 #include <boost/test/unit_test.hpp>
 
+#include <atomic>
+#include <thread>
+
+namespace
+{
+    // Make dummy block with the given number of txns
+    CBlockRef MakeBlock(size_t numTxns)
+    {
+        CBlockRef block { std::make_shared<CBlock>() };
+        for(size_t i = 0; i < numTxns; ++i)
+        {
+            CMutableTransaction tx {};
+            tx.nLockTime = i;
+            block->vtx.push_back(MakeTransactionRef(std::move(tx)));
+        }
+        return block;
+    }
+}
+
 
 BOOST_AUTO_TEST_SUITE(mining_candidates)
 
@@ -55,4 +75,89 @@ BOOST_AUTO_TEST_CASE(add_remove_candidates) {
     BOOST_CHECK(manager.Get(fiftythird)==nullptr);
 }
 
+BOOST_AUTO_TEST_CASE(shared_candidates) {
+    CMiningCandidateManager manager;
+    CBlockRef block { MakeBlock(5) };
+
+    // Callers asking for the same block share a candidate
+    CMiningCandidateRef ref { manager.GetOrCreate(block) };
+    BOOST_CHECK(manager.GetOrCreate(block) == ref);
+    BOOST_CHECK_EQUAL(1, manager.Size());
+
+    // Until a field unique to the candidate changes
+    block->nTime += 1;
+    CMiningCandidateRef ref2 { manager.GetOrCreate(block) };
+    BOOST_CHECK(ref2 != ref);
+    BOOST_CHECK(manager.GetOrCreate(block) == ref2);
+
+    // Or a different block is used
+    CMiningCandidateRef ref3 { manager.GetOrCreate(MakeBlock(5)) };
+    BOOST_CHECK(ref3 != ref2);
+    BOOST_CHECK_EQUAL(3, manager.Size());
+
+    // Or the candidate is removed
+    CBlockRef block3 { ref3->GetBlock() };
+    manager.Remove(ref3->GetId());
+    CMiningCandidateRef ref4 { manager.GetOrCreate(block3) };
+    BOOST_CHECK(ref4->GetId() != ref3->GetId());
+    BOOST_CHECK(manager.Get(ref4->GetId()) == ref4);
+
+    // The merkle proof is calculated once and matches the block
+    std::vector<uint256> leaves {};
+    for(const auto& tx : block3->vtx)
+    {
+        leaves.push_back(tx->GetHash());
+    }
+    BOOST_CHECK(ref4->GetMerkleProof() == ComputeMerkleBranch(leaves, 0));
+    BOOST_CHECK_EQUAL(&ref4->GetMerkleProof(), &ref4->GetMerkleProof());
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_candidates) {
+    constexpr int NUM_THREADS = 8;
+    constexpr int NUM_CANDIDATES = 100;
+    CMiningCandidateManager manager;
+    CBlockRef block { MakeBlock(3) };
+
+    // Threads creating their own candidates, and sharing one for the same block
+    std::vector<std::vector<CMiningCandidateRef>> created(NUM_THREADS);
+    std::vector<CMiningCandidateRef> shared(NUM_THREADS);
+    std::atomic_int numFound {0};
+    std::vector<std::thread> threads {};
+    for(int t = 0; t < NUM_THREADS; ++t)
+    {
+        threads.emplace_back(
+            [&, t]()
+            {
+                shared[t] = manager.GetOrCreate(block);
+                for(int i = 0; i < NUM_CANDIDATES; ++i)
+                {
+                    created[t].push_back(manager.Create(block));
+                    if(manager.Get(created[t].back()->GetId()) == created[t].back())
+                    {
+                        ++numFound;
+                    }
+                }
+                shared[t]->GetMerkleProof();
+            }
+        );
+    }
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    BOOST_CHECK_EQUAL(NUM_THREADS * NUM_CANDIDATES, numFound);
+    std::set<MiningCandidateId> idsSet {};
+    for(int t = 0; t < NUM_THREADS; ++t)
+    {
+        BOOST_CHECK(shared[t] == shared[0]);
+        for(const auto& ref : created[t])
+        {
+            idsSet.insert(ref->GetId());
+        }
+    }
+    BOOST_CHECK_EQUAL(NUM_THREADS * NUM_CANDIDATES, idsSet.size());
+    BOOST_CHECK_EQUAL(NUM_THREADS * NUM_CANDIDATES + 1, manager.Size());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
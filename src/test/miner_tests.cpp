@@ -997,6 +997,15 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
 {
     Test_CreateNewBlock_validity(*this);
 }
+BOOST_AUTO_TEST_CASE(CreateNewBlock_validity_parallel_selection)
+{
+    gArgs.ForceSetArg("-packageselectionthreads", "2");
+    // Don't leak the setting into later tests if a check throws
+    struct ArgReset {
+        ~ArgReset() { gArgs.ClearArg("-packageselectionthreads"); }
+    } argReset;
+    Test_CreateNewBlock_validity(*this);
+}
 BOOST_AUTO_TEST_CASE(BlockAssembler_construction)
 {
     Test_BlockAssembler_construction(*this);
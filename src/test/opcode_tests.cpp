@@ -932,6 +932,27 @@ BOOST_AUTO_TEST_CASE(limited_stack_test) {
         {{0xab}});
 }
 
+BOOST_AUTO_TEST_CASE(large_element_shrunk_by_bin2num_test) {
+    // A large number that BIN2NUM shrinks to a single byte must keep its
+    // data when it is concatenated afterwards
+    valtype padded(LARGE_STACK_ELEMENT_SIZE + 1000, 0x00);
+    padded[0] = 0x01;
+    const uint32_t maxStackSize = 2 * padded.size() + 3 * LimitedVector::ELEMENT_OVERHEAD;
+    CheckStackSize({padded}, CScript() << OP_BIN2NUM << OP_DUP << valtype{0x02} << OP_CAT,
+        SCRIPT_ERR_OK, maxStackSize, {{0x01}, {0x01, 0x02}});
+
+    Config& config = GlobalConfig::GetConfig();
+    BaseSignatureChecker sigchecker;
+    auto source = task::CCancellationSource::Make();
+    LimitedStack stack({padded}, maxStackSize);
+    BOOST_CHECK(EvalScript(config, true, source->GetToken(), stack,
+                           CScript() << OP_BIN2NUM << OP_DUP << valtype{0x02} << OP_CAT << OP_NIP,
+                           0, sigchecker, nullptr).value());
+    BOOST_REQUIRE_EQUAL(stack.size(), 1U);
+    BOOST_CHECK(stack.front() == LimitedStack({{0x01, 0x02}}, maxStackSize).front());
+    BOOST_CHECK_EQUAL(stack.getCombinedStackSize(), LimitedVector::ELEMENT_OVERHEAD + 2);
+}
+
 static void CheckBin2NumError(const stacktype &original_stack,
                               ScriptError expected_error) {
     CheckErrorForAllFlags(original_stack, CScript() << OP_BIN2NUM,
@@ -0,0 +1,126 @@
+// Copyright (c) 2019 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "persistent_vector.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+#include <thread>
+
+BOOST_FIXTURE_TEST_SUITE(persistent_vector_tests, BasicTestingSetup)
+
+// Check v holds [0, size) apart from the given overrides
+static void CheckContents(const persistent_vector<int, 4> &v, int size,
+                          const std::map<int, int> &overrides = {}) {
+    BOOST_CHECK_EQUAL(v.size(), size);
+    int i = 0;
+    for (int value : v) {
+        auto it = overrides.find(i);
+        BOOST_CHECK_EQUAL(value, it == overrides.end() ? i : it->second);
+        ++i;
+    }
+    BOOST_CHECK_EQUAL(i, size);
+}
+
+BOOST_AUTO_TEST_CASE(append_and_copy) {
+    persistent_vector<int, 4> v;
+    BOOST_CHECK(v.empty());
+    for (int i = 0; i < 10; ++i) {
+        v.push_back(i);
+    }
+    CheckContents(v, 10);
+    BOOST_CHECK_EQUAL(v.back(), 9);
+
+    // Copies keep their contents while the original grows
+    persistent_vector<int, 4> copy = v;
+    for (int i = 10; i < 20; ++i) {
+        v.push_back(i);
+    }
+    CheckContents(copy, 10);
+    CheckContents(v, 20);
+
+    // A copy appending after the original has takes its own copy of the
+    // last chunk
+    copy.push_back(100);
+    copy.push_back(101);
+    CheckContents(copy, 12, {{10, 100}, {11, 101}});
+    CheckContents(v, 20);
+
+    // The original appending after a copy has does the same
+    persistent_vector<int, 4> copy2 = v;
+    copy2.push_back(200);
+    v.push_back(20);
+    CheckContents(copy2, 21, {{20, 200}});
+    CheckContents(v, 21);
+
+    v.clear();
+    BOOST_CHECK(v.empty());
+    CheckContents(copy2, 21, {{20, 200}});
+}
+
+BOOST_AUTO_TEST_CASE(modify) {
+    persistent_vector<int, 4> v;
+    for (int i = 0; i < 10; ++i) {
+        v.push_back(i);
+    }
+
+    // Modifying a copy leaves the original alone, and vice versa
+    persistent_vector<int, 4> copy = v;
+    copy.set(0, -1);
+    copy.set(9, -9);
+    v.set(5, -5);
+    CheckContents(copy, 10, {{0, -1}, {9, -9}});
+    CheckContents(v, 10, {{5, -5}});
+
+    // Appending after modifying the last chunk
+    copy.push_back(10);
+    v.push_back(10);
+    CheckContents(copy, 11, {{0, -1}, {9, -9}});
+    CheckContents(v, 11, {{5, -5}});
+
+    // Unshared vectors are modified in place
+    persistent_vector<int, 4> unshared;
+    unshared.push_back(0);
+    const int *p = &unshared[0];
+    unshared.set(0, 1);
+    BOOST_CHECK_EQUAL(*p, 1);
+
+    // Reading a shared vector doesn't copy its chunks
+    persistent_vector<int, 4> shared = unshared;
+    BOOST_CHECK_EQUAL(&shared[0], p);
+    BOOST_CHECK_EQUAL(&unshared[0], p);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_copies) {
+    // Copies of a vector are appended to concurrently
+    persistent_vector<int, 4> v;
+    for (int i = 0; i < 10; ++i) {
+        v.push_back(i);
+    }
+    std::vector<persistent_vector<int, 4>> copies(4, v);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < copies.size(); ++t) {
+        threads.emplace_back([&copies, t]() {
+            for (int i = 10; i < 1000; ++i) {
+                copies[t].push_back(i * 10 + t);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    CheckContents(v, 10);
+    for (size_t t = 0; t < copies.size(); ++t) {
+        std::map<int, int> expected;
+        for (int i = 10; i < 1000; ++i) {
+            expected[i] = i * 10 + t;
+        }
+        CheckContents(copies[t], 1000, expected);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
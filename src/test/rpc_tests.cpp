@@ -7,8 +7,13 @@
 
 #include "base58.h"
 #include "config.h"
+#include "core_io.h"
+#include "mining/journal_builder.h"
+#include "mining/journal_change_set.h"
 #include "net/netbase.h"
 #include "policy/policy.h"
+#include "rpc/mining.h"
+#include "txmempool.h"
 #include "util.h"
 
 #include "test/test_bitcoin.h"
@@ -44,6 +49,19 @@ UniValue CallRPC(std::string args) {
             throw std::runtime_error(find_value(objError, "message").get_str());
         }
     }
+    else if (strMethod == "getblocktemplate") {
+        try {
+            CStringWriter stringWriter;
+            getblocktemplate(config, request, stringWriter, false, []{});
+            stringWriter.Flush();
+            UniValue result(UniValue::VOBJ);
+            result.read(stringWriter.MoveOutString());
+            return result;
+        }
+        catch (const UniValue& objError) {
+            throw std::runtime_error(find_value(objError, "message").get_str());
+        }
+    }
     else if (strMethod == "decoderawtransaction") {
         try {
             CStringWriter stringWriter;
@@ -586,4 +604,52 @@ BOOST_AUTO_TEST_CASE(getminingcandidate_low_height)
     nMaxTipAge = oldMaxAge;
 }
 
+BOOST_AUTO_TEST_CASE(getblocktemplate_streamed)
+{
+    // Fake things so that IBD thinks it's completed and we don't care about the lack of peers
+    gArgs.SoftSetBoolArg("-standalone", true);
+    int64_t oldMaxAge {nMaxTipAge};
+    nMaxTipAge = std::numeric_limits<int64_t>::max();
+
+    // A parent and child in the mempool
+    CMutableTransaction parent {};
+    parent.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+    parent.vout.emplace_back(Amount(10000), CScript() << OP_TRUE);
+    CMutableTransaction child {};
+    child.vin.emplace_back(COutPoint(parent.GetId(), 0));
+    child.vout.emplace_back(Amount(9000), CScript() << OP_TRUE);
+    {
+        TestMemPoolEntryHelper entry {};
+        mining::CJournalChangeSetPtr changeSet {
+            mempool.getJournalBuilder().getNewChangeSet(mining::JournalUpdateReason::NEW_TXN) };
+        mempool.AddUnchecked(parent.GetId(), entry.Fee(Amount(1000)).FromTx(parent), changeSet);
+        mempool.AddUnchecked(child.GetId(), entry.Fee(Amount(1000)).FromTx(child), changeSet);
+    }
+
+    UniValue json {};
+    BOOST_CHECK_NO_THROW(json = CallRPC(std::string("getblocktemplate")));
+    BOOST_CHECK(find_value(json.get_obj(), "error").isNull());
+    const UniValue& result { find_value(json.get_obj(), "result").get_obj() };
+    BOOST_CHECK_EQUAL(find_value(result, "height").get_int(), 1);
+    BOOST_CHECK_EQUAL(find_value(result, "mutable").size(), 3U);
+    BOOST_CHECK_EQUAL(find_value(find_value(result, "coinbaseaux").get_obj(), "flags").get_str(),
+                      HexStr(COINBASE_FLAGS.begin(), COINBASE_FLAGS.end()));
+
+    const UniValue& txns { find_value(result, "transactions").get_array() };
+    BOOST_CHECK_EQUAL(txns.size(), 2U);
+    if (txns.size() == 2) {
+        BOOST_CHECK_EQUAL(find_value(txns[0].get_obj(), "txid").get_str(), parent.GetId().GetHex());
+        BOOST_CHECK_EQUAL(find_value(txns[0].get_obj(), "data").get_str(), EncodeHexTx(CTransaction(parent)));
+        BOOST_CHECK_EQUAL(find_value(txns[0].get_obj(), "depends").size(), 0U);
+        BOOST_CHECK_EQUAL(find_value(txns[1].get_obj(), "txid").get_str(), child.GetId().GetHex());
+        BOOST_CHECK_EQUAL(find_value(txns[1].get_obj(), "depends")[0].get_int(), 1);
+        BOOST_CHECK_EQUAL(find_value(txns[1].get_obj(), "fee").get_int64(), 1000);
+    }
+
+    BOOST_CHECK_THROW(CallRPC(std::string("getblocktemplate {\"mode\":\"bogus\"}")), std::runtime_error);
+
+    mempool.Clear();
+    nMaxTipAge = oldMaxAge;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
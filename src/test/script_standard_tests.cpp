@@ -0,0 +1,292 @@
+// Copyright (c) 2020 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "config.h"
+#include "hash.h"
+#include "key.h"
+#include "script/interpreter.h"
+#include "script/script.h"
+#include "script/script_error.h"
+#include "script/standard.h"
+#include "taskcancellation.h"
+#include "test/test_bitcoin.h"
+#include "utilstrencodings.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <tuple>
+
+typedef std::vector<uint8_t> valtype;
+
+namespace
+{
+    // Deterministically accepts about half of the signatures and records the
+    // order in which they were checked.
+    class RecordingChecker : public BaseSignatureChecker
+    {
+    public:
+        mutable std::vector<std::tuple<valtype, valtype, CScript>> calls;
+
+        bool CheckSig(const valtype& vchSig,
+                      const valtype& vchPubKey,
+                      const CScript& scriptCode,
+                      bool) const override
+        {
+            calls.emplace_back(vchSig, vchPubKey, scriptCode);
+            CHashWriter ss(SER_GETHASH, 0);
+            ss << vchSig << vchPubKey;
+            return ss.GetHash().GetCheapHash() & 1;
+        }
+    };
+
+    const uint32_t flagsToTest[] = {
+        SCRIPT_VERIFY_P2SH, SCRIPT_VERIFY_STRICTENC, SCRIPT_VERIFY_DERSIG,
+        SCRIPT_VERIFY_LOW_S, SCRIPT_VERIFY_NULLDUMMY, SCRIPT_VERIFY_SIGPUSHONLY,
+        SCRIPT_VERIFY_MINIMALDATA, SCRIPT_VERIFY_CLEANSTACK,
+        SCRIPT_VERIFY_NULLFAIL, SCRIPT_VERIFY_COMPRESSED_PUBKEYTYPE,
+        SCRIPT_ENABLE_SIGHASH_FORKID, SCRIPT_GENESIS, SCRIPT_UTXO_AFTER_GENESIS};
+
+    uint32_t RandomFlags()
+    {
+        uint32_t flags = SCRIPT_VERIFY_NONE;
+        for (uint32_t flag : flagsToTest)
+        {
+            if (InsecureRandBool())
+            {
+                flags |= flag;
+            }
+        }
+        if (flags & SCRIPT_VERIFY_CLEANSTACK)
+        {
+            flags |= SCRIPT_VERIFY_P2SH;
+        }
+        return flags;
+    }
+
+    class ScriptGenerator
+    {
+        std::vector<CKey> keys;
+
+    public:
+        ScriptGenerator()
+        {
+            for (bool compressed : {true, false})
+            {
+                for (int i = 0; i < 3; ++i)
+                {
+                    keys.emplace_back();
+                    keys.back().MakeNewKey(compressed);
+                }
+            }
+        }
+
+        valtype PubKey()
+        {
+            switch (InsecureRandRange(8))
+            {
+                case 0:
+                    // Invalid encoding
+                    return InsecureRandBytes(33);
+                case 1:
+                    return InsecureRandBytes(65);
+                default:
+                {
+                    const CPubKey pubkey = keys[InsecureRandRange(keys.size())].GetPubKey();
+                    return valtype(pubkey.begin(), pubkey.end());
+                }
+            }
+        }
+
+        valtype Signature()
+        {
+            valtype sig;
+            switch (InsecureRandRange(10))
+            {
+                case 0:
+                    return sig;
+                case 1:
+                    return InsecureRandBytes(1 + InsecureRandRange(80));
+                default:
+                    keys[InsecureRandRange(keys.size())].Sign(InsecureRand256(), sig);
+                    break;
+            }
+            if (InsecureRandRange(8) == 0)
+            {
+                // Signature for a different message
+                sig[sig.size() - 1] ^= 0x01;
+            }
+            static const uint8_t hashTypes[] = {
+                SIGHASH_ALL | SIGHASH_FORKID, SIGHASH_ALL, SIGHASH_NONE | SIGHASH_FORKID,
+                SIGHASH_SINGLE | SIGHASH_ANYONECANPAY | SIGHASH_FORKID, 0x00, 0x85};
+            sig.push_back(InsecureRandRange(4) ? hashTypes[0] : hashTypes[InsecureRandRange(6)]);
+            return sig;
+        }
+
+        // Pushes the value, occasionally not in the minimal way
+        static void Push(CScript& script, const valtype& data)
+        {
+            if (InsecureRandRange(16) == 0 && data.size() < 0x100)
+            {
+                script << OP_PUSHDATA1 << static_cast<uint8_t>(data.size());
+                script.insert(script.end(), data.begin(), data.end());
+            }
+            else
+            {
+                script << data;
+            }
+        }
+
+        std::pair<CScript, CScript> Scripts()
+        {
+            CScript scriptSig;
+            CScript scriptPubKey;
+            switch (InsecureRandRange(4))
+            {
+                case 0:
+                {
+                    // P2PK
+                    Push(scriptPubKey, PubKey());
+                    scriptPubKey << OP_CHECKSIG;
+                    Push(scriptSig, Signature());
+                    break;
+                }
+                case 1:
+                case 2:
+                {
+                    // P2PKH
+                    const valtype pubkey = PubKey();
+                    uint160 hash = Hash160(pubkey.begin(), pubkey.end());
+                    if (InsecureRandRange(8) == 0)
+                    {
+                        *hash.begin() ^= 1;
+                    }
+                    scriptPubKey << OP_DUP << OP_HASH160;
+                    Push(scriptPubKey, ToByteVector(hash));
+                    scriptPubKey << OP_EQUALVERIFY << OP_CHECKSIG;
+                    Push(scriptSig, Signature());
+                    Push(scriptSig, pubkey);
+                    break;
+                }
+                default:
+                {
+                    // Multisig
+                    const int nKeys = 1 + InsecureRandRange(4);
+                    const int nSigs = 1 + InsecureRandRange(nKeys);
+                    scriptPubKey << CScript::EncodeOP_N(nSigs);
+                    for (int i = 0; i < nKeys; ++i)
+                    {
+                        Push(scriptPubKey, PubKey());
+                    }
+                    scriptPubKey << CScript::EncodeOP_N(nKeys) << OP_CHECKMULTISIG;
+                    Push(scriptSig, InsecureRandRange(8) ? valtype{} : valtype{0x00});
+                    for (int i = 0; i < nSigs; ++i)
+                    {
+                        Push(scriptSig, Signature());
+                    }
+                    break;
+                }
+            }
+
+            switch (InsecureRandRange(16))
+            {
+                case 0:
+                    // Extra value
+                    Push(scriptSig, Signature());
+                    break;
+                case 1:
+                    // Not push only
+                    scriptSig << OP_NOP;
+                    break;
+                case 2:
+                    // Truncated
+                    scriptSig = CScript(scriptSig.begin(), scriptSig.end() - 1);
+                    break;
+                default:
+                    break;
+            }
+            return {scriptSig, scriptPubKey};
+        }
+    };
+}
+
+BOOST_FIXTURE_TEST_SUITE(script_standard_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(verify_standard_script_matches_verify_script)
+{
+    const Config& config = GlobalConfig::GetConfig();
+    auto source = task::CCancellationSource::Make();
+    ScriptGenerator generator;
+
+    size_t nHandled = 0;
+    size_t nSuccess = 0;
+    for (int i = 0; i < 20000; ++i)
+    {
+        const auto [scriptSig, scriptPubKey] = generator.Scripts();
+        const uint32_t flags = RandomFlags();
+        const bool consensus = InsecureRandBool();
+
+        RecordingChecker standardChecker;
+        ScriptError standardError = SCRIPT_ERR_UNKNOWN_ERROR;
+        const auto standardResult = VerifyStandardScript(
+            config, consensus, scriptSig, scriptPubKey, flags, standardChecker,
+            &standardError);
+        if (!standardResult.has_value())
+        {
+            continue;
+        }
+        ++nHandled;
+
+        RecordingChecker checker;
+        ScriptError error = SCRIPT_ERR_UNKNOWN_ERROR;
+        const auto result = VerifyScript(
+            config, consensus, source->GetToken(), scriptSig, scriptPubKey,
+            flags, checker, &error);
+        BOOST_REQUIRE(result.has_value());
+
+        BOOST_CHECK_MESSAGE(
+            *standardResult == *result && standardError == error,
+            "scriptSig " << HexStr(scriptSig) << " scriptPubKey "
+                         << HexStr(scriptPubKey) << " flags " << flags
+                         << ": " << ScriptErrorString(standardError)
+                         << " != " << ScriptErrorString(error));
+        BOOST_CHECK(standardChecker.calls == checker.calls);
+        if (*result)
+        {
+            ++nSuccess;
+        }
+    }
+
+    // Most of the generated scripts are handled and some of them are valid
+    BOOST_CHECK_GT(nHandled, 10000U);
+    BOOST_CHECK_GT(nSuccess, 1000U);
+}
+
+BOOST_AUTO_TEST_CASE(verify_standard_script_not_handled)
+{
+    const Config& config = GlobalConfig::GetConfig();
+    const RecordingChecker checker;
+    const valtype pubkey(33, 0x02);
+    const valtype sig(72, 0x30);
+
+    // P2SH and non-standard scripts
+    const CScript redeemScript = CScript() << pubkey << OP_CHECKSIG;
+    const CScript p2sh = CScript() << OP_HASH160 << ToByteVector(CScriptID(redeemScript)) << OP_EQUAL;
+    BOOST_CHECK(!VerifyStandardScript(config, true, CScript() << sig << ToByteVector(redeemScript),
+                                      p2sh, SCRIPT_VERIFY_P2SH, checker).has_value());
+    BOOST_CHECK(!VerifyStandardScript(config, true, CScript() << OP_1, CScript() << OP_1 << OP_EQUAL,
+                                      SCRIPT_VERIFY_NONE, checker).has_value());
+
+    // scriptSig that isn't a plain push of the expected values
+    const CScript p2pk = CScript() << pubkey << OP_CHECKSIG;
+    BOOST_CHECK(VerifyStandardScript(config, true, CScript() << sig, p2pk, SCRIPT_VERIFY_NONE, checker).has_value());
+    BOOST_CHECK(!VerifyStandardScript(config, true, CScript() << sig << sig, p2pk, SCRIPT_VERIFY_NONE, checker).has_value());
+    BOOST_CHECK(!VerifyStandardScript(config, true, CScript() << OP_0 << OP_DROP << sig, p2pk, SCRIPT_VERIFY_NONE, checker).has_value());
+    BOOST_CHECK(checker.calls.size() == 1);
+
+    // Multisig with counts that are not OP_1 .. OP_16
+    const CScript multisig = CScript() << valtype{1} << pubkey << OP_1 << OP_CHECKMULTISIG;
+    BOOST_CHECK(!VerifyStandardScript(config, true, CScript() << OP_0 << sig, multisig,
+                                      SCRIPT_UTXO_AFTER_GENESIS, checker).has_value());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
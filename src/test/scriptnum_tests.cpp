@@ -9,6 +9,8 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <random>
+
 #include "big_int.h"
 
 using namespace std;
@@ -414,6 +416,78 @@ BOOST_AUTO_TEST_CASE(to_size_t_limited)
     BOOST_CHECK_EQUAL(size_t_max, CScriptNum{bint{size_t_max}}.to_size_t_limited());
 }
 
+BOOST_AUTO_TEST_CASE(fixed_width_matches_bint)
+{
+    // Operands of several widths, including values that use every bit of
+    // the fixed width and results that don't fit
+    std::mt19937_64 rng{42};
+    const auto random_operand = [&rng](size_t size) {
+        vector<uint8_t> v(size);
+        const auto pattern{rng() % 3};
+        for(auto& byte : v)
+            byte = pattern == 0 ? rng() : pattern == 1 ? 0xff : (rng() & 1) * 0xff;
+        // bint serialization is minimal
+        return bint::deserialize(v).serialize();
+    };
+    const vector<size_t> sizes{0, 1, 3, 4, 5, 8, 9, 20, 32, 33, 63, 64, 65};
+
+    for(int i = 0; i < 20000; ++i)
+    {
+        const auto a_vch{random_operand(sizes[rng() % sizes.size()])};
+        const auto b_vch{random_operand(sizes[rng() % sizes.size()])};
+        const auto a{CFixedScriptNum::Decode(a_vch, true, 1000)};
+        const auto b{CFixedScriptNum::Decode(b_vch, true, 1000)};
+        BOOST_CHECK_EQUAL(a.has_value(), a_vch.size() <= CFixedScriptNum::MAXIMUM_ELEMENT_SIZE);
+        BOOST_CHECK_EQUAL(b.has_value(), b_vch.size() <= CFixedScriptNum::MAXIMUM_ELEMENT_SIZE);
+        if(!a || !b)
+            continue;
+
+        const bint a_bint{bint::deserialize(a_vch)};
+        const bint b_bint{bint::deserialize(b_vch)};
+        BOOST_CHECK(a->getvch() == a_vch);
+        BOOST_CHECK_EQUAL(*a == *b, a_bint == b_bint);
+        BOOST_CHECK_EQUAL(*a < *b, a_bint < b_bint);
+
+        const auto check = [](CFixedScriptNum n, bool fits, const bint& expected) {
+            // Results that don't fit must be rejected rather than truncated
+            if(fits)
+                BOOST_CHECK(n.getvch() == expected.serialize());
+            else
+                BOOST_CHECK_GT(expected.serialize().size(), CFixedScriptNum::MAXIMUM_ELEMENT_SIZE);
+        };
+        CFixedScriptNum n{*a};
+        bool fits{n.Add(*b)};
+        check(n, fits, a_bint + b_bint);
+        n = *a;
+        fits = n.Sub(*b);
+        check(n, fits, a_bint - b_bint);
+        n = *a;
+        fits = n.Mul(*b);
+        check(n, fits, a_bint * b_bint);
+        n = *a;
+        n.Negate();
+        check(n, true, -a_bint);
+        if(!b->IsZero())
+        {
+            n = *a;
+            n.Div(*b);
+            check(n, true, a_bint / b_bint);
+            n = *a;
+            n.Mod(*b);
+            check(n, true, a_bint % b_bint);
+        }
+    }
+
+    // Same checks and exceptions as CScriptNum
+    BOOST_CHECK_THROW(CFixedScriptNum::Decode(vector<uint8_t>(5, 1), true, 4),
+                      scriptnum_overflow_error);
+    BOOST_CHECK_THROW(CFixedScriptNum::Decode(vector<uint8_t>{1, 0}, true, 4),
+                      scriptnum_minencode_error);
+    BOOST_CHECK(CFixedScriptNum::Decode(vector<uint8_t>{1, 0}, false, 4)->getvch() ==
+                vector<uint8_t>{1});
+    BOOST_CHECK(CFixedScriptNum::Decode(vector<uint8_t>{0x80}, false, 4)->IsZero());
+}
+
 // clang-format off
 /** A selection of numbers that do not trigger int64_t overflow
  *  when added/subtracted. */
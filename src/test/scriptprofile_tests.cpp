@@ -0,0 +1,213 @@
+// Copyright (c) 2020 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "script/scriptprofile.h"
+
+#include "config.h"
+#include "script/interpreter.h"
+#include "script/limitedstack.h"
+#include "script/script.h"
+#include "taskcancellation.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+    CTxScriptProfile MakeProfile(const TxId& txid, int64_t nTimeMicros)
+    {
+        CTxScriptProfile profile;
+        profile.txid = txid;
+        profile.inputs.resize(2);
+        profile.inputs[0].nTimeMicros = nTimeMicros / 2;
+        profile.inputs[1].nTimeMicros = nTimeMicros - nTimeMicros / 2;
+        return profile;
+    }
+
+    std::vector<int64_t> GetTimes(const CSlowScriptLog& log)
+    {
+        std::vector<int64_t> times;
+        for(const CTxScriptProfile& profile : log.GetEntries())
+        {
+            times.push_back(profile.GetTotalTimeMicros());
+        }
+        return times;
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(scriptprofile_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(verify_script_profile)
+{
+    const Config& config = GlobalConfig::GetConfig();
+    auto source = task::CCancellationSource::Make();
+
+    const std::vector<uint8_t> bigNum(70, 0x01);
+    const CScript scriptSig = CScript() << std::vector<uint8_t>(32, 0xaa);
+    const CScript scriptPubKey =
+        CScript() << OP_SHA256 << OP_DROP
+                  << OP_2 << OP_1ADD << OP_DROP
+                  << bigNum << OP_1ADD << OP_DROP
+                  << std::vector<uint8_t>(71, 0x30) << std::vector<uint8_t>(33, 0x02)
+                  << OP_CHECKSIG << OP_DROP
+                  << OP_0 << OP_IF << OP_DUP << OP_SHA256 << OP_ENDIF
+                  << OP_1;
+
+    ScriptProfile profile;
+    ScriptError error;
+    const auto res = VerifyScript(
+        config, true, source->GetToken(), scriptSig, scriptPubKey,
+        SCRIPT_UTXO_AFTER_GENESIS, BaseSignatureChecker{}, &error, &profile);
+    BOOST_REQUIRE(res.has_value());
+    BOOST_CHECK(res.value());
+
+    // Opcodes in the branch that is not executed are not counted
+    BOOST_CHECK_EQUAL(profile.nOpcodes, 17U);
+    BOOST_CHECK_EQUAL(profile.nHashedBytes, 32U);
+    BOOST_CHECK_EQUAL(profile.nSigChecks, 1U);
+    // Only the operand that doesn't fit a fixed width integer needs big numbers
+    BOOST_CHECK_EQUAL(profile.nBigNumOps, 1U);
+
+    // Profiles are accumulated
+    VerifyScript(
+        config, true, source->GetToken(), scriptSig, scriptPubKey,
+        SCRIPT_UTXO_AFTER_GENESIS, BaseSignatureChecker{}, &error, &profile);
+    BOOST_CHECK_EQUAL(profile.nOpcodes, 34U);
+    BOOST_CHECK_EQUAL(profile.nSigChecks, 2U);
+}
+
+BOOST_AUTO_TEST_CASE(bignum_ops_count)
+{
+    const Config& config = GlobalConfig::GetConfig();
+    auto source = task::CCancellationSource::Make();
+
+    const auto countBigNumOps = [&](const CScript& script)
+    {
+        ScriptProfile profile;
+        LimitedStack stack(UINT32_MAX);
+        ScriptError error;
+        BOOST_CHECK(EvalScript(
+            config, true, source->GetToken(), stack, script,
+            SCRIPT_UTXO_AFTER_GENESIS, BaseSignatureChecker{}, &error, &profile).value());
+        return profile.nBigNumOps;
+    };
+
+    // Operands that fit a fixed width integer don't need big numbers
+    BOOST_CHECK_EQUAL(countBigNumOps(CScript() << OP_5 << OP_1ADD), 0U);
+    BOOST_CHECK_EQUAL(countBigNumOps(CScript() << OP_5 << OP_6 << OP_ADD), 0U);
+    BOOST_CHECK_EQUAL(countBigNumOps(CScript() << OP_5 << OP_1 << OP_6 << OP_WITHIN), 0U);
+
+    const std::vector<uint8_t> bigNum(70, 0x01);
+    BOOST_CHECK_EQUAL(countBigNumOps(CScript() << bigNum << OP_1ADD), 1U);
+    BOOST_CHECK_EQUAL(countBigNumOps(CScript() << OP_5 << bigNum << OP_ADD), 1U);
+    BOOST_CHECK_EQUAL(countBigNumOps(CScript() << OP_5 << OP_1 << bigNum << OP_WITHIN), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(script_cost_limit)
+{
+    const Config& config = GlobalConfig::GetConfig();
+    auto source = task::CCancellationSource::Make();
+
+    ScriptProfile profile;
+    profile.nOpcodes = 17;
+    profile.nHashedBytes = 32;
+    profile.nSigChecks = 1;
+    profile.nBigNumOps = 1;
+    BOOST_CHECK_EQUAL(profile.GetCost(), 17U + 2U + 1000U + 4U);
+    BOOST_CHECK(!profile.IsOverCostLimit());
+
+    CScript script;
+    for(int i = 0; i < 100; ++i)
+    {
+        script << OP_1 << OP_DROP;
+    }
+    script << OP_1;
+
+    // Evaluation stops like on cancellation once the limit is exceeded
+    ScriptProfile limited;
+    limited.nCostLimit = 50;
+    LimitedStack stack(UINT32_MAX);
+    ScriptError error;
+    BOOST_CHECK(!EvalScript(
+        config, true, source->GetToken(), stack, script,
+        SCRIPT_UTXO_AFTER_GENESIS, BaseSignatureChecker{}, &error, &limited).has_value());
+    BOOST_CHECK_EQUAL(limited.GetCost(), 51U);
+
+    ScriptProfile unlimited;
+    LimitedStack stack2(UINT32_MAX);
+    BOOST_CHECK(EvalScript(
+        config, true, source->GetToken(), stack2, script,
+        SCRIPT_UTXO_AFTER_GENESIS, BaseSignatureChecker{}, &error, &unlimited).value());
+    BOOST_CHECK_EQUAL(unlimited.GetCost(), 201U);
+}
+
+BOOST_AUTO_TEST_CASE(slow_script_log)
+{
+    CSlowScriptLog log;
+    const TxId txid1 {InsecureRand256()};
+    const TxId txid2 {InsecureRand256()};
+    const TxId txid3 {InsecureRand256()};
+
+    // Disabled log keeps nothing
+    BOOST_CHECK(!log.IsEnabled());
+    log.Add(MakeProfile(txid1, 10));
+    BOOST_CHECK(log.GetEntries().empty());
+
+    log.SetMaxEntries(2);
+    BOOST_CHECK(log.IsEnabled());
+    log.Add(MakeProfile(txid1, 10));
+    log.Add(MakeProfile(txid2, 30));
+    log.Add(MakeProfile(txid3, 20));
+    BOOST_CHECK(GetTimes(log) == (std::vector<int64_t>{30, 20}));
+    BOOST_CHECK(log.GetEntries()[0].txid == txid2);
+    BOOST_CHECK(log.GetEntries()[1].txid == txid3);
+
+    // Faster than every logged transaction
+    log.Add(MakeProfile(txid1, 5));
+    BOOST_CHECK(GetTimes(log) == (std::vector<int64_t>{30, 20}));
+
+    // Logged transaction keeps the slower profile
+    log.Add(MakeProfile(txid3, 15));
+    BOOST_CHECK(GetTimes(log) == (std::vector<int64_t>{30, 20}));
+    log.Add(MakeProfile(txid3, 40));
+    BOOST_CHECK(GetTimes(log) == (std::vector<int64_t>{40, 30}));
+    BOOST_CHECK_EQUAL(log.GetEntries().size(), 2U);
+
+    log.SetMaxEntries(1);
+    BOOST_CHECK(GetTimes(log) == (std::vector<int64_t>{40}));
+    BOOST_CHECK(log.GetEntries()[0].txid == txid3);
+}
+
+BOOST_AUTO_TEST_CASE(profile_collector)
+{
+    CSlowScriptLog& log = GetSlowScriptLog();
+    log.SetMaxEntries(1);
+
+    const TxId txid {InsecureRand256()};
+    {
+        auto collector = std::make_shared<CTxScriptProfileCollector>(txid, 2);
+        CInputScriptProfile input;
+        input.profile.nOpcodes = 3;
+        input.nTimeMicros = 7;
+        collector->Add(1, input);
+        input.profile.nOpcodes = 4;
+        collector->Add(0, input);
+
+        // Submitted when the last reference is released
+        auto copy = collector;
+        collector.reset();
+        BOOST_CHECK(log.GetEntries().empty());
+    }
+
+    const auto entries = log.GetEntries();
+    BOOST_REQUIRE_EQUAL(entries.size(), 1U);
+    BOOST_CHECK(entries[0].txid == txid);
+    BOOST_CHECK_EQUAL(entries[0].GetTotalTimeMicros(), 14);
+    BOOST_CHECK_EQUAL(entries[0].GetTotal().nOpcodes, 7U);
+    BOOST_CHECK_EQUAL(entries[0].inputs[0].profile.nOpcodes, 4U);
+
+    log.SetMaxEntries(0);
+    BOOST_CHECK(log.GetEntries().empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
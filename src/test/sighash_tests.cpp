@@ -238,4 +238,46 @@ BOOST_AUTO_TEST_CASE(sighash_from_data) {
     }
 }
 
+// Goal: check that the cached scriptCode midstate gives the same signature
+// hashes as hashing the whole preimage
+BOOST_AUTO_TEST_CASE(sighash_scriptcode_midstate) {
+    SeedInsecureRand(false);
+
+    CMutableTransaction mtx;
+    RandomTransaction(mtx, false);
+    const CTransaction tx(mtx);
+    PrecomputedTransactionData txdata(tx);
+
+    CScript large;
+    large << std::vector<uint8_t>(4000, 0x42) << OP_DROP;
+    CScript otherLarge = large;
+    otherLarge << OP_CODESEPARATOR << OP_TRUE;
+    CScript small;
+    RandomScript(small);
+
+    for (int i = 0; i < 500; i++) {
+        // Repeated checks of the same input and scriptCode hit the cache,
+        // switching input, scriptCode or hash type invalidates it.
+        SigHashType sigHashType(insecure_rand() | SIGHASH_FORKID);
+        unsigned int nIn = InsecureRandRange(tx.vin.size());
+        const CScript &scriptCode = InsecureRandBits(2) == 0
+                                        ? otherLarge
+                                        : (InsecureRandBool() ? large : small);
+        Amount amount(int64_t(InsecureRandRange(1000)));
+
+        uint256 cached = SignatureHash(scriptCode, tx, nIn, sigHashType,
+                                       amount, &txdata);
+        uint256 uncached =
+            SignatureHash(scriptCode, tx, nIn, sigHashType, amount);
+        BOOST_CHECK(cached == uncached);
+    }
+
+    // Copies don't share the cache
+    PrecomputedTransactionData copy(txdata);
+    BOOST_CHECK(SignatureHash(large, tx, 0, SigHashType().withForkId(),
+                              Amount(1), &copy) ==
+                SignatureHash(large, tx, 0, SigHashType().withForkId(),
+                              Amount(1)));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
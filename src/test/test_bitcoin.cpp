@@ -128,6 +128,8 @@ TestingSetup::~TestingSetup() {
     UnregisterNodeSignals(GetNodeSignals());
     threadGroup.interrupt_all();
     threadGroup.join_all();
+    // Also waits for undo data to be written before the data dir is removed
+    ShutdownScriptCheckQueues();
     UnloadBlockIndex();
     delete pcoinsTip;
     delete pcoinsdbview;
@@ -65,7 +65,6 @@ struct BasicTestingSetup {
  */
 class CConnman;
 struct TestingSetup : public BasicTestingSetup {
-    CCoinsViewDB *pcoinsdbview;
     fs::path pathTemp;
     boost::thread_group threadGroup;
     CConnman *connman;
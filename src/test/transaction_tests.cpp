@@ -388,7 +388,7 @@ static CScript PushAll(const LimitedStack &values) {
         } else if (values.at(i).size() == 1 && values.at(i)[0] >= 1 && values.at(i)[0] <= 16) {
             result << CScript::EncodeOP_N(values.at(i)[0]);
         } else {
-            result << values.at(i).GetElement();
+            result << valtype(values.at(i).begin(), values.at(i).end());
         }
     }
     return result;
@@ -495,6 +495,70 @@ BOOST_AUTO_TEST_CASE(test_big_transaction) {
     threadGroup.join_all();
 }
 
+BOOST_AUTO_TEST_CASE(sign_transaction_inputs) {
+    CKey key, otherKey;
+    key.MakeNewKey(true);
+    otherKey.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    const CScript scriptPubKey =
+        GetScriptForDestination(key.GetPubKey().GetID());
+    const CScript otherScriptPubKey =
+        GetScriptForDestination(otherKey.GetPubKey().GetID());
+
+    // Enough inputs to be split into several batches, one of them unknown
+    // and one of them not signable with the keystore.
+    const size_t INPUT_COUNT = 200;
+    CMutableTransaction mtx;
+    std::vector<std::optional<SpentOutput>> spentOutputs;
+    for (size_t i = 0; i < INPUT_COUNT; i++) {
+        mtx.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+        spentOutputs.push_back(SpentOutput{
+            CTxOut(Amount(1000), i == 7 ? otherScriptPubKey : scriptPubKey),
+            true});
+    }
+    spentOutputs[3].reset();
+    mtx.vout.emplace_back(Amount(1000), CScript() << OP_TRUE);
+
+    // Signatures are deterministic, so signing in parallel must produce the
+    // same transaction as signing the inputs one by one.
+    CMutableTransaction expected(mtx);
+    for (size_t i = 0; i < INPUT_COUNT; i++) {
+        if (spentOutputs[i]) {
+            SignSignature(testConfig, keystore, true, true,
+                          spentOutputs[i]->txout.scriptPubKey, expected, i,
+                          Amount(1000), SigHashType().withForkId());
+        }
+    }
+
+    for (size_t nThreads : {1, 4}) {
+        CMutableTransaction signedTx(mtx);
+        auto errors = SignTransactionInputs(testConfig, keystore, true,
+                                            signedTx, spentOutputs, {},
+                                            SigHashType().withForkId(),
+                                            nThreads);
+        BOOST_REQUIRE_EQUAL(errors.size(), INPUT_COUNT);
+        for (size_t i = 0; i < INPUT_COUNT; i++) {
+            if (i == 3) {
+                BOOST_CHECK(!errors[i]);
+            } else if (i == 7) {
+                BOOST_CHECK(errors[i] && *errors[i] != SCRIPT_ERR_OK);
+            } else {
+                BOOST_CHECK(errors[i] && *errors[i] == SCRIPT_ERR_OK);
+            }
+        }
+        BOOST_CHECK(signedTx == expected);
+
+        // Signatures of an already signed variant are merged in
+        CMutableTransaction unsignedTx(mtx);
+        auto mergedErrors = SignTransactionInputs(
+            testConfig, CBasicKeyStore(), true, unsignedTx, spentOutputs,
+            {signedTx}, SigHashType().withForkId(), nThreads);
+        BOOST_CHECK(mergedErrors == errors);
+        BOOST_CHECK(unsignedTx == expected);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(test_witness) {
     CBasicKeyStore keystore, keystore2;
     CKey key1, key2, key3, key1L, key2L;
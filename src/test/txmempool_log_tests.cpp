@@ -0,0 +1,155 @@
+// Copyright (c) 2019 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "txmempool_log.h"
+
+#include "clientversion.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+    CTransactionRef MakeTxn()
+    {
+        CMutableTransaction mtx {};
+        mtx.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+        mtx.vout.emplace_back(Amount(1000), CScript());
+        return MakeTransactionRef(mtx);
+    }
+
+    std::vector<TxId> AddedTxIds(CTxMemPoolLogReplay& replay)
+    {
+        std::vector<TxId> txids {};
+        for (const auto& txn : replay.TakeAddedTxns()) {
+            txids.push_back(txn.first->GetId());
+        }
+        return txids;
+    }
+
+    size_t CountLogs(const fs::path& dir)
+    {
+        size_t count {0};
+        for (const auto& entry : fs::directory_iterator(dir)) {
+            if (entry.path().filename().string().find("mempool.log.") == 0) {
+                ++count;
+            }
+        }
+        return count;
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(txmempool_log_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(replay)
+{
+    CTransactionRef tx1 { MakeTxn() };
+    CTransactionRef tx2 { MakeTxn() };
+    CTransactionRef tx3 { MakeTxn() };
+    CTransactionRef tx4 { MakeTxn() };
+
+    CTxMemPoolLogReplay replay {};
+    replay.Apply(CTxMemPoolLogRecord{tx1, 1});
+    replay.Apply(CTxMemPoolLogRecord{tx2, 2});
+    replay.Apply(CTxMemPoolLogRecord{tx3, 3});
+    // Removed and added again after tx3
+    replay.Apply(CTxMemPoolLogRecord{tx1->GetId()});
+    replay.Apply(CTxMemPoolLogRecord{tx1, 4});
+    // Removed
+    replay.Apply(CTxMemPoolLogRecord{tx2->GetId()});
+    replay.Apply(CTxMemPoolLogRecord{tx4->GetId()});
+    BOOST_CHECK_EQUAL(replay.GetNumRecords(), 7U);
+
+    // Snapshot txns removed by the log are dropped, those added again are
+    // loaded at their position in the snapshot
+    BOOST_CHECK(!replay.KeepSnapshotTxn(tx2->GetId()));
+    BOOST_CHECK(!replay.KeepSnapshotTxn(tx4->GetId()));
+    BOOST_CHECK(replay.KeepSnapshotTxn(tx3->GetId()));
+    BOOST_CHECK(replay.KeepSnapshotTxn(MakeTxn()->GetId()));
+
+    std::vector<TxId> expected { tx1->GetId() };
+    std::vector<TxId> added { AddedTxIds(replay) };
+    BOOST_CHECK(added == expected);
+}
+
+BOOST_AUTO_TEST_CASE(write_and_compact)
+{
+    fs::path dir { pathTemp / "mempool_log" };
+    fs::create_directories(dir);
+    CTxMemPool pool {};
+    size_t nSnapshots {0};
+    auto snapshot {
+        [&]() {
+            ++nSnapshots;
+            CAutoFile file { fsbridge::fopen(dir / "mempool.dat", "wb"), SER_DISK, CLIENT_VERSION };
+            file << static_cast<uint64_t>(nSnapshots);
+            return true;
+        }
+    };
+
+    std::vector<CTransactionRef> txns {};
+    for (int i = 0; i < 10; ++i) {
+        txns.push_back(MakeTxn());
+    }
+    {
+        // Never compacted after the snapshot taken on start
+        CTxMemPoolLog log { pool, dir, snapshot, std::numeric_limits<uint64_t>::max() };
+        for (const auto& tx : txns) {
+            pool.NotifyEntryAdded(tx);
+        }
+        pool.NotifyEntryRemoved(txns[0], MemPoolRemovalReason::BLOCK);
+        log.Flush();
+        BOOST_CHECK_EQUAL(nSnapshots, 1U);
+        BOOST_CHECK_EQUAL(CountLogs(dir), 1U);
+    }
+    {
+        CTxMemPoolLogReplay replay { CTxMemPoolLog::Replay(dir) };
+        BOOST_CHECK_EQUAL(replay.GetNumRecords(), txns.size() + 1);
+        std::vector<TxId> added { AddedTxIds(replay) };
+        BOOST_CHECK_EQUAL(added.size(), txns.size() - 1);
+        BOOST_CHECK(added.front() == txns[1]->GetId());
+    }
+
+    // A torn write at the end of the log is ignored
+    {
+        auto path { dir / "mempool.log.1" };
+        BOOST_CHECK(fs::exists(path));
+        CAutoFile file { fsbridge::fopen(path, "ab"), SER_DISK, CLIENT_VERSION };
+        file << uint32_t{1000} << uint64_t{0} << uint8_t{1};
+    }
+    BOOST_CHECK_EQUAL(CTxMemPoolLog::Replay(dir).GetNumRecords(), txns.size() + 1);
+
+    {
+        // Compacted once the log is larger than the snapshot
+        CTxMemPoolLog log { pool, dir, snapshot, 1 };
+        log.Flush();
+        BOOST_CHECK_EQUAL(nSnapshots, 2U);
+        BOOST_CHECK_EQUAL(CountLogs(dir), 1U);
+        BOOST_CHECK(fs::exists(dir / "mempool.log.2"));
+        for (const auto& tx : txns) {
+            pool.NotifyEntryAdded(tx);
+        }
+        log.Flush();
+        BOOST_CHECK_EQUAL(nSnapshots, 3U);
+        BOOST_CHECK_EQUAL(CountLogs(dir), 1U);
+        BOOST_CHECK(fs::exists(dir / "mempool.log.3"));
+    }
+    BOOST_CHECK_EQUAL(CTxMemPoolLog::Replay(dir).GetNumRecords(), 0U);
+
+    {
+        CTxMemPoolLog log { pool, dir, snapshot, std::numeric_limits<uint64_t>::max() };
+        pool.NotifyEntryAdded(MakeTxn());
+    }
+    // Changes are written on shutdown
+    BOOST_CHECK_EQUAL(nSnapshots, 4U);
+    BOOST_CHECK_EQUAL(CTxMemPoolLog::Replay(dir).GetNumRecords(), 1U);
+
+    CTxMemPoolLog::RemoveLogs(dir);
+    BOOST_CHECK_EQUAL(CountLogs(dir), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
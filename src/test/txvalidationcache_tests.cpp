@@ -11,6 +11,7 @@
 #include "pubkey.h"
 #include "random.h"
 #include "script/scriptcache.h"
+#include "script/sigcache.h"
 #include "script/sighashtype.h"
 #include "script/sign.h"
 #include "script/standard.h"
@@ -237,6 +238,90 @@ BOOST_AUTO_TEST_CASE(tx_mempool_block_doublespend) {
     BOOST_CHECK_EQUAL(mempool.Size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(block_prechecked_transactions) {
+    // Blocks with enough transactions have the transactions that don't spend
+    // outputs of the same block checked in parallel before connecting them.
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey())
+                                     << OP_CHECKSIG;
+    auto sign = [&](CMutableTransaction &tx, const Amount amount) {
+        std::vector<uint8_t> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, CTransaction(tx), 0,
+                                     SigHashType().withForkId(), amount);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+        tx.vin[0].scriptSig = CScript() << vchSig;
+    };
+    auto spend = [&](const COutPoint &prevout, const Amount amount) {
+        CMutableTransaction tx;
+        tx.nVersion = 1;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = prevout;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = amount - CENT;
+        tx.vout[0].scriptPubKey = scriptPubKey;
+        sign(tx, amount);
+        return tx;
+    };
+
+    // Split a mature coinbase into many outputs
+    const size_t OUTPUT_COUNT = 300;
+    const Amount outputValue = 10 * CENT;
+    CMutableTransaction split;
+    split.nVersion = 1;
+    split.vin.resize(1);
+    split.vin[0].prevout = COutPoint(coinbaseTxns[0].GetId(), 0);
+    split.vout.resize(OUTPUT_COUNT);
+    for (auto &out : split.vout) {
+        out.nValue = outputValue;
+        out.scriptPubKey = scriptPubKey;
+    }
+    sign(split, coinbaseTxns[0].vout[0].nValue);
+    CBlock block = CreateAndProcessBlock({split}, scriptPubKey);
+    BOOST_REQUIRE(chainActive.Tip()->GetBlockHash() == block.GetHash());
+
+    // Spend every output and chain a few spends of those in the same block
+    std::vector<CMutableTransaction> spends;
+    for (size_t i = 0; i < OUTPUT_COUNT; ++i) {
+        spends.push_back(
+            spend(COutPoint(split.GetId(), i), outputValue));
+    }
+    for (size_t i = 0; i < 10; ++i) {
+        spends.push_back(spend(COutPoint(spends[i].GetId(), 0),
+                               spends[i].vout[0].nValue));
+    }
+
+    // A double spend between two independent transactions is rejected
+    std::vector<CMutableTransaction> doubleSpend {spends};
+    CMutableTransaction otherSpend {spends[OUTPUT_COUNT - 1]};
+    otherSpend.vout[0].nValue -= CENT;
+    sign(otherSpend, outputValue);
+    doubleSpend.push_back(otherSpend);
+    block = CreateAndProcessBlock(doubleSpend, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() != block.GetHash());
+
+    // An independent transaction spending more than its input is rejected
+    std::vector<CMutableTransaction> overspend {spends};
+    overspend[OUTPUT_COUNT / 2].vout[0].nValue = outputValue + CENT;
+    sign(overspend[OUTPUT_COUNT / 2], outputValue);
+    block = CreateAndProcessBlock(overspend, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() != block.GetHash());
+
+    // An independent transaction with an invalid signature is rejected
+    std::vector<CMutableTransaction> badSig {spends};
+    badSig[OUTPUT_COUNT / 3].vin[0].scriptSig = CScript() << OP_0;
+    block = CreateAndProcessBlock(badSig, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() != block.GetHash());
+
+    // The block itself is valid
+    block = CreateAndProcessBlock(spends, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    for (size_t i = 0; i < 10; ++i) {
+        BOOST_CHECK(
+            pcoinsTip->AccessCoin(COutPoint(spends[OUTPUT_COUNT + i].GetId(), 0))
+                .GetHeight() == chainActive.Height());
+    }
+}
+
 
 BOOST_AUTO_TEST_CASE(checkinputs_test) {
     // Test that passing CheckInputs with one set of script flags doesn't imply
@@ -564,4 +649,113 @@ BOOST_AUTO_TEST_CASE(checkinputs_test) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(checkinputs_cost_budget) {
+    // Scripts that need the interpreter, each with a cost of 401
+    CScript scriptPubKey;
+    for (int i = 0; i < 200; ++i) {
+        scriptPubKey << OP_1 << OP_DROP;
+    }
+    scriptPubKey << OP_1;
+
+    CMutableTransaction mutableTx;
+    mutableTx.vin.resize(3);
+    mutableTx.vout.resize(1);
+    mutableTx.vout[0].nValue = 3 * CENT;
+    for (CTxIn& in : mutableTx.vin) {
+        in.prevout = COutPoint(InsecureRand256(), 0);
+    }
+    const CTransaction tx(mutableTx);
+    PrecomputedTransactionData txdata(tx);
+
+    LOCK(cs_main);
+    const Config& config = GlobalConfig::GetConfig();
+    CCoinsViewCache view(pcoinsTip);
+    for (const CTxIn& in : tx.vin) {
+        view.AddCoin(in.prevout, Coin(CTxOut(CENT, scriptPubKey), 1, false),
+                     false, config.GetGenesisActivationHeight());
+    }
+    const uint32_t flags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    auto source = task::CCancellationSource::Make();
+    auto checkInputs = [&](CScriptCostBudget& budget) {
+        CValidationState state;
+        return CheckInputs(source->GetToken(), config, false, tx, state, view,
+                           true, flags, false, false, txdata, nullptr, &budget);
+    };
+
+    // Two inputs fit into the budget before it runs out
+    CScriptCostBudget budget;
+    budget.nLimit = 1000;
+    BOOST_CHECK(!checkInputs(budget).has_value());
+    BOOST_CHECK(budget.IsExhausted());
+    BOOST_REQUIRE_EQUAL(budget.vVerifiedFlags.size(), 3U);
+    BOOST_CHECK(budget.vVerifiedFlags[0].has_value());
+    BOOST_CHECK(budget.vVerifiedFlags[1].has_value());
+    BOOST_CHECK(!budget.vVerifiedFlags[2].has_value());
+
+    // Without a limit only the last input is verified
+    const uint64_t nSpent = budget.nSpent;
+    budget.nLimit = 0;
+    const auto res = checkInputs(budget);
+    BOOST_REQUIRE(res.has_value());
+    BOOST_CHECK(res.value());
+    BOOST_CHECK(budget.vVerifiedFlags[2].has_value());
+    BOOST_CHECK_EQUAL(budget.nSpent, nSpent + 401);
+
+    // Inputs verified with other flags are verified again
+    CScriptCostBudget budget2;
+    budget2.vVerifiedFlags.assign(3, flags ^ SCRIPT_VERIFY_STRICTENC);
+    BOOST_CHECK(checkInputs(budget2).value());
+    BOOST_CHECK_EQUAL(budget2.nSpent, 3 * 401U);
+}
+
+BOOST_AUTO_TEST_CASE(scriptcheck_signature_batch) {
+    const Config& config = GlobalConfig::GetConfig();
+    const uint32_t flags = MANDATORY_SCRIPT_VERIFY_FLAGS;
+    const Amount amount = 11 * CENT;
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript p2pkh = GetScriptForDestination(key.GetPubKey().GetID());
+    const CScript multisig = GetScriptForMultisig(1, {key.GetPubKey()});
+
+    CMutableTransaction mutableTx;
+    mutableTx.vin.resize(2);
+    mutableTx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+    mutableTx.vin[1].prevout = COutPoint(InsecureRand256(), 0);
+    mutableTx.vout.resize(1);
+    mutableTx.vout[0].nValue = amount;
+
+    // Input 0 spends p2pkh and input 1 multisig, both signed for the given amount
+    auto sign = [&](const CScript& scriptPubKey, unsigned int nIn, Amount signedAmount) {
+        std::vector<uint8_t> vchSig;
+        const uint256 hash = SignatureHash(scriptPubKey, CTransaction(mutableTx), nIn,
+                                           SigHashType().withForkId(), signedAmount);
+        BOOST_CHECK(key.Sign(hash, vchSig));
+        vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+        return vchSig;
+    };
+    auto source = task::CCancellationSource::Make();
+    for (Amount signedAmount : {amount, amount + Amount(1)}) {
+        const bool fValid = signedAmount == amount;
+        mutableTx.vin[0].scriptSig = CScript() << sign(p2pkh, 0, signedAmount)
+                                               << ToByteVector(key.GetPubKey());
+        mutableTx.vin[1].scriptSig = CScript() << OP_0 << sign(multisig, 1, signedAmount);
+        const CTransaction tx(mutableTx);
+        PrecomputedTransactionData txdata(tx);
+
+        CScriptCheck p2pkhCheck(config, true, p2pkh, amount, tx, 0, flags, false, txdata);
+        CScriptCheck multisigCheck(config, true, multisig, amount, tx, 1, flags, false, txdata);
+        BOOST_CHECK_EQUAL(p2pkhCheck(source->GetToken()).value(), fValid);
+        BOOST_CHECK_EQUAL(multisigCheck(source->GetToken()).value(), fValid);
+
+        // P2PKH signature is deferred to the batch, multisig is not
+        CSignatureBatch batch;
+        BOOST_CHECK(p2pkhCheck(source->GetToken(), batch).value());
+        BOOST_CHECK_EQUAL(batch.size(), 1U);
+        BOOST_CHECK_EQUAL(multisigCheck(source->GetToken(), batch).value(), fValid);
+        BOOST_CHECK_EQUAL(batch.size(), 1U);
+        BOOST_CHECK_EQUAL(batch.Verify(), fValid);
+        BOOST_CHECK(batch.empty());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,194 @@
+// Copyright (c) 2019 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "utxo_snapshot.h"
+
+#include "coins.h"
+#include "config.h"
+#include "consensus/validation.h"
+#include "mining/legacy.h"
+#include "pow.h"
+#include "taskcancellation.h"
+#include "test/test_bitcoin.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+
+namespace
+{
+    // Fill view with nTxns transactions with a random number of outputs each
+    std::map<COutPoint, Coin> PopulateCoins(CCoinsView& view, size_t nTxns, const uint256& hashBlock)
+    {
+        std::map<COutPoint, Coin> coins {};
+        CCoinsViewCache cache { &view };
+        for(size_t i = 0; i < nTxns; ++i)
+        {
+            TxId txid { InsecureRand256() };
+            size_t nOutputs { 1 + InsecureRandRange(4) };
+            for(size_t n = 0; n < nOutputs; ++n)
+            {
+                CTxOut txout {};
+                txout.nValue = Amount(int64_t(InsecureRandRange(1000000)));
+                txout.scriptPubKey.assign(1 + InsecureRandBits(6), 0);
+                Coin coin { txout, static_cast<uint32_t>(1 + InsecureRandRange(1000)), InsecureRandBool() };
+                COutPoint outpoint { txid, static_cast<uint32_t>(n) };
+                cache.AddCoin(outpoint, coin, false, GlobalConfig::GetConfig().GetGenesisActivationHeight());
+                coins.emplace(outpoint, coin);
+            }
+        }
+        cache.SetBestBlock(hashBlock);
+        BOOST_REQUIRE(cache.Flush());
+        return coins;
+    }
+
+    struct RegtestingSetup : public TestingSetup
+    {
+        RegtestingSetup() : TestingSetup(CBaseChainParams::REGTEST) {}
+    };
+
+    // Mine a block with just a coinbase on top of pindexPrev
+    CBlock MakeBlock(const CBlockIndex* pindexPrev)
+    {
+        const Config& config { GlobalConfig::GetConfig() };
+        CMutableTransaction coinbase {};
+        coinbase.vin.resize(1);
+        coinbase.vout.resize(1, CTxOut { Amount(0), CScript() << OP_TRUE });
+
+        CBlock block {};
+        block.nVersion = 4;
+        block.hashPrevBlock = pindexPrev->GetBlockHash();
+        block.nTime = pindexPrev->GetMedianTimePast() + 1;
+        block.nBits = GetNextWorkRequired(pindexPrev, &block, config);
+        block.vtx.push_back(MakeTransactionRef(coinbase));
+        unsigned int nExtraNonce {0};
+        IncrementExtraNonce(&block, pindexPrev, nExtraNonce);
+        while(!CheckProofOfWork(block.GetHash(), block.nBits, config))
+        {
+            ++block.nNonce;
+        }
+        return block;
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(utxo_snapshot_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(dump_and_load)
+{
+    auto source = task::CCancellationSource::Make();
+    uint256 hashBlock { InsecureRand256() };
+    CCoinsViewDB sourceView { 1 << 20, true };
+    std::map<COutPoint, Coin> coins { PopulateCoins(sourceView, 500, hashBlock) };
+
+    fs::path path { pathTemp / "utxo.dat" };
+    CUTXOSnapshotMetadata metadata {};
+    metadata.hashBaseBlock = hashBlock;
+    metadata.nBaseHeight = 1000;
+    metadata.nBaseChainTx = 1234;
+    std::unique_ptr<CCoinsViewCursor> cursor { sourceView.Cursor() };
+    DumpUTXOSnapshot(*cursor, metadata, path, source->GetToken());
+    BOOST_CHECK_EQUAL(metadata.nCoins, coins.size());
+    BOOST_CHECK_EQUAL(metadata.nChunks, 1U);
+
+    CUTXOSnapshotMetadata read { ReadUTXOSnapshotMetadata(path) };
+    BOOST_CHECK(read.hashBaseBlock == hashBlock);
+    BOOST_CHECK_EQUAL(read.nBaseHeight, 1000);
+    BOOST_CHECK_EQUAL(read.nBaseChainTx, 1234U);
+    BOOST_CHECK_EQUAL(read.nCoins, coins.size());
+
+    CCoinsViewDB targetView { 1 << 20, true };
+    LoadUTXOSnapshot(targetView, path, read, 4, source->GetToken());
+    BOOST_CHECK(targetView.GetBestBlock() == hashBlock);
+    BOOST_CHECK(targetView.GetHeadBlocks().empty());
+
+    for(const auto& expected : coins)
+    {
+        Coin coin {};
+        BOOST_REQUIRE(targetView.GetCoin(expected.first, coin));
+        BOOST_CHECK(coin.GetTxOut() == expected.second.GetTxOut());
+        BOOST_CHECK_EQUAL(coin.GetHeight(), expected.second.GetHeight());
+        BOOST_CHECK_EQUAL(coin.IsCoinBase(), expected.second.IsCoinBase());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(corrupted_chunk)
+{
+    auto source = task::CCancellationSource::Make();
+    uint256 hashBlock { InsecureRand256() };
+    CCoinsViewDB sourceView { 1 << 20, true };
+    PopulateCoins(sourceView, 100, hashBlock);
+
+    fs::path path { pathTemp / "utxo_corrupted.dat" };
+    CUTXOSnapshotMetadata metadata {};
+    metadata.hashBaseBlock = hashBlock;
+    std::unique_ptr<CCoinsViewCursor> cursor { sourceView.Cursor() };
+    DumpUTXOSnapshot(*cursor, metadata, path, source->GetToken());
+
+    // Flip a byte inside the payload of the first chunk
+    {
+        FILE* file { fsbridge::fopen(path, "r+b") };
+        BOOST_REQUIRE(file);
+        long offset { static_cast<long>(::GetSerializeSize(metadata, SER_DISK, 0) + 2 * sizeof(uint64_t) + 40) };
+        BOOST_REQUIRE(fseek(file, offset, SEEK_SET) == 0);
+        int c { fgetc(file) };
+        BOOST_REQUIRE(fseek(file, offset, SEEK_SET) == 0);
+        fputc(c ^ 0xff, file);
+        fclose(file);
+    }
+
+    CCoinsViewDB targetView { 1 << 20, true };
+    BOOST_CHECK_THROW(
+        LoadUTXOSnapshot(targetView, path, ReadUTXOSnapshotMetadata(path), 2, source->GetToken()),
+        std::runtime_error);
+    // Interrupted load leaves the database marked as partially written
+    BOOST_CHECK(targetView.GetBestBlock().IsNull());
+    BOOST_CHECK_EQUAL(targetView.GetHeadBlocks().size(), 2U);
+}
+
+BOOST_FIXTURE_TEST_CASE(activate_snapshot_base, RegtestingSetup)
+{
+    const Config& config { GlobalConfig::GetConfig() };
+
+    // Only headers are known up to the snapshot base
+    const CBlockIndex* pindexBase { chainActive.Tip() };
+    for(int i = 0; i < 5; ++i)
+    {
+        CValidationState state {};
+        BOOST_REQUIRE(ProcessNewBlockHeaders(config, {MakeBlock(pindexBase).GetBlockHeader()}, state, &pindexBase));
+    }
+
+    {
+        LOCK(cs_main);
+        pcoinsTip->SetBestBlock(pindexBase->GetBlockHash());
+        BOOST_REQUIRE(ActivateSnapshotBase(config, mapBlockIndex[pindexBase->GetBlockHash()], 6));
+        BOOST_CHECK(GetSnapshotBase() == pindexBase);
+        BOOST_CHECK(chainActive.Tip() == pindexBase);
+    }
+
+    // Blocks on top of the base are connected, which also runs
+    // CheckBlockIndex over the partially downloaded block tree
+    for(int i = 0; i < 2; ++i)
+    {
+        auto block = std::make_shared<const CBlock>(MakeBlock(chainActive.Tip()));
+        BOOST_REQUIRE(ProcessNewBlock(config, block, true, nullptr));
+        BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block->GetHash());
+    }
+    BOOST_CHECK_EQUAL(chainActive.Height(), 7);
+    BOOST_CHECK_EQUAL(chainActive.Tip()->nChainTx, 8U);
+}
+
+BOOST_AUTO_TEST_CASE(invalid_header)
+{
+    fs::path path { pathTemp / "not_a_snapshot.dat" };
+    {
+        CAutoFile file { fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION };
+        CUTXOSnapshotMetadata metadata {};
+        metadata.nMagic = 0;
+        file << metadata;
+    }
+    BOOST_CHECK_THROW(ReadUTXOSnapshotMetadata(path), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
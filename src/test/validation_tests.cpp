@@ -6,8 +6,18 @@
 #include "chainparams.h"
 #include "config.h"
 #include "consensus/consensus.h"
+#include "net/net.h"
+#include "policy/policy.h"
 #include "primitives/transaction.h"
+#include "script/interpreter.h"
+#include "script/scriptcache.h"
+#include "script/sighashtype.h"
+#include "streams.h"
+#include "taskcancellation.h"
 #include "test/test_bitcoin.h"
+#include "txmempool.h"
+#include "txmempool_log.h"
+#include "txn_validator.h"
 #include "util.h"
 #include "validation.h"
 
@@ -76,4 +86,181 @@ BOOST_AUTO_TEST_CASE(validation_load_external_block_file) {
     BOOST_CHECK_NO_THROW({ LoadExternalBlockFile(config, fp, 0); });
 }
 
+BOOST_FIXTURE_TEST_CASE(undo_data_written_in_background, TestChain100Setup) {
+    auto checkUndoData = [this]() {
+        // Reads undo data of the last blocks back from disk and uses it to
+        // disconnect and reconnect them
+        FlushStateToDisk();
+        LOCK(cs_main);
+        auto source = task::CCancellationSource::Make();
+        BOOST_CHECK(CVerifyDB().VerifyDB(testConfig, pcoinsTip, 4, 10,
+                                         source->GetToken()));
+    };
+
+    // Undo data of blocks connected by the fixture was written in background
+    checkUndoData();
+
+    // Both with a queue that can't hold more than one block...
+    ShutdownScriptCheckQueues();
+    BOOST_CHECK(testConfig.SetMaxUndoWriteQueueSize(1));
+    InitScriptCheckQueues(testConfig, threadGroup);
+    for (int i = 0; i < 5; ++i) {
+        CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    }
+    checkUndoData();
+
+    // ... and when written while connecting blocks
+    ShutdownScriptCheckQueues();
+    BOOST_CHECK(testConfig.SetMaxUndoWriteQueueSize(0));
+    InitScriptCheckQueues(testConfig, threadGroup);
+    for (int i = 0; i < 5; ++i) {
+        CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    }
+    checkUndoData();
+    BOOST_CHECK_EQUAL(chainActive.Height(), 110);
+}
+
+BOOST_FIXTURE_TEST_CASE(mempool_dump_load, TestChain100Setup) {
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey())
+                                     << OP_CHECKSIG;
+    auto sign = [&](CMutableTransaction& mtx, const Amount& amount) {
+        std::vector<uint8_t> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, CTransaction(mtx), 0,
+                                     SigHashType().withForkId(), amount);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+        mtx.vin[0].scriptSig = CScript() << vchSig;
+    };
+
+    // Confirm enough outputs to spread the mempool over several chunks
+    const size_t nOutputs = 1100;
+    const Amount outputValue { 100000 };
+    CMutableTransaction fanout;
+    fanout.vin.resize(1);
+    fanout.vin[0].prevout = COutPoint(coinbaseTxns[0].GetId(), 0);
+    fanout.vout.resize(nOutputs, CTxOut(outputValue, scriptPubKey));
+    sign(fanout, coinbaseTxns[0].vout[0].nValue);
+    CreateAndProcessBlock({fanout}, scriptPubKey);
+    BOOST_CHECK(pcoinsTip->HaveCoin(COutPoint(fanout.GetId(), 0)));
+
+    // Independent spends followed by chains of dependent ones
+    std::vector<CTransactionRef> txns;
+    for (size_t i = 0; i < nOutputs; ++i) {
+        CMutableTransaction spend;
+        spend.vin.resize(1);
+        spend.vin[0].prevout = COutPoint(fanout.GetId(), i);
+        spend.vout.resize(1, CTxOut(outputValue - Amount(10000), scriptPubKey));
+        sign(spend, outputValue);
+        txns.push_back(MakeTransactionRef(spend));
+    }
+    for (size_t i = 0; i < 10; ++i) {
+        CTransactionRef parent { txns[i] };
+        for (size_t depth = 0; depth < 3; ++depth) {
+            CMutableTransaction child;
+            child.vin.resize(1);
+            child.vin[0].prevout = COutPoint(parent->GetId(), 0);
+            child.vout.resize(
+                1, CTxOut(parent->vout[0].nValue - Amount(10000), scriptPubKey));
+            sign(child, parent->vout[0].nValue);
+            parent = MakeTransactionRef(child);
+            txns.push_back(parent);
+        }
+    }
+
+    TxInputDataSPtrVec vTxInputData;
+    for (const auto& tx : txns) {
+        vTxInputData.push_back(
+            std::make_shared<CTxInputData>(
+                connman->GetTxIdTracker(), tx, TxSource::rpc,
+                TxValidationPriority::normal, GetTime()));
+    }
+    auto rejected {
+        connman->getTxnValidator()->processValidation(vTxInputData, nullptr)
+    };
+    BOOST_CHECK(rejected.first.empty());
+    BOOST_CHECK_EQUAL(mempool.Size(), txns.size());
+
+    auto source = task::CCancellationSource::Make();
+    DumpMempool();
+
+    // Transactions are restored in dependency order
+    mempool.Clear();
+    BOOST_CHECK(LoadMempool(testConfig, source->GetToken()));
+    BOOST_CHECK_EQUAL(mempool.Size(), txns.size());
+
+    // Also when scripts of the dump are trusted
+    gArgs.ForceSetArg("-persistmempooltrustscripts", "1");
+    mempool.Clear();
+    BOOST_CHECK(LoadMempool(testConfig, source->GetToken()));
+    BOOST_CHECK_EQUAL(mempool.Size(), txns.size());
+
+    // Script cache keys seeded for transactions that aren't accepted, either
+    // rejected or left without their parents, are removed again
+    {
+        const CTransactionRef& conflicted { txns[0] };
+        // First child in the chain spending the conflicted transaction
+        const CTransactionRef& orphan { txns[nOutputs] };
+        CMutableTransaction conflict;
+        conflict.vin.resize(1);
+        conflict.vin[0].prevout = conflicted->vin[0].prevout;
+        conflict.vout.resize(1, CTxOut(outputValue - Amount(20000), scriptPubKey));
+        sign(conflict, outputValue);
+        mempool.Clear();
+        BOOST_CHECK(connman->getTxnValidator()->processValidation(
+            std::make_shared<CTxInputData>(
+                connman->GetTxIdTracker(), MakeTransactionRef(conflict),
+                TxSource::rpc, TxValidationPriority::normal, GetTime()),
+            nullptr).IsValid());
+        BOOST_CHECK(LoadMempool(testConfig, source->GetToken()));
+        // The conflict replaces the conflicted transaction, whose chain of 3
+        // is missing
+        BOOST_CHECK_EQUAL(mempool.Size(), txns.size() - 3);
+        BOOST_CHECK(!mempool.Exists(conflicted->GetId()));
+        BOOST_CHECK(!mempool.Exists(orphan->GetId()));
+        // Mempool script flags on regtest
+        uint32_t standardFlags =
+            StandardScriptVerifyFlags(
+                IsGenesisEnabled(testConfig, chainActive.Height() + 1), false) |
+            SCRIPT_ENABLE_SIGHASH_FORKID;
+        BOOST_CHECK(!IsKeyInScriptCache(
+            GetScriptCacheKey(*conflicted, standardFlags), false));
+        BOOST_CHECK(!IsKeyInScriptCache(
+            GetScriptCacheKey(*orphan, standardFlags), false));
+    }
+    gArgs.ForceSetArg("-persistmempooltrustscripts", "0");
+
+    // Dumps written in the unchunked format are still loaded
+    {
+        FILE *filestr = fsbridge::fopen(GetDataDir() / "mempool.dat", "wb");
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << uint64_t{1} << uint64_t{5};
+        for (size_t i = 0; i < 5; ++i) {
+            file << *txns[i] << GetTime() << int64_t{0};
+        }
+        file << std::map<uint256, Amount>{};
+    }
+    mempool.Clear();
+    BOOST_CHECK(LoadMempool(testConfig, source->GetToken()));
+    BOOST_CHECK_EQUAL(mempool.Size(), 5U);
+
+    // Changes logged after the snapshot are replayed on top of it
+    {
+        CTxMemPoolLog log { mempool, GetDataDir(), [] { return DumpMempool(); } };
+        log.Flush();
+        mempool.RemoveRecursive(*txns[0], nullptr);
+        BOOST_CHECK(connman->getTxnValidator()->processValidation(
+            std::make_shared<CTxInputData>(
+                connman->GetTxIdTracker(), txns[5], TxSource::rpc,
+                TxValidationPriority::normal, GetTime()),
+            nullptr).IsValid());
+        log.Flush();
+    }
+    mempool.Clear();
+    BOOST_CHECK(LoadMempool(testConfig, source->GetToken()));
+    BOOST_CHECK_EQUAL(mempool.Size(), 5U);
+    BOOST_CHECK(!mempool.Exists(txns[0]->GetId()));
+    BOOST_CHECK(mempool.Exists(txns[5]->GetId()));
+    CTxMemPoolLog::RemoveLogs(GetDataDir());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -100,6 +100,19 @@ public:
     //! Returns true if database is in an older format.
     bool IsOldDBFormat();
     size_t EstimateSize() const override;
+
+    //! Underlying database, for reporting statistics
+    const CDBWrapper &GetDB() const { return db; }
+
+    //! Mark the database as being in transition to hashBlock before coins are
+    //! bulk loaded into it. Until EndBulkLoad() is called the database is
+    //! reported as partially written (see GetHeadBlocks()).
+    bool BeginBulkLoad(const uint256 &hashBlock);
+    //! Write coins directly to the database, bypassing any cache. May be
+    //! called concurrently from several threads.
+    bool BulkWrite(const std::vector<std::pair<COutPoint, Coin>> &coins);
+    //! Mark the database as consistent with hashBlock after a bulk load.
+    bool EndBulkLoad(const uint256 &hashBlock);
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -146,6 +159,10 @@ public:
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(
         std::function<CBlockIndex *(const uint256 &)> insertBlockIndex);
+    //! Block whose UTXO set was loaded from a snapshot, together with its
+    //! nChainTx (which can't be recomputed as its ancestors have no data).
+    bool WriteSnapshotBase(const uint256 &hash, uint64_t nChainTx);
+    bool ReadSnapshotBase(uint256 &hash, uint64_t &nChainTx);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -0,0 +1,353 @@
+// Copyright (c) 2019 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "txmempool_log.h"
+
+#include "clientversion.h"
+#include "hash.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+
+#include <map>
+
+std::unique_ptr<CTxMemPoolLog> g_mempoolLog {};
+
+// When we get C++17 we should loose this redundant definition, until then it's required.
+constexpr uint64_t CTxMemPoolLog::DEFAULT_MIN_COMPACTION_SIZE;
+constexpr unsigned CTxMemPoolLog::RUN_FREQUENCY_MILLIS;
+
+namespace
+{
+    const uint64_t MEMPOOL_LOG_VERSION = 1;
+    const std::string MEMPOOL_LOG_PREFIX = "mempool.log.";
+    // Size of the frame header: payload size and checksum
+    const uint64_t FRAME_HEADER_SIZE = sizeof(uint32_t) + sizeof(uint64_t);
+    // Pending changes are written early once there are this many
+    const size_t MAX_PENDING_RECORDS = 10000;
+
+    // Logs in dir by their generation
+    std::map<uint64_t, fs::path> ListLogs(const fs::path& dir)
+    {
+        std::map<uint64_t, fs::path> logs {};
+        for (const auto& entry : fs::directory_iterator(dir)) {
+            const std::string name { entry.path().filename().string() };
+            if (name.compare(0, MEMPOOL_LOG_PREFIX.size(), MEMPOOL_LOG_PREFIX) != 0) {
+                continue;
+            }
+            const std::string suffix { name.substr(MEMPOOL_LOG_PREFIX.size()) };
+            uint64_t generation {0};
+            if (ParseUInt64(suffix, &generation)) {
+                logs.emplace(generation, entry.path());
+            }
+        }
+        return logs;
+    }
+
+    fs::path GetLogPath(const fs::path& dir, uint64_t generation)
+    {
+        return dir / strprintf("%s%d", MEMPOOL_LOG_PREFIX, generation);
+    }
+}
+
+void CTxMemPoolLogReplay::Apply(CTxMemPoolLogRecord&& record)
+{
+    ++mnRecords;
+    const TxId& txid { record.GetTxId() };
+    if (record.GetType() == CTxMemPoolLogRecord::Type::ADD) {
+        mRemoved.erase(txid);
+        if (mAddedIndex.emplace(txid, mAdded.size()).second) {
+            mAdded.emplace_back(record.GetTx(), record.GetTime());
+        }
+    } else {
+        auto it { mAddedIndex.find(txid) };
+        if (it != mAddedIndex.end()) {
+            mAdded[it->second].first = nullptr;
+            mAddedIndex.erase(it);
+        }
+        mRemoved.insert(txid);
+    }
+}
+
+bool CTxMemPoolLogReplay::KeepSnapshotTxn(const TxId& txid)
+{
+    if (mRemoved.count(txid)) {
+        return false;
+    }
+    auto it { mAddedIndex.find(txid) };
+    if (it != mAddedIndex.end()) {
+        mAdded[it->second].first = nullptr;
+        mAddedIndex.erase(it);
+    }
+    return true;
+}
+
+std::vector<std::pair<CTransactionRef, int64_t>> CTxMemPoolLogReplay::TakeAddedTxns()
+{
+    std::vector<std::pair<CTransactionRef, int64_t>> added {};
+    added.reserve(mAddedIndex.size());
+    for (auto& txn : mAdded) {
+        if (txn.first) {
+            added.push_back(std::move(txn));
+        }
+    }
+    mAdded.clear();
+    mAddedIndex.clear();
+    return added;
+}
+
+CTxMemPoolLog::CTxMemPoolLog(
+    CTxMemPool& pool,
+    const fs::path& dir,
+    SnapshotFn snapshot,
+    uint64_t nMinCompactionSize)
+: mDir{dir}
+, mSnapshot{std::move(snapshot)}
+, mnMinCompactionSize{nMinCompactionSize}
+{
+    auto logs { ListLogs(mDir) };
+    if (!logs.empty()) {
+        mnGeneration = logs.rbegin()->first;
+    }
+
+    mAddedConnection = pool.NotifyEntryAdded.connect(
+        [this](CTransactionRef tx) { EntryAdded(std::move(tx)); });
+    mRemovedConnection = pool.NotifyEntryRemoved.connect(
+        [this](CTransactionRef tx, MemPoolRemovalReason reason) {
+            EntryRemoved(std::move(tx), reason);
+        });
+
+    // Launch our thread
+    mThread = std::thread(&CTxMemPoolLog::ThreadWriteLog, this);
+}
+
+CTxMemPoolLog::~CTxMemPoolLog()
+{
+    Shutdown();
+}
+
+void CTxMemPoolLog::EntryAdded(CTransactionRef tx)
+{
+    std::unique_lock<std::mutex> lock { mMtx };
+    mPending.emplace_back(std::move(tx), GetTime());
+    if (++mnPendingSeq - mnWrittenSeq >= MAX_PENDING_RECORDS) {
+        mPendingCV.notify_one();
+    }
+}
+
+void CTxMemPoolLog::EntryRemoved(CTransactionRef tx, MemPoolRemovalReason)
+{
+    std::unique_lock<std::mutex> lock { mMtx };
+    mPending.emplace_back(tx->GetId());
+    if (++mnPendingSeq - mnWrittenSeq >= MAX_PENDING_RECORDS) {
+        mPendingCV.notify_one();
+    }
+}
+
+void CTxMemPoolLog::Flush()
+{
+    std::unique_lock<std::mutex> lock { mMtx };
+    uint64_t nRequest { ++mnFlushRequests };
+    mPendingCV.notify_one();
+    mWrittenCV.wait(lock, [this, nRequest] { return mnFlushesDone >= nRequest || mfStopped; });
+}
+
+void CTxMemPoolLog::Shutdown()
+{
+    // Only shutdown once
+    bool expected {true};
+    if (mRunning.compare_exchange_strong(expected, false)) {
+        mAddedConnection.disconnect();
+        mRemovedConnection.disconnect();
+        {
+            std::unique_lock<std::mutex> lock { mMtx };
+            mPendingCV.notify_one();
+        }
+        mThread.join();
+    }
+}
+
+CTxMemPoolLogReplay CTxMemPoolLog::Replay(const fs::path& dir)
+{
+    CTxMemPoolLogReplay replay {};
+    for (const auto& log : ListLogs(dir)) {
+        CAutoFile file { fsbridge::fopen(log.second, "rb"), SER_DISK, CLIENT_VERSION };
+        if (file.IsNull()) {
+            LogPrintf("Failed to open mempool log %s\n", log.second.string());
+            continue;
+        }
+        try {
+            uint64_t nRemaining { fs::file_size(log.second) };
+            uint64_t version {};
+            uint64_t generation {};
+            file >> version >> generation;
+            if (version != MEMPOOL_LOG_VERSION || generation != log.first) {
+                throw std::runtime_error("Bad mempool log header");
+            }
+            nRemaining -= 2 * sizeof(uint64_t);
+
+            std::vector<char> data {};
+            while (nRemaining >= FRAME_HEADER_SIZE) {
+                uint32_t nSize {};
+                uint64_t nChecksum {};
+                file >> nSize >> nChecksum;
+                nRemaining -= FRAME_HEADER_SIZE;
+                // The last frame may be incomplete if we crashed writing it
+                if (nSize > nRemaining) {
+                    break;
+                }
+                data.resize(nSize);
+                file.read(data.data(), nSize);
+                nRemaining -= nSize;
+                if (Hash(data.begin(), data.end()).GetCheapHash() != nChecksum) {
+                    break;
+                }
+                CDataStream stream { data, SER_DISK, CLIENT_VERSION };
+                std::vector<CTxMemPoolLogRecord> records {};
+                stream >> records;
+                for (auto& record : records) {
+                    replay.Apply(std::move(record));
+                }
+            }
+            if (nRemaining) {
+                LogPrintf("Ignored incomplete end of mempool log %s\n", log.second.string());
+            }
+        } catch (const std::exception& e) {
+            LogPrintf("Failed to read mempool log %s: %s\n", log.second.string(), e.what());
+        }
+    }
+    return replay;
+}
+
+void CTxMemPoolLog::RemoveLogs(const fs::path& dir)
+{
+    for (const auto& log : ListLogs(dir)) {
+        fs::remove(log.second);
+    }
+}
+
+void CTxMemPoolLog::ThreadWriteLog() noexcept
+{
+    RenameThread("bitcoin-mempoollog");
+    LogPrint(BCLog::MEMPOOL, "Mempool log thread starting\n");
+
+    // The first snapshot covers all changes made before we started logging
+    bool fCompact {true};
+    while (true) {
+        if (fCompact) {
+            fCompact = false;
+            try {
+                Compact();
+            } catch (const std::exception& e) {
+                LogPrintf("Failed to compact mempool log: %s\n", e.what());
+            }
+        }
+
+        std::vector<CTxMemPoolLogRecord> records {};
+        uint64_t nSeq {0};
+        uint64_t nFlushRequests {0};
+        {
+            std::unique_lock<std::mutex> lock { mMtx };
+            mPendingCV.wait_for(lock, std::chrono::milliseconds{RUN_FREQUENCY_MILLIS},
+                [this] {
+                    return !mRunning ||
+                           mnFlushRequests > mnFlushesDone ||
+                           mnPendingSeq - mnWrittenSeq >= MAX_PENDING_RECORDS;
+                });
+            records.swap(mPending);
+            nSeq = mnPendingSeq;
+            nFlushRequests = mnFlushRequests;
+        }
+
+        try {
+            if (!records.empty()) {
+                WriteRecords(records);
+            }
+            // Keep the cost of rewriting the snapshot proportional to the
+            // size of the changes
+            fCompact = mnLogSize > std::max(mnSnapshotSize, mnMinCompactionSize);
+        } catch (const std::exception& e) {
+            // The log has a gap, so replace it with a new snapshot
+            LogPrintf("Failed to write mempool log: %s\n", e.what());
+            fCompact = true;
+        }
+        if (fCompact && mRunning) {
+            fCompact = false;
+            try {
+                Compact();
+            } catch (const std::exception& e) {
+                LogPrintf("Failed to compact mempool log: %s\n", e.what());
+            }
+        }
+
+        {
+            std::unique_lock<std::mutex> lock { mMtx };
+            mnWrittenSeq = nSeq;
+            mnFlushesDone = nFlushRequests;
+            if (!mRunning && mPending.empty()) {
+                break;
+            }
+        }
+        mWrittenCV.notify_all();
+    }
+
+    mFile.reset();
+    {
+        std::unique_lock<std::mutex> lock { mMtx };
+        mfStopped = true;
+    }
+    mWrittenCV.notify_all();
+    LogPrint(BCLog::MEMPOOL, "Mempool log thread stopping\n");
+}
+
+void CTxMemPoolLog::WriteRecords(const std::vector<CTxMemPoolLogRecord>& records)
+{
+    if (!mFile) {
+        throw std::runtime_error("No mempool log open");
+    }
+    CDataStream data { SER_DISK, CLIENT_VERSION };
+    data << records;
+    *mFile << static_cast<uint32_t>(data.size())
+           << Hash(data.begin(), data.end()).GetCheapHash();
+    mFile->write(data.data(), data.size());
+    FileCommit(mFile->Get());
+    mnLogSize += FRAME_HEADER_SIZE + data.size();
+}
+
+void CTxMemPoolLog::Compact()
+{
+    int64_t nStart { GetTimeMicros() };
+
+    // Changes made from now on go to the new log
+    if (mFile) {
+        FileCommit(mFile->Get());
+        mFile.reset();
+    }
+    ++mnGeneration;
+    mnLogSize = 0;
+    fs::path path { GetLogPath(mDir, mnGeneration) };
+    mFile = std::make_unique<CAutoFile>(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+    if (mFile->IsNull()) {
+        mFile.reset();
+        throw std::runtime_error(strprintf("Failed to create mempool log %s", path.string()));
+    }
+    *mFile << MEMPOOL_LOG_VERSION << mnGeneration;
+    FileCommit(mFile->Get());
+
+    // Older logs are still needed if we fail to take the snapshot
+    if (!mSnapshot()) {
+        LogPrintf("Failed to take mempool snapshot, keeping mempool logs\n");
+        return;
+    }
+    for (const auto& log : ListLogs(mDir)) {
+        if (log.first < mnGeneration) {
+            fs::remove(log.second);
+        }
+    }
+    mnSnapshotSize = fs::file_size(mDir / "mempool.dat");
+
+    LogPrint(BCLog::MEMPOOL, "Compacted mempool log to generation %d: %.6fs\n",
+             mnGeneration, (GetTimeMicros() - nStart) * 0.000001);
+}
@@ -0,0 +1,197 @@
+// Copyright (c) 2019 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#pragma once
+
+#include "fs.h"
+#include "primitives/transaction.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <boost/signals2/connection.hpp>
+
+class CAutoFile;
+class CTxMemPool;
+enum class MemPoolRemovalReason;
+
+/**
+ * A change of the mempool as recorded in the mempool log.
+ */
+class CTxMemPoolLogRecord
+{
+  public:
+    enum class Type : uint8_t { ADD = 1, REMOVE = 2 };
+
+    CTxMemPoolLogRecord() = default;
+    CTxMemPoolLogRecord(CTransactionRef tx, int64_t nTime)
+    : mType{Type::ADD}, mTx{std::move(tx)}, mTxId{mTx->GetId()}, mnTime{nTime}
+    {}
+    explicit CTxMemPoolLogRecord(const TxId& txid)
+    : mType{Type::REMOVE}, mTxId{txid}
+    {}
+
+    Type GetType() const { return mType; }
+    const CTransactionRef& GetTx() const { return mTx; }
+    const TxId& GetTxId() const { return mTxId; }
+    int64_t GetTime() const { return mnTime; }
+
+    template <typename Stream> void Serialize(Stream& s) const {
+        s << static_cast<uint8_t>(mType);
+        if (mType == Type::ADD) {
+            s << mTx << mnTime;
+        } else {
+            s << mTxId;
+        }
+    }
+
+    template <typename Stream> void Unserialize(Stream& s) {
+        uint8_t type {};
+        s >> type;
+        mType = static_cast<Type>(type);
+        if (mType == Type::ADD) {
+            s >> mTx >> mnTime;
+            mTxId = mTx->GetId();
+        } else if (mType == Type::REMOVE) {
+            s >> mTxId;
+        } else {
+            throw std::ios_base::failure("Unknown mempool log record type");
+        }
+    }
+
+  private:
+    Type mType {Type::ADD};
+    CTransactionRef mTx {nullptr};
+    TxId mTxId {};
+    int64_t mnTime {0};
+};
+
+/**
+ * The net effect of the mempool logs on the last mempool snapshot.
+ *
+ * Replaying is idempotent: a snapshot taken after a log was started is
+ * brought up to date by applying all changes from that log onwards, as the
+ * last logged change of a txn decides whether it is in the mempool.
+ */
+class CTxMemPoolLogReplay
+{
+  public:
+    /** Apply a logged change */
+    void Apply(CTxMemPoolLogRecord&& record);
+
+    /**
+     * Whether a txn of the snapshot is still in the mempool. A txn that was
+     * added again in the log is loaded at its position in the snapshot.
+     */
+    bool KeepSnapshotTxn(const TxId& txid);
+
+    /** Txns added by the log which are not in the snapshot, in log order */
+    std::vector<std::pair<CTransactionRef, int64_t>> TakeAddedTxns();
+
+    size_t GetNumRecords() const { return mnRecords; }
+
+  private:
+    std::vector<std::pair<CTransactionRef, int64_t>> mAdded {};
+    std::unordered_map<TxId, size_t, std::hash<TxId>> mAddedIndex {};
+    std::unordered_set<TxId, std::hash<TxId>> mRemoved {};
+    size_t mnRecords {0};
+};
+
+/**
+ * Continuously persists the mempool as an append-only log of the txns
+ * added to and removed from it, next to the snapshot in mempool.dat.
+ *
+ * Changes are collected from the mempool's notifications and appended by a
+ * background thread as checksummed frames, so a torn write after a crash
+ * only loses the last frame. Once a log grows larger than the last snapshot
+ * the thread compacts it: it starts a new log, takes a new snapshot and
+ * removes the older logs.
+ */
+class CTxMemPoolLog final
+{
+  public:
+    /** Takes a snapshot of the mempool, returns false on failure */
+    using SnapshotFn = std::function<bool()>;
+
+    CTxMemPoolLog(
+        CTxMemPool& pool,
+        const fs::path& dir,
+        SnapshotFn snapshot,
+        uint64_t nMinCompactionSize = DEFAULT_MIN_COMPACTION_SIZE);
+    ~CTxMemPoolLog();
+
+    // Forbid copying/assignment
+    CTxMemPoolLog(const CTxMemPoolLog&) = delete;
+    CTxMemPoolLog(CTxMemPoolLog&&) = delete;
+    CTxMemPoolLog& operator=(const CTxMemPoolLog&) = delete;
+    CTxMemPoolLog& operator=(CTxMemPoolLog&&) = delete;
+
+    /**
+     * Wait until all changes notified so far are written to disk and the
+     * log is compacted if it grew too large.
+     */
+    void Flush();
+
+    /** Stop logging after writing all pending changes */
+    void Shutdown();
+
+    /** Read all logs in dir in the order they were written */
+    static CTxMemPoolLogReplay Replay(const fs::path& dir);
+
+    /** Remove all logs in dir */
+    static void RemoveLogs(const fs::path& dir);
+
+    /** A log is not compacted before it has at least this size */
+    static constexpr uint64_t DEFAULT_MIN_COMPACTION_SIZE {64 * 1024 * 1024};
+
+  private:
+    void EntryAdded(CTransactionRef tx);
+    void EntryRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+
+    /** Thread entry point for writing changes */
+    void ThreadWriteLog() noexcept;
+    /** Append a frame of records to the current log */
+    void WriteRecords(const std::vector<CTxMemPoolLogRecord>& records);
+    /** Start a new log, take a snapshot and remove the logs before it */
+    void Compact();
+
+    const fs::path mDir;
+    const SnapshotFn mSnapshot;
+    const uint64_t mnMinCompactionSize;
+
+    boost::signals2::scoped_connection mAddedConnection {};
+    boost::signals2::scoped_connection mRemovedConnection {};
+
+    /** Changes waiting to be written */
+    std::vector<CTxMemPoolLogRecord> mPending {};
+    uint64_t mnPendingSeq {0};
+    uint64_t mnWrittenSeq {0};
+    uint64_t mnFlushRequests {0};
+    uint64_t mnFlushesDone {0};
+    std::mutex mMtx {};
+    std::condition_variable mPendingCV {};
+    std::condition_variable mWrittenCV {};
+    std::atomic<bool> mRunning {true};
+    bool mfStopped {false};
+
+    /** State of the writer thread */
+    std::unique_ptr<CAutoFile> mFile {};
+    uint64_t mnGeneration {0};
+    uint64_t mnLogSize {0};
+    uint64_t mnSnapshotSize {0};
+
+    std::thread mThread {};
+
+    /** Frequency we write pending changes */
+    static constexpr unsigned RUN_FREQUENCY_MILLIS {1000};
+};
+
+/** The mempool log if the mempool is persisted continuously */
+extern std::unique_ptr<CTxMemPoolLog> g_mempoolLog;
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
 
 /** A default ratio for max number of standard transactions per thread. */
 static constexpr uint64_t DEFAULT_MAX_STD_TXNS_PER_THREAD_RATIO = 1000;
@@ -16,3 +17,5 @@ static constexpr std::chrono::milliseconds DEFAULT_MAX_STD_TXN_VALIDATION_DURATI
 /** The maximum wall time for non-standard transaction validation before we terminate the task */
 static constexpr std::chrono::milliseconds DEFAULT_MAX_NON_STD_TXN_VALIDATION_DURATION =
 	std::chrono::seconds{1};
+/** The maximum script cost of a standard transaction before it is moved to the non-standard queue */
+static constexpr uint64_t DEFAULT_MAX_STD_TXN_SCRIPT_COST = 200000;
@@ -7,6 +7,8 @@
 #include "txn_util.h"
 #include <enum_cast.h>
 
+#include <optional>
+
 // Enumerate possible txn's source type
 enum class TxSource : int
 {
@@ -33,6 +35,27 @@ const enumTableT<TxValidationPriority>& enumTable(TxValidationPriority);
 
 class CNode;
 
+/**
+ * Deterministic limit on the script cost of a transaction, see
+ * ScriptProfile::GetCost(), and the script verification progress made within
+ * it. A transaction that runs out of the budget of its validation priority
+ * is parked in the low priority queue and its validation continues from the
+ * inputs that were not verified yet.
+ */
+struct CScriptCostBudget
+{
+    // Cost allowed for the scripts of the transaction (0 = unlimited)
+    uint64_t nLimit {0};
+    // Cost of the scripts verified so far
+    uint64_t nSpent {0};
+    // Script flags each input was successfully verified with
+    std::vector<std::optional<uint32_t>> vVerifiedFlags {};
+
+    bool IsExhausted() const {
+        return nLimit != 0 && nSpent >= nLimit;
+    }
+};
+
 /**
  * This class is used to provide an input data to the TxnValidator.
  * It includes a pointer to a transaction and it's associated data.
@@ -107,6 +130,13 @@ public:
     bool IsTxIdStored() const {
         return mfTxIdStored;
     }
+    // GetScriptCostBudget
+    CScriptCostBudget& GetScriptCostBudget() {
+        if (!mpScriptCostBudget) {
+            mpScriptCostBudget = std::make_shared<CScriptCostBudget>();
+        }
+        return *mpScriptCostBudget;
+    }
 
     /**
      * Setters
@@ -134,6 +164,7 @@ private:
     CTransactionRef mpTx {nullptr};
     std::weak_ptr<CNode> mpNode {};
     TxIdTrackerWPtr mpTxIdTracker {};
+    std::shared_ptr<CScriptCostBudget> mpScriptCostBudget {nullptr};
     Amount mnAbsurdFee {0};
     int64_t mnAcceptTime {0};
     TxSource mTxSource {TxSource::unknown};
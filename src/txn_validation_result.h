@@ -21,4 +21,6 @@ class CTxnValResult {
     std::vector<COutPoint> mCoinsToUncache {};
     std::shared_ptr<CTxMemPoolEntry> mpEntry {nullptr};
     CTxMemPool::setEntries mSetAncestors {};
+    // CPU time used by the validating thread
+    int64_t mnCPUTimeMicros {0};
 };
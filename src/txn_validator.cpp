@@ -6,6 +6,7 @@
 #include "txn_validation_config.h"
 #include "config.h"
 #include "net/net_processing.h"
+#include "utiltime.h"
 
 /** Constructor */
 CTxnValidator::CTxnValidator(
@@ -104,6 +105,14 @@ size_t CTxnValidator::GetTransactionsInQueueCount() const {
     return mStdTxns.size() + mNonStdTxns.size() + mProcessingQueue.size();
 }
 
+CTxnValidator::ValidationStats CTxnValidator::GetStdValidationStats() const {
+    return { mStdValidatedTxns, mStdValidationCPUTime, mStdParkedTxns };
+}
+
+CTxnValidator::ValidationStats CTxnValidator::GetNonStdValidationStats() const {
+    return { mNonStdValidatedTxns, mNonStdValidationCPUTime, 0 };
+}
+
 /** Handle a new transaction */
 void CTxnValidator::newTransaction(TxInputDataSPtr pTxInputData) {
     const TxValidationPriority& txpriority = pTxInputData->GetTxValidationPriority();
@@ -525,6 +534,7 @@ CTxnValResult CTxnValidator::executeTxnValidationNL(
     bool fLimitMempoolSize,
     bool fUseLimits) {
 
+    const int64_t nCPUTimeStart { GetThreadCPUTimeMicros() };
     // Execute txn validation.
     CTxnValResult result =
         TxnValidation(
@@ -535,6 +545,8 @@ CTxnValResult CTxnValidator::executeTxnValidationNL(
             fUseLimits);
     // Process validated results for the given txn
     ProcessValidatedTxn(mMempool, result, handlers, fLimitMempoolSize);
+    result.mnCPUTimeMicros = GetThreadCPUTimeMicros() - nCPUTimeStart;
+    updateValidationStatsNL(result);
     return result;
 }
 
@@ -589,6 +601,9 @@ void CTxnValidator::postValidationStepsNL(
 
     const CTxnValResult& txStatus = result.first;
     const CValidationState& state = txStatus.mState;
+    if (CTask::Status::Canceled != result.second) {
+        updateValidationStatsNL(txStatus);
+    }
     // Check task's status
     if (CTask::Status::Faulted == result.second) {
         imdResult.mInvalidTxns.try_emplace(txStatus.mTxInputData->GetTxnPtr()->GetId(), state);
@@ -613,6 +628,7 @@ void CTxnValidator::postValidationStepsNL(
         TxValidationPriority& txpriority = txStatus.mTxInputData->GetTxValidationPriority();
         if (TxValidationPriority::high == txpriority) {
             txpriority = TxValidationPriority::low;
+            ++mStdParkedTxns;
             imdResult.mDetectedLowPriorityTxns.emplace_back(txStatus.mTxInputData);
         } else {
             imdResult.mInvalidTxns.try_emplace(txStatus.mTxInputData->GetTxnPtr()->GetId(), state);
@@ -622,6 +638,16 @@ void CTxnValidator::postValidationStepsNL(
     }
 }
 
+void CTxnValidator::updateValidationStatsNL(const CTxnValResult& result) {
+    if (TxValidationPriority::low == result.mTxInputData->GetTxValidationPriority()) {
+        ++mNonStdValidatedTxns;
+        mNonStdValidationCPUTime += result.mnCPUTimeMicros;
+    } else {
+        ++mStdValidatedTxns;
+        mStdValidationCPUTime += result.mnCPUTimeMicros;
+    }
+}
+
 void CTxnValidator::postProcessingStepsNL(
     const std::vector<TxInputDataSPtr>& vAcceptedTxns,
     const std::vector<TxId>& vRemovedTxIds,
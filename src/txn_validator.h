@@ -74,6 +74,16 @@ class CTxnValidator final
     // Default maximum memory usage (in MB) for the transaction queues
     static constexpr uint64_t DEFAULT_MAX_MEMORY_TRANSACTION_QUEUES {2048};
 
+    // Transactions validated with standard or non-standard priority
+    struct ValidationStats
+    {
+        uint64_t nTxns {0};
+        uint64_t nCPUTimeMicros {0};
+        // Standard txns moved to the non-standard queue because they ran out
+        // of time or script cost budget
+        uint64_t nParkedTxns {0};
+    };
+
     // Construction/destruction
     CTxnValidator(
         const Config& mConfig,
@@ -135,6 +145,10 @@ class CTxnValidator final
     uint64_t GetStdQueueMemUsage() const { return mStdTxnsMemSize; }
     uint64_t GetNonStdQueueMemUsage() const { return mNonStdTxnsMemSize; }
 
+    /** Get number and CPU time of validated transactions */
+    ValidationStats GetStdValidationStats() const;
+    ValidationStats GetNonStdValidationStats() const;
+
     /**
      * An interface to facilitate Unit Tests.
      */
@@ -163,6 +177,9 @@ class CTxnValidator final
         bool fUseLimits,
         std::chrono::milliseconds maxasynctasksrunduration);
 
+    /** Account the CPU time of a validated txn to its priority */
+    void updateValidationStatsNL(const CTxnValResult& result);
+
     /** Post validation step for txns before limit mempool size is done*/
     void postValidationStepsNL(
         const std::pair<CTxnValResult, CTask::Status>& result,
@@ -254,6 +271,13 @@ class CTxnValidator final
         src.erase(src.begin(), end);
     }
 
+    /** Validation statistics (updated by the validator thread and synchronous calls) */
+    std::atomic<uint64_t> mStdValidatedTxns {0};
+    std::atomic<uint64_t> mStdValidationCPUTime {0};
+    std::atomic<uint64_t> mStdParkedTxns {0};
+    std::atomic<uint64_t> mNonStdValidatedTxns {0};
+    std::atomic<uint64_t> mNonStdValidationCPUTime {0};
+
     /** List of new transactions that need processing */
     std::vector<TxInputDataSPtr> mStdTxns {};
     std::atomic<uint64_t> mStdTxnsMemSize {0};
@@ -11,6 +11,7 @@
 
 #include <atomic>
 
+#include <boost/chrono/thread_clock.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/thread.hpp>
 
@@ -48,6 +49,16 @@ int64_t GetTimeMicros() {
     return now;
 }
 
+int64_t GetThreadCPUTimeMicros() {
+#if defined(BOOST_CHRONO_HAS_THREAD_CLOCK)
+    return boost::chrono::duration_cast<boost::chrono::microseconds>(
+               boost::chrono::thread_clock::now().time_since_epoch())
+        .count();
+#else
+    return GetTimeMicros();
+#endif
+}
+
 int64_t GetSystemTimeInSeconds() {
     return GetTimeMicros() / 1000000;
 }
@@ -22,6 +22,9 @@
 int64_t GetTime();
 int64_t GetTimeMillis();
 int64_t GetTimeMicros();
+// CPU time used by the calling thread, or the system time where it is not
+// available. Only differences between two calls are meaningful.
+int64_t GetThreadCPUTimeMicros();
 // Like GetTime(), but not mockable
 int64_t GetSystemTimeInSeconds();
 int64_t GetLogTimeMicros();
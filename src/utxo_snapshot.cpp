@@ -0,0 +1,339 @@
+// Copyright (c) 2019 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include "utxo_snapshot.h"
+
+#include "clientversion.h"
+#include "coins.h"
+#include "hash.h"
+#include "logging.h"
+#include "streams.h"
+#include "task_helpers.h"
+#include "taskcancellation.h"
+#include "threadpool.h"
+#include "txdb.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <deque>
+#include <future>
+#include <vector>
+
+namespace
+{
+    // Serialize coins of one chunk grouped by txid. Cursor yields coins
+    // sorted by outpoint so outputs of one transaction are adjacent.
+    class CChunkWriter
+    {
+    public:
+        CChunkWriter() : mPayload{SER_DISK, CLIENT_VERSION} {}
+
+        void Add(const COutPoint& outpoint, const Coin& coin)
+        {
+            if(!mOutputs.empty() && mTxId != outpoint.GetTxId())
+            {
+                FlushTx();
+            }
+            mTxId = outpoint.GetTxId();
+            mOutputs.emplace_back(outpoint.GetN(), coin);
+            mPendingSize += coin.GetTxOut().scriptPubKey.size();
+            ++mCoins;
+        }
+
+        uint64_t GetCoinsCount() const { return mCoins; }
+        uint64_t GetSizeEstimate() const { return mPayload.size() + mPendingSize; }
+
+        // Write the chunk to file and reset the writer.
+        void Write(CAutoFile& file)
+        {
+            FlushTx();
+            uint64_t payloadSize = mPayload.size();
+            uint256 checksum = Hash(mPayload.begin(), mPayload.end());
+            file << mCoins;
+            file << payloadSize;
+            file.write(mPayload.data(), mPayload.size());
+            file << checksum;
+
+            mPayload.clear();
+            mCoins = 0;
+        }
+
+    private:
+        void FlushTx()
+        {
+            if(mOutputs.empty())
+            {
+                return;
+            }
+            mPayload << mTxId;
+            mPayload << VARINT(static_cast<uint64_t>(mOutputs.size()));
+            for(const auto& output : mOutputs)
+            {
+                mPayload << VARINT(output.first);
+                mPayload << output.second;
+            }
+            mOutputs.clear();
+            mPendingSize = 0;
+        }
+
+        CDataStream mPayload;
+        TxId mTxId {};
+        std::vector<std::pair<uint32_t, Coin>> mOutputs {};
+        uint64_t mPendingSize {0};
+        uint64_t mCoins {0};
+    };
+
+    struct CSnapshotChunk
+    {
+        uint64_t nCoins {0};
+        CDataStream payload {SER_DISK, CLIENT_VERSION};
+        uint256 checksum {};
+    };
+
+    // Verify, decode and write one chunk. Runs on a thread pool worker.
+    uint64_t ProcessChunk(CCoinsViewDB& view, CSnapshotChunk& chunk)
+    {
+        if(Hash(chunk.payload.begin(), chunk.payload.end()) != chunk.checksum)
+        {
+            throw std::runtime_error("Snapshot chunk checksum mismatch");
+        }
+
+        CDataStream& stream { chunk.payload };
+        std::vector<std::pair<COutPoint, Coin>> coins {};
+        coins.reserve(chunk.nCoins);
+        while(!stream.empty())
+        {
+            TxId txid;
+            uint64_t nOutputs {0};
+            stream >> txid;
+            stream >> VARINT(nOutputs);
+            for(uint64_t i = 0; i < nOutputs; ++i)
+            {
+                uint32_t n {0};
+                Coin coin {};
+                stream >> VARINT(n);
+                stream >> coin;
+                coins.emplace_back(COutPoint{txid, n}, std::move(coin));
+            }
+        }
+
+        if(coins.size() != chunk.nCoins)
+        {
+            throw std::runtime_error("Snapshot chunk coin count mismatch");
+        }
+        if(!view.BulkWrite(coins))
+        {
+            throw std::runtime_error("Failed to write snapshot coins to database");
+        }
+        return coins.size();
+    }
+
+    uint64_t GetFileSize(FILE* file)
+    {
+        long current = ftell(file);
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, current, SEEK_SET);
+        return size < 0 ? 0 : static_cast<uint64_t>(size);
+    }
+}
+
+void DumpUTXOSnapshot(
+    CCoinsViewCursor& cursor,
+    CUTXOSnapshotMetadata& metadata,
+    const fs::path& path,
+    const task::CCancellationToken& cancellationToken)
+{
+    int64_t nStart = GetTimeMillis();
+    fs::path pathTmp = path;
+    pathTmp += ".incomplete";
+
+    CAutoFile file{fsbridge::fopen(pathTmp, "wb"), SER_DISK, CLIENT_VERSION};
+    if(file.IsNull())
+    {
+        throw std::runtime_error("Unable to open snapshot file " + pathTmp.string() + " for writing");
+    }
+
+    metadata.nCoins = 0;
+    metadata.nChunks = 0;
+    // Placeholder, rewritten with final counts once all chunks are written
+    file << metadata;
+
+    CChunkWriter chunk {};
+    auto writeChunk = [&]()
+    {
+        metadata.nCoins += chunk.GetCoinsCount();
+        ++metadata.nChunks;
+        chunk.Write(file);
+    };
+
+    while(cursor.Valid())
+    {
+        if(cancellationToken.IsCanceled())
+        {
+            file.fclose();
+            fs::remove(pathTmp);
+            throw std::runtime_error("UTXO snapshot dump canceled");
+        }
+
+        COutPoint key;
+        Coin coin;
+        if(!cursor.GetKey(key) || !cursor.GetValue(coin))
+        {
+            throw std::runtime_error("Unable to read UTXO set");
+        }
+        chunk.Add(key, coin);
+
+        if(chunk.GetCoinsCount() >= UTXO_SNAPSHOT_CHUNK_MAX_COINS ||
+           chunk.GetSizeEstimate() >= UTXO_SNAPSHOT_CHUNK_MAX_SIZE)
+        {
+            writeChunk();
+        }
+        cursor.Next();
+    }
+    if(chunk.GetCoinsCount() > 0)
+    {
+        writeChunk();
+    }
+
+    if(fseek(file.Get(), 0, SEEK_SET) != 0)
+    {
+        throw std::runtime_error("Unable to rewind snapshot file");
+    }
+    file << metadata;
+    FileCommit(file.Get());
+    file.fclose();
+
+    if(!RenameOver(pathTmp, path))
+    {
+        throw std::runtime_error("Unable to rename " + pathTmp.string() + " to " + path.string());
+    }
+
+    LogPrintf("Dumped UTXO snapshot at height %d: %u coins in %u chunks, %dms\n",
+        metadata.nBaseHeight, metadata.nCoins, metadata.nChunks, GetTimeMillis() - nStart);
+}
+
+CUTXOSnapshotMetadata ReadUTXOSnapshotMetadata(const fs::path& path)
+{
+    CAutoFile file{fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION};
+    if(file.IsNull())
+    {
+        throw std::runtime_error("Unable to open snapshot file " + path.string());
+    }
+
+    CUTXOSnapshotMetadata metadata {};
+    file >> metadata;
+    if(metadata.nMagic != UTXO_SNAPSHOT_MAGIC)
+    {
+        throw std::runtime_error("Not a UTXO snapshot file");
+    }
+    if(metadata.nVersion != UTXO_SNAPSHOT_VERSION)
+    {
+        throw std::runtime_error(strprintf("Unsupported UTXO snapshot version %d", metadata.nVersion));
+    }
+    return metadata;
+}
+
+void LoadUTXOSnapshot(
+    CCoinsViewDB& view,
+    const fs::path& path,
+    const CUTXOSnapshotMetadata& metadata,
+    size_t nThreads,
+    const task::CCancellationToken& cancellationToken)
+{
+    int64_t nStart = GetTimeMillis();
+
+    CAutoFile file{fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION};
+    if(file.IsNull())
+    {
+        throw std::runtime_error("Unable to open snapshot file " + path.string());
+    }
+    uint64_t nFileSize = GetFileSize(file.Get());
+
+    CUTXOSnapshotMetadata header {};
+    file >> header;
+    if(header.hashBaseBlock != metadata.hashBaseBlock)
+    {
+        throw std::runtime_error("Snapshot file changed while loading");
+    }
+
+    if(!view.BeginBulkLoad(metadata.hashBaseBlock))
+    {
+        throw std::runtime_error("Unable to prepare coins database for snapshot load");
+    }
+
+    nThreads = std::max<size_t>(nThreads, 1);
+    CThreadPool<CQueueAdaptor> pool { "UTXOSnapshotLoad", nThreads };
+
+    // Bound the number of chunks held in memory while keeping every worker busy
+    const size_t maxInFlight { nThreads * 2 };
+    std::deque<std::future<uint64_t>> results {};
+    uint64_t nLoaded {0};
+    auto waitOldest = [&]()
+    {
+        std::future<uint64_t> result { std::move(results.front()) };
+        results.pop_front();
+        nLoaded += result.get();
+    };
+
+    try
+    {
+        for(uint64_t i = 0; i < metadata.nChunks; ++i)
+        {
+            if(cancellationToken.IsCanceled())
+            {
+                throw std::runtime_error("UTXO snapshot load canceled");
+            }
+
+            auto chunk { std::make_shared<CSnapshotChunk>() };
+            uint64_t payloadSize {0};
+            file >> chunk->nCoins;
+            file >> payloadSize;
+            if(payloadSize > nFileSize)
+            {
+                throw std::runtime_error("Snapshot chunk size exceeds file size");
+            }
+            chunk->payload.resize(payloadSize);
+            file.read(chunk->payload.data(), payloadSize);
+            file >> chunk->checksum;
+
+            while(results.size() >= maxInFlight)
+            {
+                waitOldest();
+            }
+            results.emplace_back(make_task(pool,
+                [&view, chunk](){ return ProcessChunk(view, *chunk); }));
+
+            if(i % 100 == 0)
+            {
+                LogPrint(BCLog::COINDB, "Loading UTXO snapshot: chunk %u of %u\n", i, metadata.nChunks);
+            }
+        }
+        while(!results.empty())
+        {
+            waitOldest();
+        }
+    }
+    catch(...)
+    {
+        // Let outstanding workers finish before unwinding the view reference
+        for(auto& result : results)
+        {
+            result.wait();
+        }
+        throw;
+    }
+
+    if(nLoaded != metadata.nCoins)
+    {
+        throw std::runtime_error(strprintf("Snapshot contains %u coins, expected %u", nLoaded, metadata.nCoins));
+    }
+
+    if(!view.EndBulkLoad(metadata.hashBaseBlock))
+    {
+        throw std::runtime_error("Unable to finalize coins database after snapshot load");
+    }
+
+    LogPrintf("Loaded UTXO snapshot at height %d: %u coins in %u chunks, %dms\n",
+        metadata.nBaseHeight, nLoaded, metadata.nChunks, GetTimeMillis() - nStart);
+}
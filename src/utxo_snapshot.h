@@ -0,0 +1,115 @@
+// Copyright (c) 2019 Bitcoin Association
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef BITCOIN_UTXO_SNAPSHOT_H
+#define BITCOIN_UTXO_SNAPSHOT_H
+
+#include "consensus/consensus.h"
+#include "fs.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <cstdint>
+
+class CCoinsViewCursor;
+class CCoinsViewDB;
+
+namespace task
+{
+    class CCancellationToken;
+}
+
+//! Magic bytes identifying a UTXO snapshot file ("utxo").
+static const uint32_t UTXO_SNAPSHOT_MAGIC = 0x6f787475;
+//! Current UTXO snapshot file format version.
+static const uint32_t UTXO_SNAPSHOT_VERSION = 1;
+//! Maximum number of coins stored in one snapshot chunk.
+static const uint64_t UTXO_SNAPSHOT_CHUNK_MAX_COINS = 100000;
+//! A chunk is closed as soon as its payload exceeds this size (bytes).
+static const uint64_t UTXO_SNAPSHOT_CHUNK_MAX_SIZE = 64 * ONE_MEBIBYTE;
+//! Default number of threads used for decoding snapshot chunks.
+static const int DEFAULT_UTXO_SNAPSHOT_LOAD_THREADS = 4;
+
+/**
+ * Header of a UTXO snapshot file.
+ *
+ * Snapshot file layout:
+ * - CUTXOSnapshotMetadata (fixed size, rewritten once all coins are written)
+ * - nChunks chunks, each consisting of:
+ *   - uint64_t number of coins in the chunk
+ *   - uint64_t payload size in bytes
+ *   - payload: coins grouped by txid; for every txid the txid itself,
+ *     VARINT(number of outputs) and then VARINT(n) + Coin for each output
+ *   - uint256 double SHA256 of the payload
+ *
+ * Chunks are independent of each other so they can be verified and decoded
+ * in parallel.
+ */
+class CUTXOSnapshotMetadata
+{
+public:
+    uint32_t nMagic { UTXO_SNAPSHOT_MAGIC };
+    uint32_t nVersion { UTXO_SNAPSHOT_VERSION };
+    //! Block at which the UTXO set was taken
+    uint256 hashBaseBlock {};
+    int32_t nBaseHeight { 0 };
+    //! nChainTx of the base block, needed to link later blocks to it
+    uint64_t nBaseChainTx { 0 };
+    uint64_t nCoins { 0 };
+    uint64_t nChunks { 0 };
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(nMagic);
+        READWRITE(nVersion);
+        READWRITE(hashBaseBlock);
+        READWRITE(nBaseHeight);
+        READWRITE(nBaseChainTx);
+        READWRITE(nCoins);
+        READWRITE(nChunks);
+    }
+};
+
+/**
+ * Stream all coins visible through the cursor into a snapshot file at path.
+ * Caller provides the base block information in metadata; coin and chunk
+ * counts are filled in. File is written to a temporary location and renamed
+ * once complete.
+ *
+ * Throws std::runtime_error on failure or cancellation.
+ */
+void DumpUTXOSnapshot(
+    CCoinsViewCursor& cursor,
+    CUTXOSnapshotMetadata& metadata,
+    const fs::path& path,
+    const task::CCancellationToken& cancellationToken);
+
+/**
+ * Read and sanity check the header of a snapshot file.
+ *
+ * Throws std::runtime_error if the file can't be read or is not a supported
+ * snapshot.
+ */
+CUTXOSnapshotMetadata ReadUTXOSnapshotMetadata(const fs::path& path);
+
+/**
+ * Bulk load coins from a snapshot file into the coins database.
+ *
+ * Chunks are read sequentially from disk and handed to a pool of nThreads
+ * workers which verify the checksum, decode the coins and write them to
+ * the database in independent batches. Database is marked as being in
+ * transition to the snapshot base block for the duration of the load so an
+ * interrupted load is detected at the next startup.
+ *
+ * Throws std::runtime_error on failure or cancellation.
+ */
+void LoadUTXOSnapshot(
+    CCoinsViewDB& view,
+    const fs::path& path,
+    const CUTXOSnapshotMetadata& metadata,
+    size_t nThreads,
+    const task::CCancellationToken& cancellationToken);
+
+#endif // BITCOIN_UTXO_SNAPSHOT_H
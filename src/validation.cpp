@@ -30,13 +30,17 @@
 #include "primitives/transaction.h"
 #include "random.h"
 #include "script/scriptcache.h"
+#include "script/scriptprofile.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
+#include "task_helpers.h"
 #include "taskcancellation.h"
+#include "threadpool.h"
 #include "timedata.h"
 #include "tinyformat.h"
 #include "txdb.h"
 #include "txmempool.h"
+#include "txmempool_log.h"
 #include "txn_validator.h"
 #include "ui_interface.h"
 #include "undo.h"
@@ -48,8 +52,11 @@
 #include "warnings.h"
 #include "blockfileinfostore.h"
 
+#include <algorithm>
 #include <atomic>
+#include <deque>
 #include <sstream>
+#include <unordered_set>
 
 #include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/replace.hpp>
@@ -198,6 +205,12 @@ std::set<CBlockIndex *, CBlockIndexWorkComparator> setBlockIndexCandidates;
  */
 std::multimap<CBlockIndex *, CBlockIndex *> mapBlocksUnlinked;
 
+/**
+ * Block whose UTXO set was loaded from a snapshot. Its ancestors have no data
+ * and were never validated by this node.
+ */
+CBlockIndex *pindexSnapshotBase = nullptr;
+
 
 
 
@@ -246,6 +259,7 @@ CBlockIndex *FindForkInGlobalIndex(const CChain &chain,
 
 CCoinsViewCache *pcoinsTip = nullptr;
 CBlockTreeDB *pblocktree = nullptr;
+CCoinsViewDB *pcoinsdbview = nullptr;
 
 static uint32_t GetBlockScriptFlags(const Config &config,
                                     const CBlockIndex *pChainTip);
@@ -1426,6 +1440,17 @@ CTxnValResult TxnValidation(
     uint32_t scriptVerifyFlags = GetScriptVerifyFlags(config, IsGenesisEnabled(config, chainActive.Height() + 1));
     // Check against previous transactions. This is done last to help
     // prevent CPU exhaustion denial-of-service attacks.
+    // High priority txns that run out of the script cost budget are moved to
+    // the low priority queue, where the validation continues without a budget
+    // from the inputs that were not verified yet.
+    CScriptCostBudget* budget {nullptr};
+    if (fUseLimits)
+    {
+        budget = &pTxInputData->GetScriptCostBudget();
+        budget->nLimit =
+            TxValidationPriority::high == pTxInputData->GetTxValidationPriority()
+                ? config.GetMaxStdTxnScriptCost() : 0;
+    }
     PrecomputedTransactionData txdata(tx);
     auto res =
         CheckInputs(
@@ -1439,7 +1464,9 @@ CTxnValResult TxnValidation(
             scriptVerifyFlags,
             true,      /* sigCacheStore */
             false,     /* scriptCacheStore */
-            txdata);
+            txdata,
+            nullptr,   /* pvChecks */
+            budget);
 
     if (!res.has_value())
     {
@@ -1447,7 +1474,9 @@ CTxnValResult TxnValidation(
         state.DoS(0, false, REJECT_NONSTANDARD,
                  "too-long-validation-time",
                   false,
-                  errString);
+                  budget && budget->IsExhausted()
+                      ? strprintf("script cost %d exceeds %d", budget->nSpent, budget->nLimit)
+                      : errString);
         return Result{state, pTxInputData, vCoinsToUncache};
     }
     else if (!res.value())
@@ -1619,6 +1648,7 @@ std::vector<std::pair<CTxnValResult, CTask::Status>> TxnValidationProcessingTask
         }
         CTxnValResult result {};
         try {
+            const int64_t nCPUTimeStart = GetThreadCPUTimeMicros();
             // Execute validation for the given txn
             result =
                 TxnValidation(
@@ -1629,6 +1659,7 @@ std::vector<std::pair<CTxnValResult, CTask::Status>> TxnValidationProcessingTask
                         fUseLimits);
             // Process validated results
             ProcessValidatedTxn(pool, result, handlers, false);
+            result.mnCPUTimeMicros = GetThreadCPUTimeMicros() - nCPUTimeStart;
             // Forward results to the next processing stage
             results.emplace_back(std::move(result), CTask::Status::RanToCompletion);
         } catch (const std::exception& e) {
@@ -2951,9 +2982,94 @@ void UpdateCoins(const CTransaction &tx, CCoinsViewCache &inputs, int nHeight) {
     UpdateCoins(tx, inputs, txundo, nHeight);
 }
 
+static std::optional<bool> VerifyScriptProfiled(
+    const Config& config,
+    bool consensus,
+    const task::CCancellationToken& token,
+    const CScript& scriptSig,
+    const CScript& scriptPubKey,
+    uint32_t flags,
+    const BaseSignatureChecker& checker,
+    CInputScriptProfile& input)
+{
+    const int64_t nTimeStart = GetTimeMicros();
+    auto res =
+        VerifyScript(
+            config,
+            consensus,
+            token,
+            scriptSig,
+            scriptPubKey,
+            flags,
+            checker,
+            &input.error,
+            &input.profile);
+    input.nTimeMicros = GetTimeMicros() - nTimeStart;
+    input.fVerified = res.has_value();
+    input.fValid = res.value_or(false);
+    return res;
+}
+
 std::optional<bool> CScriptCheck::operator()(const task::CCancellationToken& token)
+{
+    return Verify(token, CachingTransactionSignatureChecker{
+                             ptxTo, nIn, amount, cacheStore, txdata});
+}
+
+std::optional<bool> CScriptCheck::operator()(const task::CCancellationToken& token,
+                                             CSignatureBatch& batch)
+{
+    if (profileCollector)
+    {
+        return (*this)(token);
+    }
+    return Verify(token, BatchingTransactionSignatureChecker{
+                             ptxTo, nIn, amount, cacheStore, txdata, batch});
+}
+
+std::optional<bool> CScriptCheck::Verify(const task::CCancellationToken& token,
+                                         const BaseSignatureChecker& checker)
 {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
+
+    if (profileCollector)
+    {
+        CInputScriptProfile input;
+        input.profile.nCostLimit = GetCostLimit();
+        auto res = VerifyScriptProfiled(
+            config, consensus, token, scriptSig, scriptPubKey, nFlags, checker, input);
+        ChargeCost(input.profile);
+        error = input.error;
+        profileCollector->Add(nIn, input);
+        return res;
+    }
+
+    // Most inputs spend standard outputs which don't need the interpreter.
+    // Their cost is bounded by the sigops limit and is not charged to the
+    // budget.
+    if (auto res = VerifyStandardScript(
+            config, consensus, scriptSig, scriptPubKey, nFlags, checker, &error))
+    {
+        return res;
+    }
+    if (costBudget)
+    {
+        ScriptProfile profile;
+        profile.nCostLimit = GetCostLimit();
+        auto res =
+            VerifyScript(
+                config,
+                consensus,
+                token,
+                scriptSig,
+                scriptPubKey,
+                nFlags,
+                checker,
+                &error,
+                &profile);
+        ChargeCost(profile);
+        return res;
+    }
     return
         VerifyScript(
             config,
@@ -2962,11 +3078,28 @@ std::optional<bool> CScriptCheck::operator()(const task::CCancellationToken& tok
             scriptSig,
             scriptPubKey,
             nFlags,
-            CachingTransactionSignatureChecker(
-                ptxTo, nIn, amount, cacheStore, txdata),
+            checker,
             &error);
 }
 
+uint64_t CScriptCheck::GetCostLimit() const
+{
+    if (!costBudget || costBudget->nLimit == 0)
+    {
+        return 0;
+    }
+    // CheckInputs doesn't start a check once the budget is exhausted
+    return costBudget->nLimit - costBudget->nSpent;
+}
+
+void CScriptCheck::ChargeCost(const ScriptProfile& profile)
+{
+    if (costBudget)
+    {
+        costBudget->nSpent += profile.GetCost();
+    }
+}
+
 std::pair<int,int> GetSpendHeightAndMTP(const CCoinsViewCache &inputs) {
     CBlockIndex *pindexPrev = mapBlockIndex.find(inputs.GetBestBlock())->second;
     return { pindexPrev->nHeight + 1, pindexPrev->GetMedianTimePast() };
@@ -3049,7 +3182,8 @@ std::optional<bool> CheckInputs(
     bool sigCacheStore,
     bool scriptCacheStore,
     const PrecomputedTransactionData& txdata,
-    std::vector<CScriptCheck>* pvChecks)
+    std::vector<CScriptCheck>* pvChecks,
+    CScriptCostBudget* budget)
 {
     assert(!tx.IsCoinBase());
 
@@ -3089,6 +3223,25 @@ std::optional<bool> CheckInputs(
         return true;
     }
 
+    // Shared by the script checks of the transaction which might run on
+    // different threads
+    std::shared_ptr<CTxScriptProfileCollector> profileCollector;
+    if (GetSlowScriptLog().IsEnabled())
+    {
+        profileCollector =
+            std::make_shared<CTxScriptProfileCollector>(tx.GetId(), tx.vin.size());
+    }
+
+    // Checks pushed onto pvChecks run in parallel and are not budgeted
+    if (pvChecks)
+    {
+        budget = nullptr;
+    }
+    else if (budget)
+    {
+        budget->vVerifiedFlags.resize(tx.vin.size());
+    }
+
     for (size_t i = 0; i < tx.vin.size(); i++) 
     {
         const COutPoint &prevout = tx.vin[i].prevout;
@@ -3114,8 +3267,20 @@ std::optional<bool> CheckInputs(
         // ScriptExecutionCache does NOT contain per-input flags. That's why we clear the
         // cache when we are about to cross genesis activation line (see function FinalizeGenesisCrossing).
         // Verify signature
-        CScriptCheck check(config, consensus, scriptPubKey, amount, tx, i, flags | perInputScriptFlags, sigCacheStore,
+        const uint32_t inputFlags = flags | perInputScriptFlags;
+        if (budget && budget->vVerifiedFlags[i] == inputFlags)
+        {
+            // Verified before the budget ran out in an earlier call
+            continue;
+        }
+        if (budget && budget->IsExhausted())
+        {
+            return {};
+        }
+        CScriptCheck check(config, consensus, scriptPubKey, amount, tx, i, inputFlags, sigCacheStore,
                            txdata);
+        check.SetProfileCollector(profileCollector);
+        check.SetCostBudget(budget);
         if (pvChecks) 
         {
             pvChecks->push_back(std::move(check));
@@ -3195,6 +3360,10 @@ std::optional<bool> CheckInputs(
                 strprintf("mandatory-script-verify-flag-failed (%s)",
                           ScriptErrorString(check.GetScriptError())));
         }
+        else if (budget)
+        {
+            budget->vVerifiedFlags[i] = inputFlags;
+        }
     }
 
     if (scriptCacheStore && !pvChecks) 
@@ -3211,7 +3380,8 @@ namespace {
 
 bool UndoWriteToDisk(const CBlockUndo &blockundo, CDiskBlockPos &pos,
                      const uint256 &hashBlock,
-                     const CMessageHeader::MessageMagic &messageStart) {
+                     const CMessageHeader::MessageMagic &messageStart,
+                     bool fCommit = false) {
     // Open history file to append
     CAutoFile fileout(CDiskFiles::OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull()) {
@@ -3235,11 +3405,129 @@ bool UndoWriteToDisk(const CBlockUndo &blockundo, CDiskBlockPos &pos,
     hasher << blockundo;
     fileout << hasher.GetHash();
 
+    if (fCommit) {
+        FileCommit(fileout.Get());
+    }
+
     return true;
 }
 
+/**
+ * Writes undo data of connected blocks to disk on a background thread so
+ * that connecting the next block doesn't wait for serialization and I/O.
+ * Space for the data is reserved and its position recorded in the block index
+ * before it is queued, so Sync() must be called before the data is read back
+ * and before the block index or the coins that depend on it are flushed.
+ * Written data is committed to disk by the writer thread.
+ */
+class CBlockUndoWriter
+{
+public:
+    CBlockUndoWriter(uint64_t maxQueuedBytes)
+        : mMaxQueuedBytes{maxQueuedBytes}
+    {}
+
+    ~CBlockUndoWriter()
+    {
+        Sync();
+    }
+
+    CBlockUndoWriter(const CBlockUndoWriter&) = delete;
+    CBlockUndoWriter& operator=(const CBlockUndoWriter&) = delete;
+
+    /**
+     * Queue undo data of size nSize (as serialized) for writing at pos, the
+     * position of its index header. Waits for earlier writes while more than
+     * the maximum amount of data is queued.
+     * Returns false if an earlier write failed.
+     */
+    bool Write(
+        CBlockUndo&& blockundo,
+        uint64_t nSize,
+        const CDiskBlockPos& pos,
+        const uint256& hashBlock,
+        const CMessageHeader::MessageMagic& messageStart)
+    {
+        std::lock_guard lock{mMutex};
+        while(!mPending.empty() && mQueuedBytes + nSize > mMaxQueuedBytes)
+        {
+            WaitOldest();
+        }
+
+        auto data = std::make_shared<const CBlockUndo>(std::move(blockundo));
+        mPending.emplace_back(
+            nSize,
+            make_task(
+                mPool,
+                [data, pos, hashBlock, messageStart]
+                {
+                    int64_t nTimeStart = GetTimeMicros();
+                    CDiskBlockPos writePos{pos};
+                    bool written = false;
+                    try
+                    {
+                        written =
+                            UndoWriteToDisk(
+                                *data, writePos, hashBlock, messageStart, true);
+                    }
+                    catch(const std::exception& e)
+                    {
+                        error("%s: %s", __func__, e.what());
+                    }
+                    LogPrint(BCLog::BENCH, "    - Undo data of %s written: %.2fms\n",
+                             hashBlock.ToString(),
+                             0.001 * (GetTimeMicros() - nTimeStart));
+                    return written;
+                }));
+        mQueuedBytes += nSize;
+
+        return !mFailed;
+    }
+
+    /**
+     * Wait until all queued undo data is on disk.
+     * Returns false if any write failed.
+     */
+    bool Sync()
+    {
+        std::lock_guard lock{mMutex};
+        while(!mPending.empty())
+        {
+            WaitOldest();
+        }
+
+        return !mFailed;
+    }
+
+private:
+    void WaitOldest()
+    {
+        auto& [nSize, written] = mPending.front();
+        if(!written.get())
+        {
+            mFailed = true;
+        }
+        mQueuedBytes -= nSize;
+        mPending.pop_front();
+    }
+
+    std::mutex mMutex{};
+    const uint64_t mMaxQueuedBytes;
+    uint64_t mQueuedBytes{0};
+    std::deque<std::pair<uint64_t, std::future<bool>>> mPending{};
+    bool mFailed{false};
+    CThreadPool<CQueueAdaptor> mPool{"UndoWriter", 1};
+};
+
+std::unique_ptr<CBlockUndoWriter> blockUndoWriter;
+
 bool UndoReadFromDisk(CBlockUndo &blockundo, const CDiskBlockPos &pos,
                       const uint256 &hashBlock) {
+    // The data may still be queued for writing
+    if (blockUndoWriter && !blockUndoWriter->Sync()) {
+        return error("%s: Writing undo data failed", __func__);
+    }
+
     // Open history file to read
     CAutoFile filein(CDiskFiles::OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull()) {
@@ -3288,6 +3576,111 @@ bool AbortNode(CValidationState &state, const std::string &strMessage,
 
 } // namespace
 
+std::optional<CTxScriptProfile> ProfileTransactionScripts(
+    const Config& config,
+    const TxId& txid,
+    const task::CCancellationToken& token)
+{
+    CTransactionRef tx;
+    std::vector<Coin> coins;
+    std::vector<uint32_t> inputFlags;
+    bool consensus = false;
+    {
+        LOCK(cs_main);
+
+        uint256 hashBlock;
+        bool isGenesisEnabled;
+        if (!GetTransaction(config, txid, tx, true, hashBlock, isGenesisEnabled) ||
+            tx->IsCoinBase())
+        {
+            return std::nullopt;
+        }
+
+        uint32_t flags;
+        if (hashBlock.IsNull())
+        {
+            // Spent outputs of a mempool transaction are in the UTXO set or
+            // in the mempool
+            std::shared_lock lock(mempool.smtx);
+            CCoinsViewMemPool viewMempool(pcoinsTip, mempool);
+            for (const CTxIn& txin : tx->vin)
+            {
+                Coin coin;
+                if (!viewMempool.GetCoin(txin.prevout, coin))
+                {
+                    return std::nullopt;
+                }
+                coins.push_back(std::move(coin));
+            }
+            flags = GetScriptVerifyFlags(
+                config, IsGenesisEnabled(config, chainActive.Height() + 1));
+        }
+        else
+        {
+            // Spent outputs of a confirmed transaction are in the undo data
+            // of its block
+            const auto it = mapBlockIndex.find(hashBlock);
+            if (it == mapBlockIndex.end() || !chainActive.Contains(it->second) ||
+                it->second->GetUndoPos().IsNull())
+            {
+                return std::nullopt;
+            }
+            const CBlockIndex* pindex = it->second;
+
+            CBlock block;
+            CBlockUndo blockUndo;
+            if (!ReadBlockFromDisk(block, pindex, config) ||
+                !UndoReadFromDisk(blockUndo, pindex->GetUndoPos(),
+                                  pindex->pprev->GetBlockHash()))
+            {
+                return std::nullopt;
+            }
+            const auto txit = std::find_if(block.vtx.begin(), block.vtx.end(),
+                [&txid](const CTransactionRef& ptx) { return ptx->GetId() == txid; });
+            const size_t nTx = std::distance(block.vtx.begin(), txit);
+            if (txit == block.vtx.end() || nTx > blockUndo.vtxundo.size())
+            {
+                return std::nullopt;
+            }
+            coins = blockUndo.vtxundo[nTx - 1].vprevout;
+            consensus = true;
+            flags = GetBlockScriptFlags(config, pindex->pprev);
+        }
+
+        for (const Coin& coin : coins)
+        {
+            const bool utxoAfterGenesis = IsGenesisEnabled(
+                config, GetInputScriptBlockHeight(coin.GetHeight()));
+            inputFlags.push_back(
+                flags | (utxoAfterGenesis ? SCRIPT_UTXO_AFTER_GENESIS : 0));
+        }
+    }
+
+    if (coins.size() != tx->vin.size())
+    {
+        return std::nullopt;
+    }
+
+    CTxScriptProfile profile;
+    profile.txid = txid;
+    profile.inputs.resize(tx->vin.size());
+    const PrecomputedTransactionData txdata(*tx);
+    for (size_t i = 0; i < tx->vin.size(); ++i)
+    {
+        const CTxOut& txout = coins[i].GetTxOut();
+        const TransactionSignatureChecker checker(tx.get(), i, txout.nValue, txdata);
+        const auto res = VerifyScriptProfiled(
+            config, consensus, token, tx->vin[i].scriptSig,
+            txout.scriptPubKey, inputFlags[i], checker, profile.inputs[i]);
+        if (!res.has_value())
+        {
+            // Canceled
+            break;
+        }
+    }
+    return profile;
+}
+
 /** Restore the UTXO in a Coin at a given COutPoint. */
 DisconnectResult UndoCoinSpend(const Coin &undo, CCoinsViewCache &view,
                                const COutPoint &out, const Config &config) {
@@ -3418,6 +3811,7 @@ DisconnectResult ApplyBlockUndo(const CBlockUndo &blockUndo,
 }
 
 static std::unique_ptr<checkqueue::CCheckQueuePool<CScriptCheck, arith_uint256>> scriptCheckQueuePool;
+static std::unique_ptr<CThreadPool<CQueueAdaptor>> coinsPrefetchPool;
 
 void InitScriptCheckQueues(const Config& config, boost::thread_group& threadGroup)
 {
@@ -3427,11 +3821,278 @@ void InitScriptCheckQueues(const Config& config, boost::thread_group& threadGrou
             threadGroup,
             config.GetPerBlockScriptValidatorThreadsCount(),
             config.GetPerBlockScriptValidationMaxBatchSize());
+
+    if(config.GetCoinsPrefetchThreadsCount() > 0)
+    {
+        coinsPrefetchPool =
+            std::make_unique<CThreadPool<CQueueAdaptor>>(
+                "CoinsPrefetchPool",
+                config.GetCoinsPrefetchThreadsCount());
+    }
+
+    if(config.GetMaxUndoWriteQueueSize() > 0)
+    {
+        blockUndoWriter =
+            std::make_unique<CBlockUndoWriter>(config.GetMaxUndoWriteQueueSize());
+    }
 }
 
 void ShutdownScriptCheckQueues()
 {
     scriptCheckQueuePool.reset();
+    coinsPrefetchPool.reset();
+    // Waits for queued undo data to be written
+    blockUndoWriter.reset();
+}
+
+std::vector<std::future<void>> PrefetchBlockInputs(
+    const CBlock& block,
+    CCoinsViewCache& cache,
+    CThreadPool<CQueueAdaptor>& pool)
+{
+    // Outputs created by the block are not in the database yet
+    std::unordered_set<TxId, SaltedTxidHasher> blockTxIds {};
+    blockTxIds.reserve(block.vtx.size());
+    for(const auto& tx : block.vtx)
+    {
+        blockTxIds.insert(tx->GetId());
+    }
+
+    auto outpoints = std::make_shared<std::vector<COutPoint>>();
+    for(const auto& tx : block.vtx)
+    {
+        if(tx->IsCoinBase())
+        {
+            continue;
+        }
+        for(const CTxIn& txin : tx->vin)
+        {
+            if(blockTxIds.find(txin.prevout.GetTxId()) == blockTxIds.end())
+            {
+                outpoints->push_back(txin.prevout);
+            }
+        }
+    }
+
+    // Split lookups evenly between pool threads but don't bother other
+    // threads with tiny batches
+    constexpr size_t minBatchSize = 64;
+    size_t batchSize =
+        std::max(minBatchSize, (outpoints->size() + pool.getPoolSize() - 1) / pool.getPoolSize());
+
+    std::vector<std::future<void>> tasks {};
+    for(size_t begin = 0; begin < outpoints->size(); begin += batchSize)
+    {
+        size_t end = std::min(begin + batchSize, outpoints->size());
+        tasks.emplace_back(
+            make_task(
+                pool,
+                [&cache, outpoints, begin, end]
+                {
+                    cache.Prefetch({outpoints->begin() + begin, outpoints->begin() + end});
+                }));
+    }
+
+    return tasks;
+}
+
+namespace
+{
+    /**
+     * Prefetches inputs of a block into pcoinsTip and waits for the
+     * prefetching to finish when going out of scope. Prefetching is an
+     * optimisation only so any errors are logged and otherwise ignored; the
+     * same lookups are repeated while connecting the block.
+     */
+    class CBlockInputsPrefetchGuard
+    {
+    public:
+        CBlockInputsPrefetchGuard(const CBlock& block)
+        {
+            if(coinsPrefetchPool && pcoinsTip)
+            {
+                mTasks = PrefetchBlockInputs(block, *pcoinsTip, *coinsPrefetchPool);
+            }
+        }
+
+        ~CBlockInputsPrefetchGuard()
+        {
+            Wait();
+        }
+
+        CBlockInputsPrefetchGuard(const CBlockInputsPrefetchGuard&) = delete;
+        CBlockInputsPrefetchGuard& operator=(const CBlockInputsPrefetchGuard&) = delete;
+
+        void Wait()
+        {
+            for(auto& task : mTasks)
+            {
+                try
+                {
+                    task.get();
+                }
+                catch(const std::exception& e)
+                {
+                    LogPrintf("Prefetching block inputs failed: %s\n", e.what());
+                }
+            }
+            mTasks.clear();
+        }
+
+    private:
+        std::vector<std::future<void>> mTasks {};
+    };
+
+    /**
+     * Results of the checks that ConnectBlock makes for a transaction which
+     * only spends coins that existed before the block, so they don't depend
+     * on the other transactions of the block.
+     */
+    struct CBlockTxPrecheck
+    {
+        bool fChecked {false};
+        bool fSequenceLocks {false};
+        bool fSigOpCountError {false};
+        uint64_t nSigOpsCount {0};
+        Amount nFee {0};
+        bool fInputsValid {false};
+        CValidationState state {};
+        std::vector<CScriptCheck> vChecks {};
+    };
+
+    /**
+     * Checks sequence locks, sigops, amounts and creates script checks for
+     * transactions of the block that don't spend outputs of the block on the
+     * coins prefetch threads. Results are indexed by transaction position;
+     * transactions that were not checked (coinbase, spending outputs of the
+     * block or with missing inputs) are left to ConnectBlock which checks them
+     * in block order as well as double spends between transactions.
+     * Returns an empty vector if there are no prefetch threads or the block is
+     * too small to bother.
+     */
+    std::vector<CBlockTxPrecheck> PrecheckBlockTransactions(
+        const task::CCancellationToken& token,
+        const Config& config,
+        const CBlock& block,
+        const CBlockIndex& index,
+        const CCoinsViewCache& view,
+        int nLockTimeFlags,
+        uint32_t flags,
+        bool fScriptChecks,
+        bool fCacheResults,
+        bool fCountSigOps)
+    {
+        constexpr size_t minBatchSize = 64;
+        if(!coinsPrefetchPool || block.vtx.size() < 2 * minBatchSize)
+        {
+            return {};
+        }
+
+        std::unordered_set<TxId, SaltedTxidHasher> blockTxIds {};
+        blockTxIds.reserve(block.vtx.size());
+        for(const auto& tx : block.vtx)
+        {
+            blockTxIds.insert(tx->GetId());
+        }
+
+        std::vector<CBlockTxPrecheck> prechecks(block.vtx.size());
+        auto precheck =
+            [&](size_t begin, size_t end)
+            {
+                std::vector<int> prevheights {};
+                for(size_t i = begin; i < end; ++i)
+                {
+                    const CTransaction& tx { *block.vtx[i] };
+                    CBlockTxPrecheck& result { prechecks[i] };
+                    if(tx.IsCoinBase() ||
+                       std::any_of(
+                           tx.vin.begin(), tx.vin.end(),
+                           [&blockTxIds](const CTxIn& txin)
+                           {
+                               return blockTxIds.count(txin.prevout.GetTxId()) != 0;
+                           }) ||
+                       !view.HaveInputs(tx))
+                    {
+                        continue;
+                    }
+
+                    prevheights.resize(tx.vin.size());
+                    for(size_t j = 0; j < tx.vin.size(); ++j)
+                    {
+                        prevheights[j] = view.AccessCoin(tx.vin[j].prevout).GetHeight();
+                    }
+                    result.fSequenceLocks =
+                        SequenceLocks(tx, nLockTimeFlags, &prevheights, index);
+
+                    if(fCountSigOps)
+                    {
+                        result.nSigOpsCount =
+                            GetTransactionSigOpCount(
+                                config, tx, view, flags & SCRIPT_VERIFY_P2SH,
+                                false, result.fSigOpCountError);
+                    }
+
+                    result.nFee = view.GetValueIn(tx) - tx.GetValueOut();
+
+                    auto res =
+                        CheckInputs(
+                            token,
+                            config,
+                            true,
+                            tx,
+                            result.state,
+                            view,
+                            fScriptChecks,
+                            flags,
+                            fCacheResults,
+                            fCacheResults,
+                            PrecomputedTransactionData(tx),
+                            &result.vChecks);
+                    if(!res.has_value())
+                    {
+                        throw CBlockValidationCancellation{};
+                    }
+                    result.fInputsValid = res.value();
+                    result.fChecked = true;
+                }
+            };
+
+        // A few batches per thread so that threads finish at about the same
+        // time even if transactions differ in size
+        const size_t batchSize =
+            std::max(
+                minBatchSize,
+                block.vtx.size() / (coinsPrefetchPool->getPoolSize() * 4) + 1);
+        std::vector<std::future<void>> tasks {};
+        for(size_t begin = 0; begin < block.vtx.size(); begin += batchSize)
+        {
+            tasks.emplace_back(
+                make_task(
+                    *coinsPrefetchPool,
+                    precheck,
+                    begin,
+                    std::min(begin + batchSize, block.vtx.size())));
+        }
+        // Wait for all tasks before rethrowing as they reference our locals
+        std::exception_ptr error {};
+        for(auto& task : tasks)
+        {
+            try
+            {
+                task.get();
+            }
+            catch(...)
+            {
+                error = std::current_exception();
+            }
+        }
+        if(error)
+        {
+            std::rethrow_exception(error);
+        }
+
+        return prechecks;
+    }
 }
 
 // Returns the script flags which should be checked for a given block
@@ -3493,6 +4154,7 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 static int64_t nTimeObtainLock = 0;
+static int64_t nTimeUndo = 0;
 
 /**
  * Apply the effects of this block (with given index) on the UTXO set
@@ -3528,6 +4190,11 @@ static bool ConnectBlock(
 
     int64_t nTimeStart = GetTimeMicros();
 
+    // Load coins spent by the block into the coins cache while the block is
+    // being checked instead of reading them from the database one by one
+    // while connecting transactions below.
+    CBlockInputsPrefetchGuard prefetch { block };
+
     // Check it again in case a previous version let a bad block in
     BlockValidationOptions validationOptions =
         BlockValidationOptions(!fJustCheck, !fJustCheck);
@@ -3536,6 +4203,8 @@ static bool ConnectBlock(
                      FormatStateMessage(state));
     }
 
+    prefetch.Wait();
+
     // Verify that the view's current state corresponds to the previous block
     uint256 hashPrevBlock =
         pindex->pprev == nullptr ? uint256() : pindex->pprev->GetBlockHash();
@@ -3694,12 +4363,28 @@ static bool ConnectBlock(
 
     uint64_t maxTxSigOpsCountConsensusBeforeGenesis = config.GetMaxTxSigOpsCountConsensusBeforeGenesis();
 
+    // Don't cache results if we're actually connecting blocks (still consult
+    // the cache, though).
+    bool fCacheResults = fJustCheck;
+
+    // Checks of transactions that don't depend on other transactions in the
+    // block are done in parallel up front; the loop below only has to apply
+    // their results in block order.
+    std::vector<CBlockTxPrecheck> prechecks =
+        PrecheckBlockTransactions(
+            token, config, block, *pindex, view, nLockTimeFlags, flags,
+            fScriptChecks, fCacheResults, !isGenesisEnabled);
+
     for (size_t i = 0; i < block.vtx.size(); i++) {
         const CTransaction &tx = *(block.vtx[i]);
+        CBlockTxPrecheck *precheck =
+            (i < prechecks.size() && prechecks[i].fChecked) ? &prechecks[i]
+                                                           : nullptr;
 
         nInputs += tx.vin.size();
 
         if (!tx.IsCoinBase()) {
+            // Also catches double spends between prechecked transactions
             if (!view.HaveInputs(tx)) {
                 return state.DoS(
                     100, error("ConnectBlock(): inputs missing/spent"),
@@ -3709,12 +4394,19 @@ static bool ConnectBlock(
             // Check that transaction is BIP68 final BIP68 lock checks (as
             // opposed to nLockTime checks) must be in ConnectBlock because they
             // require the UTXO set.
-            prevheights.resize(tx.vin.size());
-            for (size_t j = 0; j < tx.vin.size(); j++) {
-                prevheights[j] = view.AccessCoin(tx.vin[j].prevout).GetHeight();
+            bool fSequenceLocks;
+            if (precheck) {
+                fSequenceLocks = precheck->fSequenceLocks;
+            } else {
+                prevheights.resize(tx.vin.size());
+                for (size_t j = 0; j < tx.vin.size(); j++) {
+                    prevheights[j] = view.AccessCoin(tx.vin[j].prevout).GetHeight();
+                }
+                fSequenceLocks =
+                    SequenceLocks(tx, nLockTimeFlags, &prevheights, *pindex);
             }
 
-            if (!SequenceLocks(tx, nLockTimeFlags, &prevheights, *pindex)) {
+            if (!fSequenceLocks) {
                 return state.DoS(
                     100, error("%s: contains a non-BIP68-final transaction",
                                __func__),
@@ -3728,7 +4420,13 @@ static bool ConnectBlock(
             // * legacy (always)
             // * p2sh (when P2SH enabled)
             bool sigOpCountError;
-            uint64_t txSigOpsCount = GetTransactionSigOpCount(config, tx, view, flags & SCRIPT_VERIFY_P2SH, false, sigOpCountError);
+            uint64_t txSigOpsCount;
+            if (precheck) {
+                sigOpCountError = precheck->fSigOpCountError;
+                txSigOpsCount = precheck->nSigOpsCount;
+            } else {
+                txSigOpsCount = GetTransactionSigOpCount(config, tx, view, flags & SCRIPT_VERIFY_P2SH, false, sigOpCountError);
+            }
             if (sigOpCountError || txSigOpsCount > maxTxSigOpsCountConsensusBeforeGenesis) {
                 return state.DoS(100, false, REJECT_INVALID, "bad-txn-sigops");
             }
@@ -3741,40 +4439,46 @@ static bool ConnectBlock(
         }
 
         if (!tx.IsCoinBase()) {
-            Amount fee = view.GetValueIn(tx) - tx.GetValueOut();
-            nFees += fee;
-
-            // Don't cache results if we're actually connecting blocks (still
-            // consult the cache, though).
-            bool fCacheResults = fJustCheck;
-
             std::vector<CScriptCheck> vChecks;
 
-            auto res =
-                CheckInputs(
-                    token,
-                    config,
-                    true,
-                    tx,
-                    state,
-                    view,
-                    fScriptChecks,
-                    flags,
-                    fCacheResults,
-                    fCacheResults,
-                    PrecomputedTransactionData(tx),
-                    &vChecks);
-            if (!res.has_value())
-            {
-                // With current implementation this can never happen as providing
-                // vChecks as parameter skips the path that checks the cancellation
-                // token
-                throw CBlockValidationCancellation{};
-            }
-            else if (!res.value())
-            {
-                return error("ConnectBlock(): CheckInputs on %s failed with %s",
-                             tx.GetId().ToString(), FormatStateMessage(state));
+            if (precheck) {
+                nFees += precheck->nFee;
+                if (!precheck->fInputsValid) {
+                    state = precheck->state;
+                    return error("ConnectBlock(): CheckInputs on %s failed with %s",
+                                 tx.GetId().ToString(), FormatStateMessage(state));
+                }
+                vChecks = std::move(precheck->vChecks);
+            } else {
+                Amount fee = view.GetValueIn(tx) - tx.GetValueOut();
+                nFees += fee;
+
+                auto res =
+                    CheckInputs(
+                        token,
+                        config,
+                        true,
+                        tx,
+                        state,
+                        view,
+                        fScriptChecks,
+                        flags,
+                        fCacheResults,
+                        fCacheResults,
+                        PrecomputedTransactionData(tx),
+                        &vChecks);
+                if (!res.has_value())
+                {
+                    // With current implementation this can never happen as providing
+                    // vChecks as parameter skips the path that checks the cancellation
+                    // token
+                    throw CBlockValidationCancellation{};
+                }
+                else if (!res.value())
+                {
+                    return error("ConnectBlock(): CheckInputs on %s failed with %s",
+                                 tx.GetId().ToString(), FormatStateMessage(state));
+                }
             }
 
             if(fScriptChecks)
@@ -3883,21 +4587,39 @@ static bool ConnectBlock(
     if (pindex->GetUndoPos().IsNull() ||
         !pindex->IsValid(BlockValidity::SCRIPTS)) {
         if (pindex->GetUndoPos().IsNull()) {
+            int64_t nTimeUndoStart = GetTimeMicros();
             CDiskBlockPos _pos;
+            const uint64_t nUndoSize =
+                ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION);
             if (!pBlockFileInfoStore->FindUndoPos(
-                    state, pindex->nFile, _pos,
-                    ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) +
-                        40, fCheckForPruning)) {
+                    state, pindex->nFile, _pos, nUndoSize + 40,
+                    fCheckForPruning)) {
                 return error("ConnectBlock(): FindUndoPos failed");
             }
-            if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(),
-                                 config.GetChainParams().DiskMagic())) {
+            if (blockUndoWriter) {
+                // The recorded position is that of the data after its header
+                const CDiskBlockPos headerPos{_pos};
+                _pos.nPos += GetBlockFileBlockHeaderSize(nUndoSize);
+                if (!blockUndoWriter->Write(std::move(blockundo), nUndoSize,
+                                            headerPos,
+                                            pindex->pprev->GetBlockHash(),
+                                            config.GetChainParams().DiskMagic())) {
+                    return AbortNode(state, "Failed to write undo data");
+                }
+            } else if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(),
+                                        config.GetChainParams().DiskMagic())) {
                 return AbortNode(state, "Failed to write undo data");
             }
 
             // update nUndoPos in block index
             pindex->nUndoPos = _pos.nPos;
             pindex->nStatus = pindex->nStatus.withUndo();
+
+            int64_t nTimeUndoEnd = GetTimeMicros();
+            nTimeUndo += nTimeUndoEnd - nTimeUndoStart;
+            LogPrint(BCLog::BENCH, "      - Undo data: %.2fms [%.2fs]\n",
+                     0.001 * (nTimeUndoEnd - nTimeUndoStart),
+                     nTimeUndo * 0.000001);
         }
 
         // since we are changing validation time we need to update
@@ -4021,6 +4743,9 @@ bool FlushStateToDisk(
                     return state.Error("out of disk space");
                 }
                 // First make sure all block and undo data is flushed to disk.
+                if (blockUndoWriter && !blockUndoWriter->Sync()) {
+                    return AbortNode(state, "Failed to write undo data");
+                }
                 pBlockFileInfoStore->FlushBlockFile();
                 // Then update all block file information (which may refer to
                 // block and undo files).
@@ -4242,6 +4967,7 @@ static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
 static int64_t nTimePostConnect = 0;
+static int64_t nBlocksToTip = 0;
 
 struct PerBlockConnectTrace {
     CBlockIndex *pindex = nullptr;
@@ -4453,6 +5179,12 @@ static bool ConnectTip(
              (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
     LogPrint(BCLog::BENCH, "- Connect block: %.2fms [%.2fs]\n",
              (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
+    // Latency from starting to connect a block until it's the tip, which
+    // doesn't include writing its undo data when that is done in background
+    ++nBlocksToTip;
+    LogPrint(BCLog::BENCH, "- Block %s to tip: %.2fms [%.2fms avg]\n",
+             pindexNew->GetBlockHash().ToString(), (nTime6 - nTime1) * 0.001,
+             nTimeTotal * 0.001 / nBlocksToTip);
 
     connectTrace.BlockConnected(pindexNew, std::move(pthisBlock));
 
@@ -6316,6 +7048,18 @@ static bool LoadBlockIndexDB(const CChainParams &chainparams) {
         return false;
     }
 
+    uint256 hashSnapshotBase;
+    uint64_t nSnapshotBaseChainTx = 0;
+    if (pblocktree->ReadSnapshotBase(hashSnapshotBase, nSnapshotBaseChainTx)) {
+        BlockMap::iterator it = mapBlockIndex.find(hashSnapshotBase);
+        if (it == mapBlockIndex.end()) {
+            return error("LoadBlockIndexDB(): UTXO snapshot base block %s "
+                         "not found",
+                         hashSnapshotBase.ToString());
+        }
+        pindexSnapshotBase = it->second;
+    }
+
     boost::this_thread::interruption_point();
 
     // Calculate nChainWork
@@ -6334,7 +7078,9 @@ static bool LoadBlockIndexDB(const CChainParams &chainparams) {
                            : pindex->nTime);
         // We can link the chain of blocks for which we've received transactions
         // at some point. Pruned nodes may have deleted the block.
-        if (pindex->nTx > 0) {
+        if (pindex == pindexSnapshotBase) {
+            pindex->nChainTx = nSnapshotBaseChainTx;
+        } else if (pindex->nTx > 0) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -6431,6 +7177,55 @@ void LoadChainTip(const CChainParams &chainparams) {
         GuessVerificationProgress(chainparams.TxData(), chainActive.Tip()));
 }
 
+bool ActivateSnapshotBase(const Config &config, CBlockIndex *pindex,
+                          uint64_t nChainTx) {
+    AssertLockHeld(cs_main);
+
+    if (pcoinsTip->GetBestBlock() != pindex->GetBlockHash() &&
+        pcoinsdbview->GetBestBlock() != pindex->GetBlockHash()) {
+        return error("%s: coins database is not at block %s", __func__,
+                     pindex->GetBlockHash().ToString());
+    }
+
+    if (!pblocktree->WriteSnapshotBase(pindex->GetBlockHash(), nChainTx)) {
+        return error("%s: failed to write snapshot base", __func__);
+    }
+
+    pindexSnapshotBase = pindex;
+    pindex->nChainTx = nChainTx;
+    pindex->RaiseValidity(BlockValidity::SCRIPTS);
+    setDirtyBlockIndex.insert(pindex);
+
+    // Link descendants that were already received.
+    std::deque<CBlockIndex *> queue;
+    queue.push_back(pindex);
+    while (!queue.empty()) {
+        CBlockIndex *pindexLink = queue.front();
+        queue.pop_front();
+        if (pindexLink != pindex) {
+            pindexLink->nChainTx =
+                pindexLink->pprev->nChainTx + pindexLink->nTx;
+        }
+        setBlockIndexCandidates.insert(pindexLink);
+        auto range = mapBlocksUnlinked.equal_range(pindexLink);
+        while (range.first != range.second) {
+            queue.push_back(range.first->second);
+            range.first = mapBlocksUnlinked.erase(range.first);
+        }
+    }
+
+    pcoinsTip->SetBestBlock(pindex->GetBlockHash());
+    LoadChainTip(config.GetChainParams());
+
+    CValidationState state;
+    return FlushStateToDisk(config.GetChainParams(), state,
+                            FLUSH_STATE_ALWAYS);
+}
+
+const CBlockIndex *GetSnapshotBase() {
+    return pindexSnapshotBase;
+}
+
 CVerifyDB::CVerifyDB() {
     uiInterface.ShowProgress(_("Verifying blocks..."), 0);
 }
@@ -6494,6 +7289,15 @@ bool CVerifyDB::VerifyDB(const Config &config, CCoinsView *coinsview,
             break;
         }
 
+        if (pindexSnapshotBase &&
+            pindex->nHeight <= pindexSnapshotBase->nHeight) {
+            // Blocks up to the snapshot base were never downloaded.
+            LogPrintf("VerifyDB(): block verification stopping at height %d "
+                      "(UTXO snapshot base)\n",
+                      pindex->nHeight);
+            break;
+        }
+
         CBlock block;
 
         // check level 0: read from disk
@@ -6795,6 +7599,7 @@ void UnloadBlockIndex() {
     pindexBestHeader = nullptr;
     mempool.Clear();
     mapBlocksUnlinked.clear();
+    pindexSnapshotBase = nullptr;
     pBlockFileInfoStore->Clear();
     nBlockSequenceId = 1;
     setDirtyBlockIndex.clear();
@@ -7118,6 +7923,18 @@ static void CheckBlockIndex(const Consensus::Params &consensusParams) {
     // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS
     // (regardless of being valid or not).
     CBlockIndex *pindexFirstNotScriptsValid = nullptr;
+    // The ancestors of a UTXO snapshot base have no data and are not valid
+    // beyond TREE. The above are reset for the subtree of the base and
+    // restored when leaving it.
+    using SnapshotTrackers = std::tuple<CBlockIndex *, CBlockIndex *,
+                                        CBlockIndex *, CBlockIndex *,
+                                        CBlockIndex *>;
+    const auto snapshotTrackers = [&]() {
+        return std::tie(pindexFirstMissing, pindexFirstNeverProcessed,
+                        pindexFirstNotTransactionsValid,
+                        pindexFirstNotChainValid, pindexFirstNotScriptsValid);
+    };
+    SnapshotTrackers snapshotBaseTrackers{};
     while (pindex != nullptr) {
         nNodes++;
         if (pindexFirstInvalid == nullptr && pindex->nStatus.hasFailed()) {
@@ -7147,6 +7964,12 @@ static void CheckBlockIndex(const Consensus::Params &consensusParams) {
             pindexFirstNotScriptsValid = pindex;
         }
 
+        // Blocks up to a UTXO snapshot base were never downloaded, so the
+        // data and validity invariants are not checked for them.
+        const bool fBelowSnapshot =
+            pindexSnapshotBase &&
+            pindex->nHeight <= pindexSnapshotBase->nHeight;
+
         // Begin: actual consistency checks.
         if (pindex->pprev == nullptr) {
             // Genesis block checks.
@@ -7160,34 +7983,37 @@ static void CheckBlockIndex(const Consensus::Params &consensusParams) {
             // (negative is used for preciousblock)
             assert(pindex->nSequenceId <= 0);
         }
-        // VALID_TRANSACTIONS is equivalent to nTx > 0 for all nodes (whether or
-        // not pruning has occurred). HAVE_DATA is only equivalent to nTx > 0
-        // (or VALID_TRANSACTIONS) if no pruning has occurred.
-        if (!fHavePruned) {
-            // If we've never pruned, then HAVE_DATA should be equivalent to nTx
-            // > 0
-            assert(!pindex->nStatus.hasData() == (pindex->nTx == 0));
-            assert(pindexFirstMissing == pindexFirstNeverProcessed);
-        } else if (pindex->nStatus.hasData()) {
-            // If we have pruned, then we can only say that HAVE_DATA implies
-            // nTx > 0
-            assert(pindex->nTx > 0);
-        }
-        if (pindex->nStatus.hasUndo()) {
-            assert(pindex->nStatus.hasData());
-        }
-        // This is pruning-independent.
-        assert((pindex->nStatus.getValidity() >= BlockValidity::TRANSACTIONS) ==
-               (pindex->nTx > 0));
-        // All parents having had data (at some point) is equivalent to all
-        // parents being VALID_TRANSACTIONS, which is equivalent to nChainTx
-        // being set.
-        // nChainTx != 0 is used to signal that all parent blocks have been
-        // processed (but may have been pruned).
-        assert((pindexFirstNeverProcessed != nullptr) ==
-               (pindex->nChainTx == 0));
-        assert((pindexFirstNotTransactionsValid != nullptr) ==
-               (pindex->nChainTx == 0));
+        if (!fBelowSnapshot) {
+            // VALID_TRANSACTIONS is equivalent to nTx > 0 for all nodes
+            // (whether or not pruning has occurred). HAVE_DATA is only
+            // equivalent to nTx > 0 (or VALID_TRANSACTIONS) if no pruning has
+            // occurred.
+            if (!fHavePruned) {
+                // If we've never pruned, then HAVE_DATA should be equivalent
+                // to nTx > 0
+                assert(!pindex->nStatus.hasData() == (pindex->nTx == 0));
+                assert(pindexFirstMissing == pindexFirstNeverProcessed);
+            } else if (pindex->nStatus.hasData()) {
+                // If we have pruned, then we can only say that HAVE_DATA
+                // implies nTx > 0
+                assert(pindex->nTx > 0);
+            }
+            if (pindex->nStatus.hasUndo()) {
+                assert(pindex->nStatus.hasData());
+            }
+            // This is pruning-independent.
+            assert((pindex->nStatus.getValidity() >=
+                    BlockValidity::TRANSACTIONS) == (pindex->nTx > 0));
+            // All parents having had data (at some point) is equivalent to all
+            // parents being VALID_TRANSACTIONS, which is equivalent to
+            // nChainTx being set.
+            // nChainTx != 0 is used to signal that all parent blocks have been
+            // processed (but may have been pruned).
+            assert((pindexFirstNeverProcessed != nullptr) ==
+                   (pindex->nChainTx == 0));
+            assert((pindexFirstNotTransactionsValid != nullptr) ==
+                   (pindex->nChainTx == 0));
+        }
         // nHeight must be consistent.
         assert(pindex->nHeight == nHeight);
         // For every block except the genesis block, the chainwork must be
@@ -7203,11 +8029,13 @@ static void CheckBlockIndex(const Consensus::Params &consensusParams) {
             // TREE valid implies all parents are TREE valid
             assert(pindexFirstNotTreeValid == nullptr);
         }
-        if (pindex->nStatus.getValidity() >= BlockValidity::CHAIN) {
+        if (!fBelowSnapshot &&
+            pindex->nStatus.getValidity() >= BlockValidity::CHAIN) {
             // CHAIN valid implies all parents are CHAIN valid
             assert(pindexFirstNotChainValid == nullptr);
         }
-        if (pindex->nStatus.getValidity() >= BlockValidity::SCRIPTS) {
+        if (!fBelowSnapshot &&
+            pindex->nStatus.getValidity() >= BlockValidity::SCRIPTS) {
             // SCRIPTS valid implies all parents are SCRIPTS valid
             assert(pindexFirstNotScriptsValid == nullptr);
         }
@@ -7229,43 +8057,44 @@ static void CheckBlockIndex(const Consensus::Params &consensusParams) {
             }
             rangeUnlinked.first++;
         }
-        if (pindex->pprev && pindex->nStatus.hasData() &&
-            pindexFirstNeverProcessed != nullptr &&
-            pindexFirstInvalid == nullptr) {
-            // If this block has block data available, some parent was never
-            // received, and has no invalid parents, it must be in
-            // mapBlocksUnlinked.
-            assert(foundInUnlinked);
-        }
         if (!pindex->nStatus.hasData()) {
             // Can't be in mapBlocksUnlinked if we don't HAVE_DATA
             assert(!foundInUnlinked);
         }
-        if (pindexFirstMissing == nullptr) {
-            // We aren't missing data for any parent -- cannot be in
-            // mapBlocksUnlinked.
-            assert(!foundInUnlinked);
-        }
-        if (pindex->pprev && pindex->nStatus.hasData() &&
-            pindexFirstNeverProcessed == nullptr &&
-            pindexFirstMissing != nullptr) {
-            // We HAVE_DATA for this block, have received data for all parents
-            // at some point, but we're currently missing data for some parent.
-            // We must have pruned.
-            assert(fHavePruned);
-            // This block may have entered mapBlocksUnlinked if:
-            //  - it has a descendant that at some point had more work than the
-            //    tip, and
-            //  - we tried switching to that descendant but were missing
-            //    data for some intermediate block between chainActive and the
-            //    tip.
-            // So if this block is itself better than chainActive.Tip() and it
-            // wasn't in
-            // setBlockIndexCandidates, then it must be in mapBlocksUnlinked.
-            if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) &&
-                setBlockIndexCandidates.count(pindex) == 0) {
-                if (pindexFirstInvalid == nullptr) {
-                    assert(foundInUnlinked);
+        if (!fBelowSnapshot) {
+            if (pindex->pprev && pindex->nStatus.hasData() &&
+                pindexFirstNeverProcessed != nullptr &&
+                pindexFirstInvalid == nullptr) {
+                // If this block has block data available, some parent was
+                // never received, and has no invalid parents, it must be in
+                // mapBlocksUnlinked.
+                assert(foundInUnlinked);
+            }
+            if (pindexFirstMissing == nullptr) {
+                // We aren't missing data for any parent -- cannot be in
+                // mapBlocksUnlinked.
+                assert(!foundInUnlinked);
+            }
+            if (pindex->pprev && pindex->nStatus.hasData() &&
+                pindexFirstNeverProcessed == nullptr && pindexFirstMissing != nullptr) {
+                // We HAVE_DATA for this block, have received data for all
+                // parents at some point, but we're currently missing data for
+                // some parent. We must have pruned.
+                assert(fHavePruned);
+                // This block may have entered mapBlocksUnlinked if:
+                //  - it has a descendant that at some point had more work than
+                //    the tip, and
+                //  - we tried switching to that descendant but were missing
+                //    data for some intermediate block between chainActive and
+                //    the tip.
+                // So if this block is itself better than chainActive.Tip() and
+                // it wasn't in setBlockIndexCandidates, then it must be in
+                // mapBlocksUnlinked.
+                if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) &&
+                    setBlockIndexCandidates.count(pindex) == 0) {
+                    if (pindexFirstInvalid == nullptr) {
+                        assert(foundInUnlinked);
+                    }
                 }
             }
         }
@@ -7273,6 +8102,13 @@ static void CheckBlockIndex(const Consensus::Params &consensusParams) {
         // // Perhaps too slow
         // End: actual consistency checks.
 
+        if (pindex == pindexSnapshotBase) {
+            // Blocks building on the snapshot base see it as fully processed
+            // until the search leaves its subtree.
+            snapshotBaseTrackers = snapshotTrackers();
+            snapshotTrackers() = SnapshotTrackers{};
+        }
+
         // Try descending into the first subnode.
         std::pair<std::multimap<CBlockIndex *, CBlockIndex *>::iterator,
                   std::multimap<CBlockIndex *, CBlockIndex *>::iterator>
@@ -7286,6 +8122,9 @@ static void CheckBlockIndex(const Consensus::Params &consensusParams) {
         // This is a leaf node. Move upwards until we reach a node of which we
         // have not yet visited the last child.
         while (pindex) {
+            if (pindex == pindexSnapshotBase) {
+                snapshotTrackers() = snapshotBaseTrackers;
+            }
             // We are going to either move to a parent or a sibling of pindex.
             // If pindex was the first with a certain property, unset the
             // corresponding variable.
@@ -7354,90 +8193,290 @@ CBlockFileInfo *GetBlockFileInfo(size_t n) {
     return pBlockFileInfoStore->GetBlockFileInfo(n);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+/** Version of mempool.dat written as a single sequence of transactions */
+static const uint64_t MEMPOOL_DUMP_VERSION_UNCHUNKED = 1;
+/** Number of transactions in an independently decodable chunk of mempool.dat */
+static const size_t MEMPOOL_DUMP_CHUNK_SIZE = 1000;
+/** Number of transactions submitted to the validator at once on load */
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 10000;
 
-bool LoadMempool(const Config &config, const task::CCancellationToken& shutdownToken)
+namespace
 {
-    try {
-        int64_t nExpiryTimeout = config.GetMemPoolExpiry();
-        FILE *filestr = fsbridge::fopen(GetDataDir() / "mempool.dat", "rb");
-        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
-        if (file.IsNull()) {
-            throw std::runtime_error("Failed to open mempool file from disk");
-        }
+    // A transaction as persisted in mempool.dat
+    struct CMempoolDumpEntry
+    {
+        CTransactionRef tx {};
+        int64_t nTime {0};
+        int64_t nFeeDelta {0};
 
-        int64_t count = 0;
-        int64_t skipped = 0;
-        int64_t failed = 0;
-        int64_t nNow = GetTime();
+        ADD_SERIALIZE_METHODS;
 
-        uint64_t version;
-        file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
-            throw std::runtime_error("Bad mempool dump version");
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream &s, Operation ser_action) {
+            READWRITE(tx);
+            READWRITE(nTime);
+            READWRITE(nFeeDelta);
         }
-        uint64_t num;
-        file >> num;
-        double prioritydummy = 0;
-        // Take a reference to the validator.
-        const auto& txValidator = g_connman->getTxnValidator();
-        // A pointer to the TxIdTracker.
-        const TxIdTrackerWPtr& pTxIdTracker = g_connman->GetTxIdTracker();
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-            Amount amountdelta(nFeeDelta);
+    };
+    using CMempoolDumpChunk = std::vector<CMempoolDumpEntry>;
+
+    CMempoolDumpChunk DecodeMempoolDumpChunk(const std::vector<uint8_t>& data)
+    {
+        CDataStream stream { data, SER_DISK, CLIENT_VERSION };
+        CMempoolDumpChunk chunk {};
+        stream >> chunk;
+        return chunk;
+    }
+
+    /**
+     * Collects transactions read from mempool.dat into batches and submits
+     * them to the validator. Transactions are dumped parents first, so each
+     * batch only depends on itself and on the batches submitted before it.
+     */
+    class CMempoolLoader
+    {
+    public:
+        CMempoolLoader(const Config& config)
+        : mConfig{config}
+        , mTxValidator{g_connman->getTxnValidator()}
+        , mTxIdTracker{g_connman->GetTxIdTracker()}
+        , mnExpiryTimeout{static_cast<int64_t>(config.GetMemPoolExpiry())}
+        {}
+
+        void SetTrustScripts(bool fTrustScripts) { mfTrustScripts = fTrustScripts; }
+        bool IsTrustingScripts() const { return mfTrustScripts; }
+
+        void Add(const CMempoolDumpEntry& entry)
+        {
+            Amount amountdelta(entry.nFeeDelta);
             if (amountdelta != Amount(0)) {
-                mempool.PrioritiseTransaction(tx->GetId(),
-                                              tx->GetId().ToString(),
+                double prioritydummy = 0;
+                mempool.PrioritiseTransaction(entry.tx->GetId(),
+                                              entry.tx->GetId().ToString(),
                                               prioritydummy, amountdelta);
             }
-            if (nTime + nExpiryTimeout > nNow) {
-                // Mempool Journal ChangeSet
-                CJournalChangeSetPtr changeSet {
-                    mempool.getJournalBuilder().getNewChangeSet(JournalUpdateReason::INIT)
-                };
-                const CValidationState& state {
-                    // Execute txn validation synchronously.
-                    txValidator->processValidation(
-                        std::make_shared<CTxInputData>(
-                            pTxIdTracker, // a pointer to the TxIdTracker
-                            tx,    // a pointer to the tx
-                            TxSource::file, // tx source
-                            TxValidationPriority::normal,  // tx validation priority
-                            nTime, // nAcceptTime
-                            true),  // fLimitFree
-                        changeSet, // an instance of the mempool journal
-                        true) // fLimitMempoolSize
-                };
-                // Check results
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    ++failed;
+            if (entry.nTime + mnExpiryTimeout <= mnNow) {
+                ++mnSkipped;
+                return;
+            }
+            mBatch.emplace_back(
+                std::make_shared<CTxInputData>(
+                    mTxIdTracker, // a pointer to the TxIdTracker
+                    entry.tx,     // a pointer to the tx
+                    TxSource::file, // tx source
+                    TxValidationPriority::normal, // tx validation priority
+                    entry.nTime,  // nAcceptTime
+                    true));       // fLimitFree
+            if (mBatch.size() >= MEMPOOL_LOAD_BATCH_SIZE) {
+                Submit();
+            }
+        }
+
+        void Submit()
+        {
+            if (mBatch.empty()) {
+                return;
+            }
+            // Script cache keys seeded for the batch
+            std::unordered_map<TxId, uint256, std::hash<TxId>> seededKeys {};
+            if (mfTrustScripts) {
+                // Scripts of the batch were verified against the same chain
+                // tip before the dump, so let the validator find them in the
+                // script cache. The key commits to the policy script flags,
+                // hence a change of policy still causes the scripts to be
+                // executed. Only the policy flags pass is skipped: the second
+                // pass against the block script flags and block validation
+                // keep executing the scripts.
+                uint32_t standardFlags;
+                {
+                    LOCK(cs_main);
+                    standardFlags = GetScriptVerifyFlags(
+                        mConfig, IsGenesisEnabled(mConfig, chainActive.Height() + 1));
                 }
-            } else {
-                ++skipped;
+                for (const auto& txInputData : mBatch) {
+                    const CTransaction& tx { *txInputData->GetTxnPtr() };
+                    const uint256 key { GetScriptCacheKey(tx, standardFlags) };
+                    AddKeyInScriptCache(key);
+                    seededKeys.emplace(tx.GetId(), key);
+                }
+            }
+            size_t nBatchSize = mBatch.size();
+            // Mempool Journal ChangeSet
+            CJournalChangeSetPtr changeSet {
+                mempool.getJournalBuilder().getNewChangeSet(JournalUpdateReason::INIT)
+            };
+            // Execute txn validation synchronously.
+            const auto& rejected {
+                mTxValidator->processValidation(
+                    std::move(mBatch),
+                    changeSet, // an instance of the mempool journal
+                    true) // fLimitMempoolSize
+            };
+            // Don't let transactions that didn't make it into the mempool,
+            // whether rejected, orphaned or missing inputs, skip their
+            // scripts later on
+            for (const auto& [txid, key] : seededKeys) {
+                if (!mempool.Exists(txid)) {
+                    RemoveKeyFromScriptCache(key);
+                }
+            }
+            mBatch.clear();
+            mnFailed += rejected.first.size();
+            mnCount += nBatchSize - rejected.first.size();
+        }
+
+        int64_t GetCount() const { return mnCount; }
+        int64_t GetFailed() const { return mnFailed; }
+        int64_t GetSkipped() const { return mnSkipped; }
+
+    private:
+        const Config& mConfig;
+        const std::shared_ptr<CTxnValidator> mTxValidator;
+        const TxIdTrackerWPtr mTxIdTracker;
+        const int64_t mnExpiryTimeout;
+        const int64_t mnNow { GetTime() };
+        bool mfTrustScripts {false};
+        TxInputDataSPtrVec mBatch {};
+        int64_t mnCount {0};
+        int64_t mnFailed {0};
+        int64_t mnSkipped {0};
+    };
+}
+
+/**
+ * Load the transactions of a mempool snapshot which are still in the mempool
+ * after the changes in the mempool logs. Returns false if interrupted.
+ */
+static bool LoadMempoolSnapshot(
+    CAutoFile& file,
+    CMempoolLoader& loader,
+    CTxMemPoolLogReplay& logReplay,
+    const task::CCancellationToken& shutdownToken)
+{
+    uint64_t version;
+    file >> version;
+    if (version != MEMPOOL_DUMP_VERSION &&
+        version != MEMPOOL_DUMP_VERSION_UNCHUNKED) {
+        throw std::runtime_error("Bad mempool dump version");
+    }
+
+    uint64_t num;
+    if (version == MEMPOOL_DUMP_VERSION) {
+        uint256 hashTip;
+        file >> hashTip;
+        // Logged changes were validated at later tips
+        if (gArgs.GetBoolArg("-persistmempooltrustscripts",
+                             DEFAULT_PERSIST_MEMPOOL_TRUST_SCRIPTS) &&
+            !logReplay.GetNumRecords()) {
+            LOCK(cs_main);
+            bool fTrustScripts = chainActive.Tip() &&
+                                 chainActive.Tip()->GetBlockHash() == hashTip;
+            if (!fTrustScripts) {
+                LogPrintf("Mempool was dumped at a different chain tip %s, "
+                          "verifying scripts of loaded transactions\n",
+                          hashTip.ToString());
             }
+            loader.SetTrustScripts(fTrustScripts);
+        }
+    }
+    file >> num;
+
+    auto add {
+        [&](const CMempoolDumpEntry& entry) {
+            if (logReplay.KeepSnapshotTxn(entry.tx->GetId())) {
+                loader.Add(entry);
+            }
+        }
+    };
+    if (version == MEMPOOL_DUMP_VERSION_UNCHUNKED) {
+        // num is the number of transactions
+        while (num--) {
+            CMempoolDumpEntry entry {};
+            file >> entry;
+            add(entry);
             if (shutdownToken.IsCanceled()) {
                 return false;
             }
         }
-        std::map<uint256, Amount> mapDeltas;
-        file >> mapDeltas;
+    } else {
+        // num is the number of chunks, which are decoded in parallel while
+        // the transactions of the previous ones are validated.
+        size_t nThreads = static_cast<size_t>(std::max(1, GetNumCores()));
+        CThreadPool<CQueueAdaptor> pool { "MempoolLoad", nThreads };
+        std::deque<std::future<CMempoolDumpChunk>> decoding {};
+        auto processOldest {
+            [&]() {
+                CMempoolDumpChunk chunk { decoding.front().get() };
+                decoding.pop_front();
+                for (const auto& entry : chunk) {
+                    add(entry);
+                }
+                return !shutdownToken.IsCanceled();
+            }
+        };
+        while (num--) {
+            std::vector<uint8_t> data;
+            file >> data;
+            decoding.push_back(make_task(pool, DecodeMempoolDumpChunk, std::move(data)));
+            // Bound the number of decoded transactions held in memory
+            if (decoding.size() > 2 * nThreads && !processOldest()) {
+                return false;
+            }
+        }
+        while (!decoding.empty()) {
+            if (!processOldest()) {
+                return false;
+            }
+        }
+    }
 
-        for (const auto &i : mapDeltas) {
-            mempool.PrioritiseTransaction(i.first, i.first.ToString(),
-                                          prioritydummy, i.second);
+    std::map<uint256, Amount> mapDeltas;
+    file >> mapDeltas;
+
+    double prioritydummy = 0;
+    for (const auto &i : mapDeltas) {
+        mempool.PrioritiseTransaction(i.first, i.first.ToString(),
+                                      prioritydummy, i.second);
+    }
+    return true;
+}
+
+bool LoadMempool(const Config &config, const task::CCancellationToken& shutdownToken)
+{
+    try {
+        int64_t nStart = GetTimeMicros();
+        // Changes made after the snapshot was taken if the mempool was
+        // persisted continuously
+        CTxMemPoolLogReplay logReplay { CTxMemPoolLog::Replay(GetDataDir()) };
+        FILE *filestr = fsbridge::fopen(GetDataDir() / "mempool.dat", "rb");
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        if (file.IsNull() && !logReplay.GetNumRecords()) {
+            throw std::runtime_error("Failed to open mempool file from disk");
+        }
+
+        CMempoolLoader loader { config };
+        if (!file.IsNull() &&
+            !LoadMempoolSnapshot(file, loader, logReplay, shutdownToken)) {
+            return false;
+        }
+        for (const auto& txn : logReplay.TakeAddedTxns()) {
+            loader.Add(CMempoolDumpEntry{txn.first, txn.second, 0});
+            if (shutdownToken.IsCanceled()) {
+                return false;
+            }
+        }
+        loader.Submit();
+        if (shutdownToken.IsCanceled()) {
+            return false;
         }
 
         LogPrintf("Imported mempool transactions from disk: %i successes, %i "
-                  "failed, %i expired\n",
-                  count, failed, skipped);
+                  "failed, %i expired, %i logged changes in %.6fs%s\n",
+                  loader.GetCount(), loader.GetFailed(), loader.GetSkipped(),
+                  logReplay.GetNumRecords(),
+                  (GetTimeMicros() - nStart) * 0.000001,
+                  loader.IsTrustingScripts() ? " (scripts trusted)" : "");
 
     }
     catch (const std::exception &e) {
@@ -7449,13 +8488,18 @@ bool LoadMempool(const Config &config, const task::CCancellationToken& shutdownT
     return mempool.getNonFinalPool().loadMempool(shutdownToken);
 }
 
-void DumpMempool(void) {
+bool DumpMempool(void) {
     int64_t start = GetTimeMicros();
 
     std::map<uint256, Amount> mapDeltas;
     std::vector<TxMempoolInfo> vinfo;
+    uint256 hashTip;
 
     {
+        LOCK(cs_main);
+        if (chainActive.Tip()) {
+            hashTip = chainActive.Tip()->GetBlockHash();
+        }
         std::shared_lock lock(mempool.smtx);
         for (const auto &i : mempool.mapDeltas) {
             mapDeltas[i.first] = i.second.second;
@@ -7465,30 +8509,45 @@ void DumpMempool(void) {
 
     int64_t mid = GetTimeMicros();
 
+    bool fDumped = false;
     try {
         FILE *filestr = fsbridge::fopen(GetDataDir() / "mempool.dat.new", "wb");
         if (!filestr) {
-            return;
+            return false;
         }
 
         CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
 
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
-
-        file << (uint64_t)vinfo.size();
-        for (const auto &i : vinfo) {
-            file << *(i.tx);
-            file << (int64_t)i.nTime;
-            file << (int64_t)i.nFeeDelta.GetSatoshis();
-            mapDeltas.erase(i.tx->GetId());
+        file << hashTip;
+
+        // Transactions are sorted by depth, so each chunk only depends on
+        // itself and on the chunks written before it.
+        uint64_t nChunks =
+            (vinfo.size() + MEMPOOL_DUMP_CHUNK_SIZE - 1) / MEMPOOL_DUMP_CHUNK_SIZE;
+        file << nChunks;
+        CMempoolDumpChunk chunk {};
+        chunk.reserve(MEMPOOL_DUMP_CHUNK_SIZE);
+        CDataStream stream { SER_DISK, CLIENT_VERSION };
+        for (size_t i = 0; i < vinfo.size(); ++i) {
+            chunk.push_back(CMempoolDumpEntry{vinfo[i].tx,
+                                              vinfo[i].nTime,
+                                              vinfo[i].nFeeDelta.GetSatoshis()});
+            mapDeltas.erase(vinfo[i].tx->GetId());
+            if (chunk.size() == MEMPOOL_DUMP_CHUNK_SIZE || i + 1 == vinfo.size()) {
+                stream << chunk;
+                file << std::vector<uint8_t>(stream.begin(), stream.end());
+                stream.clear();
+                chunk.clear();
+            }
         }
 
         file << mapDeltas;
         FileCommit(file.Get());
         file.fclose();
-        RenameOver(GetDataDir() / "mempool.dat.new",
-                   GetDataDir() / "mempool.dat");
+        fDumped = RenameOver(GetDataDir() / "mempool.dat.new",
+                             GetDataDir() / "mempool.dat");
         int64_t last = GetTimeMicros();
         LogPrintf("Dumped mempool: %.6fs to copy, %.6fs to dump\n",
                   (mid - start) * 0.000001, (last - mid) * 0.000001);
@@ -7498,6 +8557,7 @@ void DumpMempool(void) {
 
     // Dump non-final pool
     mempool.getNonFinalPool().dumpMempool();
+    return fDumped;
 }
 
 //! Guess how far we are in the verification process at the given block index
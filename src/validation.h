@@ -21,6 +21,8 @@
 #include "mining/journal_change_set.h"
 #include "protocol.h" // For CMessageHeader::MessageMagic
 #include "script/script_error.h"
+#include "script/scriptprofile.h"
+#include "script/sigcache.h"
 #include "sync.h"
 #include "streams.h"
 #include "task.h"
@@ -34,7 +36,9 @@
 #include <cstdint>
 #include <exception>
 #include <functional>
+#include <future>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <thread>
@@ -43,11 +47,13 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsViewDB;
 class CBloomFilter;
 class CChainParams;
 class CConnman;
 class CInv;
 class Config;
+class CQueueAdaptor;
 class CScriptCheck;
 class CTxMemPool;
 struct CTxnHandlers;
@@ -59,6 +65,8 @@ struct ChainTxData;
 struct PrecomputedTransactionData;
 struct LockPoints;
 
+template <typename QueueAdaptor> class CThreadPool;
+
 namespace boost
 {
     class thread_group;
@@ -113,6 +121,15 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 64;
 /** -threadsperblock default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of threads loading block inputs from the coins database */
+static const int MAX_COINS_PREFETCH_THREADS = 64;
+/** -coinsprefetchthreads default (0 disables prefetching) */
+static const int DEFAULT_COINS_PREFETCH_THREADS = 4;
+/**
+ * -maxundowritequeue default in MB: undo data of connected blocks that may be
+ * waiting to be written to disk (0 writes it while connecting the block)
+ */
+static const int64_t DEFAULT_MAX_UNDO_WRITE_QUEUE_SIZE = 1024;
 /** Number of blocks that can be requested at any given time from a single peer.
  */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
@@ -198,6 +215,10 @@ static const unsigned int DEFAULT_INVALID_CHECKSUM_FREQUENCY = 100;
 
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -persistmempooltrustscripts */
+static const bool DEFAULT_PERSIST_MEMPOOL_TRUST_SCRIPTS = false;
+/** Default for -persistmempoollog */
+static const bool DEFAULT_PERSIST_MEMPOOL_LOG = false;
 /** Default for using fee filter */
 static const bool DEFAULT_FEEFILTER = true;
 
@@ -511,12 +532,42 @@ void LoadChainTip(const CChainParams &chainparams);
 void UnloadBlockIndex();
 
 /**
- * Initialize script checking pool.
+ * Make a block whose UTXO set was bulk loaded from a snapshot the active chain
+ * tip. Ancestors of the block are not downloaded; they are treated as valid
+ * and the chain can only be extended (not reorganised) below this block.
+ * Requires cs_main and a coins database whose best block is pindex.
+ */
+bool ActivateSnapshotBase(const Config &config, CBlockIndex *pindex,
+                          uint64_t nChainTx);
+
+/**
+ * Block whose UTXO set was loaded from a snapshot or nullptr if the chain was
+ * fully validated from genesis (protected by cs_main).
+ */
+const CBlockIndex *GetSnapshotBase();
+
+/**
+ * Initialize script checking pool, the pool used for prefetching block
+ * inputs and the thread writing undo data of connected blocks.
  */
 void InitScriptCheckQueues(const Config& config, boost::thread_group& threadGroup);
-//! Shutdown script checking pool.
+/**
+ * Shutdown script checking and input prefetching pools and wait for queued
+ * undo data to be written.
+ */
 void ShutdownScriptCheckQueues();
 
+/**
+ * Start loading coins spent by block from the backing view of cache into
+ * cache on pool. Outputs created by the block itself are skipped. The
+ * returned futures become ready once all lookups are done; the backing view
+ * of cache must not be modified before that (see CCoinsViewCache::Prefetch).
+ */
+std::vector<std::future<void>> PrefetchBlockInputs(
+    const CBlock& block,
+    CCoinsViewCache& cache,
+    CThreadPool<CQueueAdaptor>& pool);
+
 /**
  * Check whether we are doing an initial block download (synchronizing from disk
  * or network)
@@ -541,6 +592,17 @@ std::string GetWarnings(const std::string &strFor);
 bool GetTransaction(const Config &config, const TxId &txid, CTransactionRef &tx,
     bool fAllowSlow, uint256 &hashBlock, bool& isGenesisEnabled);
 
+/**
+ * Verify the scripts of a transaction from the mempool or the active chain
+ * again with profiling enabled. Signatures are verified without the signature
+ * cache. Returns std::nullopt if the transaction or the outputs it spends
+ * can't be found.
+ */
+std::optional<CTxScriptProfile> ProfileTransactionScripts(
+    const Config& config,
+    const TxId& txid,
+    const task::CCancellationToken& token);
+
 /**
  * Find the best known block, and make it the active tip of the block chain.
  * If it fails, the tip is not updated.
@@ -837,6 +899,11 @@ uint64_t GetTransactionSigOpCount(const Config &config,
  *
  * In case a task cancellation is triggered through token before result is
  * known the function returns a std::nullopt
+ *
+ * If budget is not nullptr, scripts that are evaluated inline are charged to
+ * it and the function returns std::nullopt once the budget is exhausted.
+ * Inputs that the budget records as verified with the same flags are skipped,
+ * so a later call with a larger budget continues where this one stopped.
  */
 std::optional<bool> CheckInputs(
     const task::CCancellationToken& token,
@@ -850,7 +917,8 @@ std::optional<bool> CheckInputs(
     bool sigCacheStore,
     bool scriptCacheStore,
     const PrecomputedTransactionData& txdata,
-    std::vector<CScriptCheck>* pvChecks = nullptr);
+    std::vector<CScriptCheck>* pvChecks = nullptr,
+    CScriptCostBudget* budget = nullptr);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction &tx, CCoinsViewCache &inputs, int nHeight);
@@ -931,6 +999,8 @@ private:
     PrecomputedTransactionData txdata;
     std::reference_wrapper<const Config> config;
     bool consensus = false;
+    std::shared_ptr<CTxScriptProfileCollector> profileCollector;
+    CScriptCostBudget* costBudget = nullptr;
 
 public:
     CScriptCheck(const Config &configIn, bool consensusIn, const CScript &scriptPubKeyIn, const Amount amountIn,
@@ -941,9 +1011,46 @@ public:
           nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn),
           error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn), config(configIn), consensus(consensusIn) {}
 
+    /**
+     * Signatures of P2PK and P2PKH inputs checked in a script check queue are
+     * verified in batches after the scripts. Such checks don't report the
+     * script error if the signature turns out to be invalid.
+     */
+    using batch_type = CSignatureBatch;
+
     std::optional<bool> operator()(const task::CCancellationToken& token);
+    std::optional<bool> operator()(const task::CCancellationToken& token,
+                                   CSignatureBatch& batch);
 
     ScriptError GetScriptError() const { return error; }
+
+    /**
+     * Profile the script execution into the given collector. Profiled inputs
+     * are always evaluated by the interpreter and their signatures are not
+     * batched.
+     */
+    void SetProfileCollector(std::shared_ptr<CTxScriptProfileCollector> collector)
+    {
+        profileCollector = std::move(collector);
+    }
+
+    /**
+     * Charge the cost of the scripts evaluated by the interpreter to the
+     * budget and stop once it is exhausted. The budget is not synchronized,
+     * so the check must not run in parallel with others that share it.
+     */
+    void SetCostBudget(CScriptCostBudget* budget)
+    {
+        costBudget = budget;
+    }
+
+private:
+    std::optional<bool> Verify(const task::CCancellationToken& token,
+                               const BaseSignatureChecker& checker);
+
+    // Cost limit of the script that is left in the budget, 0 if unlimited
+    uint64_t GetCostLimit() const;
+    void ChargeCost(const ScriptProfile& profile);
 };
 
 /** Functions for disk access for blocks */
@@ -1068,6 +1175,10 @@ extern CCoinsViewCache *pcoinsTip;
  */
 extern CBlockTreeDB *pblocktree;
 
+/** Global variable that points to the coins database backing pcoinsTip
+ * (protected by cs_main) */
+extern CCoinsViewDB *pcoinsdbview;
+
 /**
  * Return the MTP and spend height, which is one more than the inputs.GetBestBlock().
  * While checking, GetBestBlock() refers to the parent block. (protected by
@@ -1091,8 +1202,8 @@ static const unsigned int REJECT_CONFLICT = 0x102;
 /** No space for transaction */
 static const unsigned int REJECT_MEMPOOL_FULL = 0x103;
 
-/** Dump the mempool to disk. */
-void DumpMempool();
+/** Dump the mempool to disk. Returns false on failure. */
+bool DumpMempool();
 
 /** Load the mempool from disk. */
 bool LoadMempool(const Config &config, const task::CCancellationToken& shutdownToken);
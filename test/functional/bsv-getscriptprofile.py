@@ -0,0 +1,52 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 Bitcoin Association
+# Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_greater_than, assert_raises_rpc_error
+
+# Test script profiling:
+# 1. Transactions accepted to the mempool are added to the slow script log.
+# 2. getscriptprofile replays the scripts of a mempool transaction.
+# 3. getscriptprofile replays the scripts of a confirmed transaction using the
+#    undo data of its block.
+
+
+class GetScriptProfileTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+        self.extra_args = [["-slowscriptlogsize=10", "-txindex"]]
+
+    def check_profile(self, profile, txid):
+        assert_equal(profile["txid"], txid)
+        assert_greater_than(len(profile["inputs"]), 0)
+        for input in profile["inputs"]:
+            assert input["verified"]
+            assert input["valid"]
+            assert_greater_than(input["opcodes"], 0)
+            assert_equal(input["sigchecks"], 1)
+        assert_equal(profile["sigchecks"], len(profile["inputs"]))
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(101)
+
+        txid = node.sendtoaddress(node.getnewaddress(), 10)
+        logged = node.getscriptprofile()
+        assert txid in [entry["txid"] for entry in logged]
+
+        self.check_profile(node.getscriptprofile(txid), txid)
+
+        node.generate(1)
+        assert_equal(node.getrawmempool(), [])
+        self.check_profile(node.getscriptprofile(txid), txid)
+
+        # Coinbase transactions have no scripts to verify
+        coinbase = node.getblock(node.getbestblockhash())["tx"][0]
+        assert_raises_rpc_error(-5, "No such mempool or blockchain transaction",
+                                node.getscriptprofile, coinbase)
+
+
+if __name__ == '__main__':
+    GetScriptProfileTest().main()